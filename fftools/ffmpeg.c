@@ -119,12 +119,13 @@ typedef struct BenchmarkTimeStamps {
 static BenchmarkTimeStamps get_benchmark_time_stamps(void);
 static int64_t getmaxrss(void);
 
-int64_t nb_frames_dup = 0;
-int64_t nb_frames_drop = 0;
+atomic_int_least64_t nb_frames_dup  = 0;
+atomic_int_least64_t nb_frames_drop = 0;
 unsigned nb_output_dumped = 0;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *stats_json_avio = NULL;
 
 InputFile   **input_files   = NULL;
 int        nb_input_files   = 0;
@@ -360,6 +361,10 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
 
+    /* the decoder threads feed the filtering threads, stop them first */
+    for (InputStream *ist = ist_iter(NULL); ist; ist = ist_iter(ist))
+        dec_free(&ist->decoder);
+
     for (i = 0; i < nb_filtergraphs; i++)
         fg_free(&filtergraphs[i]);
     av_freep(&filtergraphs);
@@ -380,6 +385,16 @@ static void ffmpeg_cleanup(int ret)
     av_freep(&vstats_filename);
     of_enc_stats_close();
 
+    /* only closed here, as the timers of still running demuxer threads
+     * check it */
+    if (stats_json_avio) {
+        int err = avio_closep(&stats_json_avio);
+        if (err < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing stats_json output, loss of information possible: %s\n",
+                   av_err2str(err));
+    }
+
     hw_device_free_all();
 
     av_freep(&filter_nbthreads);
@@ -442,13 +457,20 @@ void remove_avoptions(AVDictionary **a, AVDictionary *b)
     }
 }
 
-void assert_avoptions(AVDictionary *m)
+int check_avoptions(AVDictionary *m)
 {
     const AVDictionaryEntry *t;
     if ((t = av_dict_get(m, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
         av_log(NULL, AV_LOG_FATAL, "Option %s not found.\n", t->key);
-        exit_program(1);
+        return AVERROR_OPTION_NOT_FOUND;
     }
+    return 0;
+}
+
+void assert_avoptions(AVDictionary *m)
+{
+    if (check_avoptions(m) < 0)
+        exit_program(1);
 }
 
 void update_benchmark(const char *fmt, ...)
@@ -475,12 +497,169 @@ void update_benchmark(const char *fmt, ...)
 void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
-    ost->finished |= ENCODER_FINISHED;
+    atomic_fetch_or(&ost->finished, ENCODER_FINISHED);
 
     if (ost->sq_idx_encode >= 0)
         sq_send(of->sq_encode, ost->sq_idx_encode, SQFRAME(NULL));
 }
 
+static int64_t thread_cpu_time(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+void stage_timer_start(StageTimer *t)
+{
+    if (!stats_json_avio)
+        return;
+
+    t->wall = av_gettime_relative();
+    t->cpu  = thread_cpu_time();
+}
+
+void stage_timer_stop(StageTimer *t, StageStats *s)
+{
+    if (!stats_json_avio)
+        return;
+
+    atomic_fetch_add(&s->wall_time, av_gettime_relative() - t->wall);
+    atomic_fetch_add(&s->cpu_time,  thread_cpu_time()      - t->cpu);
+}
+
+static void stats_json_stage(AVBPrint *bp, const char *name, StageStats *s,
+                             const char *in_name, const char *out_name,
+                             ThreadQueueStats *q)
+{
+    av_bprintf(bp, "\"%s\":{\"wall_time_us\":%"PRId64",\"cpu_time_us\":%"PRId64,
+               name, (int64_t)atomic_load(&s->wall_time),
+               (int64_t)atomic_load(&s->cpu_time));
+    if (in_name)
+        av_bprintf(bp, ",\"%s\":%"PRIu64, in_name, (uint64_t)atomic_load(&s->nb_in));
+    if (out_name)
+        av_bprintf(bp, ",\"%s\":%"PRIu64, out_name, (uint64_t)atomic_load(&s->nb_out));
+    if (q)
+        av_bprintf(bp, ",\"queue\":{\"max_depth\":%d,\"send_wait_us\":%"PRId64
+                   ",\"recv_wait_us\":%"PRId64"}", atomic_load(&q->max_depth),
+                   (int64_t)atomic_load(&q->send_wait),
+                   (int64_t)atomic_load(&q->recv_wait));
+    av_bprintf(bp, "}");
+}
+
+static void stats_json_string(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
+static void stats_json_filters(AVBPrint *bp, AVFilterGraph *graph)
+{
+    for (unsigned i = 0; graph && i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        const AVFilterStats *st = avfilter_get_stats(filter);
+
+        av_bprintf(bp, "%s{\"name\":", i ? "," : "");
+        stats_json_string(bp, filter->name);
+        av_bprintf(bp, ",\"type\":\"%s\",\"activations\":%"PRId64
+                   ",\"time_us\":%"PRId64",\"frames_in\":%"PRId64
+                   ",\"frames_out\":%"PRId64",\"framesync_wait_us\":%"PRId64
+                   ",\"slice_time_us\":%"PRId64",\"slice_busy_us\":%"PRId64
+                   ",\"slice_capacity_us\":%"PRId64"}",
+                   filter->filter->name, st->nb_activations, st->time,
+                   st->frames_in, st->frames_out, st->framesync_wait,
+                   st->slice_time, st->slice_busy, st->slice_capacity);
+    }
+}
+
+static void print_stats_json(int is_last_report, int64_t elapsed)
+{
+    AVBPrint bp;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    av_bprintf(&bp, "{\"time_us\":%"PRId64",\"final\":%s,\"inputs\":[",
+               elapsed, is_last_report ? "true" : "false");
+    for (int i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+
+        av_bprintf(&bp, "%s{\"index\":%d,", i ? "," : "", f->index);
+        stats_json_stage(&bp, "demux", &f->stats_demux, NULL, "packets",
+                         &f->queue_stats);
+        av_bprintf(&bp, ",\"streams\":[");
+        for (int j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = f->streams[j];
+
+            av_bprintf(&bp, "%s{\"index\":%d,\"type\":\"%s\"", j ? "," : "",
+                       ist->index, av_get_media_type_string(ist->par->codec_type));
+            if (ist->decoding_needed) {
+                av_bprintf(&bp, ",");
+                stats_json_stage(&bp, "decode", &ist->stats_dec,
+                                 "packets", "frames", &ist->queue_stats);
+            }
+            av_bprintf(&bp, "}");
+        }
+        av_bprintf(&bp, "]}");
+    }
+
+    av_bprintf(&bp, "],\"filtergraphs\":[");
+    for (int i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        av_bprintf(&bp, "%s{\"index\":%d,\"simple\":%s,", i ? "," : "",
+                   fg->index, filtergraph_is_simple(fg) ? "true" : "false");
+        stats_json_stage(&bp, "filter", &fg->stats, "frames_in", "frames_out",
+                         &fg->queue_stats);
+        av_bprintf(&bp, ",\"filters\":[");
+        fg_lock(fg);
+        stats_json_filters(&bp, fg->graph);
+        fg_unlock(fg);
+        av_bprintf(&bp, "]}");
+    }
+
+    av_bprintf(&bp, "],\"outputs\":[");
+    for (int i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        av_bprintf(&bp, "%s{\"index\":%d,", i ? "," : "", of->index);
+        stats_json_stage(&bp, "mux", &of->stats_mux, "packets", NULL,
+                         &of->queue_stats);
+        av_bprintf(&bp, ",\"streams\":[");
+        for (int j = 0; j < of->nb_streams; j++) {
+            OutputStream *ost = of->streams[j];
+
+            av_bprintf(&bp, "%s{\"index\":%d,\"type\":\"%s\"", j ? "," : "",
+                       ost->index, av_get_media_type_string(ost->type));
+            if (ost->enc_ctx) {
+                av_bprintf(&bp, ",");
+                stats_json_stage(&bp, "encode", &ost->stats_enc,
+                                 "frames", "packets", &ost->queue_stats);
+            }
+            av_bprintf(&bp, "}");
+        }
+        av_bprintf(&bp, "]}");
+    }
+    av_bprintf(&bp, "]}\n");
+
+    if (av_bprint_is_complete(&bp)) {
+        avio_write(stats_json_avio, bp.str, bp.len);
+        avio_flush(stats_json_avio);
+    }
+    av_bprint_finalize(&bp, NULL);
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     AVBPrint buf, buf_script;
@@ -489,6 +668,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     double bitrate;
     double speed;
     int64_t pts = INT64_MIN + 1;
+    int64_t frames_dup, frames_drop;
     static int64_t last_time = -1;
     static int first_report = 1;
     int hours, mins, secs, us;
@@ -496,7 +676,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int ret;
     float t;
 
-    if (!print_stats && !is_last_report && !progress_avio)
+    if (!print_stats && !is_last_report && !progress_avio && !stats_json_avio)
         return;
 
     if (!is_last_report) {
@@ -515,7 +695,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
     av_bprint_init(&buf_script, 0, AV_BPRINT_SIZE_AUTOMATIC);
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        const float q = ost->enc ? ost->quality / (float) FF_QP2LAMBDA : -1;
+        const float q = ost->enc ? atomic_load(&ost->quality) / (float) FF_QP2LAMBDA : -1;
+        const int64_t last_mux_dts = atomic_load(&ost->last_mux_dts);
 
         if (vid && ost->type == AVMEDIA_TYPE_VIDEO) {
             av_bprintf(&buf, "q=%2.1f ", q);
@@ -539,8 +720,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
             vid = 1;
         }
         /* compute min output value */
-        if (ost->last_mux_dts != AV_NOPTS_VALUE) {
-            pts = FFMAX(pts, ost->last_mux_dts);
+        if (last_mux_dts != AV_NOPTS_VALUE) {
+            pts = FFMAX(pts, last_mux_dts);
             if (copy_ts) {
                 if (copy_ts_first_pts == AV_NOPTS_VALUE && pts > 1)
                     copy_ts_first_pts = pts;
@@ -550,7 +731,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
 
         if (is_last_report)
-            nb_frames_drop += ost->last_dropped;
+            atomic_fetch_add(&nb_frames_drop, ost->last_dropped);
     }
 
     secs = FFABS(pts) / AV_TIME_BASE;
@@ -594,10 +775,12 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                    hours_sign, hours, mins, secs, us);
     }
 
-    if (nb_frames_dup || nb_frames_drop)
-        av_bprintf(&buf, " dup=%"PRId64" drop=%"PRId64, nb_frames_dup, nb_frames_drop);
-    av_bprintf(&buf_script, "dup_frames=%"PRId64"\n", nb_frames_dup);
-    av_bprintf(&buf_script, "drop_frames=%"PRId64"\n", nb_frames_drop);
+    frames_dup  = atomic_load(&nb_frames_dup);
+    frames_drop = atomic_load(&nb_frames_drop);
+    if (frames_dup || frames_drop)
+        av_bprintf(&buf, " dup=%"PRId64" drop=%"PRId64, frames_dup, frames_drop);
+    av_bprintf(&buf_script, "dup_frames=%"PRId64"\n", frames_dup);
+    av_bprintf(&buf_script, "drop_frames=%"PRId64"\n", frames_drop);
 
     if (speed < 0) {
         av_bprintf(&buf, " speed=N/A");
@@ -632,6 +815,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
     }
 
+    if (stats_json_avio)
+        print_stats_json(is_last_report, cur_time - timer_start);
+
     first_report = 0;
 }
 
@@ -900,24 +1086,25 @@ static int choose_output(OutputStream **post)
     OutputStream *ost_min = NULL;
 
     for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        int64_t opts;
+        int64_t opts = ost->filter ? atomic_load(&ost->filter->last_pts) :
+                                     AV_NOPTS_VALUE;
 
-        if (ost->filter && ost->filter->last_pts != AV_NOPTS_VALUE) {
-            opts = ost->filter->last_pts;
-        } else {
-            opts = ost->last_mux_dts == AV_NOPTS_VALUE ?
-                   INT64_MIN : ost->last_mux_dts;
-            if (ost->last_mux_dts == AV_NOPTS_VALUE)
+        if (opts == AV_NOPTS_VALUE) {
+            opts = atomic_load(&ost->last_mux_dts);
+            if (opts == AV_NOPTS_VALUE) {
+                opts = INT64_MIN;
                 av_log(ost, AV_LOG_DEBUG,
                     "cur_dts is invalid [init:%d i_done:%d finish:%d] (this is harmless if it occurs once at the start per stream)\n",
-                    ost->initialized, ost->inputs_done, ost->finished);
+                    atomic_load(&ost->initialized), ost->inputs_done,
+                    atomic_load(&ost->finished));
+            }
         }
 
-        if (!ost->initialized && !ost->inputs_done && !ost->finished) {
+        if (!atomic_load(&ost->initialized) && !ost->inputs_done && !atomic_load(&ost->finished)) {
             ost_min = ost;
             break;
         }
-        if (!ost->finished && opts < opts_min) {
+        if (!atomic_load(&ost->finished) && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost;
         }
@@ -977,6 +1164,7 @@ static int check_keyboard_interaction(int64_t cur_time)
                    target, time, command, arg);
             for (i = 0; i < nb_filtergraphs; i++) {
                 FilterGraph *fg = filtergraphs[i];
+                fg_lock(fg);
                 if (fg->graph) {
                     if (time < 0) {
                         ret = avfilter_graph_send_command(fg->graph, target, command, arg, buf, sizeof(buf),
@@ -991,6 +1179,7 @@ static int check_keyboard_interaction(int64_t cur_time)
                             fprintf(stderr, "Queuing command failed with error %s\n", av_err2str(ret));
                     }
                 }
+                fg_unlock(fg);
             }
         } else {
             av_log(NULL, AV_LOG_ERROR,
@@ -1099,7 +1288,8 @@ static int process_input(int file_index)
                 OutputStream *ost = ist->outputs[oidx];
                 OutputFile    *of = output_files[ost->file_index];
                 close_output_stream(ost);
-                of_output_packet(of, ost->pkt, ost, 1);
+                if (of_output_packet(of, ost->pkt, ost, 1) < 0)
+                    exit_program(1);
             }
         }
 
@@ -1171,6 +1361,17 @@ static int transcode(int *err_rate_exceeded)
         av_log(NULL, AV_LOG_INFO, "Press [q] to stop, [?] for help\n");
     }
 
+    for (i = 0; i < nb_filtergraphs; i++) {
+        ret = fg_thread_start(filtergraphs[i]);
+        if (ret < 0)
+            return ret;
+    }
+    for (ist = ist_iter(NULL); ist; ist = ist_iter(ist)) {
+        ret = dec_thread_start(ist);
+        if (ret < 0)
+            return ret;
+    }
+
     timer_start = av_gettime_relative();
 
     while (!received_sigterm) {
@@ -1220,6 +1421,14 @@ static int transcode(int *err_rate_exceeded)
         } else if (err_rate)
             av_log(ist, AV_LOG_VERBOSE, "Decode error rate %g\n", err_rate);
     }
+
+    /* all the decoders are flushed now, wait for the filtering threads to
+     * process their input */
+    for (i = 0; i < nb_filtergraphs; i++) {
+        int err = fg_thread_stop(filtergraphs[i]);
+        ret = err_merge(ret, err);
+    }
+
     enc_flush();
 
     term_exit();
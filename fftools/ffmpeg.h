@@ -28,6 +28,7 @@
 
 #include "cmdutils.h"
 #include "sync_queue.h"
+#include "thread_queue.h"
 
 #include "libavformat/avformat.h"
 #include "libavformat/avio.h"
@@ -277,6 +278,22 @@ typedef struct OptionsContext {
     int        nb_mux_stats_fmt;
 } OptionsContext;
 
+/* processing statistics of one pipeline stage, reported with -stats_json;
+ * updated by the thread running the stage, read by the main thread */
+typedef struct StageStats {
+    // wall clock and thread CPU time spent processing, in microseconds
+    atomic_int_least64_t  wall_time;
+    atomic_int_least64_t  cpu_time;
+    // number of packets/frames that entered and left the stage
+    atomic_uint_least64_t nb_in;
+    atomic_uint_least64_t nb_out;
+} StageStats;
+
+typedef struct StageTimer {
+    int64_t wall;
+    int64_t cpu;
+} StageTimer;
+
 typedef struct InputFilter {
     struct FilterGraph *graph;
     uint8_t            *name;
@@ -307,8 +324,9 @@ typedef struct OutputFilter {
     const AVChannelLayout *ch_layouts;
     const int *sample_rates;
 
-    /* pts of the last frame received from this filter, in AV_TIME_BASE_Q */
-    int64_t last_pts;
+    /* pts of the last frame received from this filter, in AV_TIME_BASE_Q;
+     * written by the filtering thread, read by the main thread */
+    atomic_int_least64_t last_pts;
 } OutputFilter;
 
 typedef struct FilterGraph {
@@ -323,6 +341,10 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+    StageStats     stats;
+    // statistics of the queue feeding the filtering thread, if any
+    ThreadQueueStats queue_stats;
 } FilterGraph;
 
 typedef struct Decoder Decoder;
@@ -403,6 +425,10 @@ typedef struct InputStream {
     uint64_t frames_decoded;
     uint64_t samples_decoded;
     uint64_t decode_errors;
+
+    StageStats stats_dec;
+    // statistics of the queue feeding the decoder thread, if any
+    ThreadQueueStats queue_stats;
 } InputStream;
 
 typedef struct LastFrameDuration {
@@ -444,6 +470,9 @@ typedef struct InputFile {
      * the last frame duration back to the demuxer thread */
     AVThreadMessageQueue *audio_duration_queue;
     int                   audio_duration_queue_size;
+
+    StageStats            stats_demux;
+    ThreadQueueStats      queue_stats;
 } InputFile;
 
 enum forced_keyframes_const {
@@ -543,8 +572,9 @@ typedef struct OutputStream {
     InputStream *ist;
 
     AVStream *st;            /* stream in the output file */
-    /* dts of the last packet sent to the muxing queue, in AV_TIME_BASE_Q */
-    int64_t last_mux_dts;
+    /* dts of the last packet sent to the muxing queue, in AV_TIME_BASE_Q;
+     * written by the encoding thread, read by the main thread */
+    atomic_int_least64_t last_mux_dts;
 
     // the timebase of the packets sent to the muxer
     AVRational mux_timebase;
@@ -591,13 +621,14 @@ typedef struct OutputStream {
     AVDictionary *sws_dict;
     AVDictionary *swr_opts;
     char *apad;
-    OSTFinished finished;        /* no more packets should be written for this stream */
+    atomic_int finished;         /* OSTFinished flags, no more packets should be written for this stream */
     int unavailable;                     /* true if the steram is unavailable (possibly temporarily) */
 
     // init_output_stream() has been called for this stream
     // The encoder and the bitstream filters have been initialized and the stream
     // parameters are set in the AVStream.
-    int initialized;
+    // May be set by a filtering thread, read by the main thread.
+    atomic_int initialized;
 
     int inputs_done;
 
@@ -608,12 +639,13 @@ typedef struct OutputStream {
     /* stats */
     // number of packets send to the muxer
     atomic_uint_least64_t packets_written;
-    // number of frames/samples sent to the encoder
+    // number of frames/samples sent to the encoder; only accessed by the
+    // encoding thread until enc_flush() has joined it
     uint64_t frames_encoded;
     uint64_t samples_encoded;
 
     /* packet quality factor */
-    int quality;
+    atomic_int quality;
 
     int sq_idx_encode;
     int sq_idx_mux;
@@ -621,6 +653,10 @@ typedef struct OutputStream {
     EncStats enc_stats_pre;
     EncStats enc_stats_post;
 
+    StageStats       stats_enc;
+    // statistics of the queue feeding the encoder thread, if any
+    ThreadQueueStats queue_stats;
+
     /*
      * bool on whether this stream should be utilized for splitting
      * subtitles utilizing fix_sub_duration at random access points.
@@ -646,6 +682,9 @@ typedef struct OutputFile {
 
     int shortest;
     int bitexact;
+
+    StageStats       stats_mux;
+    ThreadQueueStats queue_stats;
 } OutputFile;
 
 // optionally attached as opaque_ref to decoded AVFrames
@@ -686,6 +725,7 @@ extern int print_stats;
 extern int64_t stats_period;
 extern int stdin_interaction;
 extern AVIOContext *progress_avio;
+extern AVIOContext *stats_json_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
@@ -707,8 +747,8 @@ extern int recast_media;
 
 extern FILE *vstats_file;
 
-extern int64_t nb_frames_dup;
-extern int64_t nb_frames_drop;
+extern atomic_int_least64_t nb_frames_dup;
+extern atomic_int_least64_t nb_frames_drop;
 
 #if FFMPEG_OPT_PSNR
 extern int do_psnr;
@@ -721,6 +761,11 @@ void show_usage(void);
 
 void remove_avoptions(AVDictionary **a, AVDictionary *b);
 void assert_avoptions(AVDictionary *m);
+/**
+ * Log an error and return AVERROR_OPTION_NOT_FOUND if any options in m were
+ * not consumed.
+ */
+int check_avoptions(AVDictionary *m);
 
 void assert_file_overwrite(const char *filename);
 char *file_read(const char *filename);
@@ -732,6 +777,10 @@ int parse_and_set_vsync(const char *arg, int *vsync_var, int file_idx, int st_id
 int configure_filtergraph(FilterGraph *fg);
 void check_filter_outputs(void);
 int filtergraph_is_simple(const FilterGraph *fg);
+/**
+ * @return 1 if the graph is currently run by its own filtering thread
+ */
+int filtergraph_is_threaded(const FilterGraph *fg);
 int init_simple_filtergraph(InputStream *ist, OutputStream *ost,
                             char *graph_desc);
 int init_complex_filtergraph(FilterGraph *fg);
@@ -771,6 +820,25 @@ void fg_free(FilterGraph **pfg);
  */
 int fg_transcode_step(FilterGraph *graph, InputStream **best_ist);
 
+/**
+ * Start a thread running the given filtergraph, if that is possible for it.
+ * Frames sent to its input are then queued for the thread. The thread stops
+ * after the input EOF, the graph is then drained on the main thread.
+ */
+int fg_thread_start(FilterGraph *fg);
+/**
+ * Wait for the filtering thread of the graph, if any, to finish.
+ *
+ * @return the error the thread terminated with, or 0
+ */
+int fg_thread_stop(FilterGraph *fg);
+/**
+ * Lock the graph against its filtering thread, must be held by other threads
+ * when accessing fg->graph.
+ */
+void fg_lock(FilterGraph *fg);
+void fg_unlock(FilterGraph *fg);
+
 /**
  * Get and encode new output from any of the filtergraphs, without causing
  * activity.
@@ -815,13 +883,22 @@ void dec_free(Decoder **pdec);
  * decoders and await further input.
  */
 int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof);
+/**
+ * Start a thread running the decoder, if all its output goes to threaded
+ * filtergraphs. Must be called after fg_thread_start().
+ */
+int dec_thread_start(InputStream *ist);
 
 int enc_alloc(Encoder **penc, const AVCodec *codec);
 void enc_free(Encoder **penc);
 
 int enc_open(OutputStream *ost, AVFrame *frame);
 void enc_subtitle(OutputFile *of, OutputStream *ost, AVSubtitle *sub);
-void enc_frame(OutputStream *ost, AVFrame *frame);
+int enc_frame(OutputStream *ost, AVFrame *frame);
+/**
+ * @return 1 if the encoder of this stream may run in its own thread
+ */
+int enc_thread_allowed(const OutputStream *ost);
 void enc_flush(void);
 
 /*
@@ -831,6 +908,12 @@ void enc_flush(void);
  * Open the muxer once all the streams have been initialized.
  */
 int of_stream_init(OutputFile *of, OutputStream *ost);
+/**
+ * Get the timebase packets submitted to of_output_packet() for the given
+ * stream should be in. May be called from any thread; it only takes a lock
+ * until the muxer thread has been started.
+ */
+AVRational of_stream_mux_timebase(OutputStream *ost);
 int of_write_trailer(OutputFile *of);
 int of_open(const OptionsContext *o, const char *filename);
 void of_close(OutputFile **pof);
@@ -847,8 +930,14 @@ void of_enc_stats_close(void);
  * If eof is set, instead indicate EOF to all bitstream filters and
  * therefore flush any delayed packets to the output.  A blank packet
  * must be supplied in this case.
+ *
+ * May be called from an encoder thread, so it never exits the program by
+ * itself.
+ *
+ * @return 0 on success, a negative error code when muxing failed and
+ *         -xerror is set
  */
-void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof);
+int of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof);
 
 /**
  * @param dts predicted packet dts in AV_TIME_BASE_Q
@@ -893,6 +982,16 @@ int trigger_fix_sub_duration_heartbeat(OutputStream *ost, const AVPacket *pkt);
 int process_subtitle(InputStream *ist, AVSubtitle *subtitle, int *got_output);
 void update_benchmark(const char *fmt, ...);
 
+/**
+ * Measure the time spent in a pipeline stage for -stats_json. Both are no-ops
+ * unless -stats_json is used.
+ */
+void stage_timer_start(StageTimer *t);
+/**
+ * Add the time elapsed since stage_timer_start() to the stage statistics.
+ */
+void stage_timer_stop(StageTimer *t, StageStats *s);
+
 /**
  * Merge two return codes - return one of the error codes if at least one of
  * them was negative, 0 otherwise.
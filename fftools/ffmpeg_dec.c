@@ -22,6 +22,7 @@
 #include "libavutil/log.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/thread.h"
 #include "libavutil/timestamp.h"
 
 #include "libavcodec/avcodec.h"
@@ -30,6 +31,8 @@
 #include "libavfilter/buffersrc.h"
 
 #include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
 
 struct Decoder {
     AVFrame         *frame;
@@ -43,8 +46,35 @@ struct Decoder {
     AVRational      last_frame_tb;
     int64_t         last_filter_in_rescale_delta;
     int             last_frame_sample_rate;
+
+    pthread_t       thread;
+    /**
+     * Queue for sending packets from the main thread to the decoder thread.
+     * NULL when the decoder runs on the main thread.
+     */
+    ThreadQueue    *queue;
+    // new references to packets sent to the decoder thread are made here
+    AVPacket       *send_pkt;
 };
 
+/* number of packets that may be queued for a decoder thread */
+#define DEC_THREAD_QUEUE_SIZE 8
+
+static int dec_thread_stop(Decoder *d)
+{
+    void *ret;
+
+    if (!d->queue)
+        return 0;
+
+    tq_send_finish(d->queue, 0);
+    pthread_join(d->thread, &ret);
+
+    tq_free(&d->queue);
+
+    return (int)(intptr_t)ret;
+}
+
 void dec_free(Decoder **pdec)
 {
     Decoder *dec = *pdec;
@@ -52,8 +82,11 @@ void dec_free(Decoder **pdec)
     if (!dec)
         return;
 
+    dec_thread_stop(dec);
+
     av_frame_free(&dec->frame);
     av_packet_free(&dec->pkt);
+    av_packet_free(&dec->send_pkt);
 
     av_freep(pdec);
 }
@@ -383,9 +416,16 @@ out:
 static int transcode_subtitles(InputStream *ist, const AVPacket *pkt)
 {
     AVSubtitle subtitle;
+    StageTimer timer;
     int got_output;
-    int ret = avcodec_decode_subtitle2(ist->dec_ctx,
-                                       &subtitle, &got_output, pkt);
+    int ret;
+
+    stage_timer_start(&timer);
+    ret = avcodec_decode_subtitle2(ist->dec_ctx, &subtitle, &got_output, pkt);
+    stage_timer_stop(&timer, &ist->stats_dec);
+    atomic_fetch_add(&ist->stats_dec.nb_in, 1);
+    if (ret >= 0 && got_output)
+        atomic_fetch_add(&ist->stats_dec.nb_out, 1);
 
     if (ret < 0) {
         av_log(ist, AV_LOG_ERROR, "Error decoding subtitles: %s\n",
@@ -421,38 +461,46 @@ static int send_filter_eof(InputStream *ist)
     return 0;
 }
 
-int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
+/*
+ * Send a packet to the decoder, or flush it when pkt is NULL, and pass the
+ * decoded frames on to the filtergraphs.
+ *
+ * Return
+ * - 0 -- the packet was processed, errors in decoding it (if any) are
+ *   not fatal
+ * - AVERROR_EOF -- the decoder is fully flushed
+ * - another negative error code -- a fatal error occurred
+ */
+static int packet_decode(InputStream *ist, const AVPacket *pkt, int no_eof)
 {
     Decoder *d = ist->decoder;
     AVCodecContext *dec = ist->dec_ctx;
     const char *type_desc = av_get_media_type_string(dec->codec_type);
+    StageTimer timer;
     int ret;
 
-    if (dec->codec_type == AVMEDIA_TYPE_SUBTITLE)
-        return transcode_subtitles(ist, pkt ? pkt : d->pkt);
-
-    // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
-    // reason. This seems like a semi-critical bug. Don't trigger EOF, and
-    // skip the packet.
-    if (pkt && pkt->size == 0)
-        return 0;
-
+    stage_timer_start(&timer);
     ret = avcodec_send_packet(dec, pkt);
+    stage_timer_stop(&timer, &ist->stats_dec);
+    if (pkt && ret >= 0)
+        atomic_fetch_add(&ist->stats_dec.nb_in, 1);
     if (ret < 0 && !(ret == AVERROR_EOF && !pkt)) {
         // In particular, we don't expect AVERROR(EAGAIN), because we read all
         // decoded frames with avcodec_receive_frame() until done.
         if (ret == AVERROR(EAGAIN)) {
             av_log(ist, AV_LOG_FATAL, "A decoder returned an unexpected error code. "
                                       "This is a bug, please report it.\n");
-            exit_program(1);
+            return AVERROR_BUG;
         }
         av_log(ist, AV_LOG_ERROR, "Error submitting %s to decoder: %s\n",
                pkt ? "packet" : "EOF", av_err2str(ret));
         if (exit_on_error)
-            exit_program(1);
+            return ret == AVERROR_EOF ? AVERROR_EXIT : ret;
 
-        if (ret != AVERROR_EOF)
+        if (ret != AVERROR_EOF) {
             ist->decode_errors++;
+            return 0;
+        }
 
         return ret;
     }
@@ -461,9 +509,13 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
         AVFrame *frame = d->frame;
 
         update_benchmark(NULL);
+        stage_timer_start(&timer);
         ret = avcodec_receive_frame(dec, frame);
+        stage_timer_stop(&timer, &ist->stats_dec);
         update_benchmark("decode_%s %d.%d", type_desc,
                          ist->file_index, ist->index);
+        if (ret >= 0)
+            atomic_fetch_add(&ist->stats_dec.nb_out, 1);
 
         if (ret == AVERROR(EAGAIN)) {
             av_assert0(pkt); // should never happen during flushing
@@ -475,7 +527,7 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
                 ret = send_filter_eof(ist);
                 if (ret < 0) {
                     av_log(NULL, AV_LOG_FATAL, "Error marking filters as finished\n");
-                    exit_program(1);
+                    return ret;
                 }
             }
 
@@ -483,16 +535,18 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
         } else if (ret < 0) {
             av_log(ist, AV_LOG_ERROR, "Decoding error: %s\n", av_err2str(ret));
             if (exit_on_error)
-                exit_program(1);
+                return ret;
             ist->decode_errors++;
-            return ret;
+            return 0;
         }
 
         if (frame->decode_error_flags || (frame->flags & AV_FRAME_FLAG_CORRUPT)) {
             av_log(ist, exit_on_error ? AV_LOG_FATAL : AV_LOG_WARNING,
                    "corrupt decoded frame\n");
-            if (exit_on_error)
-                exit_program(1);
+            if (exit_on_error) {
+                av_frame_unref(frame);
+                return AVERROR_INVALIDDATA;
+            }
         }
 
         if (ist->want_frame_data) {
@@ -502,7 +556,7 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
             frame->opaque_ref = av_buffer_allocz(sizeof(*fd));
             if (!frame->opaque_ref) {
                 av_frame_unref(frame);
-                report_and_exit(AVERROR(ENOMEM));
+                return AVERROR(ENOMEM);
             }
             fd      = (FrameData*)frame->opaque_ref->data;
             fd->pts = frame->pts;
@@ -522,7 +576,8 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
             if (ret < 0) {
                 av_log(NULL, AV_LOG_FATAL, "Error while processing the decoded "
                        "data for stream #%d:%d\n", ist->file_index, ist->index);
-                exit_program(1);
+                av_frame_unref(frame);
+                return ret;
             }
         }
 
@@ -531,8 +586,182 @@ int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
         ret = send_frame_to_filters(ist, frame);
         av_frame_unref(frame);
         if (ret < 0)
-            exit_program(1);
+            return ret;
+    }
+}
+
+static void *decoder_thread(void *arg)
+{
+    InputStream *ist = arg;
+    Decoder       *d = ist->decoder;
+    AVPacket    *pkt = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "dec%d:%d:%s", ist->file_index, ist->index,
+             ist->dec_ctx->codec->name);
+    ff_thread_setname(name);
+
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int stream_idx, flush;
+
+        ret = tq_receive(d->queue, &stream_idx, pkt);
+        flush = ret >= 0 && !pkt->size;
+
+        if (ret < 0 || flush) {
+            /* either the main thread is done sending packets, or the input
+             * is looped; in the latter case the filtergraphs must not
+             * see an EOF */
+            do {
+                ret = packet_decode(ist, NULL, flush);
+            } while (ret >= 0);
+            if (ret == AVERROR_EOF)
+                ret = 0;
+
+            if (!flush || ret < 0)
+                break;
+            continue;
+        }
+
+        ret = packet_decode(ist, pkt, 0);
+        av_packet_unref(pkt);
+        if (ret < 0 && ret != AVERROR_EOF)
+            break;
+    }
+
+finish:
+    av_packet_free(&pkt);
+
+    tq_receive_finish(d->queue, 0);
+
+    av_log(ist, AV_LOG_VERBOSE, "Terminating decoder thread\n");
+
+    return (void*)(intptr_t)ret;
+}
+
+static void packet_move(void *dst, void *src)
+{
+    av_packet_move_ref(dst, src);
+}
+
+int dec_thread_start(InputStream *ist)
+{
+    Decoder *d = ist->decoder;
+    ObjPool *op;
+    int ret;
+
+    /* only decode in a separate thread when all the decoded frames go to
+     * filtergraphs running in their own threads */
+    if (!ist->decoding_needed || !ist->nb_filters ||
+        (ist->dec_ctx->codec_type != AVMEDIA_TYPE_VIDEO &&
+         ist->dec_ctx->codec_type != AVMEDIA_TYPE_AUDIO))
+        return 0;
+    for (int i = 0; i < ist->nb_filters; i++)
+        if (!filtergraph_is_threaded(ist->filters[i]->graph))
+            return 0;
+
+    d->send_pkt = av_packet_alloc();
+    if (!d->send_pkt)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_packets();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    d->queue = tq_alloc(1, DEC_THREAD_QUEUE_SIZE, op, packet_move);
+    if (!d->queue) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+    tq_set_stats(d->queue, &ist->queue_stats);
+
+    ret = pthread_create(&d->thread, NULL, decoder_thread, ist);
+    if (ret) {
+        av_log(ist, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               strerror(ret));
+        tq_free(&d->queue);
+        return AVERROR(ret);
     }
+
+    return 0;
+}
+
+/* whether some output fed by this stream waits for its first frame; until
+ * then every packet is decoded and filtered before the next one is read, so
+ * that the outputs are initialized at the same point as without threads */
+static int outputs_pending(const InputStream *ist)
+{
+    for (int i = 0; i < ist->nb_filters; i++) {
+        const FilterGraph *fg = ist->filters[i]->graph;
+
+        for (int j = 0; j < fg->nb_outputs; j++) {
+            OutputStream *ost = fg->outputs[j]->ost;
+            if (!atomic_load(&ost->initialized) && !atomic_load(&ost->finished))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static int dec_thread_send(InputStream *ist, const AVPacket *pkt, int no_eof)
+{
+    Decoder *d = ist->decoder;
+    int ret;
+
+    if (!pkt && !no_eof) {
+        ret = dec_thread_stop(d);
+        return ret < 0 ? ret : AVERROR_EOF;
+    }
+
+    /* an empty packet tells the decoder thread to flush the decoder */
+    if (pkt) {
+        ret = av_packet_ref(d->send_pkt, pkt);
+        if (ret < 0)
+            return ret;
+    }
+
+    ret = tq_send(d->queue, 0, d->send_pkt);
+    if (ret < 0) {
+        av_packet_unref(d->send_pkt);
+
+        /* the decoder thread terminated early, which only happens on errors */
+        ret = dec_thread_stop(d);
+        return ret < 0 ? ret : AVERROR_BUG;
+    }
+
+    /* when flushing, the caller accesses the decoder afterwards */
+    if (!pkt || outputs_pending(ist))
+        tq_wait_idle(d->queue);
+
+    return pkt ? 0 : AVERROR_EOF;
+}
+
+int dec_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
+{
+    Decoder *d = ist->decoder;
+    int ret;
+
+    if (ist->dec_ctx->codec_type == AVMEDIA_TYPE_SUBTITLE)
+        return transcode_subtitles(ist, pkt ? pkt : d->pkt);
+
+    // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
+    // reason. This seems like a semi-critical bug. Don't trigger EOF, and
+    // skip the packet.
+    if (pkt && pkt->size == 0)
+        return 0;
+
+    ret = d->queue ? dec_thread_send(ist, pkt, no_eof) :
+                     packet_decode(ist, pkt, no_eof);
+    if (ret < 0 && ret != AVERROR_EOF)
+        exit_program(1);
+
+    return ret;
 }
 
 static enum AVPixelFormat get_format(AVCodecContext *s, const enum AVPixelFormat *pix_fmts)
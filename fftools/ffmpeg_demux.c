@@ -586,8 +586,12 @@ static void *input_thread(void *arg)
 
     while (1) {
         DemuxMsg msg = { NULL };
+        StageTimer timer;
+        int64_t send_start;
 
+        stage_timer_start(&timer);
         ret = av_read_frame(f->ctx, pkt);
+        stage_timer_stop(&timer, &f->stats_demux);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -647,6 +651,7 @@ static void *input_thread(void *arg)
         if (f->readrate)
             readrate_sleep(d);
 
+        send_start = av_gettime_relative();
         ret = av_thread_message_queue_send(d->in_thread_queue, &msg, flags);
         if (flags && ret == AVERROR(EAGAIN)) {
             flags = 0;
@@ -656,6 +661,15 @@ static void *input_thread(void *arg)
                    "thread_queue_size option (current value: %d)\n",
                    d->thread_queue_size);
         }
+        if (stats_json_avio && ret >= 0) {
+            int depth = av_thread_message_queue_nb_elems(d->in_thread_queue);
+
+            atomic_fetch_add(&f->queue_stats.send_wait,
+                             av_gettime_relative() - send_start);
+            if (depth > atomic_load(&f->queue_stats.max_depth))
+                atomic_store(&f->queue_stats.max_depth, depth);
+            atomic_fetch_add(&f->stats_demux.nb_out, 1);
+        }
         if (ret < 0) {
             if (ret != AVERROR_EOF)
                 av_log(f, AV_LOG_ERROR,
@@ -746,6 +760,7 @@ int ifile_get_packet(InputFile *f, AVPacket **pkt)
 {
     Demuxer *d = demuxer_from_ifile(f);
     DemuxMsg msg;
+    int64_t recv_start;
     int ret;
 
     if (!d->in_thread_queue) {
@@ -754,9 +769,13 @@ int ifile_get_packet(InputFile *f, AVPacket **pkt)
             return ret;
     }
 
+    recv_start = av_gettime_relative();
     ret = av_thread_message_queue_recv(d->in_thread_queue, &msg,
                                        d->non_blocking ?
                                        AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (stats_json_avio && !d->non_blocking)
+        atomic_fetch_add(&f->queue_stats.recv_wait,
+                         av_gettime_relative() - recv_start);
     if (ret < 0)
         return ret;
     if (msg.looping)
@@ -20,6 +20,8 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -32,6 +34,7 @@
 #include "libavutil/log.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
+#include "libavutil/thread.h"
 #include "libavutil/timestamp.h"
 
 #include "libavfilter/buffersink.h"
@@ -57,14 +60,43 @@ struct Encoder {
 
     AVFrame *sq_frame;
 
+    /* the following are only accessed by the thread running the encoder */
+
     // combined size of all the packets received from the encoder
     uint64_t data_size;
 
     // number of packets received from the encoder
     uint64_t packets_encoded;
+
+    pthread_t    thread;
+    /**
+     * Queue for sending frames from the main thread to the encoder thread.
+     * NULL when the encoder runs on the main thread.
+     */
+    ThreadQueue *queue;
+    // new references to frames sent to the encoder thread are made here
+    AVFrame     *send_frame;
 };
 
-static uint64_t dup_warning = 1000;
+/* number of frames that may be queued for an encoder thread */
+#define ENC_THREAD_QUEUE_SIZE 8
+
+static atomic_uint_least64_t dup_warning = 1000;
+
+static int enc_thread_stop(Encoder *e)
+{
+    void *ret;
+
+    if (!e->queue)
+        return 0;
+
+    tq_send_finish(e->queue, 0);
+    pthread_join(e->thread, &ret);
+
+    tq_free(&e->queue);
+
+    return (int)(intptr_t)ret;
+}
 
 void enc_free(Encoder **penc)
 {
@@ -73,7 +105,10 @@ void enc_free(Encoder **penc)
     if (!enc)
         return;
 
+    enc_thread_stop(enc);
+
     av_frame_free(&enc->last_frame);
+    av_frame_free(&enc->send_frame);
     av_frame_free(&enc->sq_frame);
 
     av_freep(penc);
@@ -200,6 +235,134 @@ static void init_encoder_time_base(OutputStream *ost, AVRational default_time_ba
     enc_ctx->time_base = default_time_base;
 }
 
+static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame);
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    OutputFile    *of = output_files[ost->file_index];
+    Encoder        *e = ost->enc;
+    AVFrame    *frame = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "enc%d:%d:%s", ost->file_index, ost->index,
+             ost->enc_ctx->codec->name);
+    ff_thread_setname(name);
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int stream_idx;
+
+        ret = tq_receive(e->queue, &stream_idx, frame);
+        if (ret < 0) {
+            /* the main thread is done sending frames, flush the encoder */
+            ret = encode_frame(of, ost, NULL);
+            break;
+        }
+
+        ret = encode_frame(of, ost, frame);
+        av_frame_unref(frame);
+        if (ret < 0)
+            break;
+    }
+
+finish:
+    av_frame_free(&frame);
+
+    tq_receive_finish(e->queue, 0);
+
+    av_log(ost, AV_LOG_VERBOSE, "Terminating encoder thread\n");
+
+    return (void*)(intptr_t)ret;
+}
+
+static void frame_move(void *dst, void *src)
+{
+    av_frame_move_ref(dst, src);
+}
+
+int enc_thread_allowed(const OutputStream *ost)
+{
+    /* keep encoding on the main thread when it touches state shared with
+     * other streams: subtitle heartbeats, vstats, benchmarking and encoding
+     * stats files (which may be shared between streams) */
+    return (ost->type == AVMEDIA_TYPE_VIDEO || ost->type == AVMEDIA_TYPE_AUDIO) &&
+           !ost->fix_sub_duration_heartbeat && !vstats_filename && !do_benchmark_all &&
+           !ost->enc_stats_pre.io && !ost->enc_stats_post.io;
+}
+
+static int enc_thread_start(OutputStream *ost)
+{
+    Encoder *e = ost->enc;
+    ObjPool *op;
+    int ret;
+
+    if (!enc_thread_allowed(ost))
+        return 0;
+
+    e->send_frame = av_frame_alloc();
+    if (!e->send_frame)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    e->queue = tq_alloc(1, ENC_THREAD_QUEUE_SIZE, op, frame_move);
+    if (!e->queue) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+    tq_set_stats(e->queue, &ost->queue_stats);
+
+    ret = pthread_create(&e->thread, NULL, encoder_thread, ost);
+    if (ret) {
+        av_log(ost, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               strerror(ret));
+        tq_free(&e->queue);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+/* Send a frame to the encoder, or flush it when frame is NULL.
+ * Returns AVERROR_EOF once the encoder is flushed. */
+static int enc_send_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    Encoder *e = ost->enc;
+    int ret;
+
+    if (!e->queue)
+        return encode_frame(of, ost, frame);
+
+    if (!frame) {
+        ret = enc_thread_stop(e);
+        return ret < 0 ? ret : AVERROR_EOF;
+    }
+
+    ret = av_frame_ref(e->send_frame, frame);
+    if (ret < 0)
+        return ret;
+
+    ret = tq_send(e->queue, 0, e->send_frame);
+    if (ret < 0) {
+        av_frame_unref(e->send_frame);
+
+        /* the encoder thread terminated early, which only happens on errors */
+        ret = enc_thread_stop(e);
+        return ret < 0 ? ret : AVERROR_BUG;
+    }
+
+    return 0;
+}
+
 int enc_open(OutputStream *ost, AVFrame *frame)
 {
     InputStream *ist = ost->ist;
@@ -210,7 +373,7 @@ int enc_open(OutputStream *ost, AVFrame *frame)
     OutputFile      *of = output_files[ost->file_index];
     int ret;
 
-    if (ost->initialized)
+    if (atomic_load(&ost->initialized))
         return 0;
 
     set_encoder_id(output_files[ost->file_index], ost);
@@ -392,7 +555,10 @@ int enc_open(OutputStream *ost, AVFrame *frame)
                          ost->sq_idx_encode, ost->enc_ctx->frame_size);
     }
 
-    assert_avoptions(ost->encoder_opts);
+    ret = check_avoptions(ost->encoder_opts);
+    if (ret < 0)
+        return ret;
+
     if (ost->enc_ctx->bit_rate && ost->enc_ctx->bit_rate < 1000 &&
         ost->enc_ctx->codec_id != AV_CODEC_ID_CODEC2 /* don't complain about 700 bit/s modes */)
         av_log(ost, AV_LOG_WARNING, "The bitrate parameter is set too low."
@@ -402,7 +568,7 @@ int enc_open(OutputStream *ost, AVFrame *frame)
     if (ret < 0) {
         av_log(ost, AV_LOG_FATAL,
                "Error initializing the output stream codec context.\n");
-        exit_program(1);
+        return ret;
     }
 
     if (ost->enc_ctx->nb_coded_side_data) {
@@ -455,6 +621,10 @@ int enc_open(OutputStream *ost, AVFrame *frame)
     if (ret < 0)
         return ret;
 
+    ret = enc_thread_start(ost);
+    if (ret < 0)
+        return ret;
+
     return 0;
 }
 
@@ -484,7 +654,7 @@ void enc_subtitle(OutputFile *of, OutputStream *ost, AVSubtitle *sub)
             exit_program(1);
         return;
     }
-    if (ost->finished ||
+    if (atomic_load(&ost->finished) ||
         (of->start_time != AV_NOPTS_VALUE && sub->pts < of->start_time))
         return;
 
@@ -506,6 +676,7 @@ void enc_subtitle(OutputFile *of, OutputStream *ost, AVSubtitle *sub)
         pts -= output_files[ost->file_index]->start_time;
     for (i = 0; i < nb; i++) {
         AVSubtitle local_sub = *sub;
+        StageTimer timer;
 
         if (!check_recording_time(ost, pts, AV_TIME_BASE_Q))
             return;
@@ -529,7 +700,12 @@ void enc_subtitle(OutputFile *of, OutputStream *ost, AVSubtitle *sub)
 
         ost->frames_encoded++;
 
+        stage_timer_start(&timer);
         subtitle_out_size = avcodec_encode_subtitle(enc, pkt->data, pkt->size, &local_sub);
+        stage_timer_stop(&timer, &ost->stats_enc);
+        atomic_fetch_add(&ost->stats_enc.nb_in, 1);
+        if (subtitle_out_size >= 0)
+            atomic_fetch_add(&ost->stats_enc.nb_out, 1);
         if (subtitle_out_size < 0) {
             av_log(ost, AV_LOG_FATAL, "Subtitle encoding failed\n");
             exit_program(1);
@@ -549,7 +725,8 @@ void enc_subtitle(OutputFile *of, OutputStream *ost, AVSubtitle *sub)
         }
         pkt->dts = pkt->pts;
 
-        of_output_packet(of, pkt, ost, 0);
+        if (of_output_packet(of, pkt, ost, 0) < 0)
+            exit_program(1);
     }
 }
 
@@ -635,10 +812,13 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     int64_t frame_number;
     double ti1, bitrate, avg_bitrate;
     double psnr_val = -1;
+    int quality;
 
-    ost->quality   = sd ? AV_RL32(sd) : -1;
+    quality        = sd ? AV_RL32(sd) : -1;
     pict_type      = sd ? sd[4] : AV_PICTURE_TYPE_NONE;
 
+    atomic_store(&ost->quality, quality);
+
     if ((enc->flags & AV_CODEC_FLAG_PSNR) && sd && sd[5]) {
         // FIXME the scaling assumes 8bit
         double error = AV_RL64(sd + 8) / (enc->width * enc->height * 255.0 * 255.0);
@@ -661,10 +841,10 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     frame_number = e->packets_encoded;
     if (vstats_version <= 1) {
         fprintf(vstats_file, "frame= %5"PRId64" q= %2.1f ", frame_number,
-                ost->quality / (float)FF_QP2LAMBDA);
+                quality / (float)FF_QP2LAMBDA);
     } else  {
         fprintf(vstats_file, "out= %2d st= %2d frame= %5"PRId64" q= %2.1f ", ost->file_index, ost->index, frame_number,
-                ost->quality / (float)FF_QP2LAMBDA);
+                quality / (float)FF_QP2LAMBDA);
     }
 
     if (psnr_val >= 0)
@@ -690,6 +870,8 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     AVPacket         *pkt = ost->pkt;
     const char *type_desc = av_get_media_type_string(enc->codec_type);
     const char    *action = frame ? "encode" : "flush";
+    AVRational     mux_tb;
+    StageTimer     timer;
     int ret;
 
     if (frame) {
@@ -714,7 +896,11 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
 
     update_benchmark(NULL);
 
+    stage_timer_start(&timer);
     ret = avcodec_send_frame(enc, frame);
+    stage_timer_stop(&timer, &ost->stats_enc);
+    if (frame && ret >= 0)
+        atomic_fetch_add(&ost->stats_enc.nb_in, 1);
     if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
         av_log(ost, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
                type_desc);
@@ -722,7 +908,11 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     }
 
     while (1) {
+        stage_timer_start(&timer);
         ret = avcodec_receive_packet(enc, pkt);
+        stage_timer_stop(&timer, &ost->stats_enc);
+        if (ret >= 0)
+            atomic_fetch_add(&ost->stats_enc.nb_out, 1);
         update_benchmark("%s_%s %d.%d", action, type_desc,
                          ost->file_index, ost->index);
 
@@ -736,8 +926,8 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
             av_assert0(frame); // should never happen during flushing
             return 0;
         } else if (ret == AVERROR_EOF) {
-            of_output_packet(of, pkt, ost, 1);
-            return ret;
+            ret = of_output_packet(of, pkt, ost, 1);
+            return ret < 0 ? ret : AVERROR_EOF;
         } else if (ret < 0) {
             av_log(ost, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
             return ret;
@@ -759,8 +949,9 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
                    av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
         }
 
-        av_packet_rescale_ts(pkt, pkt->time_base, ost->mux_timebase);
-        pkt->time_base = ost->mux_timebase;
+        mux_tb = of_stream_mux_timebase(ost);
+        av_packet_rescale_ts(pkt, pkt->time_base, mux_tb);
+        pkt->time_base = mux_tb;
 
         if (debug_ts) {
             av_log(ost, AV_LOG_INFO, "encoder -> type:%s "
@@ -776,14 +967,16 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
             av_log(NULL, AV_LOG_ERROR,
                    "Subtitle heartbeat logic failed in %s! (%s)\n",
                    __func__, av_err2str(ret));
-            exit_program(1);
+            return ret;
         }
 
         e->data_size += pkt->size;
 
         e->packets_encoded++;
 
-        of_output_packet(of, pkt, ost, 0);
+        ret = of_output_packet(of, pkt, ost, 0);
+        if (ret < 0)
+            return ret;
     }
 
     av_assert0(0);
@@ -796,7 +989,7 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
     int ret;
 
     if (ost->sq_idx_encode < 0)
-        return encode_frame(of, ost, frame);
+        return enc_send_frame(of, ost, frame);
 
     if (frame) {
         ret = av_frame_ref(e->sq_frame, frame);
@@ -825,7 +1018,7 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
             return (ret == AVERROR(EAGAIN)) ? 0 : ret;
         }
 
-        ret = encode_frame(of, ost, enc_frame);
+        ret = enc_send_frame(of, ost, enc_frame);
         if (enc_frame)
             av_frame_unref(enc_frame);
         if (ret < 0) {
@@ -836,8 +1029,8 @@ static int submit_encode_frame(OutputFile *of, OutputStream *ost,
     }
 }
 
-static void do_audio_out(OutputFile *of, OutputStream *ost,
-                         AVFrame *frame)
+static int do_audio_out(OutputFile *of, OutputStream *ost,
+                        AVFrame *frame)
 {
     Encoder          *e = ost->enc;
     AVCodecContext *enc = ost->enc_ctx;
@@ -847,7 +1040,7 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
         enc->ch_layout.nb_channels != frame->ch_layout.nb_channels) {
         av_log(ost, AV_LOG_ERROR,
                "Audio channel count changed and encoder does not support parameter changes\n");
-        return;
+        return 0;
     }
 
     if (frame->pts == AV_NOPTS_VALUE)
@@ -863,13 +1056,12 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                                     enc->time_base);
 
     if (!check_recording_time(ost, frame->pts, frame->time_base))
-        return;
+        return 0;
 
     e->next_pts = frame->pts + frame->nb_samples;
 
     ret = submit_encode_frame(of, ost, frame);
-    if (ret < 0 && ret != AVERROR_EOF)
-        exit_program(1);
+    return (ret < 0 && ret != AVERROR_EOF) ? ret : 0;
 }
 
 static double adjust_frame_pts_to_encoder_tb(OutputFile *of, OutputStream *ost,
@@ -1054,13 +1246,14 @@ force_keyframe:
 }
 
 /* May modify/reset frame */
-static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
+static int do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
 {
     int ret;
     Encoder *e = ost->enc;
     AVCodecContext *enc = ost->enc_ctx;
     AVRational frame_rate;
-    int64_t nb_frames, nb_frames_prev, i;
+    int64_t nb_frames, nb_frames_prev, nb_dups, nb_dups_total, i;
+    uint_least64_t warning;
     double duration = 0;
     AVFilterContext *filter = ost->filter->filter;
 
@@ -1078,7 +1271,7 @@ static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
                        &nb_frames, &nb_frames_prev);
 
     if (nb_frames_prev == 0 && ost->last_dropped) {
-        nb_frames_drop++;
+        atomic_fetch_add(&nb_frames_drop, 1);
         av_log(ost, AV_LOG_VERBOSE,
                "*** dropping frame %"PRId64" at ts %"PRId64"\n",
                e->vsync_frame_number, e->last_frame->pts);
@@ -1086,15 +1279,17 @@ static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
     if (nb_frames > (nb_frames_prev && ost->last_dropped) + (nb_frames > nb_frames_prev)) {
         if (nb_frames > dts_error_threshold * 30) {
             av_log(ost, AV_LOG_ERROR, "%"PRId64" frame duplication too large, skipping\n", nb_frames - 1);
-            nb_frames_drop++;
-            return;
+            atomic_fetch_add(&nb_frames_drop, 1);
+            return 0;
         }
-        nb_frames_dup += nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
+        nb_dups = nb_frames - (nb_frames_prev && ost->last_dropped) - (nb_frames > nb_frames_prev);
+        nb_dups_total = atomic_fetch_add(&nb_frames_dup, nb_dups) + nb_dups;
         av_log(ost, AV_LOG_VERBOSE, "*** %"PRId64" dup!\n", nb_frames - 1);
-        if (nb_frames_dup > dup_warning) {
-            av_log(ost, AV_LOG_WARNING, "More than %"PRIu64" frames duplicated\n", dup_warning);
-            dup_warning *= 10;
-        }
+        /* the counter is shared by all the video encoding threads */
+        warning = atomic_load(&dup_warning);
+        if (nb_dups_total > warning &&
+            atomic_compare_exchange_strong(&dup_warning, &warning, warning * 10))
+            av_log(ost, AV_LOG_WARNING, "More than %"PRIu64" frames duplicated\n", warning);
     }
     ost->last_dropped = nb_frames == nb_frames_prev && frame;
     ost->kf.dropped_keyframe = ost->last_dropped && frame && (frame->flags & AV_FRAME_FLAG_KEY);
@@ -1109,12 +1304,12 @@ static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
             in_picture = frame;
 
         if (!in_picture)
-            return;
+            return 0;
 
         in_picture->pts = e->next_pts;
 
         if (!check_recording_time(ost, in_picture->pts, ost->enc_ctx->time_base))
-            return;
+            return 0;
 
         in_picture->quality = enc->global_quality;
         in_picture->pict_type = forced_kf_apply(ost, &ost->kf, enc->time_base, in_picture, i);
@@ -1123,7 +1318,7 @@ static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
         if (ret == AVERROR_EOF)
             break;
         else if (ret < 0)
-            exit_program(1);
+            return ret;
 
         e->next_pts++;
         e->vsync_frame_number++;
@@ -1132,19 +1327,21 @@ static void do_video_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
     av_frame_unref(e->last_frame);
     if (frame)
         av_frame_move_ref(e->last_frame, frame);
+
+    return 0;
 }
 
-void enc_frame(OutputStream *ost, AVFrame *frame)
+int enc_frame(OutputStream *ost, AVFrame *frame)
 {
     OutputFile *of = output_files[ost->file_index];
     int ret;
 
     ret = enc_open(ost, frame);
     if (ret < 0)
-        exit_program(1);
+        return ret;
 
-    if (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO) do_video_out(of, ost, frame);
-    else                                                do_audio_out(of, ost, frame);
+    return ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO ?
+           do_video_out(of, ost, frame) : do_audio_out(of, ost, frame);
 }
 
 void enc_flush(void)
@@ -1166,7 +1363,7 @@ void enc_flush(void)
 
         // Try to enable encoding with no input frames.
         // Maybe we should just let encoding fail instead.
-        if (!ost->initialized) {
+        if (!atomic_load(&ost->initialized)) {
             FilterGraph *fg = ost->filter->graph;
 
             av_log(ost, AV_LOG_WARNING,
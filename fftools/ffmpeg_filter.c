@@ -21,6 +21,8 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
 
 #include "libavfilter/avfilter.h"
 #include "libavfilter/buffersink.h"
@@ -36,6 +38,7 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/thread.h"
 #include "libavutil/timestamp.h"
 
 typedef struct FilterGraphPriv {
@@ -47,8 +50,30 @@ typedef struct FilterGraphPriv {
 
     // frame for temporarily holding output from the filtergraph
     AVFrame *frame;
+
+    // held by the filtering thread while it runs the graph, see fg_lock()
+    pthread_mutex_t lock;
+
+    pthread_t    thread;
+    /**
+     * Queue for sending frames to the filtering thread, a frame without
+     * data marks EOF. NULL when the graph is run on the main thread.
+     */
+    ThreadQueue *queue;
+    // new references to frames sent to the filtering thread are made here
+    AVFrame     *send_frame;
+    // set by the sending side once it is done with the queue
+    atomic_int   eof_sent;
+    // error the filtering thread terminated with; only valid once it
+    // marked the queue as finished
+    int          thread_ret;
+    // the graph outputs reached EOF on the filtering thread
+    int          outputs_eof;
 } FilterGraphPriv;
 
+/* number of frames that may be queued for a filtering thread */
+#define FG_THREAD_QUEUE_SIZE 8
+
 static FilterGraphPriv *fgp_from_fg(FilterGraph *fg)
 {
     return (FilterGraphPriv*)fg;
@@ -580,7 +605,7 @@ static OutputFilter *ofilter_alloc(FilterGraph *fg)
     ofilter           = ALLOC_ARRAY_ELEM(fg->outputs, fg->nb_outputs);
     ofilter->graph    = fg;
     ofilter->format   = -1;
-    ofilter->last_pts = AV_NOPTS_VALUE;
+    atomic_init(&ofilter->last_pts, AV_NOPTS_VALUE);
 
     return ofilter;
 }
@@ -731,6 +756,10 @@ void fg_free(FilterGraph **pfg)
         return;
     fgp = fgp_from_fg(fg);
 
+    fg_thread_stop(fg);
+    av_frame_free(&fgp->send_frame);
+    pthread_mutex_destroy(&fgp->lock);
+
     avfilter_graph_free(&fg->graph);
     for (int j = 0; j < fg->nb_inputs; j++) {
         InputFilter *ifilter = fg->inputs[j];
@@ -792,6 +821,10 @@ FilterGraph *fg_create(char *graph_desc)
     if (!fgp->frame)
         report_and_exit(AVERROR(ENOMEM));
 
+    ret = pthread_mutex_init(&fgp->lock, NULL);
+    if (ret)
+        report_and_exit(AVERROR(ret));
+
     /* this graph is only used for determining the kinds of inputs
      * and outputs we have, and is discarded on exit from this function */
     graph = avfilter_graph_alloc();
@@ -1532,6 +1565,9 @@ int configure_filtergraph(FilterGraph *fg)
         fg->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    // the per-filter timings are only reported in the -stats_json output
+    fg->graph->collect_stats = !!stats_json_avio;
+
     hw_device = hw_device_for_filter();
 
     if ((ret = graph_parse(fg->graph, graph_desc, &inputs, &outputs, hw_device)) < 0)
@@ -1685,56 +1721,87 @@ int filtergraph_is_simple(const FilterGraph *fg)
     return fgp->is_simple;
 }
 
-int reap_filters(int flush)
+int filtergraph_is_threaded(const FilterGraph *fg)
 {
-    /* Reap all buffers present in the buffer sinks */
-    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
-        FilterGraphPriv *fgp;
-        AVFrame *filtered_frame;
-        AVFilterContext *filter;
-        int ret = 0;
+    const FilterGraphPriv *fgp = cfgp_from_cfg(fg);
+    return !!fgp->queue;
+}
 
-        if (!ost->filter || !ost->filter->graph->graph)
-            continue;
-        filter = ost->filter->filter;
-        fgp    = fgp_from_fg(ost->filter->graph);
-
-        filtered_frame = fgp->frame;
-
-        while (1) {
-            ret = av_buffersink_get_frame_flags(filter, filtered_frame,
-                                               AV_BUFFERSINK_FLAG_NO_REQUEST);
-            if (ret < 0) {
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-                    av_log(NULL, AV_LOG_WARNING,
-                           "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
-                } else if (flush && ret == AVERROR_EOF) {
-                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
-                        enc_frame(ost, NULL);
-                }
-                break;
-            }
-            if (ost->finished) {
-                av_frame_unref(filtered_frame);
-                continue;
-            }
+/* Reap all buffers present in the buffer sink of the given output */
+static int reap_output(OutputStream *ost, int flush)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(ost->filter->graph);
+    AVFrame *filtered_frame = fgp->frame;
+    AVFilterContext *filter = ost->filter->filter;
+    int ret;
 
-            if (filtered_frame->pts != AV_NOPTS_VALUE) {
-                AVRational tb = av_buffersink_get_time_base(filter);
-                ost->filter->last_pts = av_rescale_q(filtered_frame->pts, tb,
-                                                     AV_TIME_BASE_Q);
-                filtered_frame->time_base = tb;
-
-                if (debug_ts)
-                    av_log(NULL, AV_LOG_INFO, "filter_raw -> pts:%s pts_time:%s time_base:%d/%d\n",
-                           av_ts2str(filtered_frame->pts),
-                           av_ts2timestr(filtered_frame->pts, &tb),
-                           tb.num, tb.den);
-            }
+    while (1) {
+        StageTimer timer;
 
-            enc_frame(ost, filtered_frame);
+        stage_timer_start(&timer);
+        ret = av_buffersink_get_frame_flags(filter, filtered_frame,
+                                           AV_BUFFERSINK_FLAG_NO_REQUEST);
+        stage_timer_stop(&timer, &ost->filter->graph->stats);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                av_log(NULL, AV_LOG_WARNING,
+                       "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
+            } else if (flush && ret == AVERROR_EOF) {
+                if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
+                    return enc_frame(ost, NULL);
+            }
+            return 0;
+        }
+        atomic_fetch_add(&ost->filter->graph->stats.nb_out, 1);
+        if (atomic_load(&ost->finished)) {
             av_frame_unref(filtered_frame);
+            continue;
+        }
+
+        if (filtered_frame->pts != AV_NOPTS_VALUE) {
+            AVRational tb = av_buffersink_get_time_base(filter);
+            atomic_store(&ost->filter->last_pts,
+                         av_rescale_q(filtered_frame->pts, tb, AV_TIME_BASE_Q));
+            filtered_frame->time_base = tb;
+
+            if (debug_ts)
+                av_log(NULL, AV_LOG_INFO, "filter_raw -> pts:%s pts_time:%s time_base:%d/%d\n",
+                       av_ts2str(filtered_frame->pts),
+                       av_ts2timestr(filtered_frame->pts, &tb),
+                       tb.num, tb.den);
         }
+
+        ret = enc_frame(ost, filtered_frame);
+        av_frame_unref(filtered_frame);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static int reap_graph(FilterGraph *fg, int flush)
+{
+    if (!fg->graph)
+        return 0;
+
+    for (int i = 0; i < fg->nb_outputs; i++) {
+        int ret = reap_output(fg->outputs[i]->ost, flush);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int reap_filters(int flush)
+{
+    /* Reap all buffers present in the buffer sinks, except for the graphs
+     * run by filtering threads */
+    for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
+        if (!ost->filter || !ost->filter->graph->graph ||
+            filtergraph_is_threaded(ost->filter->graph))
+            continue;
+
+        if (reap_output(ost, flush) < 0)
+            exit_program(1);
     }
 
     return 0;
@@ -1802,7 +1869,7 @@ int ifilter_sub2video(InputFilter *ifilter, const AVSubtitle *subtitle)
     return 0;
 }
 
-int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
+static int send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     int ret;
@@ -1810,10 +1877,14 @@ int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
     ifp->eof = 1;
 
     if (ifp->filter) {
+        StageTimer timer;
+
         pts = av_rescale_q_rnd(pts, tb, ifp->time_base,
                                AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
 
+        stage_timer_start(&timer);
         ret = av_buffersrc_close(ifp->filter, pts, AV_BUFFERSRC_FLAG_PUSH);
+        stage_timer_stop(&timer, &ifilter->graph->stats);
         if (ret < 0)
             return ret;
     } else {
@@ -1850,11 +1921,12 @@ int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
     return 0;
 }
 
-int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+static int send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
 {
     InputFilterPriv *ifp = ifp_from_ifilter(ifilter);
     FilterGraph *fg = ifilter->graph;
     AVFrameSideData *sd;
+    StageTimer timer;
     int need_reinit, ret;
 
     /* determine if the parameters for this input changed */
@@ -1905,7 +1977,8 @@ int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
             return ret;
         }
 
-        ret = reap_filters(0);
+        /* the filtering thread must not touch the other graphs */
+        ret = filtergraph_is_threaded(fg) ? reap_graph(fg, 0) : reap_filters(0);
         if (ret < 0 && ret != AVERROR_EOF) {
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
             return ret;
@@ -1935,24 +2008,43 @@ int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
     )
 #endif
 
+    stage_timer_start(&timer);
     ret = av_buffersrc_add_frame_flags(ifp->filter, frame,
                                        AV_BUFFERSRC_FLAG_PUSH);
+    stage_timer_stop(&timer, &fg->stats);
     if (ret < 0) {
         av_frame_unref(frame);
         if (ret != AVERROR_EOF)
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
         return ret;
     }
+    atomic_fetch_add(&fg->stats.nb_in, 1);
 
     return 0;
 }
 
 int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
 {
+    StageTimer timer;
     int i, ret;
     int nb_requests, nb_requests_max = 0;
     InputStream *ist;
 
+    if (filtergraph_is_threaded(graph)) {
+        FilterGraphPriv *fgp = fgp_from_fg(graph);
+
+        /* the filtering thread runs the graph until its input is finished,
+         * draining it afterwards is done here */
+        if (!atomic_load(&fgp->eof_sent)) {
+            *best_ist = ifp_from_ifilter(graph->inputs[0])->ist;
+            return 0;
+        }
+
+        ret = fg_thread_stop(graph);
+        if (ret < 0)
+            return ret;
+    }
+
     if (!graph->graph) {
         for (int i = 0; i < graph->nb_inputs; i++) {
             InputFilter *ifilter = graph->inputs[i];
@@ -1971,7 +2063,9 @@ int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
     }
 
     *best_ist = NULL;
+    stage_timer_start(&timer);
     ret = avfilter_graph_request_oldest(graph->graph);
+    stage_timer_stop(&timer, &graph->stats);
     if (ret >= 0)
         return reap_filters(0);
 
@@ -2004,3 +2098,249 @@ int fg_transcode_step(FilterGraph *graph, InputStream **best_ist)
 
     return 0;
 }
+
+/* Run a graph fed by a filtering thread until it needs more input, like the
+ * main loop does with fg_transcode_step() for the graphs it runs itself. */
+static int fg_thread_run(FilterGraph *fg)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    int ret;
+
+    ret = reap_graph(fg, 0);
+    if (ret < 0)
+        return ret;
+
+    while (fg->graph && !fgp->outputs_eof) {
+        StageTimer timer;
+
+        stage_timer_start(&timer);
+        ret = avfilter_graph_request_oldest(fg->graph);
+        stage_timer_stop(&timer, &fg->stats);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+
+        if (ret == AVERROR_EOF) {
+            fgp->outputs_eof = 1;
+            ret = reap_graph(fg, 1);
+            for (int i = 0; i < fg->nb_outputs; i++)
+                close_output_stream(fg->outputs[i]->ost);
+            return ret;
+        }
+        if (ret < 0)
+            return ret;
+
+        ret = reap_graph(fg, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static void *filter_thread(void *arg)
+{
+    FilterGraph      *fg = arg;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    InputFilter *ifilter = fg->inputs[0];
+    AVFrame       *frame = NULL;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "fg%d", fg->index);
+    ff_thread_setname(name);
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int stream_idx, eof;
+
+        ret = tq_receive(fgp->queue, &stream_idx, frame);
+        if (ret < 0) {
+            /* the sending side stopped without an EOF, we are being
+             * torn down */
+            ret = 0;
+            break;
+        }
+        eof = !frame->buf[0];
+
+        pthread_mutex_lock(&fgp->lock);
+        if (eof) {
+            /* the graph outputs are drained on the main thread, once
+             * this thread is joined */
+            ret = send_eof(ifilter, frame->pts, frame->time_base);
+            if (ret >= 0)
+                ret = reap_graph(fg, 0);
+        } else {
+            ret = send_frame(ifilter, frame, 0);
+            if (ret >= 0 || ret == AVERROR_EOF)
+                ret = fg_thread_run(fg);
+        }
+        pthread_mutex_unlock(&fgp->lock);
+
+        av_frame_unref(frame);
+        if (ret < 0 || eof)
+            break;
+    }
+
+finish:
+    av_frame_free(&frame);
+
+    /* must be set before tq_receive_finish(), which makes it visible to
+     * the sending side */
+    fgp->thread_ret = ret;
+    tq_receive_finish(fgp->queue, 0);
+
+    av_log(NULL, AV_LOG_VERBOSE, "Terminating filtering thread %d\n", fg->index);
+
+    return (void*)(intptr_t)ret;
+}
+
+static void frame_move(void *dst, void *src)
+{
+    av_frame_move_ref(dst, src);
+}
+
+int fg_thread_start(FilterGraph *fg)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    InputFilterPriv *ifp;
+    ObjPool *op;
+    int ret;
+
+    /* only simple audio/video graphs whose encoder runs in its own thread
+     * get a filtering thread; everything else touches state shared with
+     * other streams (see enc_thread_allowed()) */
+    if (!fgp->is_simple)
+        return 0;
+    ifp = ifp_from_ifilter(fg->inputs[0]);
+    if ((ifp->type_src != AVMEDIA_TYPE_VIDEO && ifp->type_src != AVMEDIA_TYPE_AUDIO) ||
+        !enc_thread_allowed(fg->outputs[0]->ost))
+        return 0;
+
+    fgp->send_frame = av_frame_alloc();
+    if (!fgp->send_frame)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    fgp->queue = tq_alloc(1, FG_THREAD_QUEUE_SIZE, op, frame_move);
+    if (!fgp->queue) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+    tq_set_stats(fgp->queue, &fg->queue_stats);
+
+    ret = pthread_create(&fgp->thread, NULL, filter_thread, fg);
+    if (ret) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               strerror(ret));
+        tq_free(&fgp->queue);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+int fg_thread_stop(FilterGraph *fg)
+{
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    void *ret;
+
+    if (!fgp->queue)
+        return 0;
+
+    tq_send_finish(fgp->queue, 0);
+    pthread_join(fgp->thread, &ret);
+
+    tq_free(&fgp->queue);
+
+    return (int)(intptr_t)ret;
+}
+
+void fg_lock(FilterGraph *fg)
+{
+    pthread_mutex_lock(&fgp_from_fg(fg)->lock);
+}
+
+void fg_unlock(FilterGraph *fg)
+{
+    pthread_mutex_unlock(&fgp_from_fg(fg)->lock);
+}
+
+/* whether some output of the graph waits for its first frame, see
+ * outputs_pending() in ffmpeg_dec.c */
+static int graph_outputs_pending(const FilterGraph *fg)
+{
+    for (int i = 0; i < fg->nb_outputs; i++) {
+        OutputStream *ost = fg->outputs[i]->ost;
+        if (!atomic_load(&ost->initialized) && !atomic_load(&ost->finished))
+            return 1;
+    }
+    return 0;
+}
+
+int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+{
+    FilterGraph      *fg = ifilter->graph;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    int ret;
+
+    if (!fgp->queue)
+        return send_frame(ifilter, frame, keep_reference);
+
+    if (keep_reference) {
+        ret = av_frame_ref(fgp->send_frame, frame);
+        if (ret < 0)
+            return ret;
+    } else
+        av_frame_move_ref(fgp->send_frame, frame);
+
+    ret = tq_send(fgp->queue, 0, fgp->send_frame);
+    if (ret < 0) {
+        av_frame_unref(fgp->send_frame);
+        /* the filtering thread terminated early, which only happens on errors */
+        return fgp->thread_ret < 0 ? fgp->thread_ret : AVERROR_BUG;
+    }
+
+    if (graph_outputs_pending(fg))
+        tq_wait_idle(fgp->queue);
+
+    return 0;
+}
+
+int ifilter_send_eof(InputFilter *ifilter, int64_t pts, AVRational tb)
+{
+    FilterGraph      *fg = ifilter->graph;
+    FilterGraphPriv *fgp = fgp_from_fg(fg);
+    AVFrame *eof = fgp->send_frame;
+    int ret;
+
+    if (!fgp->queue)
+        return send_eof(ifilter, pts, tb);
+    if (atomic_load(&fgp->eof_sent))
+        return 0;
+
+    eof->pts       = pts;
+    eof->time_base = tb;
+
+    ret = tq_send(fgp->queue, 0, eof);
+    av_frame_unref(eof);
+    if (ret >= 0) {
+        tq_send_finish(fgp->queue, 0);
+        /* wait for the EOF to be processed, so its errors are reported
+         * like without threads */
+        tq_wait_idle(fgp->queue);
+    }
+    ret = fgp->thread_ret < 0 ? fgp->thread_ret : ret < 0 ? AVERROR_BUG : 0;
+
+    /* the queue is not touched by this thread afterwards */
+    atomic_store(&fgp->eof_sent, 1);
+
+    return ret;
+}
@@ -40,6 +40,10 @@
 
 int want_sdp = 1;
 
+/* Serializes muxer initialization against packets submitted from encoder
+ * threads, which may race with mux_check_init() starting the muxer threads. */
+static pthread_mutex_t mux_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static Muxer *mux_from_of(OutputFile *of)
 {
     return (Muxer*)of;
@@ -62,6 +66,7 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 {
     MuxStream *ms = ms_from_ost(ost);
     AVFormatContext *s = mux->fc;
+    StageTimer timer;
     int64_t fs;
     uint64_t frame_num;
     int ret;
@@ -137,13 +142,16 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     if (ms->stats.io)
         enc_stats_write(ost, &ms->stats, NULL, pkt, frame_num);
 
+    stage_timer_start(&timer);
     ret = av_interleaved_write_frame(s, pkt);
+    stage_timer_stop(&timer, &mux->of.stats_mux);
     if (ret < 0) {
         av_log(ost, AV_LOG_ERROR,
                "Error submitting a packet to the muxer: %s\n",
                av_err2str(ret));
         goto fail;
     }
+    atomic_fetch_add(&mux->of.stats_mux.nb_in, 1);
 
     return 0;
 fail:
@@ -245,7 +253,7 @@ static int thread_submit_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 {
     int ret = 0;
 
-    if (!pkt || ost->finished & MUXER_FINISHED)
+    if (!pkt || atomic_load(&ost->finished) & MUXER_FINISHED)
         goto finish;
 
     ret = tq_send(mux->tq, ost->index, pkt);
@@ -258,7 +266,7 @@ finish:
     if (pkt)
         av_packet_unref(pkt);
 
-    ost->finished |= MUXER_FINISHED;
+    atomic_fetch_or(&ost->finished, MUXER_FINISHED);
     tq_send_finish(mux->tq, ost->index);
     return ret == AVERROR_EOF ? 0 : ret;
 }
@@ -309,11 +317,21 @@ static int submit_packet(Muxer *mux, AVPacket *pkt, OutputStream *ost)
 {
     int ret;
 
+    /* once the muxer thread is running, mux->tq will not change until
+     * thread_stop() is called, which happens after all encoder threads
+     * are joined */
+    if (atomic_load(&mux->thread_started))
+        return thread_submit_packet(mux, ost, pkt);
+
+    pthread_mutex_lock(&mux_init_lock);
+
     if (mux->tq) {
+        pthread_mutex_unlock(&mux_init_lock);
         return thread_submit_packet(mux, ost, pkt);
     } else {
         /* the muxer is not initialized yet, buffer the packet */
         ret = queue_packet(ost, pkt);
+        pthread_mutex_unlock(&mux_init_lock);
         if (ret < 0) {
             if (pkt)
                 av_packet_unref(pkt);
@@ -324,7 +342,7 @@ static int submit_packet(Muxer *mux, AVPacket *pkt, OutputStream *ost)
     return 0;
 }
 
-void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
+int of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
 {
     Muxer *mux = mux_from_of(of);
     MuxStream *ms = ms_from_ost(ost);
@@ -332,7 +350,8 @@ void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
     int ret = 0;
 
     if (!eof && pkt->dts != AV_NOPTS_VALUE)
-        ost->last_mux_dts = av_rescale_q(pkt->dts, pkt->time_base, AV_TIME_BASE_Q);
+        atomic_store(&ost->last_mux_dts,
+                     av_rescale_q(pkt->dts, pkt->time_base, AV_TIME_BASE_Q));
 
     /* apply the output bitstream filters */
     if (ms->bsf_ctx) {
@@ -347,7 +366,7 @@ void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
         while (!bsf_eof) {
             ret = av_bsf_receive_packet(ms->bsf_ctx, pkt);
             if (ret == AVERROR(EAGAIN))
-                return;
+                return 0;
             else if (ret == AVERROR_EOF)
                 bsf_eof = 1;
             else if (ret < 0) {
@@ -365,16 +384,14 @@ void of_output_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int eof)
             goto mux_fail;
     }
 
-    return;
+    return 0;
 
 mux_fail:
     err_msg = "submitting a packet to the muxer";
 
 fail:
     av_log(ost, AV_LOG_ERROR, "Error %s\n", err_msg);
-    if (exit_on_error)
-        exit_program(1);
-
+    return exit_on_error ? ret : 0;
 }
 
 void of_streamcopy(OutputStream *ost, const AVPacket *pkt, int64_t dts)
@@ -382,7 +399,8 @@ void of_streamcopy(OutputStream *ost, const AVPacket *pkt, int64_t dts)
     OutputFile *of = output_files[ost->file_index];
     MuxStream  *ms = ms_from_ost(ost);
     int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
-    int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->mux_timebase);
+    AVRational mux_tb = of_stream_mux_timebase(ost);
+    int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, mux_tb);
     AVPacket *opkt = ost->pkt;
 
     av_packet_unref(opkt);
@@ -393,7 +411,8 @@ void of_streamcopy(OutputStream *ost, const AVPacket *pkt, int64_t dts)
 
     // EOF: flush output bitstream filters.
     if (!pkt) {
-        of_output_packet(of, opkt, ost, 1);
+        if (of_output_packet(of, opkt, ost, 1) < 0)
+            exit_program(1);
         return;
     }
 
@@ -415,7 +434,7 @@ void of_streamcopy(OutputStream *ost, const AVPacket *pkt, int64_t dts)
     if (av_packet_ref(opkt, pkt) < 0)
         exit_program(1);
 
-    opkt->time_base = ost->mux_timebase;
+    opkt->time_base = mux_tb;
 
     if (pkt->pts != AV_NOPTS_VALUE)
         opkt->pts = av_rescale_q(pkt->pts, pkt->time_base, opkt->time_base) - ost_tb_start_time;
@@ -447,7 +466,8 @@ void of_streamcopy(OutputStream *ost, const AVPacket *pkt, int64_t dts)
         }
     }
 
-    of_output_packet(of, opkt, ost, 0);
+    if (of_output_packet(of, opkt, ost, 0) < 0)
+        exit_program(1);
 
     ms->streamcopy_started = 1;
 }
@@ -464,6 +484,7 @@ static int thread_stop(Muxer *mux)
 
     pthread_join(mux->thread, &ret);
 
+    atomic_store(&mux->thread_started, 0);
     tq_free(&mux->tq);
 
     return (int)(intptr_t)ret;
@@ -489,6 +510,7 @@ static int thread_start(Muxer *mux)
         objpool_free(&op);
         return AVERROR(ENOMEM);
     }
+    tq_set_stats(mux->tq, &mux->of.queue_stats);
 
     ret = pthread_create(&mux->thread, NULL, muxer_thread, (void*)mux);
     if (ret) {
@@ -517,6 +539,8 @@ static int thread_start(Muxer *mux)
         }
     }
 
+    atomic_store(&mux->thread_started, 1);
+
     return 0;
 }
 
@@ -584,7 +608,7 @@ int mux_check_init(Muxer *mux)
 
     for (i = 0; i < fc->nb_streams; i++) {
         OutputStream *ost = of->streams[i];
-        if (!ost->initialized)
+        if (!atomic_load(&ost->initialized))
             return 0;
     }
 
@@ -666,9 +690,31 @@ int of_stream_init(OutputFile *of, OutputStream *ost)
     if (ret < 0)
         return ret;
 
-    ost->initialized = 1;
+    pthread_mutex_lock(&mux_init_lock);
+
+    atomic_store(&ost->initialized, 1);
 
-    return mux_check_init(mux);
+    ret = mux_check_init(mux);
+
+    pthread_mutex_unlock(&mux_init_lock);
+
+    return ret;
+}
+
+AVRational of_stream_mux_timebase(OutputStream *ost)
+{
+    Muxer *mux = mux_from_of(output_files[ost->file_index]);
+    AVRational tb;
+
+    if (atomic_load(&mux->thread_started))
+        return ost->mux_timebase;
+
+    /* mux_timebase may be updated by thread_start() */
+    pthread_mutex_lock(&mux_init_lock);
+    tb = ost->mux_timebase;
+    pthread_mutex_unlock(&mux_init_lock);
+
+    return tb;
 }
 
 static int check_written(OutputFile *of)
@@ -905,6 +951,12 @@ void of_close(OutputFile **pof)
         return;
     mux = mux_from_of(of);
 
+    /* encoder threads may still be submitting packets to the muxer thread,
+     * so they must be terminated first */
+    for (int i = 0; i < of->nb_streams; i++)
+        if (of->streams[i])
+            enc_free(&of->streams[i]->enc);
+
     thread_stop(mux);
 
     sq_free(&of->sq_encode);
@@ -90,6 +90,10 @@ typedef struct Muxer {
 
     pthread_t    thread;
     ThreadQueue *tq;
+    /* set once the muxer thread runs and the packets queued before it was
+     * started have been sent to it; mux_timebase of the streams does not
+     * change afterwards */
+    atomic_int   thread_started;
 
     AVDictionary *opts;
 
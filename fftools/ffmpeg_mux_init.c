@@ -810,7 +810,7 @@ static void new_stream_audio(Muxer *mux, const OptionsContext *o,
 static void new_stream_attachment(Muxer *mux, const OptionsContext *o,
                                   OutputStream *ost)
 {
-    ost->finished    = 1;
+    atomic_store(&ost->finished, ENCODER_FINISHED);
 }
 
 static void new_stream_subtitle(Muxer *mux, const OptionsContext *o,
@@ -1237,7 +1237,7 @@ static OutputStream *ost_add(Muxer *mux, const OptionsContext *o,
     if (ost->enc_ctx && av_get_exact_bits_per_sample(ost->enc_ctx->codec_id) == 24)
         av_dict_set(&ost->swr_opts, "output_sample_bits", "24", 0);
 
-    ost->last_mux_dts = AV_NOPTS_VALUE;
+    atomic_init(&ost->last_mux_dts, AV_NOPTS_VALUE);
 
     MATCH_PER_STREAM_OPT(copy_initial_nonkeyframes, i,
                          ms->copy_initial_nonkeyframes, oc, st);
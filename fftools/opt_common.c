@@ -1080,6 +1080,35 @@ int opt_cpucount(void *optctx, const char *opt, const char *arg)
     return ret;
 }
 
+int opt_shared_threads(void *optctx, const char *opt, const char *arg)
+{
+    int ret;
+    int count;
+
+    static const AVOption opts[] = {
+        {"count", NULL, 0, AV_OPT_TYPE_INT, { .i64 = 0}, 0, INT_MAX},
+        {NULL},
+    };
+    static const AVClass class = {
+        .class_name = "shared_threads",
+        .item_name  = av_default_item_name,
+        .option     = opts,
+        .version    = LIBAVUTIL_VERSION_INT,
+    };
+    const AVClass *pclass = &class;
+
+    ret = av_opt_eval_int(&pclass, opts, arg, &count);
+    if (ret < 0)
+        return ret;
+
+    ret = av_cpu_set_shared_threads(count);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Failed to set up shared threads: %s\n",
+               av_err2str(ret));
+
+    return ret;
+}
+
 static void expand_filename_template(AVBPrint *bp, const char *template,
                                      struct tm *tm)
 {
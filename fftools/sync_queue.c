@@ -27,6 +27,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/thread.h"
 #include "libavutil/timestamp.h"
 
 #include "objpool.h"
@@ -110,6 +111,10 @@ struct SyncQueue {
     int have_limiting;
 
     uintptr_t align_mask;
+
+    /* the streams of an encoding queue may be fed from several filtering
+     * threads */
+    pthread_mutex_t lock;
 };
 
 static void frame_move(const SyncQueue *sq, SyncQueueFrame dst,
@@ -340,7 +345,7 @@ static int overflow_heartbeat(SyncQueue *sq, int stream_idx)
     return 1;
 }
 
-int sq_send(SyncQueue *sq, unsigned int stream_idx, SyncQueueFrame frame)
+static int send_locked(SyncQueue *sq, unsigned int stream_idx, SyncQueueFrame frame)
 {
     SyncQueueStream *st;
     SyncQueueFrame dst;
@@ -406,6 +411,17 @@ int sq_send(SyncQueue *sq, unsigned int stream_idx, SyncQueueFrame frame)
     return 0;
 }
 
+int sq_send(SyncQueue *sq, unsigned int stream_idx, SyncQueueFrame frame)
+{
+    int ret;
+
+    pthread_mutex_lock(&sq->lock);
+    ret = send_locked(sq, stream_idx, frame);
+    pthread_mutex_unlock(&sq->lock);
+
+    return ret;
+}
+
 static void offset_audio(AVFrame *f, int nb_samples)
 {
     const int planar = av_sample_fmt_is_planar(f->format);
@@ -607,13 +623,19 @@ static int receive_internal(SyncQueue *sq, int stream_idx, SyncQueueFrame frame)
 
 int sq_receive(SyncQueue *sq, int stream_idx, SyncQueueFrame frame)
 {
-    int ret = receive_internal(sq, stream_idx, frame);
+    int ret;
+
+    pthread_mutex_lock(&sq->lock);
+
+    ret = receive_internal(sq, stream_idx, frame);
 
     /* try again if the queue overflowed and triggered a fake heartbeat
      * for lagging streams */
     if (ret == AVERROR(EAGAIN) && overflow_heartbeat(sq, stream_idx))
         ret = receive_internal(sq, stream_idx, frame);
 
+    pthread_mutex_unlock(&sq->lock);
+
     return ret;
 }
 
@@ -653,9 +675,11 @@ void sq_limit_frames(SyncQueue *sq, unsigned int stream_idx, uint64_t frames)
     av_assert0(stream_idx < sq->nb_streams);
     st = &sq->streams[stream_idx];
 
+    pthread_mutex_lock(&sq->lock);
     st->frames_max = frames;
     if (st->frames_sent >= st->frames_max)
         finish_stream(sq, stream_idx);
+    pthread_mutex_unlock(&sq->lock);
 }
 
 void sq_frame_samples(SyncQueue *sq, unsigned int stream_idx,
@@ -667,9 +691,11 @@ void sq_frame_samples(SyncQueue *sq, unsigned int stream_idx,
     av_assert0(stream_idx < sq->nb_streams);
     st = &sq->streams[stream_idx];
 
+    pthread_mutex_lock(&sq->lock);
     st->frame_samples = frame_samples;
 
     sq->align_mask = av_cpu_max_align() - 1;
+    pthread_mutex_unlock(&sq->lock);
 }
 
 SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us, void *logctx)
@@ -693,6 +719,12 @@ SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us, void *logctx)
         return NULL;
     }
 
+    if (pthread_mutex_init(&sq->lock, NULL)) {
+        objpool_free(&sq->pool);
+        av_freep(&sq);
+        return NULL;
+    }
+
     return sq;
 }
 
@@ -715,5 +747,7 @@ void sq_free(SyncQueue **psq)
 
     objpool_free(&sq->pool);
 
+    pthread_mutex_destroy(&sq->lock);
+
     av_freep(psq);
 }
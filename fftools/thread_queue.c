@@ -25,6 +25,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "objpool.h"
 #include "thread_queue.h"
@@ -50,6 +51,11 @@ struct ThreadQueue {
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
+
+    // the receiver is blocked in tq_receive(), waiting for items
+    int recv_waiting;
+
+    ThreadQueueStats *stats;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -117,8 +123,22 @@ fail:
     return NULL;
 }
 
+void tq_set_stats(ThreadQueue *tq, ThreadQueueStats *stats)
+{
+    pthread_mutex_lock(&tq->lock);
+    tq->stats = stats;
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static void stats_add_wait(atomic_int_least64_t *wait, int64_t start)
+{
+    if (start != AV_NOPTS_VALUE)
+        atomic_fetch_add(wait, av_gettime_relative() - start);
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
+    int64_t wait_start = AV_NOPTS_VALUE;
     int *finished;
     int ret;
 
@@ -132,9 +152,15 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         goto finish;
     }
 
+    if (tq->stats && !(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
+        wait_start = av_gettime_relative();
+
     while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
         pthread_cond_wait(&tq->cond, &tq->lock);
 
+    if (tq->stats)
+        stats_add_wait(&tq->stats->send_wait, wait_start);
+
     if (*finished & FINISHED_RECV) {
         ret = AVERROR_EOF;
         *finished |= FINISHED_SEND;
@@ -150,6 +176,12 @@ int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
         ret = av_fifo_write(tq->fifo, &elem, 1);
         av_assert0(ret >= 0);
         pthread_cond_broadcast(&tq->cond);
+
+        if (tq->stats) {
+            int depth = av_fifo_can_read(tq->fifo);
+            if (depth > atomic_load(&tq->stats->max_depth))
+                atomic_store(&tq->stats->max_depth, depth);
+        }
     }
 
 finish:
@@ -190,6 +222,7 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
 
 int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 {
+    int64_t wait_start = AV_NOPTS_VALUE;
     int ret;
 
     *stream_idx = -1;
@@ -199,13 +232,22 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
     while (1) {
         ret = receive_locked(tq, stream_idx, data);
         if (ret == AVERROR(EAGAIN)) {
+            if (tq->stats && wait_start == AV_NOPTS_VALUE)
+                wait_start = av_gettime_relative();
+            /* wake up senders waiting in tq_wait_idle() */
+            tq->recv_waiting = 1;
+            pthread_cond_broadcast(&tq->cond);
             pthread_cond_wait(&tq->cond, &tq->lock);
+            tq->recv_waiting = 0;
             continue;
         }
 
         break;
     }
 
+    if (tq->stats)
+        stats_add_wait(&tq->stats->recv_wait, wait_start);
+
     if (ret == 0)
         pthread_cond_broadcast(&tq->cond);
 
@@ -214,6 +256,25 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
     return ret;
 }
 
+static int recv_finished(const ThreadQueue *tq)
+{
+    for (unsigned int i = 0; i < tq->nb_streams; i++)
+        if (!(tq->finished[i] & FINISHED_RECV))
+            return 0;
+    return 1;
+}
+
+void tq_wait_idle(ThreadQueue *tq)
+{
+    pthread_mutex_lock(&tq->lock);
+
+    while (!(tq->recv_waiting && !av_fifo_can_read(tq->fifo)) &&
+           !recv_finished(tq))
+        pthread_cond_wait(&tq->cond, &tq->lock);
+
+    pthread_mutex_unlock(&tq->lock);
+}
+
 void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
@@ -19,12 +19,27 @@
 #ifndef FFTOOLS_THREAD_QUEUE_H
 #define FFTOOLS_THREAD_QUEUE_H
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "objpool.h"
 
 typedef struct ThreadQueue ThreadQueue;
 
+/**
+ * Queue usage statistics. They are updated atomically, so they may be read
+ * from any thread while the queue is in use, as well as after it was freed.
+ */
+typedef struct ThreadQueueStats {
+    // time the senders spent waiting for free space, in microseconds
+    atomic_int_least64_t send_wait;
+    // time the receiver spent waiting for items, in microseconds
+    atomic_int_least64_t recv_wait;
+    // highest number of items that were queued at the same time
+    atomic_int           max_depth;
+} ThreadQueueStats;
+
 /**
  * Allocate a queue for sending data between threads.
  *
@@ -40,6 +55,12 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
                       ObjPool *obj_pool, void (*obj_move)(void *dst, void *src));
 void         tq_free(ThreadQueue **tq);
 
+/**
+ * Start collecting queue statistics into stats, which must remain valid for
+ * as long as the queue is in use.
+ */
+void tq_set_stats(ThreadQueue *tq, ThreadQueueStats *stats);
+
 /**
  * Send an item for the given stream to the queue.
  *
@@ -53,6 +74,12 @@ void         tq_free(ThreadQueue **tq);
  * - AVERROR_EOF the receiving side has marked the given stream as finished
  */
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data);
+/**
+ * Wait until the receiving side has consumed all the items sent so far and
+ * is waiting for more, or has marked all streams as finished. The receiver
+ * is assumed to be done with an item once it calls tq_receive() again.
+ */
+void tq_wait_idle(ThreadQueue *tq);
 /**
  * Mark the given stream finished from the sending side.
  */
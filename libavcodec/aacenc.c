@@ -827,6 +827,48 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+/**
+ * Run the quantizer search for one channel. The channels are independent of
+ * each other here, so with slice threading they are searched in parallel,
+ * each thread using its own copy of the context for the scratch buffers.
+ */
+static int search_channel(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    AACEncContext *s = avctx->priv_data;
+    int ch = *(int *)arg + jobnr;
+    AACEncChannelSearch *cs = &s->search[ch];
+
+    if (s->workers) {
+        AACEncContext *w = s->workers[threadnr];
+        w->lambda     = s->lambda;
+        w->psy.cutoff = s->psy.cutoff;
+        s = w;
+    }
+    s->cur_channel      = ch;
+    s->cur_type         = cs->type;
+    s->psy.bitres.alloc = cs->bitres_alloc;
+    if (s->options.pns && s->coder->mark_pns)
+        s->coder->mark_pns(s, avctx, cs->sce);
+    s->coder->search_for_quantizers(avctx, s, cs->sce, s->lambda);
+    cs->cutoff = s->psy.cutoff;
+
+    return 0;
+}
+
+/**
+ * Search the quantizers of the channels from start_ch to end_ch, which
+ * leaves the psy cutoff set by the search of the last of them, as when they
+ * are searched one after another.
+ */
+static void search_channels(AVCodecContext *avctx, AACEncContext *s,
+                            int start_ch, int end_ch)
+{
+    if (start_ch >= end_ch)
+        return;
+    avctx->execute2(avctx, search_channel, &start_ch, NULL, end_ch - start_ch);
+    s->psy.cutoff = s->search[end_ch - 1].cutoff;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
@@ -835,7 +877,7 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     ChannelElement *cpe;
     SingleChannelElement *sce;
     IndividualChannelStream *ics;
-    int i, its, ch, w, chans, tag, start_ch, ret, frame_bits;
+    int i, its, ch, w, chans, tag, start_ch, search_ch, ret, frame_bits;
     int target_bits, rate_bits, too_many_bits, too_few_bits;
     int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
     int chan_el_counter[4];
@@ -960,20 +1002,25 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
         if ((avctx->frame_num & 0xFF)==1 && !(avctx->flags & AV_CODEC_FLAG_BITEXACT))
             put_bitstream_info(s, LIBAVCODEC_IDENT);
-        start_ch = 0;
+        start_ch = search_ch = 0;
         target_bits = 0;
-        memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
             FFPsyWindowInfo* wi = windows + start_ch;
             const float *coeffs[2];
+            /* the twoloop coder sets the psy cutoff unless it is given, and
+             * the analysis of an element must see the value left by the
+             * search of the previous one: only the channels of one element
+             * are searched in parallel then */
+            if (s->options.coder == AAC_CODER_TWOLOOP && avctx->cutoff <= 0) {
+                search_channels(avctx, s, search_ch, start_ch);
+                search_ch = start_ch;
+            }
             tag      = s->chan_map[i+1];
             chans    = tag == TYPE_CPE ? 2 : 1;
             cpe      = &s->cpe[i];
             cpe->common_window = 0;
             memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
             memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
-            put_bits(&s->pb, 3, tag);
-            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             for (ch = 0; ch < chans; ch++) {
                 sce = &cpe->ch[ch];
                 coeffs[ch] = sce->coeffs;
@@ -995,13 +1042,27 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
                 s->psy.bitres.alloc /= chans;
             }
-            s->cur_type = tag;
             for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                if (s->options.pns && s->coder->mark_pns)
-                    s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
+                AACEncChannelSearch *cs = &s->search[start_ch + ch];
+                cs->sce          = &cpe->ch[ch];
+                cs->type         = tag;
+                cs->bitres_alloc = s->psy.bitres.alloc;
             }
+            start_ch += chans;
+        }
+
+        search_channels(avctx, s, search_ch, s->channels);
+
+        start_ch = 0;
+        memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        for (i = 0; i < s->chan_map[0]; i++) {
+            FFPsyWindowInfo* wi = windows + start_ch;
+            tag      = s->chan_map[i+1];
+            chans    = tag == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
+            put_bits(&s->pb, 3, tag);
+            put_bits(&s->pb, 4, chan_el_counter[tag]++);
+            s->cur_type = tag;
             if (chans > 1
                 && wi[0].window_type[0] == wi[1].window_type[0]
                 && wi[0].window_shape   == wi[1].window_shape) {
@@ -1176,6 +1237,9 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
 
     av_log(avctx, AV_LOG_INFO, "Qavg: %.3f\n", s->lambda_count ? s->lambda_sum / s->lambda_count : NAN);
 
+    for (int i = 0; i < s->nb_workers; i++)
+        av_freep(&s->workers[i]);
+    av_freep(&s->workers);
     av_tx_uninit(&s->mdct1024);
     av_tx_uninit(&s->mdct128);
     ff_psy_end(&s->psy);
@@ -1224,6 +1288,26 @@ static av_cold int alloc_buffers(AVCodecContext *avctx, AACEncContext *s)
     return 0;
 }
 
+static av_cold int alloc_workers(AVCodecContext *avctx, AACEncContext *s)
+{
+    s->workers = av_calloc(avctx->thread_count, sizeof(*s->workers));
+    if (!s->workers)
+        return AVERROR(ENOMEM);
+
+    /* the workers share everything but the scratch buffers and the
+     * current channel state with the main context */
+    for (; s->nb_workers < avctx->thread_count; s->nb_workers++) {
+        AACEncContext *w = av_memdup(s, sizeof(*s));
+        if (!w)
+            return AVERROR(ENOMEM);
+        w->workers    = NULL;
+        w->nb_workers = 0;
+        s->workers[s->nb_workers] = w;
+    }
+
+    return 0;
+}
+
 static av_cold int aac_encode_init(AVCodecContext *avctx)
 {
     AACEncContext *s = avctx->priv_data;
@@ -1383,6 +1467,9 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
     ff_af_queue_init(avctx, &s->afq);
     ff_aac_tableinit();
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1)
+        return alloc_workers(avctx, s);
+
     return 0;
 }
 
@@ -1421,7 +1508,7 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
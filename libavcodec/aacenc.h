@@ -102,6 +102,16 @@ typedef struct AACPCEInfo {
     uint8_t reorder_map[16];                     ///< maps channels from lavc to aac order
 } AACPCEInfo;
 
+/**
+ * Parameters of the quantizer search for one channel of the current frame
+ */
+typedef struct AACEncChannelSearch {
+    SingleChannelElement *sce;
+    enum RawDataBlockType type;                  ///< type of the channel element
+    int bitres_alloc;                            ///< bits allocated to the channel by psy
+    int cutoff;                                  ///< psy cutoff after the search
+} AACEncChannelSearch;
+
 /**
  * AAC encoder context
  */
@@ -137,6 +147,10 @@ typedef struct AACEncContext {
     int lambda_count;                            ///< count(lambda), for Qvg reporting
     enum RawDataBlockType cur_type;              ///< channel group type cur_channel belongs to
 
+    AACEncChannelSearch search[16];              ///< per-channel quantizer search parameters
+    struct AACEncContext **workers;              ///< per-thread contexts for the quantizer search
+    int nb_workers;
+
     AudioFrameQueue afq;
     DECLARE_ALIGNED(16, int,   qcoefs)[96];      ///< quantized coefficients
     DECLARE_ALIGNED(32, float, scoefs)[1024];    ///< scaled coefficients
@@ -2098,6 +2098,20 @@ typedef struct AVCodecContext {
      *   an error.
      */
     int64_t frame_num;
+
+    /**
+     * Number of slice threads used by each frame thread.
+     *
+     * When frame threading is active and this is larger than 1, decoders
+     * supporting it additionally decode the slices, tiles or wavefront rows
+     * of each frame with this many threads, so that few frames need to be
+     * decoded at once (bounding the decoding delay) while still using many
+     * threads. Up to thread_count * slice_thread_count threads are used.
+     *
+     * - encoding: unused
+     * - decoding: Set by user.
+     */
+    int slice_thread_count;
 } AVCodecContext;
 
 /**
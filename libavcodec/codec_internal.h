@@ -88,6 +88,12 @@
  * encoders do.
  */
 #define FF_CODEC_CAP_EOF_FLUSH              (1 << 10)
+/**
+ * The decoder supports slice threading within each of its frame threads,
+ * i.e. it reports frame progress correctly while the rows of a frame are
+ * decoded by several slice threads. See AVCodecContext.slice_thread_count.
+ */
+#define FF_CODEC_CAP_FRAME_SLICE_THREADS    (1 << 11)
 
 /**
  * FFCodec.codec_tags termination value
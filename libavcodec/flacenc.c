@@ -102,6 +102,18 @@ typedef struct FlacFrame {
     int verbatim_only;
 } FlacFrame;
 
+/**
+ * A frame encoded by one of the threads in multithreaded mode.
+ */
+typedef struct FlacEncodeJob {
+    AVFrame *frame;
+    uint32_t frame_count;
+    uint8_t *buf;
+    unsigned int buf_size;
+    int size;
+    int ret;
+} FlacEncodeJob;
+
 typedef struct FlacEncodeContext {
     AVClass *class;
     PutBitContext pb;
@@ -128,6 +140,18 @@ typedef struct FlacEncodeContext {
 
     int flushed;
     int64_t next_pts;
+
+    /* Multithreaded mode: consecutive frames are queued and encoded in
+     * parallel in batches of nb_jobs, each thread using its own worker
+     * context; the MD5 sum is updated in order by one extra job. */
+    struct FlacEncodeContext **workers;
+    int nb_workers;
+    FlacEncodeJob *jobs;
+    int nb_jobs;
+    int nb_queued;  ///< frames queued in jobs[0..nb_queued)
+    int out_index;  ///< packets ready to be returned in jobs[out_index..nb_out)
+    int nb_out;
+    int md5_ret;
 } FlacEncodeContext;
 
 
@@ -266,6 +290,45 @@ static av_cold void dprint_compression_options(FlacEncodeContext *s)
 }
 
 
+static av_cold int init_workers(FlacEncodeContext *s)
+{
+    AVCodecContext *avctx = s->avctx;
+    int ret;
+
+    s->nb_jobs = avctx->thread_count;
+    s->jobs    = av_calloc(s->nb_jobs, sizeof(*s->jobs));
+    s->workers = av_calloc(avctx->thread_count, sizeof(*s->workers));
+    if (!s->jobs || !s->workers)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < s->nb_jobs; i++) {
+        s->jobs[i].frame = av_frame_alloc();
+        if (!s->jobs[i].frame)
+            return AVERROR(ENOMEM);
+    }
+
+    for (; s->nb_workers < avctx->thread_count; s->nb_workers++) {
+        FlacEncodeContext *w = av_memdup(s, sizeof(*s));
+        if (!w)
+            return AVERROR(ENOMEM);
+        s->workers[s->nb_workers] = w;
+        w->md5ctx          = NULL;
+        w->md5_buffer      = NULL;
+        w->md5_buffer_size = 0;
+        w->workers         = NULL;
+        w->jobs            = NULL;
+        memset(&w->lpc_ctx, 0, sizeof(w->lpc_ctx));
+        ret = ff_lpc_init(&w->lpc_ctx, avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0) {
+            s->nb_workers++;
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+
 static av_cold int flac_encode_init(AVCodecContext *avctx)
 {
     int freq = avctx->sample_rate;
@@ -471,6 +534,10 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
 
     dprint_compression_options(s);
 
+    if (ret >= 0 && avctx->active_thread_type & FF_THREAD_SLICE &&
+        avctx->thread_count > 1)
+        ret = init_workers(s);
+
     return ret;
 }
 
@@ -1561,9 +1628,9 @@ static void write_frame_footer(FlacEncodeContext *s)
 }
 
 
-static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
+static int write_frame(FlacEncodeContext *s, uint8_t *buf, int size)
 {
-    init_put_bits(&s->pb, avpkt->data, avpkt->size);
+    init_put_bits(&s->pb, buf, size);
     write_frame_header(s);
     write_subframes(s);
     write_frame_footer(s);
@@ -1571,10 +1638,11 @@ static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
 }
 
 
-static int update_md5_sum(FlacEncodeContext *s, const void *samples)
+static int update_md5_sum(FlacEncodeContext *s, const void *samples,
+                          int nb_samples)
 {
     const uint8_t *buf;
-    int buf_size = s->frame.blocksize * s->channels *
+    int buf_size = nb_samples * s->channels *
                    ((s->avctx->bits_per_raw_sample + 7) / 8);
 
     if (s->avctx->bits_per_raw_sample > 16 || HAVE_BIGENDIAN) {
@@ -1595,7 +1663,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++) {
+        for (i = 0; i < nb_samples * s->channels; i++) {
             int32_t v = samples0[i] >> 8;
             AV_WL24(tmp + 3*i, v);
         }
@@ -1606,7 +1674,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++)
+        for (i = 0; i < nb_samples * s->channels; i++)
             AV_WL32(tmp + 4*i, samples0[i]);
         buf = s->md5_buffer;
     }
@@ -1616,6 +1684,172 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 }
 
 
+/**
+ * Analyze one block of samples and prepare s->frame for writing it.
+ *
+ * @return the maximum size of the frame in bytes or a negative error code
+ */
+static int encode_block(FlacEncodeContext *s, const AVFrame *frame)
+{
+    int max_framesize = s->max_framesize;
+    int frame_bytes;
+
+    /* change max_framesize for small final frame */
+    if (frame->nb_samples < s->max_blocksize) {
+        max_framesize = flac_get_max_frame_size(frame->nb_samples,
+                                                s->channels,
+                                                s->avctx->bits_per_raw_sample);
+    }
+
+    init_frame(s, frame->nb_samples);
+
+    copy_samples(s, frame->data[0]);
+
+    channel_decorrelation(s);
+
+    remove_wasted_bits(s);
+
+    frame_bytes = encode_frame(s);
+
+    /* Fall back on verbatim mode if the compressed frame is larger than it
+       would be if encoded uncompressed. */
+    if (frame_bytes < 0 || frame_bytes > max_framesize) {
+        s->frame.verbatim_only = 1;
+        frame_bytes = encode_frame(s);
+        if (frame_bytes < 0) {
+            av_log(s->avctx, AV_LOG_ERROR, "Bad frame count\n");
+            return frame_bytes;
+        }
+    }
+
+    return frame_bytes;
+}
+
+
+static void update_frame_stats(FlacEncodeContext *s, const AVFrame *frame,
+                               int out_bytes)
+{
+    s->sample_count += frame->nb_samples;
+    if (out_bytes > s->max_encoded_framesize)
+        s->max_encoded_framesize = out_bytes;
+    if (out_bytes < s->min_framesize)
+        s->min_framesize = out_bytes;
+
+    s->next_pts = frame->pts + ff_samples_to_time_base(s->avctx, frame->nb_samples);
+}
+
+
+static int set_packet_props(AVCodecContext *avctx, AVPacket *avpkt,
+                            const AVFrame *frame)
+{
+    avpkt->pts      = frame->pts;
+    avpkt->duration = frame->duration ? frame->duration :
+                      ff_samples_to_time_base(avctx, frame->nb_samples);
+
+    return ff_encode_reordered_opaque(avctx, avpkt, frame);
+}
+
+
+static int encode_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacEncodeContext *w = s->workers[threadnr];
+    FlacEncodeJob *job;
+    int frame_bytes;
+
+    /* job 0 updates the MD5 sum of the whole batch in order */
+    if (!jobnr) {
+        for (int i = 0; i < s->nb_out && !s->md5_ret; i++) {
+            const AVFrame *frame = s->jobs[i].frame;
+            s->md5_ret = update_md5_sum(s, frame->data[0], frame->nb_samples);
+        }
+        return s->md5_ret;
+    }
+
+    job = &s->jobs[jobnr - 1];
+    w->frame_count = job->frame_count;
+    frame_bytes = encode_block(w, job->frame);
+    if (frame_bytes < 0)
+        return job->ret = frame_bytes;
+
+    av_fast_malloc(&job->buf, &job->buf_size, frame_bytes);
+    if (!job->buf)
+        return job->ret = AVERROR(ENOMEM);
+    job->size = write_frame(w, job->buf, frame_bytes);
+
+    return job->ret = 0;
+}
+
+
+static int encode_batch(AVCodecContext *avctx)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+
+    s->out_index = 0;
+    s->nb_out    = s->nb_queued;
+    s->nb_queued = 0;
+
+    avctx->execute2(avctx, encode_job, NULL, NULL, s->nb_out + 1);
+
+    if (s->md5_ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+        return s->md5_ret;
+    }
+    for (int i = 0; i < s->nb_out; i++) {
+        if (s->jobs[i].ret < 0)
+            return s->jobs[i].ret;
+        update_frame_stats(s, s->jobs[i].frame, s->jobs[i].size);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Queue frames until a batch is complete, encode it with all threads and
+ * return the packets one by one while the next batch is being queued.
+ * A frame is queued in a slot whose packet has already been returned.
+ */
+static int encode_frame_threaded(AVCodecContext *avctx, AVPacket *avpkt,
+                                 const AVFrame *frame, int *got_packet_ptr)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    FlacEncodeJob *job;
+    int ret;
+
+    if (frame) {
+        av_assert1(s->nb_queued < s->nb_jobs);
+        job = &s->jobs[s->nb_queued];
+        ret = av_frame_ref(job->frame, frame);
+        if (ret < 0)
+            return ret;
+        job->frame_count = s->frame_count++;
+        s->nb_queued++;
+    }
+
+    if (s->out_index == s->nb_out && s->nb_queued &&
+        (s->nb_queued == s->nb_jobs || !frame)) {
+        ret = encode_batch(avctx);
+        if (ret < 0)
+            return ret;
+    }
+    if (s->out_index == s->nb_out)
+        return 0;
+
+    job = &s->jobs[s->out_index++];
+    if ((ret = ff_get_encode_buffer(avctx, avpkt, job->size, 0)) < 0)
+        return ret;
+    memcpy(avpkt->data, job->buf, job->size);
+    ret = set_packet_props(avctx, avpkt, job->frame);
+    av_frame_unref(job->frame);
+    if (ret < 0)
+        return ret;
+
+    *got_packet_ptr = 1;
+    return 0;
+}
+
+
 static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                              const AVFrame *frame, int *got_packet_ptr)
 {
@@ -1624,6 +1858,9 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
     s = avctx->priv_data;
 
+    if (s->jobs && (frame || s->nb_queued || s->out_index < s->nb_out))
+        return encode_frame_threaded(avctx, avpkt, frame, got_packet_ptr);
+
     /* when the last block is reached, update the header in extradata */
     if (!frame) {
         s->max_framesize = s->max_encoded_framesize;
@@ -1646,54 +1883,28 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
         return 0;
     }
 
-    /* change max_framesize for small final frame */
-    if (frame->nb_samples < s->frame.blocksize) {
-        s->max_framesize = flac_get_max_frame_size(frame->nb_samples,
-                                                   s->channels,
-                                                   avctx->bits_per_raw_sample);
-    }
-
-    init_frame(s, frame->nb_samples);
-
-    copy_samples(s, frame->data[0]);
-
-    channel_decorrelation(s);
-
-    remove_wasted_bits(s);
-
-    frame_bytes = encode_frame(s);
-
-    /* Fall back on verbatim mode if the compressed frame is larger than it
-       would be if encoded uncompressed. */
-    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
-        s->frame.verbatim_only = 1;
-        frame_bytes = encode_frame(s);
-        if (frame_bytes < 0) {
-            av_log(avctx, AV_LOG_ERROR, "Bad frame count\n");
-            return frame_bytes;
-        }
-    }
+    frame_bytes = encode_block(s, frame);
+    if (frame_bytes < 0)
+        return frame_bytes;
 
     if ((ret = ff_get_encode_buffer(avctx, avpkt, frame_bytes, 0)) < 0)
         return ret;
 
-    out_bytes = write_frame(s, avpkt);
+    out_bytes = write_frame(s, avpkt->data, avpkt->size);
 
     s->frame_count++;
-    s->sample_count += frame->nb_samples;
-    if ((ret = update_md5_sum(s, frame->data[0])) < 0) {
+    if ((ret = update_md5_sum(s, frame->data[0], frame->nb_samples)) < 0) {
         av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
         return ret;
     }
-    if (out_bytes > s->max_encoded_framesize)
-        s->max_encoded_framesize = out_bytes;
-    if (out_bytes < s->min_framesize)
-        s->min_framesize = out_bytes;
-
-    s->next_pts = frame->pts + ff_samples_to_time_base(avctx, frame->nb_samples);
+    update_frame_stats(s, frame, out_bytes);
 
     av_shrink_packet(avpkt, out_bytes);
 
+    ret = set_packet_props(avctx, avpkt, frame);
+    if (ret < 0)
+        return ret;
+
     *got_packet_ptr = 1;
     return 0;
 }
@@ -1703,6 +1914,17 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 {
     FlacEncodeContext *s = avctx->priv_data;
 
+    for (int i = 0; i < s->nb_workers; i++) {
+        ff_lpc_end(&s->workers[i]->lpc_ctx);
+        av_freep(&s->workers[i]);
+    }
+    av_freep(&s->workers);
+    for (int i = 0; s->jobs && i < s->nb_jobs; i++) {
+        av_frame_free(&s->jobs[i].frame);
+        av_freep(&s->jobs[i].buf);
+    }
+    av_freep(&s->jobs);
+
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
     ff_lpc_end(&s->lpc_ctx);
@@ -1755,6 +1977,7 @@ const FFCodec ff_flac_encoder = {
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                       AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
@@ -1764,5 +1987,5 @@ const FFCodec ff_flac_encoder = {
                                                      AV_SAMPLE_FMT_S32,
                                                      AV_SAMPLE_FMT_NONE },
     .p.priv_class   = &flac_encoder_class,
-    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_EOF_FLUSH,
+    .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
 };
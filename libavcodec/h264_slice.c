@@ -2510,7 +2510,9 @@ static void decode_finish_row(const H264Context *h, H264SliceContext *sl)
 
     ff_h264_draw_horiz_band(h, sl, top, height);
 
-    if (h->droppable || h->er.error_occurred)
+    /* slices decoded in parallel finish out of order, progress is reported
+     * once all of them are done in ff_h264_execute_decode_slices() */
+    if (h->droppable || h->er.error_occurred || h->nb_slice_ctx_queued > 1)
         return;
 
     ff_thread_report_progress(&h->cur_pic_ptr->tf, top + height - 1,
@@ -2810,6 +2812,16 @@ int ff_h264_execute_decode_slices(H264Context *h)
                 }
             }
         }
+
+        /* all rows above the one the last slice ended in are complete, except
+         * for the lines the deblocking of that row may still modify */
+        if (!h->droppable && !h->er.error_occurred) {
+            sl = &h->slice_ctx[context_count - 1];
+            ff_thread_report_progress(&h->cur_pic_ptr->tf,
+                                      16 * (sl->mb_y >> FIELD_PICTURE(h)) -
+                                      (8 << FRAME_MBAFF(h)) - 1,
+                                      h->picture_structure == PICT_BOTTOM_FIELD);
+        }
     }
 
 finish:
@@ -656,13 +656,13 @@ static void deblocking_filter_CTB(const HEVCContext *s, int x0, int y0)
     }
 }
 
-static int boundary_strength(const HEVCContext *s, const MvField *curr, const MvField *neigh,
+static int boundary_strength(const RefPicList *refPicList, const MvField *curr, const MvField *neigh,
                              const RefPicList *neigh_refPicList)
 {
     if (curr->pred_flag == PF_BI &&  neigh->pred_flag == PF_BI) {
         // same L0 and L1
-        if (s->ref->refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
-            s->ref->refPicList[0].list[curr->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]] &&
+        if (refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
+            refPicList[0].list[curr->ref_idx[0]] == refPicList[1].list[curr->ref_idx[1]] &&
             neigh_refPicList[0].list[neigh->ref_idx[0]] == neigh_refPicList[1].list[neigh->ref_idx[1]]) {
             if ((FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
                  FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4) &&
@@ -671,15 +671,15 @@ static int boundary_strength(const HEVCContext *s, const MvField *curr, const Mv
                 return 1;
             else
                 return 0;
-        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[1].list[neigh->ref_idx[1]] == refPicList[1].list[curr->ref_idx[1]]) {
             if (FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
                 FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4)
                 return 1;
             else
                 return 0;
-        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[0].list[neigh->ref_idx[0]] == refPicList[1].list[curr->ref_idx[1]]) {
             if (FFABS(neigh->mv[1].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[0].y) >= 4 ||
                 FFABS(neigh->mv[0].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[1].y) >= 4)
                 return 1;
@@ -694,10 +694,10 @@ static int boundary_strength(const HEVCContext *s, const MvField *curr, const Mv
 
         if (curr->pred_flag & 1) {
             A     = curr->mv[0];
-            ref_A = s->ref->refPicList[0].list[curr->ref_idx[0]];
+            ref_A = refPicList[0].list[curr->ref_idx[0]];
         } else {
             A     = curr->mv[1];
-            ref_A = s->ref->refPicList[1].list[curr->ref_idx[1]];
+            ref_A = refPicList[1].list[curr->ref_idx[1]];
         }
 
         if (neigh->pred_flag & 1) {
@@ -739,7 +739,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
         ((!s->sh.slice_loop_filter_across_slices_enabled_flag &&
           lc->boundary_flags & BOUNDARY_UPPER_SLICE &&
           (y0 % (1 << s->ps.sps->log2_ctb_size)) == 0) ||
-         (!s->ps.pps->loop_filter_across_tiles_enabled_flag &&
+         ((!s->ps.pps->loop_filter_across_tiles_enabled_flag || s->enable_parallel_tiles) &&
           lc->boundary_flags & BOUNDARY_UPPER_TILE &&
           (y0 % (1 << s->ps.sps->log2_ctb_size)) == 0)))
         boundary_upper = 0;
@@ -766,7 +766,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 else if (curr_cbf_luma || top_cbf_luma)
                     bs = 1;
                 else
-                    bs = boundary_strength(s, curr, top, rpl_top);
+                    bs = boundary_strength(s->ref->refPicList, curr, top, rpl_top);
                 s->horizontal_bs[((x0 + i) + y0 * s->bs_width) >> 2] = bs;
             }
     }
@@ -777,7 +777,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
         ((!s->sh.slice_loop_filter_across_slices_enabled_flag &&
           lc->boundary_flags & BOUNDARY_LEFT_SLICE &&
           (x0 % (1 << s->ps.sps->log2_ctb_size)) == 0) ||
-         (!s->ps.pps->loop_filter_across_tiles_enabled_flag &&
+         ((!s->ps.pps->loop_filter_across_tiles_enabled_flag || s->enable_parallel_tiles) &&
           lc->boundary_flags & BOUNDARY_LEFT_TILE &&
           (x0 % (1 << s->ps.sps->log2_ctb_size)) == 0)))
         boundary_left = 0;
@@ -804,7 +804,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 else if (curr_cbf_luma || left_cbf_luma)
                     bs = 1;
                 else
-                    bs = boundary_strength(s, curr, left, rpl_left);
+                    bs = boundary_strength(s->ref->refPicList, curr, left, rpl_left);
                 s->vertical_bs[(x0 + (y0 + i) * s->bs_width) >> 2] = bs;
             }
     }
@@ -822,7 +822,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 const MvField *top  = &tab_mvf[yp_pu * min_pu_width + x_pu];
                 const MvField *curr = &tab_mvf[yq_pu * min_pu_width + x_pu];
 
-                bs = boundary_strength(s, curr, top, rpl);
+                bs = boundary_strength(rpl, curr, top, rpl);
                 s->horizontal_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
             }
         }
@@ -837,31 +837,129 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 const MvField *left = &tab_mvf[y_pu * min_pu_width + xp_pu];
                 const MvField *curr = &tab_mvf[y_pu * min_pu_width + xq_pu];
 
-                bs = boundary_strength(s, curr, left, rpl);
+                bs = boundary_strength(rpl, curr, left, rpl);
                 s->vertical_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
             }
         }
     }
 }
 
+void ff_hevc_tile_boundary_strengths(const HEVCContext *s, int x_ctb, int y_ctb)
+{
+    const HEVCSPS *sps   = s->ps.sps;
+    const HEVCPPS *pps   = s->ps.pps;
+    const MvField *tab_mvf = s->ref->tab_mvf;
+    int log2_min_pu_size = sps->log2_min_pu_size;
+    int log2_min_tu_size = sps->log2_min_tb_size;
+    int min_pu_width     = sps->min_pu_width;
+    int min_tu_width     = sps->min_tb_width;
+    int ctb_size         = 1 << sps->log2_ctb_size;
+    int ctb_addr_rs      = (y_ctb >> sps->log2_ctb_size) * sps->ctb_width +
+                           (x_ctb >> sps->log2_ctb_size);
+    int tile_id          = pps->tile_id[pps->ctb_addr_rs_to_ts[ctb_addr_rs]];
+    int slice_addr       = s->tab_slice_address[ctb_addr_rs];
+    const RefPicList *rpl;
+    int i, bs;
+
+    if (!pps->loop_filter_across_tiles_enabled_flag || slice_addr < 0 ||
+        s->deblocking_disabled[ctb_addr_rs])
+        return;
+
+    rpl = ff_hevc_get_ref_list(s, s->ref, x_ctb, y_ctb);
+
+    if (y_ctb > 0) {
+        int up_rs = ctb_addr_rs - sps->ctb_width;
+
+        if (pps->tile_id[pps->ctb_addr_rs_to_ts[up_rs]] != tile_id &&
+            s->tab_slice_address[up_rs] >= 0 &&
+            (s->tab_slice_address[up_rs] == slice_addr ||
+             s->filter_slice_edges[ctb_addr_rs])) {
+            const RefPicList *rpl_top = ff_hevc_get_ref_list(s, s->ref, x_ctb, y_ctb - 1);
+            int yp_pu = (y_ctb - 1) >> log2_min_pu_size;
+            int yq_pu =  y_ctb      >> log2_min_pu_size;
+            int yp_tu = (y_ctb - 1) >> log2_min_tu_size;
+            int yq_tu =  y_ctb      >> log2_min_tu_size;
+
+            for (i = 0; i < FFMIN(ctb_size, sps->width - x_ctb); i += 4) {
+                int x_pu = (x_ctb + i) >> log2_min_pu_size;
+                int x_tu = (x_ctb + i) >> log2_min_tu_size;
+                const MvField *top  = &tab_mvf[yp_pu * min_pu_width + x_pu];
+                const MvField *curr = &tab_mvf[yq_pu * min_pu_width + x_pu];
+                uint8_t top_cbf_luma  = s->cbf_luma[yp_tu * min_tu_width + x_tu];
+                uint8_t curr_cbf_luma = s->cbf_luma[yq_tu * min_tu_width + x_tu];
+
+                if (curr->pred_flag == PF_INTRA || top->pred_flag == PF_INTRA)
+                    bs = 2;
+                else if (curr_cbf_luma || top_cbf_luma)
+                    bs = 1;
+                else
+                    bs = boundary_strength(rpl, curr, top, rpl_top);
+                s->horizontal_bs[((x_ctb + i) + y_ctb * s->bs_width) >> 2] = bs;
+            }
+        }
+    }
+
+    if (x_ctb > 0) {
+        int left_rs = ctb_addr_rs - 1;
+
+        if (pps->tile_id[pps->ctb_addr_rs_to_ts[left_rs]] != tile_id &&
+            s->tab_slice_address[left_rs] >= 0 &&
+            (s->tab_slice_address[left_rs] == slice_addr ||
+             s->filter_slice_edges[ctb_addr_rs])) {
+            const RefPicList *rpl_left = ff_hevc_get_ref_list(s, s->ref, x_ctb - 1, y_ctb);
+            int xp_pu = (x_ctb - 1) >> log2_min_pu_size;
+            int xq_pu =  x_ctb      >> log2_min_pu_size;
+            int xp_tu = (x_ctb - 1) >> log2_min_tu_size;
+            int xq_tu =  x_ctb      >> log2_min_tu_size;
+
+            for (i = 0; i < FFMIN(ctb_size, sps->height - y_ctb); i += 4) {
+                int y_pu = (y_ctb + i) >> log2_min_pu_size;
+                int y_tu = (y_ctb + i) >> log2_min_tu_size;
+                const MvField *left = &tab_mvf[y_pu * min_pu_width + xp_pu];
+                const MvField *curr = &tab_mvf[y_pu * min_pu_width + xq_pu];
+                uint8_t left_cbf_luma = s->cbf_luma[y_tu * min_tu_width + xp_tu];
+                uint8_t curr_cbf_luma = s->cbf_luma[y_tu * min_tu_width + xq_tu];
+
+                if (curr->pred_flag == PF_INTRA || left->pred_flag == PF_INTRA)
+                    bs = 2;
+                else if (curr_cbf_luma || left_cbf_luma)
+                    bs = 1;
+                else
+                    bs = boundary_strength(rpl, curr, left, rpl_left);
+                s->vertical_bs[(x_ctb + (y_ctb + i) * s->bs_width) >> 2] = bs;
+            }
+        }
+    }
+}
+
 #undef LUMA
 #undef CB
 #undef CR
 
+int ff_hevc_skip_loop_filter(const HEVCContext *s)
+{
+    return s->avctx->skip_loop_filter >= AVDISCARD_ALL ||
+           (s->avctx->skip_loop_filter >= AVDISCARD_NONKEY && !IS_IDR(s)) ||
+           (s->avctx->skip_loop_filter >= AVDISCARD_NONINTRA &&
+            s->sh.slice_type != HEVC_SLICE_I) ||
+           (s->avctx->skip_loop_filter >= AVDISCARD_BIDIR &&
+            s->sh.slice_type == HEVC_SLICE_B) ||
+           (s->avctx->skip_loop_filter >= AVDISCARD_NONREF &&
+            ff_hevc_nal_is_nonref(s->nal_unit_type));
+}
+
 void ff_hevc_hls_filter(HEVCLocalContext *lc, int x, int y, int ctb_size)
 {
     const HEVCContext *const s = lc->parent;
     int x_end = x >= s->ps.sps->width  - ctb_size;
-    int skip = 0;
-    if (s->avctx->skip_loop_filter >= AVDISCARD_ALL ||
-        (s->avctx->skip_loop_filter >= AVDISCARD_NONKEY && !IS_IDR(s)) ||
-        (s->avctx->skip_loop_filter >= AVDISCARD_NONINTRA &&
-         s->sh.slice_type != HEVC_SLICE_I) ||
-        (s->avctx->skip_loop_filter >= AVDISCARD_BIDIR &&
-         s->sh.slice_type == HEVC_SLICE_B) ||
-        (s->avctx->skip_loop_filter >= AVDISCARD_NONREF &&
-        ff_hevc_nal_is_nonref(s->nal_unit_type)))
-        skip = 1;
+    int skip;
+
+    /* when the filters are postponed, s->sh is not the slice of this CTB */
+    if (s->enable_parallel_tiles)
+        skip = CTB(s->skip_loop_filter, x >> s->ps.sps->log2_ctb_size,
+                   y >> s->ps.sps->log2_ctb_size);
+    else
+        skip = ff_hevc_skip_loop_filter(s);
 
     if (!skip)
         deblocking_filter_CTB(s, x, y);
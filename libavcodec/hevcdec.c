@@ -80,6 +80,8 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->qp_y_tab);
     av_freep(&s->tab_slice_address);
     av_freep(&s->filter_slice_edges);
+    av_freep(&s->deblocking_disabled);
+    av_freep(&s->skip_loop_filter);
 
     av_freep(&s->horizontal_bs);
     av_freep(&s->vertical_bs);
@@ -122,12 +124,15 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
     if (!s->tab_ipm || !s->cbf_luma || !s->is_pcm)
         goto fail;
 
-    s->filter_slice_edges = av_mallocz(ctb_count);
-    s->tab_slice_address  = av_malloc_array(pic_size_in_ctb,
+    s->filter_slice_edges  = av_mallocz(ctb_count);
+    s->deblocking_disabled = av_mallocz(ctb_count);
+    s->skip_loop_filter    = av_mallocz(ctb_count);
+    s->tab_slice_address   = av_malloc_array(pic_size_in_ctb,
                                       sizeof(*s->tab_slice_address));
-    s->qp_y_tab           = av_malloc_array(pic_size_in_ctb,
+    s->qp_y_tab            = av_malloc_array(pic_size_in_ctb,
                                       sizeof(*s->qp_y_tab));
-    if (!s->qp_y_tab || !s->filter_slice_edges || !s->tab_slice_address)
+    if (!s->qp_y_tab || !s->filter_slice_edges || !s->tab_slice_address ||
+        !s->deblocking_disabled || !s->skip_loop_filter)
         goto fail;
 
     s->horizontal_bs = av_calloc(s->bs_width, s->bs_height);
@@ -981,13 +986,10 @@ static int hls_slice_header(HEVCContext *s)
                 unsigned val = get_bits_long(gb, offset_len);
                 sh->entry_point_offset[i] = val + 1; // +1; // +1 to get the size
             }
-            if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1)) {
-                s->enable_parallel_tiles = 0; // TODO: you can enable tiles in parallel here
+            if (s->threads_number > 1 && s->ps.pps->entropy_coding_sync_enabled_flag &&
+                (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1))
                 s->threads_number = 1;
-            } else
-                s->enable_parallel_tiles = 0;
-        } else
-            s->enable_parallel_tiles = 0;
+        }
     }
 
     if (s->ps.pps->slice_header_extension_present_flag) {
@@ -2499,11 +2501,16 @@ static void hls_decode_neighbour(HEVCLocalContext *lc, int x_ctb, int y_ctb,
     if (s->ps.pps->tiles_enabled_flag) {
         if (x_ctb > 0 && s->ps.pps->tile_id[ctb_addr_ts] != s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs - 1]])
             lc->boundary_flags |= BOUNDARY_LEFT_TILE;
-        if (x_ctb > 0 && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - 1])
+        /* With parallel tiles, the CTBs of other tiles may still be decoded
+         * concurrently; the edges to them are handled by
+         * ff_hevc_tile_boundary_strengths() once the picture is decoded. */
+        if (x_ctb > 0 && !(s->enable_parallel_tiles && lc->boundary_flags & BOUNDARY_LEFT_TILE) &&
+            s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - 1])
             lc->boundary_flags |= BOUNDARY_LEFT_SLICE;
         if (y_ctb > 0 && s->ps.pps->tile_id[ctb_addr_ts] != s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs - s->ps.sps->ctb_width]])
             lc->boundary_flags |= BOUNDARY_UPPER_TILE;
-        if (y_ctb > 0 && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - s->ps.sps->ctb_width])
+        if (y_ctb > 0 && !(s->enable_parallel_tiles && lc->boundary_flags & BOUNDARY_UPPER_TILE) &&
+            s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - s->ps.sps->ctb_width])
             lc->boundary_flags |= BOUNDARY_UPPER_SLICE;
     } else {
         if (ctb_addr_in_slice <= 0)
@@ -2518,17 +2525,8 @@ static void hls_decode_neighbour(HEVCLocalContext *lc, int x_ctb, int y_ctb,
     lc->ctb_up_left_flag = ((x_ctb > 0) && (y_ctb > 0)  && (ctb_addr_in_slice-1 >= s->ps.sps->ctb_width) && (s->ps.pps->tile_id[ctb_addr_ts] == s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs-1 - s->ps.sps->ctb_width]]));
 }
 
-static int hls_decode_entry(AVCodecContext *avctxt, void *arg)
+static int check_slice_segment_start(const HEVCContext *s, int ctb_addr_ts)
 {
-    HEVCContext *s  = avctxt->priv_data;
-    HEVCLocalContext *const lc = s->HEVClc;
-    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
-    int more_data   = 1;
-    int x_ctb       = 0;
-    int y_ctb       = 0;
-    int ctb_addr_ts = s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
-    int ret;
-
     if (!ctb_addr_ts && s->sh.dependent_slice_segment_flag) {
         av_log(s->avctx, AV_LOG_ERROR, "Impossible initial tile.\n");
         return AVERROR_INVALIDDATA;
@@ -2542,6 +2540,24 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *arg)
         }
     }
 
+    return 0;
+}
+
+static int hls_decode_entry(AVCodecContext *avctxt, void *arg)
+{
+    HEVCContext *s  = avctxt->priv_data;
+    HEVCLocalContext *const lc = s->HEVClc;
+    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
+    int more_data   = 1;
+    int x_ctb       = 0;
+    int y_ctb       = 0;
+    int ctb_addr_ts = s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int ret;
+
+    ret = check_slice_segment_start(s, ctb_addr_ts);
+    if (ret < 0)
+        return ret;
+
     while (more_data && ctb_addr_ts < s->ps.sps->ctb_size) {
         int ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
 
@@ -2560,6 +2576,8 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *arg)
         s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
         s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
         s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+        s->deblocking_disabled[ctb_addr_rs] = s->sh.disable_deblocking_filter_flag;
+        s->skip_loop_filter[ctb_addr_rs]    = ff_hevc_skip_loop_filter(s);
 
         more_data = hls_coding_quadtree(lc, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
         if (more_data < 0) {
@@ -2570,10 +2588,12 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *arg)
 
         ctb_addr_ts++;
         ff_hevc_save_states(lc, ctb_addr_ts);
-        ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
+        if (!s->enable_parallel_tiles)
+            ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
     }
 
-    if (x_ctb + ctb_size >= s->ps.sps->width &&
+    if (!s->enable_parallel_tiles &&
+        x_ctb + ctb_size >= s->ps.sps->width &&
         y_ctb + ctb_size >= s->ps.sps->height)
         ff_hevc_hls_filter(lc, x_ctb, y_ctb, ctb_size);
 
@@ -2670,35 +2690,180 @@ error:
     return ret;
 }
 
+static int alloc_local_contexts(HEVCContext *s)
+{
+    int i;
+
+    for (i = 1; i < s->threads_number; i++) {
+        if (s->HEVClcList[i])
+            continue;
+        s->HEVClcList[i] = av_mallocz(sizeof(HEVCLocalContext));
+        if (!s->HEVClcList[i])
+            return AVERROR(ENOMEM);
+        s->HEVClcList[i]->logctx = s->avctx;
+        s->HEVClcList[i]->parent = s;
+        s->HEVClcList[i]->common_cabac_state = &s->cabac;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode one tile of a slice segment, without in-loop filtering.
+ * The local context the last tile was decoded with is returned through
+ * last_lc, the state of the slice segment continues with it.
+ */
+static int hls_decode_entry_tile(AVCodecContext *avctxt, void *last_lc,
+                                 int job, int self_id)
+{
+    HEVCContext *s  = avctxt->priv_data;
+    HEVCLocalContext *lc = s->HEVClcList[self_id];
+    const HEVCSPS *sps = s->ps.sps;
+    const HEVCPPS *pps = s->ps.pps;
+    int ctb_addr_ts = pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int tile        = pps->tile_id[ctb_addr_ts] + job;
+    int more_data   = 1;
+    int idx_x, ret;
+
+    if (job) {
+        ctb_addr_ts = pps->ctb_addr_rs_to_ts[pps->tile_pos_rs[tile]];
+        ret = init_get_bits8(&lc->gb, s->data + s->sh.offset[job - 1], s->sh.size[job - 1]);
+        if (ret < 0)
+            return ret;
+    } else {
+        ret = check_slice_segment_start(s, ctb_addr_ts);
+        if (ret < 0)
+            return ret;
+    }
+
+    idx_x = pps->col_idxX[pps->ctb_addr_ts_to_rs[ctb_addr_ts] % sps->ctb_width];
+    lc->end_of_tiles_x = (pps->col_bd[idx_x] + pps->column_width[idx_x]) << sps->log2_ctb_size;
+
+    while (more_data && ctb_addr_ts < sps->ctb_size && pps->tile_id[ctb_addr_ts] == tile) {
+        int ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        int x_ctb = (ctb_addr_rs % sps->ctb_width) << sps->log2_ctb_size;
+        int y_ctb = (ctb_addr_rs / sps->ctb_width) << sps->log2_ctb_size;
+
+        hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
+
+        ret = ff_hevc_cabac_init(lc, ctb_addr_ts);
+        if (ret < 0) {
+            s->tab_slice_address[ctb_addr_rs] = -1;
+            return ret;
+        }
+
+        hls_sao_param(lc, x_ctb >> sps->log2_ctb_size, y_ctb >> sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+        s->deblocking_disabled[ctb_addr_rs] = s->sh.disable_deblocking_filter_flag;
+        s->skip_loop_filter[ctb_addr_rs]    = ff_hevc_skip_loop_filter(s);
+
+        more_data = hls_coding_quadtree(lc, x_ctb, y_ctb, sps->log2_ctb_size, 0);
+        if (more_data < 0) {
+            s->tab_slice_address[ctb_addr_rs] = -1;
+            return more_data;
+        }
+
+        ctb_addr_ts++;
+    }
+
+    if (job == s->sh.num_entry_point_offsets) {
+        *(HEVCLocalContext **)last_lc = lc;
+        return ctb_addr_ts;
+    }
+
+    return 0;
+}
+
+static int hls_filter_ctb_row(AVCodecContext *avctxt, void *hevc_lclist,
+                              int job, int self_id)
+{
+    HEVCLocalContext *lc = ((HEVCLocalContext**)hevc_lclist)[self_id];
+    const HEVCContext *const s = lc->parent;
+    const HEVCSPS *sps = s->ps.sps;
+    int ctb_size    = 1 << sps->log2_ctb_size;
+    int y_ctb       = job << sps->log2_ctb_size;
+    int ctb_addr_rs = job * sps->ctb_width;
+    int thread      = job % s->threads_number;
+    int x_ctb;
+
+    for (x_ctb = 0; x_ctb < sps->width; x_ctb += ctb_size, ctb_addr_rs++) {
+        ff_thread_await_progress2(s->avctx, job, thread, SHIFT_CTB_WPP);
+
+        if (s->tab_slice_address[ctb_addr_rs] >= 0) {
+            ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
+            if (x_ctb + ctb_size >= sps->width && y_ctb + ctb_size >= sps->height)
+                ff_hevc_hls_filter(lc, x_ctb, y_ctb, ctb_size);
+        }
+
+        ff_thread_report_progress2(s->avctx, job, thread, 1);
+    }
+    ff_thread_report_progress2(s->avctx, job, thread, SHIFT_CTB_WPP);
+
+    return 0;
+}
+
+/**
+ * Apply the in-loop filters postponed while decoding the tiles of the
+ * current picture in parallel, in CTB rows run wavefront-style.
+ */
+static int hls_filter_picture(HEVCContext *s)
+{
+    const HEVCSPS *sps = s->ps.sps;
+    int x_ctb, y_ctb, ret;
+
+    ret = alloc_local_contexts(s);
+    if (ret < 0)
+        goto end;
+
+    for (y_ctb = 0; y_ctb < sps->height; y_ctb += 1 << sps->log2_ctb_size)
+        for (x_ctb = 0; x_ctb < sps->width; x_ctb += 1 << sps->log2_ctb_size)
+            ff_hevc_tile_boundary_strengths(s, x_ctb, y_ctb);
+
+    ret = ff_slice_thread_allocz_entries(s->avctx, sps->ctb_height);
+    if (ret < 0)
+        goto end;
+
+    s->avctx->execute2(s->avctx, hls_filter_ctb_row, s->HEVClcList, NULL, sps->ctb_height);
+
+end:
+    s->enable_parallel_tiles = 0;
+    return ret;
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
     int length          = nal->size;
     HEVCLocalContext *lc = s->HEVClc;
+    HEVCLocalContext *last_lc = NULL;
     int *ret;
     int64_t offset;
     int64_t startheader, cmpt = 0;
     int i, j, res = 0;
 
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
+    if (s->ps.pps->entropy_coding_sync_enabled_flag &&
+        s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
         av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
             s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
             s->ps.sps->ctb_width, s->ps.sps->ctb_height
         );
         return AVERROR_INVALIDDATA;
     }
-
-    for (i = 1; i < s->threads_number; i++) {
-        if (s->HEVClcList[i])
-            continue;
-        s->HEVClcList[i] = av_mallocz(sizeof(HEVCLocalContext));
-        if (!s->HEVClcList[i])
-            return AVERROR(ENOMEM);
-        s->HEVClcList[i]->logctx = s->avctx;
-        s->HEVClcList[i]->parent = s;
-        s->HEVClcList[i]->common_cabac_state = &s->cabac;
+    if (s->enable_parallel_tiles &&
+        s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs]] + s->sh.num_entry_point_offsets >=
+        s->ps.pps->num_tile_columns * s->ps.pps->num_tile_rows) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile entry points are wrong (%d %d)\n",
+               s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets);
+        return AVERROR_INVALIDDATA;
     }
 
+    res = alloc_local_contexts(s);
+    if (res < 0)
+        return res;
+
     offset = (lc->gb.index >> 3);
 
     for (j = 0, cmpt = 0, startheader = offset + s->sh.entry_point_offset[0]; j < nal->skipped_bytes; j++) {
@@ -2749,6 +2914,17 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 
     if (s->ps.pps->entropy_coding_sync_enabled_flag)
         s->avctx->execute2(s->avctx, hls_decode_entry_wpp, s->HEVClcList, ret, s->sh.num_entry_point_offsets + 1);
+    else if (s->enable_parallel_tiles)
+        s->avctx->execute2(s->avctx, hls_decode_entry_tile, &last_lc, ret, s->sh.num_entry_point_offsets + 1);
+
+    /* a following dependent slice segment continues where the last tile ended */
+    if (last_lc && last_lc != lc) {
+        memcpy(lc->cabac_state, last_lc->cabac_state, sizeof(lc->cabac_state));
+        memcpy(lc->stat_coeff, last_lc->stat_coeff, sizeof(lc->stat_coeff));
+        lc->qp_y           = last_lc->qp_y;
+        lc->qPy_pred       = last_lc->qPy_pred;
+        lc->end_of_tiles_x = last_lc->end_of_tiles_x;
+    }
 
     for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
         res += ret[i];
@@ -2913,6 +3089,13 @@ static int hevc_frame_start(HEVCContext *s)
     memset(s->is_pcm,        0, (s->ps.sps->min_pu_width + 1) * (s->ps.sps->min_pu_height + 1));
     memset(s->tab_slice_address, -1, pic_size_in_ctb * sizeof(*s->tab_slice_address));
 
+    /* tiles are decoded in parallel, the in-loop filters are applied to the
+     * whole picture once it is decoded, see hls_filter_picture() */
+    s->enable_parallel_tiles = s->threads_number > 1 && !s->avctx->hwaccel &&
+                               s->ps.pps->tiles_enabled_flag &&
+                               !s->ps.pps->entropy_coding_sync_enabled_flag &&
+                               (s->ps.pps->num_tile_columns > 1 || s->ps.pps->num_tile_rows > 1);
+
     s->is_decoded        = 0;
     s->first_nal_type    = s->nal_unit_type;
 
@@ -3161,6 +3344,11 @@ static int decode_nal_unit(HEVCContext *s, const H2645NAL *nal)
             else
                 ctb_addr_ts = hls_slice_data(s);
             if (ctb_addr_ts >= (s->ps.sps->ctb_width * s->ps.sps->ctb_height)) {
+                if (s->enable_parallel_tiles) {
+                    ret = hls_filter_picture(s);
+                    if (ret < 0)
+                        goto fail;
+                }
                 ret = hevc_frame_end(s);
                 if (ret < 0)
                     goto fail;
@@ -3277,6 +3465,9 @@ static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
     }
 
 fail:
+    /* filter what was decoded of an incomplete picture */
+    if (s->ref && s->enable_parallel_tiles)
+        hls_filter_picture(s);
     if (s->ref && s->threads_type == FF_THREAD_FRAME)
         ff_thread_report_progress(&s->ref->tf, INT_MAX, 0);
 
@@ -3692,7 +3883,9 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     } else
         s->threads_number = 1;
 
-    if((avctx->active_thread_type & FF_THREAD_FRAME) && avctx->thread_count > 1)
+    /* with frame threading, thread_count is the number of slice threads
+     * used by this frame thread, which may be 1 */
+    if (avctx->active_thread_type & FF_THREAD_FRAME)
         s->threads_type = FF_THREAD_FRAME;
     else
         s->threads_type = FF_THREAD_SLICE;
@@ -3766,7 +3959,8 @@ const FFCodec ff_hevc_decoder = {
     .p.capabilities        = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
                              AV_CODEC_CAP_SLICE_THREADS | AV_CODEC_CAP_FRAME_THREADS,
     .caps_internal         = FF_CODEC_CAP_EXPORTS_CROPPING |
-                             FF_CODEC_CAP_ALLOCATE_PROGRESS | FF_CODEC_CAP_INIT_CLEANUP,
+                             FF_CODEC_CAP_ALLOCATE_PROGRESS | FF_CODEC_CAP_INIT_CLEANUP |
+                             FF_CODEC_CAP_FRAME_SLICE_THREADS,
     .p.profiles            = NULL_IF_CONFIG_SMALL(ff_hevc_profiles),
     .hw_configs            = (const AVCodecHWConfigInternal *const []) {
 #if CONFIG_HEVC_DXVA2_HWACCEL
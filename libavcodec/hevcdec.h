@@ -566,6 +566,9 @@ typedef struct HEVCContext {
 
     // CTB-level flags affecting loop filter operation
     uint8_t *filter_slice_edges;
+    // only used when the loop filters are postponed with parallel tiles
+    uint8_t *deblocking_disabled;
+    uint8_t *skip_loop_filter;
 
     /** used on BE to byteswap the lines for checksumming */
     uint8_t *checksum_buf;
@@ -581,7 +584,7 @@ typedef struct HEVCContext {
     /** The target for the common_cabac_state of the local contexts. */
     HEVCCABACState cabac;
 
-    int enable_parallel_tiles;
+    int enable_parallel_tiles; ///< tiles of the current picture are decoded in parallel, in-loop filtering is postponed
     atomic_int wpp_err;
 
     const uint8_t *data;
@@ -701,11 +704,22 @@ void ff_hevc_luma_mv_mvp_mode(HEVCLocalContext *lc, int x0, int y0,
                               int part_idx, int merge_idx,
                               MvField *mv, int mvp_lx_flag, int LX);
 void ff_hevc_hls_filter(HEVCLocalContext *lc, int x, int y, int ctb_size);
+/**
+ * @return whether avctx->skip_loop_filter discards the loop filters for the
+ *         current slice
+ */
+int ff_hevc_skip_loop_filter(const HEVCContext *s);
 void ff_hevc_hls_filters(HEVCLocalContext *lc, int x_ctb, int y_ctb, int ctb_size);
 void ff_hevc_set_qPy(HEVCLocalContext *lc, int xBase, int yBase,
                      int log2_cb_size);
 void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                                            int log2_trafo_size);
+/**
+ * Derive the boundary strengths of the CTB edges on tile boundaries, which are
+ * left out by ff_hevc_deblocking_boundary_strengths() while the tiles of a
+ * picture are decoded in parallel.
+ */
+void ff_hevc_tile_boundary_strengths(const HEVCContext *s, int x_ctb, int y_ctb);
 int ff_hevc_cu_qp_delta_sign_flag(HEVCLocalContext *lc);
 int ff_hevc_cu_qp_delta_abs(HEVCLocalContext *lc);
 int ff_hevc_cu_chroma_qp_offset_flag(HEVCLocalContext *lc);
@@ -72,6 +72,12 @@ typedef struct AVCodecInternal {
 
     void *thread_ctx;
 
+    /**
+     * Slice threading context. Kept apart from thread_ctx, so that the
+     * copies used by frame threading can run slice threads of their own.
+     */
+    void *slice_thread_ctx;
+
     /**
      * This packet is used to hold the packet given to decoders
      * implementing the .decode API; it is unused by the generic
@@ -50,6 +50,7 @@
 #include "jpeglsdec.h"
 #include "profiles.h"
 #include "put_bits.h"
+#include "thread.h"
 #include "tiff.h"
 #include "exif.h"
 #include "bytestream.h"
@@ -751,7 +752,7 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
         }
 
         av_frame_unref(s->picture_ptr);
-        if (ff_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
+        if (ff_thread_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
             return -1;
         s->picture_ptr->pict_type = AV_PICTURE_TYPE_I;
         s->picture_ptr->flags |= AV_FRAME_FLAG_KEY;
@@ -810,10 +811,11 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -822,47 +824,48 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb, int *last_dc,
+                        int16_t *block, int component,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
+    val = val * (unsigned)quant_matrix[0] + last_dc[component];
     val = av_clip_int16(val);
-    s->last_dc[component] = val;
+    last_dc[component] = val;
     block[0] = val;
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -872,7 +875,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -883,7 +886,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, &s->gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
@@ -1177,7 +1180,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                 if(dc == 0xFFFFF)
                     return -1;
 
@@ -1311,7 +1314,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1382,7 +1385,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1451,6 +1454,87 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+typedef struct ScanThreadData {
+    int nb_components;
+    int nb_intervals;
+    int start;      ///< offset of the first restart interval in s->gb
+    uint8_t *data[MAX_COMPONENTS];
+    int linesize[MAX_COMPONENTS];
+    int chroma_width, chroma_height;
+    int bytes_per_pixel;
+} ScanThreadData;
+
+/* Decode one restart interval of a sequential scan; restart intervals are
+ * independent, so they are decoded in parallel. */
+static int decode_scan_interval(AVCodecContext *avctx, void *arg,
+                                int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    const ScanThreadData *td = arg;
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+    int last_dc[MAX_COMPONENTS];
+    GetBitContext gb;
+    int start   = jobnr ? s->restart_offsets[jobnr - 1] : td->start;
+    int end     = jobnr + 1 < td->nb_intervals ? s->restart_offsets[jobnr] - 2
+                                               : s->gb.size_in_bits >> 3;
+    int64_t mcu = (int64_t)jobnr * s->restart_interval;
+    int64_t end_mcu = FFMIN(mcu + s->restart_interval,
+                            (int64_t)s->mb_width * s->mb_height);
+    int i, ret;
+
+    if (end < start)
+        return AVERROR_INVALIDDATA;
+    ret = init_get_bits8(&gb, s->gb.buffer + start, end - start);
+    if (ret < 0)
+        return ret;
+
+    for (i = 0; i < td->nb_components; i++)
+        last_dc[i] = (4 << s->bits);
+
+    for (; mcu < end_mcu; mcu++) {
+        int mb_x = mcu % s->mb_width;
+        int mb_y = mcu / s->mb_width;
+
+        if (get_bits_left(&gb) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "overread %d\n", -get_bits_left(&gb));
+            return AVERROR_INVALIDDATA;
+        }
+        for (i = 0; i < td->nb_components; i++) {
+            int n = s->nb_blocks[i];
+            int c = s->comp_index[i];
+            int h = s->h_scount[i];
+            int v = s->v_scount[i];
+            int x = 0, y = 0;
+
+            for (int j = 0; j < n; j++) {
+                int block_offset = (((td->linesize[c] * (v * mb_y + y) * 8) +
+                                     (h * mb_x + x) * 8 * td->bytes_per_pixel) >> avctx->lowres);
+
+                s->bdsp.clear_block(block);
+                if (decode_block(s, &gb, last_dc, block, i,
+                                 s->dc_index[i], s->ac_index[i],
+                                 s->quant_matrixes[s->quant_sindex[i]]) < 0) {
+                    av_log(avctx, AV_LOG_ERROR, "error y=%d x=%d\n", mb_y, mb_x);
+                    return AVERROR_INVALIDDATA;
+                }
+                if (   8*(h * mb_x + x) < ((c == 1) || (c == 2) ? td->chroma_width  : s->width)
+                    && 8*(v * mb_y + y) < ((c == 1) || (c == 2) ? td->chroma_height : s->height)
+                    && td->linesize[c]) {
+                    uint8_t *ptr = td->data[c] + block_offset;
+                    s->idsp.idct_put(ptr, td->linesize[c], block);
+                    if (s->bits & 7)
+                        shift_output(s, ptr, td->linesize[c]);
+                }
+                if (++x == h) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
@@ -1486,6 +1570,39 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->coefs_finished[c] |= 1;
     }
 
+    if (!s->progressive && !mb_bitmask && !s->interlaced &&
+        s->restart_interval && s->nb_restart_offsets > 0 &&
+        s->gb.buffer == s->buffer) {
+        ScanThreadData td = {
+            .nb_components   = nb_components,
+            .start           = get_bits_count(&s->gb) >> 3,
+            .chroma_width    = chroma_width,
+            .chroma_height   = chroma_height,
+            .bytes_per_pixel = bytes_per_pixel,
+        };
+        int64_t nb_intervals = ((int64_t)s->mb_width * s->mb_height +
+                                s->restart_interval - 1) / s->restart_interval;
+
+        /* only when every restart marker has been found where expected */
+        if (nb_intervals == s->nb_restart_offsets + 1) {
+            int ret = 0;
+
+            td.nb_intervals = nb_intervals;
+            memcpy(td.data,     data,     sizeof(data));
+            memcpy(td.linesize, linesize, sizeof(linesize));
+            av_fast_malloc(&s->slice_ret, &s->slice_ret_size,
+                           nb_intervals * sizeof(*s->slice_ret));
+            if (!s->slice_ret)
+                return AVERROR(ENOMEM);
+            s->avctx->execute2(s->avctx, decode_scan_interval, &td,
+                               s->slice_ret, nb_intervals);
+            for (i = 0; i < nb_intervals && !ret; i++)
+                ret = s->slice_ret[i];
+            skip_bits_long(&s->gb, get_bits_left(&s->gb));
+            return ret;
+        }
+    }
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1527,7 +1644,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
 
                         } else {
                             s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
+                            if (decode_block(s, &s->gb, s->last_dc, s->block, i,
                                              s->dc_index[i], s->ac_index[i],
                                              s->quant_matrixes[s->quant_sindex[i]]) < 0) {
                                 av_log(s->avctx, AV_LOG_ERROR,
@@ -2248,6 +2365,12 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         const uint8_t *src = *buf_ptr;
         const uint8_t *ptr = src;
         uint8_t *dst = s->buffer;
+        /* the restart intervals can only be decoded in parallel when
+         * the position of every restart marker is known */
+        int record_rst = s->avctx->active_thread_type & FF_THREAD_SLICE &&
+                         s->avctx->thread_count > 1;
+
+        s->nb_restart_offsets = 0;
 
         #define copy_data_segment(skip) do {       \
             ptrdiff_t length = (ptr - src) - (skip);  \
@@ -2286,6 +2409,18 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (record_rst) {
+                        int *offsets = av_fast_realloc(s->restart_offsets,
+                                                       &s->restart_offsets_size,
+                                                       (s->nb_restart_offsets + 1) * sizeof(*offsets));
+                        if (offsets) {
+                            s->restart_offsets = offsets;
+                            /* where the data following the marker ends up */
+                            offsets[s->nb_restart_offsets++] = dst - s->buffer + (ptr - src);
+                        } else {
+                            s->nb_restart_offsets = 0;
+                            record_rst = 0;
+                        }
                     }
                 }
             }
@@ -2391,6 +2526,8 @@ int ff_mjpeg_decode_frame_from_buf(AVCodecContext *avctx, AVFrame *frame,
     if (s->iccnum != 0)
         reset_icc_profile(s);
 
+    s->setup_finished = 0;
+
 redo_for_pal8:
     buf_ptr = buf;
     buf_end = buf + buf_size;
@@ -2422,6 +2559,18 @@ redo_for_pal8:
         if (s->avctx->debug & FF_DEBUG_STARTCODE)
             av_log(avctx, AV_LOG_DEBUG, "startcode: %X\n", start_code);
 
+        /* the next frame thread copies the tables and the picture
+         * parameters, so they must not change once setup is finished */
+        if (s->setup_finished &&
+            (start_code == DHT || start_code == DQT ||
+             (start_code >= APP0 && start_code <= APP15) ||
+             (start_code >= SOF0 && start_code <= SOF3) ||
+             start_code == SOF48)) {
+            av_log(avctx, AV_LOG_WARNING,
+                   "Ignoring marker 0x%x after the last scan\n", start_code);
+            goto skip;
+        }
+
         /* process markers */
         if (start_code >= RST0 && start_code <= RST7) {
             av_log(avctx, AV_LOG_DEBUG,
@@ -2572,6 +2721,18 @@ eoi_parser:
             s->raw_scan_buffer_size = buf_end - buf_ptr;
 
             s->cur_scan++;
+            /* Everything the next packet depends on is known once the scan
+             * of a single-scan sequential picture starts: it covers all
+             * components, so no further scans or tables may follow.
+             * Interlaced pictures, whose second field may be in the next
+             * packet, JPEG-LS palettes and multi-scan pictures finish setup
+             * only after the whole packet. */
+            if (s->cur_scan == 1 && !s->progressive && !s->interlaced &&
+                !s->ls && get_bits_left(&s->gb) >= 24 &&
+                (show_bits_long(&s->gb, 24) & 0xFF) == s->nb_components) {
+                ff_thread_finish_setup(avctx);
+                s->setup_finished = !!(avctx->active_thread_type & FF_THREAD_FRAME);
+            }
             if (avctx->skip_frame == AVDISCARD_ALL) {
                 skip_bits(&s->gb, get_bits_left(&s->gb));
                 break;
@@ -2946,6 +3107,8 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->restart_offsets);
+    av_freep(&s->slice_ret);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -2978,6 +3141,94 @@ static void decode_flush(AVCodecContext *avctx)
 }
 
 #if CONFIG_MJPEG_DECODER
+#if HAVE_THREADS
+static int mjpeg_update_thread_context(AVCodecContext *dst,
+                                       const AVCodecContext *src)
+{
+    MJpegDecodeContext *s = dst->priv_data;
+    const MJpegDecodeContext *s1 = src->priv_data;
+    int ret;
+
+    if (dst == src)
+        return 0;
+
+    /* tables defined in one picture remain in use for the following ones */
+    for (int class = 0; class < 2; class++) {
+        for (int index = 0; index < 4; index++) {
+            uint8_t bits_table[17] = { 0 };
+
+            if (!memcmp(s->raw_huffman_lengths[class][index],
+                        s1->raw_huffman_lengths[class][index], 16) &&
+                !memcmp(s->raw_huffman_values[class][index],
+                        s1->raw_huffman_values[class][index], 256))
+                continue;
+
+            memcpy(s->raw_huffman_lengths[class][index],
+                   s1->raw_huffman_lengths[class][index], 16);
+            memcpy(s->raw_huffman_values[class][index],
+                   s1->raw_huffman_values[class][index], 256);
+            ff_free_vlc(&s->vlcs[class][index]);
+            if (class > 0)
+                ff_free_vlc(&s->vlcs[2][index]);
+            if (!s1->vlcs[class][index].table)
+                continue;
+
+            memcpy(bits_table + 1, s->raw_huffman_lengths[class][index], 16);
+            ret = ff_mjpeg_build_vlc(&s->vlcs[class][index], bits_table,
+                                     s->raw_huffman_values[class][index],
+                                     class > 0, dst);
+            if (ret < 0)
+                return ret;
+            if (class > 0) {
+                ret = ff_mjpeg_build_vlc(&s->vlcs[2][index], bits_table,
+                                         s->raw_huffman_values[class][index],
+                                         0, dst);
+                if (ret < 0)
+                    return ret;
+            }
+        }
+    }
+    memcpy(s->quant_matrixes, s1->quant_matrixes, sizeof(s->quant_matrixes));
+    memcpy(s->qscale,         s1->qscale,         sizeof(s->qscale));
+
+    s->buggy_avid         = s1->buggy_avid;
+    s->cs_itu601          = s1->cs_itu601;
+    s->interlace_polarity = s1->interlace_polarity;
+    s->multiscope         = s1->multiscope;
+
+    /* the interlacing is detected from size changes */
+    s->first_picture = s1->first_picture;
+    s->width         = s1->width;
+    s->height        = s1->height;
+    s->bits          = s1->bits;
+    memcpy(s->h_count, s1->h_count, sizeof(s->h_count));
+    memcpy(s->v_count, s1->v_count, sizeof(s->v_count));
+    s->interlaced    = s1->interlaced;
+    s->bottom_field  = s1->bottom_field;
+
+    s->hwaccel_pix_fmt    = s1->hwaccel_pix_fmt;
+    s->hwaccel_sw_pix_fmt = s1->hwaccel_sw_pix_fmt;
+
+    /* the second field of an interlaced picture may be in the next packet;
+     * the previous thread has finished decoding the first one then */
+    s->got_picture = 0;
+    if (s1->interlaced && s1->got_picture && !src->hwaccel) {
+        av_frame_unref(s->picture_ptr);
+        ret = av_frame_ref(s->picture_ptr, s1->picture_ptr);
+        if (ret < 0)
+            return ret;
+        s->got_picture = 1;
+        s->rgb         = s1->rgb;
+        s->pix_desc    = s1->pix_desc;
+        memcpy(s->linesize,  s1->linesize,  sizeof(s->linesize));
+        memcpy(s->upscale_h, s1->upscale_h, sizeof(s->upscale_h));
+        memcpy(s->upscale_v, s1->upscale_v, sizeof(s->upscale_v));
+    }
+
+    return 0;
+}
+#endif
+
 #define OFFSET(x) offsetof(MJpegDecodeContext, x)
 #define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
 static const AVOption options[] = {
@@ -3002,8 +3253,10 @@ const FFCodec ff_mjpeg_decoder = {
     .init           = ff_mjpeg_decode_init,
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_DECODE_CB(ff_mjpeg_decode_frame),
+    UPDATE_THREAD_CONTEXT(mjpeg_update_thread_context),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -123,6 +123,11 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *restart_offsets;     ///< position of the data following each RSTn marker of the current scan
+    unsigned int restart_offsets_size;
+    int nb_restart_offsets;
+    int *slice_ret;
+    unsigned int slice_ret_size;
 
     int buggy_avid;
     int cs_itu601;
@@ -132,6 +137,7 @@ typedef struct MJpegDecodeContext {
     int mjpb_skiptosod;
 
     int cur_scan; /* current scan, used by JPEG-LS */
+    int setup_finished; /* frame threading setup finished for this packet */
     int flipped; /* true if picture is flipped */
 
     uint16_t (*ljpeg_buffer)[4];
@@ -750,6 +750,8 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
             }
             if (codec->close && p->thread_init != UNINITIALIZED)
                 codec->close(ctx);
+            if (ctx->internal->slice_thread_ctx)
+                ff_slice_thread_free(ctx);
 
             if (ctx->priv_data) {
                 if (codec->p.priv_class)
@@ -846,6 +848,14 @@ static av_cold int init_thread(PerThreadContext *p, int *threads_to_free,
     if (!copy->internal->last_pkt_props)
         return AVERROR(ENOMEM);
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE) {
+        /* each frame thread decodes its frame with its own slice threads */
+        copy->thread_count = avctx->slice_thread_count;
+        err = ff_slice_thread_init(copy);
+        if (err < 0)
+            return err;
+    }
+
     if (codec->init) {
         err = codec->init(copy);
         if (err < 0) {
@@ -886,6 +896,12 @@ int ff_frame_thread_init(AVCodecContext *avctx)
     }
 
     if (thread_count <= 1) {
+        if (avctx->active_thread_type & FF_THREAD_SLICE) {
+            /* only the slice threads of the single frame thread remain */
+            avctx->active_thread_type = FF_THREAD_SLICE;
+            avctx->thread_count       = avctx->slice_thread_count;
+            return ff_slice_thread_init(avctx);
+        }
         avctx->active_thread_type = 0;
         return 0;
     }
@@ -274,7 +274,7 @@ static int update_size(AVCodecContext *avctx, int w, int h)
     s->sb_rows   = (h + 63) >> 6;
     s->cols      = (w + 7) >> 3;
     s->rows      = (h + 7) >> 3;
-    lflvl_len    = avctx->active_thread_type == FF_THREAD_SLICE ? s->sb_rows : 1;
+    lflvl_len    = avctx->active_thread_type & FF_THREAD_SLICE ? s->sb_rows : 1;
 
 #define assign(var, type, n) var = (type) p; p += s->sb_cols * (n) * sizeof(*var)
     av_freep(&s->intra_pred_data[0]);
@@ -808,11 +808,14 @@ static int decode_frame_header(AVCodecContext *avctx,
         }
 
         s->s.h.tiling.tile_cols = 1 << s->s.h.tiling.log2_tile_cols;
-        s->active_tile_cols = avctx->active_thread_type == FF_THREAD_SLICE ?
+        s->active_tile_cols = avctx->active_thread_type & FF_THREAD_SLICE ?
                               s->s.h.tiling.tile_cols : 1;
         vp9_alloc_entries(avctx, s->sb_rows);
-        if (avctx->active_thread_type == FF_THREAD_SLICE) {
+        if (avctx->active_thread_type & FF_THREAD_SLICE) {
             n_range_coders = 4; // max_tile_rows
+            // two-pass frames of frame threads are decoded by decode_tiles()
+            if (avctx->active_thread_type & FF_THREAD_FRAME)
+                n_range_coders = FFMAX(n_range_coders, s->s.h.tiling.tile_cols);
         } else {
             n_range_coders = s->s.h.tiling.tile_cols;
         }
@@ -1504,6 +1507,7 @@ int loopfilter_proc(AVCodecContext *avctx)
                                      yoff, uvoff);
             }
         }
+        ff_thread_report_progress(&s->s.frames[CUR_FRAME].tf, i, 0);
     }
     return 0;
 }
@@ -1664,7 +1668,7 @@ static int vp9_decode_frame(AVCodecContext *avctx, AVFrame *frame,
     memset(s->above_uv_nnz_ctx[1], 0, s->sb_cols * 16 >> s->ss_h);
     memset(s->above_segpred_ctx, 0, s->cols);
     s->pass = s->s.frames[CUR_FRAME].uses_2pass =
-        avctx->active_thread_type == FF_THREAD_FRAME && s->s.h.refreshctx && !s->s.h.parallelmode;
+        avctx->active_thread_type & FF_THREAD_FRAME && s->s.h.refreshctx && !s->s.h.parallelmode;
     if ((ret = update_block_buffers(avctx)) < 0) {
         av_log(avctx, AV_LOG_ERROR,
                "Failed to allocate block buffers\n");
@@ -1709,11 +1713,9 @@ static int vp9_decode_frame(AVCodecContext *avctx, AVFrame *frame,
         }
 
 #if HAVE_THREADS
-        if (avctx->active_thread_type == FF_THREAD_SLICE) {
+        if (avctx->active_thread_type & FF_THREAD_SLICE && !s->pass) {
             int tile_row, tile_col;
 
-            av_assert1(!s->pass);
-
             for (tile_row = 0; tile_row < s->s.h.tiling.tile_rows; tile_row++) {
                 for (tile_col = 0; tile_col < s->s.h.tiling.tile_cols; tile_col++) {
                     int64_t tile_size;
@@ -1750,7 +1752,7 @@ static int vp9_decode_frame(AVCodecContext *avctx, AVFrame *frame,
         }
 
         // Sum all counts fields into td[0].counts for tile threading
-        if (avctx->active_thread_type == FF_THREAD_SLICE)
+        if (avctx->active_thread_type & FF_THREAD_SLICE && !s->pass)
             for (i = 1; i < s->s.h.tiling.tile_cols; i++)
                 for (j = 0; j < sizeof(s->td[i].counts) / sizeof(unsigned); j++)
                     ((unsigned *)&s->td[0].counts)[j] += ((unsigned *)&s->td[i].counts)[j];
@@ -1895,7 +1897,8 @@ const FFCodec ff_vp9_decoder = {
     .p.capabilities        = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS,
     .caps_internal         = FF_CODEC_CAP_INIT_CLEANUP |
                              FF_CODEC_CAP_SLICE_THREAD_HAS_MF |
-                             FF_CODEC_CAP_ALLOCATE_PROGRESS,
+                             FF_CODEC_CAP_ALLOCATE_PROGRESS |
+                             FF_CODEC_CAP_FRAME_SLICE_THREADS,
     .flush                 = vp9_decode_flush,
     UPDATE_THREAD_CONTEXT(vp9_decode_update_thread_context),
     .p.profiles            = NULL_IF_CONFIG_SMALL(ff_vp9_profiles),
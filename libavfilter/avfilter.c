@@ -19,6 +19,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -33,6 +35,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
 
 #define FF_INTERNAL_FIELDS 1
 #include "framequeue.h"
@@ -635,6 +638,50 @@ static int default_execute(AVFilterContext *ctx, avfilter_action_func *func, voi
     return 0;
 }
 
+typedef struct TimedJobs {
+    avfilter_action_func *func;
+    void                 *arg;
+    atomic_int_least64_t  busy;
+} TimedJobs;
+
+static int timed_job(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    TimedJobs *jobs = arg;
+    int64_t start = av_gettime_relative();
+    int ret = jobs->func(ctx, jobs->arg, jobnr, nb_jobs);
+
+    atomic_fetch_add_explicit(&jobs->busy, av_gettime_relative() - start,
+                              memory_order_relaxed);
+    return ret;
+}
+
+int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                      void *arg, int *ret, int nb_jobs)
+{
+    AVFilterStats *stats = &ctx->internal->stats;
+    TimedJobs jobs = { .func = func, .arg = arg };
+    int nb_threads = 1;
+    int64_t start, elapsed;
+    int err;
+
+    if (!ctx->graph->collect_stats)
+        return ctx->internal->execute(ctx, func, arg, ret, nb_jobs);
+
+    if (ctx->internal->execute != default_execute)
+        nb_threads = FFMAX(FFMIN(nb_jobs, ff_filter_get_nb_threads(ctx)), 1);
+
+    atomic_init(&jobs.busy, 0);
+    start = av_gettime_relative();
+    err = ctx->internal->execute(ctx, timed_job, &jobs, ret, nb_jobs);
+    elapsed = av_gettime_relative() - start;
+
+    stats->slice_time     += elapsed;
+    stats->slice_capacity += elapsed * nb_threads;
+    stats->slice_busy     += atomic_load_explicit(&jobs.busy, memory_order_relaxed);
+
+    return err;
+}
+
 AVFilterContext *ff_filter_alloc(const AVFilter *filter, const char *inst_name)
 {
     AVFilterContext *ret;
@@ -1312,6 +1359,9 @@ static int ff_filter_activate_default(AVFilterContext *filter)
 
 int ff_filter_activate(AVFilterContext *filter)
 {
+    AVFilterStats *stats = &filter->internal->stats;
+    const int timed = filter->graph->collect_stats;
+    int64_t start = timed ? av_gettime_relative() : 0;
     int ret;
 
     /* Generic timeline support is not yet implemented but should be easy */
@@ -1322,9 +1372,29 @@ int ff_filter_activate(AVFilterContext *filter)
           ff_filter_activate_default(filter);
     if (ret == FFERROR_NOT_READY)
         ret = 0;
+
+    if (timed)
+        stats->time += av_gettime_relative() - start;
+    stats->nb_activations++;
+
     return ret;
 }
 
+const AVFilterStats *avfilter_get_stats(AVFilterContext *filter)
+{
+    AVFilterStats *stats = &filter->internal->stats;
+
+    stats->frames_in = stats->frames_out = 0;
+    for (unsigned i = 0; i < filter->nb_inputs; i++)
+        if (filter->inputs[i])
+            stats->frames_in  += filter->inputs[i]->frame_count_out;
+    for (unsigned i = 0; i < filter->nb_outputs; i++)
+        if (filter->outputs[i])
+            stats->frames_out += filter->outputs[i]->frame_count_in;
+
+    return stats;
+}
+
 int ff_inlink_acknowledge_status(AVFilterLink *link, int *rstatus, int64_t *rpts)
 {
     *rpts = link->current_pts;
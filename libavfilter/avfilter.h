@@ -748,6 +748,69 @@ int avfilter_config_links(AVFilterContext *filter);
  */
 int avfilter_process_command(AVFilterContext *filter, const char *cmd, const char *arg, char *res, int res_len, int flags);
 
+/**
+ * Processing statistics of a filter instance, collected by libavfilter while
+ * the filter graph runs.
+ *
+ * All times are in microseconds of wall clock time. sizeof(AVFilterStats) is
+ * not a part of the public ABI, new fields may be added to the end.
+ */
+typedef struct AVFilterStats {
+    /**
+     * Number of times the filter was activated.
+     */
+    int64_t nb_activations;
+
+    /**
+     * Total time spent processing in the filter, including the slice
+     * threaded execution counted in slice_time.
+     */
+    int64_t time;
+
+    /**
+     * Number of frames consumed on all inputs and sent on all outputs.
+     */
+    int64_t frames_in;
+    int64_t frames_out;
+
+    /**
+     * Time spent by filters synchronizing multiple inputs, such as overlay,
+     * waiting for frames on some inputs while frames on other inputs were
+     * already available.
+     */
+    int64_t framesync_wait;
+
+    /**
+     * Time spent in slice threaded execution.
+     */
+    int64_t slice_time;
+
+    /**
+     * Time spent running slice jobs, summed over all threads.
+     */
+    int64_t slice_busy;
+
+    /**
+     * slice_time multiplied by the number of threads that could run slice
+     * jobs at that time. The slice threading utilization of the filter is
+     * slice_busy / slice_capacity.
+     */
+    int64_t slice_capacity;
+} AVFilterStats;
+
+/**
+ * Get the processing statistics of a filter instance.
+ *
+ * The frame and activation counts are always available, the timings only
+ * while AVFilterGraph.collect_stats is set.
+ *
+ * Must not be called concurrently with processing in the filter's graph.
+ *
+ * @return a pointer to the statistics, valid until the filter is freed and
+ *         updated whenever the graph is run
+ */
+const AVFilterStats *avfilter_get_stats(AVFilterContext *filter);
+
 /**
  * Iterate over all registered filters.
  *
@@ -915,6 +978,14 @@ typedef struct AVFilterGraph {
      */
     avfilter_execute_func *execute;
 
+    /**
+     * Whether the processing of the filters in this graph is timed for
+     * avfilter_get_stats(). May be set by the caller at any time, the timings
+     * are collected from then on. Zero (the default) disables the timing, as
+     * timing every activation and slice threaded execution has a cost.
+     */
+    int collect_stats;
+
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
 
     /**
@@ -1467,7 +1538,10 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
  * Dump a graph into a human-readable string representation.
  *
  * @param graph    the graph to dump
- * @param options  formatting options; currently ignored
+ * @param options  formatting options; "stats" dumps a table with the
+ *                 processing statistics of each filter (see
+ *                 avfilter_get_stats()) instead of the graph layout,
+ *                 other values are currently ignored
  * @return  a string, or NULL in case of memory allocation failure;
  *          the string must be freed using av_free
  */
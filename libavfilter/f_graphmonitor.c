@@ -92,6 +92,7 @@ enum {
     FLAG_FC_DELTA = 1 << 14,
     FLAG_SC_DELTA = 1 << 15,
     FLAG_DISABLED = 1 << 16,
+    FLAG_STATS    = 1 << 17,
 };
 
 #define OFFSET(x) offsetof(GraphMonitorContext, x)
@@ -131,6 +132,7 @@ static const AVOption graphmonitor_options[] = {
         { "sample_count_out", NULL, 0, AV_OPT_TYPE_CONST, {.i64=FLAG_SCIN},    0, 0, VFR, "flags" },
         { "sample_count_delta",NULL,0, AV_OPT_TYPE_CONST, {.i64=FLAG_SC_DELTA},0, 0, VFR, "flags" },
         { "disabled",         NULL, 0, AV_OPT_TYPE_CONST, {.i64=FLAG_DISABLED},0, 0, VFR, "flags" },
+        { "stats",            NULL, 0, AV_OPT_TYPE_CONST, {.i64=FLAG_STATS},   0, 0, VFR, "flags" },
     { "rate", "set video rate", OFFSET(frame_rate), AV_OPT_TYPE_VIDEO_RATE, {.str = "25"}, 0, INT_MAX, VF },
     { "r",    "set video rate", OFFSET(frame_rate), AV_OPT_TYPE_VIDEO_RATE, {.str = "25"}, 0, INT_MAX, VF },
     { NULL }
@@ -383,6 +385,33 @@ static int draw_items(AVFilterContext *ctx,
     return 0;
 }
 
+static void draw_stats(AVFilterContext *ctx, AVFilterContext *filter,
+                       AVFrame *out, int xpos, int ypos)
+{
+    GraphMonitorContext *s = ctx->priv;
+    const AVFilterStats *st = avfilter_get_stats(filter);
+    char buffer[1024] = { 0 };
+    int len;
+
+    len = snprintf(buffer, sizeof(buffer)-1, " | time: %.1fms",
+                   st->time / 1000.0);
+    drawtext(out, xpos, ypos, buffer, len, s->white);
+    xpos += len * 8;
+    if (st->framesync_wait) {
+        len = snprintf(buffer, sizeof(buffer)-1, " | fs_wait: %.1fms",
+                       st->framesync_wait / 1000.0);
+        drawtext(out, xpos, ypos, buffer, len, s->white);
+        xpos += len * 8;
+    }
+    if (st->slice_capacity) {
+        len = snprintf(buffer, sizeof(buffer)-1, " | slices: %.1fms %.0f%%",
+                       st->slice_time / 1000.0,
+                       100.0 * st->slice_busy / st->slice_capacity);
+        drawtext(out, xpos, ypos, buffer, len, s->white);
+        xpos += len * 8;
+    }
+}
+
 static int create_frame(AVFilterContext *ctx, int64_t pts)
 {
     GraphMonitorContext *s = ctx->priv;
@@ -418,6 +447,9 @@ static int create_frame(AVFilterContext *ctx, int64_t pts)
         xpos += len * 8 + 10;
         len = strlen(filter->filter->name);
         drawtext(out, xpos, ypos, filter->filter->name, len, s->white);
+        xpos += len * 8;
+        if (s->flags & FLAG_STATS)
+            draw_stats(ctx, filter, out, xpos, ypos);
         ypos += 10;
         for (int j = 0; j < filter->nb_inputs; j++) {
             AVFilterLink *l = filter->inputs[j];
@@ -554,6 +586,9 @@ static int config_output(AVFilterLink *outlink)
     outlink->frame_rate = s->frame_rate;
     outlink->time_base = av_inv_q(s->frame_rate);
 
+    if (s->flags & FLAG_STATS)
+        outlink->src->graph->collect_stats = 1;
+
     return 0;
 }
 
@@ -20,6 +20,7 @@
 
 #include "libavutil/avassert.h"
 #include "libavutil/opt.h"
+#include "libavutil/time.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "framesync.h"
@@ -93,6 +94,7 @@ int ff_framesync_init(FFFrameSync *fs, AVFilterContext *parent, unsigned nb_in)
     ff_framesync_preinit(fs);
     fs->parent = parent;
     fs->nb_in  = nb_in;
+    fs->wait_start = AV_NOPTS_VALUE;
 
     fs->in = av_calloc(nb_in, sizeof(*fs->in));
     if (!fs->in)
@@ -352,11 +354,30 @@ static int consume_from_fifos(FFFrameSync *fs)
     return 1;
 }
 
+static void framesync_update_wait(FFFrameSync *fs)
+{
+    int waiting = 0;
+
+    if (!fs->eof && !fs->frame_ready)
+        for (unsigned i = 0; i < fs->nb_in; i++)
+            waiting |= fs->in[i].have_next;
+
+    if (waiting && fs->wait_start == AV_NOPTS_VALUE) {
+        fs->wait_start = av_gettime_relative();
+    } else if (!waiting && fs->wait_start != AV_NOPTS_VALUE) {
+        fs->parent->internal->stats.framesync_wait +=
+            av_gettime_relative() - fs->wait_start;
+        fs->wait_start = AV_NOPTS_VALUE;
+    }
+}
+
 int ff_framesync_activate(FFFrameSync *fs)
 {
     int ret;
 
     ret = framesync_advance(fs);
+    if (fs->parent->graph->collect_stats)
+        framesync_update_wait(fs);
     if (ret < 0)
         return ret;
     if (fs->eof || !fs->frame_ready)
@@ -229,6 +229,12 @@ typedef struct FFFrameSync {
     int opt_eof_action;
     int opt_ts_sync_mode;
 
+    /**
+     * Time since when a frame event is waiting for frames on some inputs,
+     * or AV_NOPTS_VALUE
+     */
+    int64_t wait_start;
+
 } FFFrameSync;
 
 /**
@@ -154,17 +154,58 @@ static void avfilter_graph_dump_to_buf(AVBPrint *buf, AVFilterGraph *graph)
     }
 }
 
+static void avfilter_graph_dump_stats_to_buf(AVBPrint *buf, AVFilterGraph *graph)
+{
+    int name_w = strlen("filter"), type_w = strlen("type");
+    int64_t total = 0;
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        total  += avfilter_get_stats(filter)->time;
+        name_w  = FFMAX(name_w, (int)strlen(filter->name));
+        type_w  = FFMAX(type_w, (int)strlen(filter->filter->name));
+    }
+
+    av_bprintf(buf, "%-*s %-*s %11s %11s %6s %10s %10s %11s %11s %6s\n",
+               name_w, "filter", type_w, "type", "activations", "time[ms]",
+               "share", "frames_in", "frames_out", "fs_wait[ms]",
+               "slices[ms]", "util");
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        const AVFilterStats *st = avfilter_get_stats(filter);
+
+        av_bprintf(buf, "%-*s %-*s %11"PRId64" %11.3f %5.1f%% %10"PRId64
+                   " %10"PRId64" %11.3f %11.3f ",
+                   name_w, filter->name, type_w, filter->filter->name,
+                   st->nb_activations, st->time / 1000.0,
+                   total ? 100.0 * st->time / total : 0.0,
+                   st->frames_in, st->frames_out,
+                   st->framesync_wait / 1000.0, st->slice_time / 1000.0);
+        if (st->slice_capacity)
+            av_bprintf(buf, "%5.1f%%\n", 100.0 * st->slice_busy / st->slice_capacity);
+        else
+            av_bprintf(buf, "%6s\n", "-");
+    }
+}
+
 char *avfilter_graph_dump(AVFilterGraph *graph, const char *options)
 {
+    void (*dump_to_buf)(AVBPrint *buf, AVFilterGraph *graph) =
+        avfilter_graph_dump_to_buf;
     AVBPrint buf;
     char *dump = NULL;
 
+    if (options && !strcmp(options, "stats"))
+        dump_to_buf = avfilter_graph_dump_stats_to_buf;
+
     av_bprint_init(&buf, 0, AV_BPRINT_SIZE_COUNT_ONLY);
-    avfilter_graph_dump_to_buf(&buf, graph);
+    dump_to_buf(&buf, graph);
     dump = av_malloc(buf.len + 1);
     if (!dump)
         return NULL;
     av_bprint_init_for_buffer(&buf, dump, buf.len + 1);
-    avfilter_graph_dump_to_buf(&buf, graph);
+    dump_to_buf(&buf, graph);
     return dump;
 }
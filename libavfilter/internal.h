@@ -141,13 +141,16 @@ struct AVFilterInternal {
     // 1 when avfilter_init_*() was successfully called on this filter
     // 0 otherwise
     int initialized;
+
+    AVFilterStats stats;
 };
 
-static av_always_inline int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
-                                              void *arg, int *ret, int nb_jobs)
-{
-    return ctx->internal->execute(ctx, func, arg, ret, nb_jobs);
-}
+/**
+ * Run func as nb_jobs slice jobs, in parallel if slice threading is enabled
+ * for the filter.
+ */
+int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                      void *arg, int *ret, int nb_jobs);
 
 enum FilterFormatsState {
     /**
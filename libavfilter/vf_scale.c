@@ -112,6 +112,14 @@ typedef struct ScaleContext {
     const AVClass *class;
     struct SwsContext *sws;     ///< software scaler context
     struct SwsContext *isws[2]; ///< software scaler context for interlaced material
+    /**
+     * Per-slice scaler contexts for slice threading, nb_slices each, for
+     * progressive material and for both fields of interlaced material.
+     * The first context of each is sws, isws[0] and isws[1] respectively.
+     */
+    struct SwsContext **slice_sws[3];
+    int nb_slices;              ///< number of output slices scaled in parallel
+    int *slice_err;             ///< per-slice return codes
     // context used for forwarding options to sws
     struct SwsContext *sws_opts;
 
@@ -353,14 +361,35 @@ static av_cold int init(AVFilterContext *ctx)
     ret = av_opt_get_int(scale->sws_opts, "threads", 0, &threads);
     if (ret < 0)
         return ret;
-    if (!threads)
+    scale->nb_slices = 1;
+    if (!threads && ctx->thread_type & AVFILTER_THREAD_SLICE) {
+        // scale slices on the filtergraph threads instead of letting every
+        // scaler context spawn its own
+        scale->nb_slices = ff_filter_get_nb_threads(ctx);
+        av_opt_set_int(scale->sws_opts, "threads", 1, 0);
+    } else if (!threads)
         av_opt_set_int(scale->sws_opts, "threads", ff_filter_get_nb_threads(ctx), 0);
 
+    scale->slice_err = av_calloc(scale->nb_slices, sizeof(*scale->slice_err));
+    if (!scale->slice_err)
+        return AVERROR(ENOMEM);
+
     scale->in_frame_range = AVCOL_RANGE_UNSPECIFIED;
 
     return 0;
 }
 
+static void free_sws(ScaleContext *scale)
+{
+    for (int i = 0; i < FF_ARRAY_ELEMS(scale->slice_sws); i++) {
+        if (scale->slice_sws[i])
+            for (int j = 0; j < scale->nb_slices; j++)
+                sws_freeContext(scale->slice_sws[i][j]);
+        av_freep(&scale->slice_sws[i]);
+    }
+    scale->isws[0] = scale->isws[1] = scale->sws = NULL;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     ScaleContext *scale = ctx->priv;
@@ -368,10 +397,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_expr_free(scale->h_pexpr);
     scale->w_pexpr = scale->h_pexpr = NULL;
     sws_freeContext(scale->sws_opts);
-    sws_freeContext(scale->sws);
-    sws_freeContext(scale->isws[0]);
-    sws_freeContext(scale->isws[1]);
-    scale->sws = NULL;
+    free_sws(scale);
+    av_freep(&scale->slice_err);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -544,13 +571,7 @@ static int config_props(AVFilterLink *outlink)
     if (outfmt == AV_PIX_FMT_PAL8) outfmt = AV_PIX_FMT_BGR8;
     scale->output_is_pal = av_pix_fmt_desc_get(outfmt)->flags & AV_PIX_FMT_FLAG_PAL;
 
-    if (scale->sws)
-        sws_freeContext(scale->sws);
-    if (scale->isws[0])
-        sws_freeContext(scale->isws[0]);
-    if (scale->isws[1])
-        sws_freeContext(scale->isws[1]);
-    scale->isws[0] = scale->isws[1] = scale->sws = NULL;
+    free_sws(scale);
     if (inlink0->w == outlink->w &&
         inlink0->h == outlink->h &&
         !scale->out_color_matrix &&
@@ -563,10 +584,16 @@ static int config_props(AVFilterLink *outlink)
 
         for (i = 0; i < 3; i++) {
             int in_v_chr_pos = scale->in_v_chr_pos, out_v_chr_pos = scale->out_v_chr_pos;
-            struct SwsContext *const s = sws_alloc_context();
+            struct SwsContext *s;
+
+            scale->slice_sws[i] = av_calloc(scale->nb_slices, sizeof(*scale->slice_sws[i]));
+            if (!scale->slice_sws[i])
+                return AVERROR(ENOMEM);
+
+            s = sws_alloc_context();
             if (!s)
                 return AVERROR(ENOMEM);
-            *swscs[i] = s;
+            *swscs[i] = scale->slice_sws[i][0] = s;
 
             ret = av_opt_copy(s, scale->sws_opts);
             if (ret < 0)
@@ -604,8 +631,21 @@ static int config_props(AVFilterLink *outlink)
             av_opt_set_int(s, "dst_h_chr_pos", scale->out_h_chr_pos, 0);
             av_opt_set_int(s, "dst_v_chr_pos", out_v_chr_pos, 0);
 
-            if ((ret = sws_init_context(s, NULL, NULL)) < 0)
-                return ret;
+            // identically configured contexts for the other slices
+            for (int j = 1; j < scale->nb_slices; j++) {
+                scale->slice_sws[i][j] = sws_alloc_context();
+                if (!scale->slice_sws[i][j])
+                    return AVERROR(ENOMEM);
+
+                ret = av_opt_copy(scale->slice_sws[i][j], s);
+                if (ret < 0)
+                    return ret;
+            }
+
+            for (int j = 0; j < scale->nb_slices; j++)
+                if ((ret = sws_init_context(scale->slice_sws[i][j], NULL, NULL)) < 0)
+                    return ret;
+
             if (!scale->interlaced)
                 break;
         }
@@ -665,9 +705,69 @@ static void frame_offset(AVFrame *frame, int dir, int is_pal)
     }
 }
 
-static int scale_field(ScaleContext *scale, AVFrame *dst, AVFrame *src,
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int sws_idx;
+} ThreadData;
+
+static int scale_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ScaleContext *scale = ctx->priv;
+    ThreadData *td = arg;
+    struct SwsContext *sws = scale->slice_sws[td->sws_idx][jobnr];
+    const int align        = sws_receive_slice_alignment(sws);
+    const int slice_height = FFALIGN(FFMAX((td->out->height + nb_jobs - 1) / nb_jobs, 1),
+                                     align);
+    const int slice_start  = jobnr * slice_height;
+    const int slice_end    = FFMIN((jobnr + 1) * slice_height, td->out->height);
+    int ret;
+
+    if (slice_end <= slice_start)
+        return 0;
+
+    ret = sws_frame_start(sws, td->out, td->in);
+    if (ret < 0)
+        return ret;
+
+    ret = sws_send_slice(sws, 0, td->in->height);
+    if (ret >= 0)
+        ret = sws_receive_slice(sws, slice_start, slice_end - slice_start);
+
+    sws_frame_end(sws);
+
+    return ret;
+}
+
+/* scale src into dst using the scaler contexts in slice_sws[sws_idx] */
+static int scale_slices(AVFilterContext *ctx, AVFrame *dst, AVFrame *src,
+                        int sws_idx)
+{
+    ScaleContext *scale = ctx->priv;
+    struct SwsContext *sws = scale->slice_sws[sws_idx][0];
+    ThreadData td = { .in = src, .out = dst, .sws_idx = sws_idx };
+    int64_t dither;
+    int nb_jobs = FFMIN(scale->nb_slices, dst->height / sws_receive_slice_alignment(sws));
+    int ret = 0;
+
+    // error diffusion dithering carries state from line to line
+    if (nb_jobs > 1 && av_opt_get_int(sws, "sws_dither", 0, &dither) >= 0 &&
+        dither == av_opt_find(sws, "ed", "sws_dither", 0, 0)->default_val.i64)
+        nb_jobs = 1;
+
+    if (nb_jobs <= 1)
+        return sws_scale_frame(sws, dst, src);
+
+    ff_filter_execute(ctx, scale_slice, &td, scale->slice_err, nb_jobs);
+    for (int i = 0; i < nb_jobs; i++)
+        ret = FFMIN(ret, scale->slice_err[i]);
+
+    return ret;
+}
+
+static int scale_field(AVFilterContext *ctx, AVFrame *dst, AVFrame *src,
                        int field)
 {
+    ScaleContext *scale = ctx->priv;
     int orig_h_src = src->height;
     int orig_h_dst = dst->height;
     int ret;
@@ -686,7 +786,7 @@ static int scale_field(ScaleContext *scale, AVFrame *dst, AVFrame *src,
     src->height /= 2;
     dst->height /= 2;
 
-    ret = sws_scale_frame(scale->isws[field], dst, src);
+    ret = scale_slices(ctx, dst, src, 1 + field);
     if (ret < 0)
         return ret;
 
@@ -864,17 +964,14 @@ scale:
         if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
             out_full = (scale->out_range == AVCOL_RANGE_JPEG);
 
-        sws_setColorspaceDetails(scale->sws, inv_table, in_full,
-                                 table, out_full,
-                                 brightness, contrast, saturation);
-        if (scale->isws[0])
-            sws_setColorspaceDetails(scale->isws[0], inv_table, in_full,
-                                     table, out_full,
-                                     brightness, contrast, saturation);
-        if (scale->isws[1])
-            sws_setColorspaceDetails(scale->isws[1], inv_table, in_full,
-                                     table, out_full,
-                                     brightness, contrast, saturation);
+        for (int i = 0; i < FF_ARRAY_ELEMS(scale->slice_sws); i++) {
+            if (!scale->slice_sws[i])
+                continue;
+            for (int j = 0; j < scale->nb_slices; j++)
+                sws_setColorspaceDetails(scale->slice_sws[i][j], inv_table, in_full,
+                                         table, out_full,
+                                         brightness, contrast, saturation);
+        }
 
         out->color_range = out_full ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
     }
@@ -886,11 +983,11 @@ scale:
 
     if (scale->interlaced>0 || (scale->interlaced<0 &&
         (in->flags & AV_FRAME_FLAG_INTERLACED))) {
-        ret = scale_field(scale, out, in, 0);
+        ret = scale_field(ctx, out, in, 0);
         if (ret >= 0)
-            ret = scale_field(scale, out, in, 1);
+            ret = scale_field(ctx, out, in, 1);
     } else {
-        ret = sws_scale_frame(scale->sws, out, in);
+        ret = scale_slices(ctx, out, in, 0);
     }
 
     av_frame_free(&in);
@@ -1072,6 +1169,7 @@ const AVFilter ff_vf_scale = {
     .uninit          = uninit,
     .priv_size       = sizeof(ScaleContext),
     .priv_class      = &scale_class,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
     FILTER_INPUTS(avfilter_vf_scale_inputs),
     FILTER_OUTPUTS(avfilter_vf_scale_outputs),
     FILTER_QUERY_FUNC(query_formats),
@@ -1114,6 +1212,7 @@ const AVFilter ff_vf_scale2ref = {
     .uninit          = uninit,
     .priv_size       = sizeof(ScaleContext),
     .priv_class      = &scale_class,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
     FILTER_INPUTS(avfilter_vf_scale2ref_inputs),
     FILTER_OUTPUTS(avfilter_vf_scale2ref_outputs),
     FILTER_QUERY_FUNC(query_formats),
@@ -1243,6 +1243,7 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_FAST_SEEK   0x80000 ///< Enable fast, but inaccurate seeks for some formats
 #define AVFMT_FLAG_SHORTEST   0x100000 ///< Stop muxing when the shortest stream stops.
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+#define AVFMT_FLAG_FAST_PROBE 0x400000 ///< Stop avformat_find_stream_info() once the codec parameters of all streams are known
 
     /**
      * Maximum number of bytes read from input in order to determine stream
@@ -1659,6 +1660,12 @@ typedef struct AVFormatContext {
      * additional internal format contexts. Thus the AVFormatContext pointer
      * passed to this callback may be different from the one facing the caller.
      * It will, however, have the same 'opaque' field.
+     *
+     * @note Some muxers and demuxers call this callback from their own
+     * threads, concurrently with the calling thread, when asked to write or
+     * read files asynchronously, e.g. with the upload_threads option of the
+     * dash and hls muxers or the prefetch_segments option of the hls
+     * demuxer. It must be thread-safe in that case.
      */
     int (*io_open)(struct AVFormatContext *s, AVIOContext **pb, const char *url,
                    int flags, AVDictionary **options);
@@ -1711,8 +1718,29 @@ typedef struct AVFormatContext {
      * @param s the format context
      * @param pb IO context to be closed and freed
      * @return 0 on success, a negative AVERROR code on failure
+     *
+     * @note Like io_open, this may be called from threads of the muxer or
+     * demuxer.
      */
     int (*io_close2)(struct AVFormatContext *s, AVIOContext *pb);
+
+    /**
+     * Number of threads used to decode the streams in parallel in
+     * avformat_find_stream_info(). 0 selects the number automatically,
+     * 1 decodes the streams serially.
+     * - encoding: unused
+     * - decoding: set by user
+     */
+    int probe_threads;
+
+    /**
+     * Directory caching the result of avformat_find_stream_info() for
+     * seekable inputs, so that probing the same input again only restores
+     * it.
+     * - encoding: unused
+     * - decoding: set by user
+     */
+    char *probe_cache;
 } AVFormatContext;
 
 /**
@@ -77,6 +77,12 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * If set, ffio_read_ref() may return references to the memory of the
+     * protocol; set for demuxers with FF_FMT_ZERO_COPY.
+     */
+    int read_ref;
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
@@ -111,6 +117,18 @@ void ffio_init_context(FFIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes from AVIOContext as a reference to the data of the
+ * underlying protocol, without copying them, if the protocol supports it.
+ * The referenced data is followed by at least AV_INPUT_BUFFER_PADDING_SIZE
+ * zero bytes, but is read-only, so this is only done if
+ * FFIOContext.read_ref is set.
+ *
+ * @return size on success, AVERROR(ENOSYS) if the data cannot be referenced,
+ *         in which case nothing was read, or another AVERROR on failure
+ */
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf);
+
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
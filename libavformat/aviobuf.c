@@ -702,6 +702,43 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_read_ref(AVIOContext *s, int size, AVBufferRef **buf)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    URLContext *h = ffio_geturlcontext(s);
+    int64_t pos = avio_tell(s), end, buffer_pos;
+    int ret;
+
+    if (!ctx->read_ref || !h || s->write_flag || s->update_checksum ||
+        size <= 0 || pos < 0)
+        return AVERROR(ENOSYS);
+
+    ret = ffurl_get_buffer(h, pos, size, buf);
+    if (ret < 0)
+        return ret;
+
+    /* skip the data, without reading it into the buffer */
+    end        = pos + size;
+    buffer_pos = s->pos - (s->buf_end - s->buffer);
+    if (end <= s->pos) {
+        s->buf_ptr = s->buffer + (end - buffer_pos);
+    } else {
+        int64_t res = s->seek(s->opaque, end, SEEK_SET);
+        if (res < 0) {
+            av_buffer_unref(buf);
+            return res;
+        }
+        s->buf_end = s->buf_ptr = s->buffer;
+        s->pos = end;
+        s->eof_reached = 0;
+    }
+
+    ctx->bytes_read += size;
+    s->bytes_read = ctx->bytes_read;
+
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -1015,7 +1052,8 @@ URLContext* ffio_geturlcontext(AVIOContext *s)
 int ffio_copy_url_options(AVIOContext* pb, AVDictionary** avio_opts)
 {
     const char *opts[] = {
-        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy", NULL };
+        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy",
+        "connection_pool", NULL };
     const char **opt = opts;
     uint8_t *buf = NULL;
     int ret = 0;
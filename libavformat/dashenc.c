@@ -52,6 +52,7 @@
 #include "isom.h"
 #include "mux.h"
 #include "os_support.h"
+#include "uploadqueue.h"
 #include "url.h"
 #include "vpcc.h"
 #include "dash.h"
@@ -68,12 +69,20 @@ enum {
     FRAG_TYPE_EVERY_FRAME,
     FRAG_TYPE_DURATION,
     FRAG_TYPE_PFRAMES,
+    FRAG_TYPE_FRAMES,
     FRAG_TYPE_NB
 };
 
 #define MPD_PROFILE_DASH 1
 #define MPD_PROFILE_DVB  2
 
+typedef struct Chunk {
+    int64_t start_pos;
+    int64_t range_length;
+    int64_t duration;  /* in the stream time base */
+    int independent;
+} Chunk;
+
 typedef struct Segment {
     char file[1024];
     int64_t start_pos;
@@ -82,6 +91,9 @@ typedef struct Segment {
     double prog_date_time;
     int64_t duration;
     int n;
+    int64_t upload_id; /* id of the asynchronous upload, 0 if written synchronously */
+    Chunk *chunks;
+    int nb_chunks;
 } Segment;
 
 typedef struct AdaptationSet {
@@ -143,6 +155,15 @@ typedef struct OutputStream {
     int64_t gop_size;
     AVRational sar;
     int coding_dependency;
+    int64_t upload_id; /* upload of the segment about to be added */
+    int frag_frames;
+    Chunk *chunks;     /* chunks of the current segment written so far */
+    int nb_chunks;
+    int chunk_frames;  /* frames muxed since the last chunk */
+    int64_t chunk_start, chunk_duration;
+    int64_t part_target; /* fixed at the first frame, no chunk is longer */
+    int part_target_exceeded;
+    int chunk_independent;
 } OutputStream;
 
 typedef struct DASHContext {
@@ -189,10 +210,13 @@ typedef struct DASHContext {
     int ignore_io_errors;
     int lhls;
     int ldash;
+    int cmaf;
     int master_publish_rate;
     int nr_of_streams_to_flush;
     int nr_of_streams_flushed;
     int frag_type;
+    int frag_frames;
+    int64_t hls_part_target;
     int write_prft;
     int64_t max_gop_size;
     int64_t max_segment_duration;
@@ -202,6 +226,11 @@ typedef struct DASHContext {
     AVRational min_playback_rate;
     AVRational max_playback_rate;
     int64_t update_period;
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    UploadQueue *upload_queue;
+    int64_t upload_completed; /* all uploads up to this id have finished */
 } DASHContext;
 
 static struct codec_string {
@@ -489,6 +518,33 @@ static void set_http_options(AVDictionary **options, DASHContext *c)
         av_dict_set_int(options, "timeout", c->timeout, 0);
 }
 
+static int upload_segment(AVFormatContext *s, OutputStream *os, int *range_length,
+                          int use_rename)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *opts = NULL;
+    uint8_t *buffer;
+    int64_t id;
+
+    av_write_frame(os->ctx, NULL);
+    *range_length = avio_close_dyn_buf(os->ctx->pb, &buffer);
+    os->ctx->pb = NULL;
+    if (!buffer)
+        return AVERROR(ENOMEM);
+
+    set_http_options(&opts, c);
+    if (c->http_persistent)
+        av_dict_set(&opts, "connection_pool", "1", 0);
+    id = ff_upload_queue_add(c->upload_queue, os->temp_path, opts, os->temp_path,
+                             use_rename ? os->full_path : NULL, buffer, *range_length);
+    av_dict_free(&opts);
+    if (id < 0)
+        return id;
+    os->upload_id = id;
+
+    return avio_open_dyn_buf(&os->ctx->pb);
+}
+
 static void get_hls_playlist_name(char *playlist_name, int string_size,
                                   const char *base_url, int id) {
     if (base_url)
@@ -497,6 +553,15 @@ static void get_hls_playlist_name(char *playlist_name, int string_size,
         snprintf(playlist_name, string_size, "media_%d.m3u8", id);
 }
 
+/* Number of segments that can be listed, leaving out those still being uploaded. */
+static int nb_complete_segments(DASHContext *c, OutputStream *os)
+{
+    int nb_segments = os->nb_segments;
+    while (nb_segments > 0 && os->segments[nb_segments - 1]->upload_id > c->upload_completed)
+        nb_segments--;
+    return nb_segments;
+}
+
 static void get_start_index_number(OutputStream *os, DASHContext *c,
                                    int *start_index, int *start_number) {
     *start_index = 0;
@@ -507,6 +572,38 @@ static void get_start_index_number(OutputStream *os, DASHContext *c,
     }
 }
 
+/* chunks of segments that are still being written can be listed as LL-HLS
+ * parts, addressed with byte ranges into the segment */
+static int write_hls_parts(DASHContext *c, OutputStream *os)
+{
+    return c->hls_playlist && c->streaming && !c->single_file &&
+           os->frag_type == FRAG_TYPE_FRAMES;
+}
+
+static int add_chunk(OutputStream *os, int64_t end_pos)
+{
+    Chunk *chunks = av_realloc_array(os->chunks, os->nb_chunks + 1, sizeof(*os->chunks));
+
+    if (!chunks)
+        return AVERROR(ENOMEM);
+    os->chunks = chunks;
+    chunks[os->nb_chunks++] = (Chunk) {
+        .start_pos    = os->chunk_start,
+        .range_length = end_pos - os->chunk_start,
+        .duration     = os->chunk_duration,
+        .independent  = os->chunk_independent,
+    };
+    os->chunk_start        = end_pos;
+    os->chunk_duration     = 0;
+    return 0;
+}
+
+static void free_segment(Segment *seg)
+{
+    av_free(seg->chunks);
+    av_free(seg);
+}
+
 static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
                                      int representation_id, int final,
                                      char *prefetch_url) {
@@ -520,11 +617,15 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     const char *proto = avio_find_protocol_name(c->dirname);
     int use_rename = proto && !strcmp(proto, "file");
     int i, start_index, start_number;
+    int nb_segments = nb_complete_segments(c, os);
     double prog_date_time = 0;
+    int parts = write_hls_parts(c, os) && !final;
+    double part_target = (double)os->part_target / timescale;
+    int64_t remaining = 0; /* duration from the current segment to the end */
 
     get_start_index_number(os, c, &start_index, &start_number);
 
-    if (!c->hls_playlist || start_index >= os->nb_segments ||
+    if (!c->hls_playlist || (start_index >= nb_segments && !(parts && os->nb_chunks)) ||
         os->segment_type != SEGMENT_TYPE_MP4)
         return;
 
@@ -540,22 +641,43 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
         handle_io_open_error(s, ret, temp_filename_hls);
         return;
     }
-    for (i = start_index; i < os->nb_segments; i++) {
+    for (i = start_index; i < nb_segments; i++) {
         Segment *seg = os->segments[i];
         double duration = (double) seg->duration / timescale;
         if (target_duration <= duration)
             target_duration = lrint(duration);
     }
 
+    if (parts && !target_duration)
+        target_duration = lrint((double)os->seg_duration / AV_TIME_BASE);
+
     ff_hls_write_playlist_header(c->m3u8_out, 6, -1, target_duration,
                                  start_number, PLAYLIST_TYPE_NONE, 0);
 
+    if (parts) {
+        ff_hls_write_server_control(c->m3u8_out, 0, 3 * part_target);
+        ff_hls_write_part_inf(c->m3u8_out, part_target);
+        for (i = start_index; i < nb_segments; i++)
+            remaining += os->segments[i]->duration;
+        for (i = 0; i < os->nb_chunks; i++)
+            remaining += os->chunks[i].duration;
+    }
+
     ff_hls_write_init_file(c->m3u8_out, os->initfile, c->single_file,
                            os->init_range_length, os->init_start_pos);
 
-    for (i = start_index; i < os->nb_segments; i++) {
+    for (i = start_index; i < nb_segments; i++) {
         Segment *seg = os->segments[i];
 
+        /* parts are only listed for the last three target durations */
+        if (parts && remaining <= 3 * target_duration * timescale) {
+            for (int j = 0; j < seg->nb_chunks; j++)
+                ff_hls_write_part(c->m3u8_out, (double) seg->chunks[j].duration / timescale,
+                                  NULL, seg->file, seg->chunks[j].independent,
+                                  seg->chunks[j].range_length, seg->chunks[j].start_pos);
+        }
+        remaining -= seg->duration;
+
         if (fabs(prog_date_time) < 1e-7) {
             if (os->nb_segments == 1)
                 prog_date_time = c->start_time_s;
@@ -574,6 +696,14 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
         }
     }
 
+    if (parts) {
+        for (i = 0; i < os->nb_chunks; i++)
+            ff_hls_write_part(c->m3u8_out, (double) os->chunks[i].duration / timescale,
+                              NULL, os->filename, os->chunks[i].independent,
+                              os->chunks[i].range_length, os->chunks[i].start_pos);
+        ff_hls_write_preload_hint(c->m3u8_out, NULL, os->filename, os->chunk_start);
+    }
+
     if (prefetch_url)
         avio_printf(c->m3u8_out, "#EXT-X-PREFETCH:%s\n", prefetch_url);
 
@@ -609,6 +739,8 @@ static void dash_free(AVFormatContext *s)
     DASHContext *c = s->priv_data;
     int i, j;
 
+    ff_upload_queue_free(&c->upload_queue);
+
     if (c->as) {
         for (i = 0; i < c->nb_as; i++) {
             av_dict_free(&c->as[i].metadata);
@@ -633,8 +765,9 @@ static void dash_free(AVFormatContext *s)
         avcodec_free_context(&os->parser_avctx);
         av_parser_close(os->parser);
         for (j = 0; j < os->nb_segments; j++)
-            av_free(os->segments[j]);
+            free_segment(os->segments[j]);
         av_free(os->segments);
+        av_freep(&os->chunks);
         av_freep(&os->single_file_name);
         av_freep(&os->init_seg_name);
         av_freep(&os->media_seg_name);
@@ -651,19 +784,20 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
 {
     DASHContext *c = s->priv_data;
     int i, start_index, start_number;
+    int nb_segments = nb_complete_segments(c, os);
     get_start_index_number(os, c, &start_index, &start_number);
 
     if (c->use_template) {
         int timescale = c->use_timeline ? os->ctx->streams[0]->time_base.den : AV_TIME_BASE;
         avio_printf(out, "\t\t\t\t<SegmentTemplate timescale=\"%d\" ", timescale);
-        if (!c->use_timeline) {
+        if (!c->use_timeline)
             avio_printf(out, "duration=\"%"PRId64"\" ", os->seg_duration);
-            if (c->streaming && os->availability_time_offset)
-                avio_printf(out, "availabilityTimeOffset=\"%.3f\" ",
-                            os->availability_time_offset);
+        if (c->streaming && os->availability_time_offset) {
+            avio_printf(out, "availabilityTimeOffset=\"%.3f\" ",
+                        os->availability_time_offset);
+            if (!final)
+                avio_printf(out, "availabilityTimeComplete=\"false\" ");
         }
-        if (c->streaming && os->availability_time_offset && !final)
-            avio_printf(out, "availabilityTimeComplete=\"false\" ");
 
         avio_printf(out, "initialization=\"%s\" media=\"%s\" startNumber=\"%d\"", os->init_seg_name, os->media_seg_name, c->use_timeline ? start_number : 1);
         if (c->presentation_time_offset)
@@ -672,7 +806,7 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
         if (c->use_timeline) {
             int64_t cur_time = 0;
             avio_printf(out, "\t\t\t\t\t<SegmentTimeline>\n");
-            for (i = start_index; i < os->nb_segments; ) {
+            for (i = start_index; i < nb_segments; ) {
                 Segment *seg = os->segments[i];
                 int repeat = 0;
                 avio_printf(out, "\t\t\t\t\t\t<S ");
@@ -681,7 +815,7 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
                     avio_printf(out, "t=\"%"PRId64"\" ", seg->time);
                 }
                 avio_printf(out, "d=\"%"PRId64"\" ", seg->duration);
-                while (i + repeat + 1 < os->nb_segments &&
+                while (i + repeat + 1 < nb_segments &&
                        os->segments[i + repeat + 1]->duration == seg->duration &&
                        os->segments[i + repeat + 1]->time == os->segments[i + repeat]->time + os->segments[i + repeat]->duration)
                     repeat++;
@@ -698,7 +832,7 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
         avio_printf(out, "\t\t\t\t<BaseURL>%s</BaseURL>\n", os->initfile);
         avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" startNumber=\"%d\">\n", AV_TIME_BASE, FFMIN(os->seg_duration, os->last_duration), start_number);
         avio_printf(out, "\t\t\t\t\t<Initialization range=\"%"PRId64"-%"PRId64"\" />\n", os->init_start_pos, os->init_start_pos + os->init_range_length - 1);
-        for (i = start_index; i < os->nb_segments; i++) {
+        for (i = start_index; i < nb_segments; i++) {
             Segment *seg = os->segments[i];
             avio_printf(out, "\t\t\t\t\t<SegmentURL mediaRange=\"%"PRId64"-%"PRId64"\" ", seg->start_pos, seg->start_pos + seg->range_length - 1);
             if (seg->index_length)
@@ -709,7 +843,7 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
     } else {
         avio_printf(out, "\t\t\t\t<SegmentList timescale=\"%d\" duration=\"%"PRId64"\" startNumber=\"%d\">\n", AV_TIME_BASE, FFMIN(os->seg_duration, os->last_duration), start_number);
         avio_printf(out, "\t\t\t\t\t<Initialization sourceURL=\"%s\" />\n", os->initfile);
-        for (i = start_index; i < os->nb_segments; i++) {
+        for (i = start_index; i < nb_segments; i++) {
             Segment *seg = os->segments[i];
             avio_printf(out, "\t\t\t\t\t<SegmentURL media=\"%s\" />\n", seg->file);
         }
@@ -1025,6 +1159,8 @@ static int parse_adaptation_sets(AVFormatContext *s)
                 as->frag_type = FRAG_TYPE_PFRAMES;
             else if (!strcmp(type_str, "every_frame"))
                 as->frag_type = FRAG_TYPE_EVERY_FRAME;
+            else if (!strcmp(type_str, "frames"))
+                as->frag_type = FRAG_TYPE_FRAMES;
             else if (!strcmp(type_str, "none"))
                 as->frag_type = FRAG_TYPE_NONE;
             else {
@@ -1165,9 +1301,12 @@ static int write_manifest(AVFormatContext *s, int final)
                 "\txsi:schemaLocation=\"urn:mpeg:DASH:schema:MPD:2011 http://standards.iso.org/ittf/PubliclyAvailableStandards/MPEG-DASH_schema_files/DASH-MPD.xsd\"\n"
                 "\tprofiles=\"");
     if (c->profile & MPD_PROFILE_DASH)
-         avio_printf(out, "%s%s", "urn:mpeg:dash:profile:isoff-live:2011", c->profile & MPD_PROFILE_DVB ? "," : "\"\n");
+         avio_printf(out, "%s%s", "urn:mpeg:dash:profile:isoff-live:2011", c->profile & MPD_PROFILE_DVB ? "," : "");
     if (c->profile & MPD_PROFILE_DVB)
-         avio_printf(out, "%s", "urn:dvb:dash:profile:dvb-dash:2014\"\n");
+         avio_printf(out, "%s", "urn:dvb:dash:profile:dvb-dash:2014");
+    if (c->cmaf)
+         avio_printf(out, "%s", ",urn:mpeg:dash:profile:cmaf:2019");
+    avio_printf(out, "\"\n");
     avio_printf(out, "\ttype=\"%s\"\n",
                 final ? "static" : "dynamic");
     if (final) {
@@ -1274,6 +1413,9 @@ static int write_manifest(AVFormatContext *s, int final)
         }
 
         ff_hls_write_playlist_version(c->m3u8_out, 7);
+        // every CMAF segment starts with a keyframe
+        if (c->cmaf)
+            avio_printf(c->m3u8_out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
 
         if (c->has_video) {
             // treat audio streams as alternative renditions for video streams
@@ -1286,13 +1428,16 @@ static int write_manifest(AVFormatContext *s, int final)
                 char playlist_file[64];
                 AVStream *st = s->streams[i];
                 OutputStream *os = &c->streams[i];
+                AVDictionaryEntry *lang;
                 if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
                     continue;
                 if (os->segment_type != SEGMENT_TYPE_MP4)
                     continue;
+                lang = c->cmaf ? av_dict_get(st->metadata, "language", NULL, 0) : NULL;
                 get_hls_playlist_name(playlist_file, sizeof(playlist_file), NULL, i);
                 ff_hls_write_audio_rendition(c->m3u8_out, (char *)audio_group,
-                                             playlist_file, NULL, i, is_default);
+                                             playlist_file, lang ? lang->value : NULL,
+                                             i, is_default);
                 max_audio_bitrate = FFMAX(st->codecpar->bit_rate +
                                           os->muxer_overhead, max_audio_bitrate);
                 if (!av_strnstr(audio_codec_str, os->codec_str, sizeof(audio_codec_str))) {
@@ -1411,6 +1556,18 @@ static int dash_init(AVFormatContext *s)
         c->hls_playlist = 1;
     }
 
+    if (c->cmaf) {
+        if (c->segment_type_option == SEGMENT_TYPE_WEBM) {
+            av_log(s, AV_LOG_ERROR, "CMAF requires mp4 segments\n");
+            return AVERROR(EINVAL);
+        }
+        c->segment_type_option = SEGMENT_TYPE_MP4;
+        if (!c->hls_playlist) {
+            av_log(s, AV_LOG_INFO, "Enabling hls_playlist as CMAF is enabled\n");
+            c->hls_playlist = 1;
+        }
+    }
+
     if (c->ldash && !c->streaming) {
         av_log(s, AV_LOG_WARNING, "Enabling streaming as LDash is enabled\n");
         c->streaming = 1;
@@ -1430,6 +1587,21 @@ static int dash_init(AVFormatContext *s)
         av_log(s, AV_LOG_WARNING, "Global SIDX option will be ignored as streaming is enabled\n");
         c->global_sidx = 0;
     }
+
+    if (c->upload_threads) {
+        if (c->single_file || c->streaming) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous upload is not supported with "
+                   "single_file or streaming, uploading synchronously\n");
+        } else {
+            ret = ff_upload_queue_alloc(&c->upload_queue, s, c->upload_threads,
+                                        c->upload_queue_size, c->upload_retries);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "Asynchronous upload requires threads, "
+                       "uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
     if (c->frag_type == FRAG_TYPE_NONE && c->streaming) {
         av_log(s, AV_LOG_VERBOSE, "Changing frag_type from none to every_frame as streaming is enabled\n");
         c->frag_type = FRAG_TYPE_EVERY_FRAME;
@@ -1614,6 +1786,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         os->seg_duration = as->seg_duration;
         os->frag_duration = as->frag_duration;
         os->frag_type = as->frag_type;
+        os->frag_frames = c->frag_frames;
 
         c->max_segment_duration = FFMAX(c->max_segment_duration, as->seg_duration);
 
@@ -1635,6 +1808,10 @@ FF_ENABLE_DEPRECATION_WARNINGS
                 av_log(s, AV_LOG_WARNING, "frag_type set to P-Frame reordering, but no parser found for stream %d\n", i);
             os->frag_type = c->streaming ? FRAG_TYPE_EVERY_FRAME : FRAG_TYPE_NONE;
         }
+        if (os->frag_type == FRAG_TYPE_FRAMES && os->segment_type != SEGMENT_TYPE_MP4) {
+            av_log(s, AV_LOG_WARNING, "frag_type set to frames for stream %d but the segments are not mp4\n", i);
+            os->frag_type = c->streaming ? FRAG_TYPE_EVERY_FRAME : FRAG_TYPE_NONE;
+        }
         if (os->frag_type != FRAG_TYPE_PFRAMES && as->trick_idx < 0)
             // Set this now if a parser isn't used
             os->coding_dependency = 1;
@@ -1656,6 +1833,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
                 av_dict_set(&opts, "movflags", "+frag_custom", AV_DICT_APPEND);
             if (os->frag_type == FRAG_TYPE_DURATION)
                 av_dict_set_int(&opts, "frag_duration", os->frag_duration, 0);
+            if (c->cmaf)
+                av_dict_set(&opts, "movflags", "+cmaf", AV_DICT_APPEND);
             if (c->write_prft)
                 av_dict_set(&opts, "write_prft", "wallclock", 0);
         } else {
@@ -1786,6 +1965,15 @@ static int add_segment(OutputStream *os, const char *file,
     seg->start_pos = start_pos;
     seg->range_length = range_length;
     seg->index_length = index_length;
+    seg->upload_id = os->upload_id;
+    os->upload_id = 0;
+    seg->chunks    = os->chunks;
+    seg->nb_chunks = os->nb_chunks;
+    os->chunks     = NULL;
+    os->nb_chunks  = 0;
+    os->chunk_frames = 0;
+    os->chunk_start = 0;
+    os->chunk_duration = 0;
     os->segments[os->nb_segments++] = seg;
     os->segment_index++;
     //correcting the segment index if it has fallen behind the expected value
@@ -1905,11 +2093,21 @@ static int dashenc_delete_segment_file(AVFormatContext *s, const char* file)
 
 static inline void dashenc_delete_media_segments(AVFormatContext *s, OutputStream *os, int remove_count)
 {
+    DASHContext *c = s->priv_data;
+
+    /* segments still being uploaded are removed by a later call */
+    for (int i = 0; i < remove_count; i++) {
+        if (os->segments[i]->upload_id > c->upload_completed) {
+            remove_count = i;
+            break;
+        }
+    }
+
     for (int i = 0; i < remove_count; ++i) {
         dashenc_delete_segment_file(s, os->segments[i]->file);
 
         // Delete the segment regardless of whether the file was successfully deleted
-        av_free(os->segments[i]);
+        free_segment(os->segments[i]);
     }
 
     os->nb_segments -= remove_count;
@@ -1967,17 +2165,20 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
         if (c->single_file)
             snprintf(os->full_path, sizeof(os->full_path), "%s%s", c->dirname, os->initfile);
 
-        ret = flush_dynbuf(c, os, &range_length);
+        if (c->upload_queue)
+            ret = upload_segment(s, os, &range_length, use_rename);
+        else
+            ret = flush_dynbuf(c, os, &range_length);
         if (ret < 0)
             break;
         os->packets_written = 0;
 
         if (c->single_file) {
             find_index_range(s, os->full_path, os->pos, &index_length);
-        } else {
+        } else if (!c->upload_queue) {
             dashenc_io_close(s, &os->out, os->temp_path);
 
-            if (use_rename) {
+            if (use_rename && strcmp(os->temp_path, os->full_path)) {
                 ret = ff_rename(os->temp_path, os->full_path, os->ctx);
                 if (ret < 0)
                     break;
@@ -1996,6 +2197,9 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
         if (!os->bit_rate && !os->first_segment_bit_rate) {
             os->first_segment_bit_rate = (int64_t) range_length * 8 * AV_TIME_BASE / duration;
         }
+        if (write_hls_parts(c, os) && range_length > os->chunk_start &&
+            (ret = add_chunk(os, range_length)) < 0)
+            break;
         add_segment(os, os->filename, os->start_pts, os->max_pts - os->start_pts, os->pos, range_length, index_length, next_exp_index);
         av_log(s, AV_LOG_VERBOSE, "Representation %d media segment %d written to: %s\n", i, os->segment_index, os->full_path);
 
@@ -2042,9 +2246,16 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
 
             c->nr_of_streams_flushed = 0;
         }
+        if (final && c->upload_queue) {
+            ret = ff_upload_queue_flush(c->upload_queue);
+            if (ret < 0 && !c->ignore_io_errors)
+                return ret;
+            c->upload_completed = INT64_MAX;
+        }
         // In streaming mode the manifest is written at the beginning
-        // of the segment instead
-        if (!c->streaming || final)
+        // of the segment instead, uploaded segments are added to the
+        // manifest once they are complete
+        if ((!c->streaming && !c->upload_queue) || final)
             ret = write_manifest(s, final);
     }
     return ret;
@@ -2076,6 +2287,23 @@ static int dash_parse_prft(DASHContext *c, AVPacket *pkt)
     return 0;
 }
 
+/* Publish the manifest when new segments are complete. */
+static int poll_uploads(AVFormatContext *s)
+{
+    DASHContext *c = s->priv_data;
+    int64_t completed;
+    int ret;
+
+    ret = ff_upload_queue_poll(c->upload_queue, &completed);
+    if (ret < 0 && !c->ignore_io_errors)
+        return ret;
+    if (completed == c->upload_completed)
+        return 0;
+    c->upload_completed = completed;
+
+    return write_manifest(s, 0);
+}
+
 static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     DASHContext *c = s->priv_data;
@@ -2083,8 +2311,12 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     OutputStream *os = &c->streams[pkt->stream_index];
     AdaptationSet *as = &c->as[os->as_idx - 1];
     int64_t seg_end_duration, elapsed_duration;
+    int chunk_written = 0;
     int ret;
 
+    if (c->upload_queue && (ret = poll_uploads(s)) < 0)
+        return ret;
+
     ret = update_stream_extradata(s, os, pkt, &st->avg_frame_rate);
     if (ret < 0)
         return ret;
@@ -2130,7 +2362,8 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     if (!os->availability_time_offset &&
         ((os->frag_type == FRAG_TYPE_DURATION && os->seg_duration != os->frag_duration) ||
-         (os->frag_type == FRAG_TYPE_EVERY_FRAME && pkt->duration))) {
+         ((os->frag_type == FRAG_TYPE_EVERY_FRAME ||
+           os->frag_type == FRAG_TYPE_FRAMES) && pkt->duration))) {
         AdaptationSet *as = &c->as[os->as_idx - 1];
         int64_t frame_duration = 0;
 
@@ -2141,6 +2374,10 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         case FRAG_TYPE_EVERY_FRAME:
             frame_duration = av_rescale_q(pkt->duration, st->time_base, AV_TIME_BASE_Q);
             break;
+        case FRAG_TYPE_FRAMES:
+            frame_duration = av_rescale_q(pkt->duration * os->frag_frames,
+                                          st->time_base, AV_TIME_BASE_Q);
+            break;
         }
 
          os->availability_time_offset = ((double) os->seg_duration -
@@ -2240,6 +2477,28 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         c->max_gop_size = FFMAX(c->max_gop_size, os->gop_size);
     }
 
+    if (write_hls_parts(c, os) && pkt->duration) {
+        if (!os->part_target)
+            os->part_target = c->hls_part_target ?
+                              av_rescale_q(c->hls_part_target, AV_TIME_BASE_Q, st->time_base) :
+                              pkt->duration * os->frag_frames;
+        if (pkt->duration > os->part_target && !os->part_target_exceeded) {
+            av_log(s, AV_LOG_WARNING, "Frame longer than the part target of stream %d, "
+                   "set hls_part_target\n", pkt->stream_index);
+            os->part_target_exceeded = 1;
+        }
+        // close the chunk before the frame instead of exceeding the target
+        if (os->chunk_frames &&
+            os->chunk_duration + pkt->duration > os->part_target) {
+            if ((ret = av_write_frame(os->ctx, NULL)) < 0)
+                return ret;
+            os->chunk_frames = 0;
+            if ((ret = add_chunk(os, avio_tell(os->ctx->pb))) < 0)
+                return ret;
+            chunk_written = 1;
+        }
+    }
+
     if ((ret = ff_write_chained(os->ctx, 0, pkt, s, 0)) < 0)
         return ret;
 
@@ -2247,6 +2506,11 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     os->total_pkt_size += pkt->size;
     os->total_pkt_duration += pkt->duration;
     os->last_flags = pkt->flags;
+    if (os->frag_type == FRAG_TYPE_FRAMES) {
+        if (!os->chunk_frames++)
+            os->chunk_independent = !!(pkt->flags & AV_PKT_FLAG_KEY);
+        os->chunk_duration += pkt->duration;
+    }
 
     if (!os->init_range_length)
         flush_init_segment(s, os);
@@ -2255,7 +2519,8 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (!c->single_file && os->packets_written == 1) {
         AVDictionary *opts = NULL;
         const char *proto = avio_find_protocol_name(s->url);
-        int use_rename = proto && !strcmp(proto, "file");
+        // chunks are readable while the segment is written
+        int use_rename = proto && !strcmp(proto, "file") && !write_hls_parts(c, os);
         if (os->segment_type == SEGMENT_TYPE_MP4)
             write_styp(os->ctx->pb);
         os->filename[0] = os->full_path[0] = os->temp_path[0] = '\0';
@@ -2266,11 +2531,14 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
                  os->filename);
         snprintf(os->temp_path, sizeof(os->temp_path),
                  use_rename ? "%s.tmp" : "%s", os->full_path);
-        set_http_options(&opts, c);
-        ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
-        av_dict_free(&opts);
-        if (ret < 0) {
-            return handle_io_open_error(s, ret, os->temp_path);
+        // an uploaded segment is only written once it is complete
+        if (!c->upload_queue) {
+            set_http_options(&opts, c);
+            ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
+            av_dict_free(&opts);
+            if (ret < 0) {
+                return handle_io_open_error(s, ret, os->temp_path);
+            }
         }
 
         // in streaming mode, the segments are available for playing
@@ -2286,6 +2554,20 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         }
     }
 
+    // complete the chunk right away instead of when the next frame arrives,
+    // which needs the duration of its last frame
+    if (os->frag_type == FRAG_TYPE_FRAMES && os->chunk_frames >= os->frag_frames &&
+        pkt->duration) {
+        if ((ret = av_write_frame(os->ctx, NULL)) < 0)
+            return ret;
+        os->chunk_frames = 0;
+        if (write_hls_parts(c, os)) {
+            if ((ret = add_chunk(os, avio_tell(os->ctx->pb))) < 0)
+                return ret;
+            chunk_written = 1;
+        }
+    }
+
     //write out the data immediately in streaming mode
     if (c->streaming && os->segment_type == SEGMENT_TYPE_MP4) {
         int len = 0;
@@ -2299,6 +2581,9 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         os->written_len = len;
     }
 
+    if (chunk_written)
+        write_hls_media_playlist(os, s, pkt->stream_index, 0, NULL);
+
     return ret;
 }
 
@@ -2378,6 +2663,9 @@ static const AVOption options[] = {
     { "every_frame", "fragment at every frame", 0, AV_OPT_TYPE_CONST, {.i64 = FRAG_TYPE_EVERY_FRAME }, 0, UINT_MAX, E, "frag_type"},
     { "duration", "fragment at specific time intervals", 0, AV_OPT_TYPE_CONST, {.i64 = FRAG_TYPE_DURATION }, 0, UINT_MAX, E, "frag_type"},
     { "pframes", "fragment at keyframes and following P-Frame reordering (Video only, experimental)", 0, AV_OPT_TYPE_CONST, {.i64 = FRAG_TYPE_PFRAMES }, 0, UINT_MAX, E, "frag_type"},
+    { "frames", "fragment every frag_frames frames, written as soon as the last frame is muxed (mp4 only)", 0, AV_OPT_TYPE_CONST, {.i64 = FRAG_TYPE_FRAMES }, 0, UINT_MAX, E, "frag_type"},
+    { "frag_frames", "number of frames per fragment with frag_type frames", OFFSET(frag_frames), AV_OPT_TYPE_INT, { .i64 = 1 }, 1, INT_MAX, E },
+    { "hls_part_target", "LL-HLS part target duration, frag_frames times the first frame duration if 0", OFFSET(hls_part_target), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT_MAX, E },
     { "remove_at_exit", "remove all segments when finished", OFFSET(remove_at_exit), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "use_template", "Use SegmentTemplate instead of SegmentList", OFFSET(use_template), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { "use_timeline", "Use SegmentTimeline in SegmentTemplate", OFFSET(use_timeline), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
@@ -2403,6 +2691,7 @@ static const AVOption options[] = {
     { "ignore_io_errors", "Ignore IO errors during open and write. Useful for long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "lhls", "Enable Low-latency HLS(Experimental). Adds #EXT-X-PREFETCH tag with current segment's URI", OFFSET(lhls), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "ldash", "Enable Low-latency dash. Constrains the value of a few elements", OFFSET(ldash), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { "cmaf", "Write CMAF segments and reference them from both the DASH and the HLS manifests", OFFSET(cmaf), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "master_m3u8_publish_rate", "Publish master playlist every after this many segment intervals", OFFSET(master_publish_rate), AV_OPT_TYPE_INT, {.i64 = 0}, 0, UINT_MAX, E},
     { "write_prft", "Write producer reference time element", OFFSET(write_prft), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, E},
     { "mpd_profile", "Set profiles. Elements and values used in the manifest may be constrained by them", OFFSET(profile), AV_OPT_TYPE_FLAGS, {.i64 = MPD_PROFILE_DASH }, 0, UINT_MAX, E, "mpd_profile"},
@@ -2413,6 +2702,9 @@ static const AVOption options[] = {
     { "min_playback_rate", "Set desired minimum playback rate", OFFSET(min_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "max_playback_rate", "Set desired maximum playback rate", OFFSET(max_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "upload_threads", "Number of threads uploading segments asynchronously", OFFSET(upload_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E },
+    { "upload_queue_size", "Maximum number of segments being uploaded asynchronously", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 8}, 1, INT_MAX, E },
+    { "upload_retries", "Number of times a failed asynchronous segment upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 1}, 0, INT_MAX, E },
     { NULL },
 };
 
@@ -31,6 +31,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/time.h"
 #include "libavutil/timestamp.h"
 
@@ -45,6 +46,7 @@
 #include "demux.h"
 #include "id3v2.h"
 #include "internal.h"
+#include "probecache.h"
 #include "url.h"
 
 static int64_t wrap_timestamp(const AVStream *st, int64_t timestamp)
@@ -257,6 +259,9 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
         goto fail;
     s->probe_score = ret;
 
+    if (s->pb && s->iformat->flags_internal & FF_FMT_ZERO_COPY)
+        ffiocontext(s->pb)->read_ref = 1;
+
     if (!s->protocol_whitelist && s->pb && s->pb->protocol_whitelist) {
         s->protocol_whitelist = av_strdup(s->pb->protocol_whitelist);
         if (!s->protocol_whitelist) {
@@ -2439,6 +2444,161 @@ static int add_coded_side_data(AVStream *st, AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * State for decoding the probed packets of several streams in parallel.
+ * Packets are collected in demuxing order and decoded in batches, with one
+ * job per stream, so every decoder still sees its packets in order.
+ */
+typedef struct ProbeThread {
+    AVSliceThread   *thread;
+    AVFormatContext *ic;
+    AVDictionary   **options;
+    int              orig_nb_streams;
+
+    AVPacket       **pkts;
+    /* codec_info_nb_frames of the packet's stream when it was read */
+    int             *pkt_nb_frames;
+    int              nb_pkts;
+    int              max_pkts;
+
+    /* stream index of each job */
+    int             *streams;
+    unsigned         streams_size;
+} ProbeThread;
+
+static void probe_thread_worker(void *priv, int jobnr, int threadnr,
+                                int nb_jobs, int nb_threads)
+{
+    ProbeThread *const pt = priv;
+    const int idx         = pt->streams[jobnr];
+    AVStream *const st    = pt->ic->streams[idx];
+    FFStream *const sti   = ffstream(st);
+    const int nb_frames   = sti->codec_info_nb_frames;
+
+    for (int i = 0; i < pt->nb_pkts; i++) {
+        if (pt->pkts[i]->stream_index != idx)
+            continue;
+        /* decode the packet as if it had just been read */
+        sti->codec_info_nb_frames = pt->pkt_nb_frames[i];
+        try_decode_frame(pt->ic, st, pt->pkts[i],
+                         (pt->options && idx < pt->orig_nb_streams) ?
+                         &pt->options[idx] : NULL);
+    }
+    sti->codec_info_nb_frames = nb_frames;
+}
+
+static void probe_thread_free(ProbeThread **ppt)
+{
+    ProbeThread *pt = *ppt;
+
+    if (!pt)
+        return;
+
+    avpriv_slicethread_free(&pt->thread);
+    for (int i = 0; i < pt->max_pkts && pt->pkts; i++)
+        av_packet_free(&pt->pkts[i]);
+    av_freep(&pt->pkts);
+    av_freep(&pt->pkt_nb_frames);
+    av_freep(&pt->streams);
+    av_freep(ppt);
+}
+
+static int probe_thread_init(ProbeThread **ppt, AVFormatContext *ic,
+                             AVDictionary **options, int orig_nb_streams)
+{
+    ProbeThread *pt;
+    int ret;
+
+    *ppt = NULL;
+    if (ic->probe_threads == 1 ||
+        (ic->nb_streams < 2 && !(ic->ctx_flags & AVFMTCTX_NOHEADER)))
+        return 0;
+
+    pt = av_mallocz(sizeof(*pt));
+    if (!pt)
+        return AVERROR(ENOMEM);
+    pt->ic              = ic;
+    pt->options         = options;
+    pt->orig_nb_streams = orig_nb_streams;
+    /* larger batches decode in parallel for longer, but read further ahead
+     * of the point where the probing could have stopped */
+    pt->max_pkts        = FFMAX(2 * ic->nb_streams, 16);
+
+    pt->pkts          = av_calloc(pt->max_pkts, sizeof(*pt->pkts));
+    pt->pkt_nb_frames = av_calloc(pt->max_pkts, sizeof(*pt->pkt_nb_frames));
+    if (!pt->pkts || !pt->pkt_nb_frames) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < pt->max_pkts; i++) {
+        pt->pkts[i] = av_packet_alloc();
+        if (!pt->pkts[i]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    ret = avpriv_slicethread_create(&pt->thread, pt, probe_thread_worker,
+                                    NULL, ic->probe_threads);
+    if (ret < 0)
+        goto fail;
+    if (ret < 2) {
+        probe_thread_free(&pt);
+        return 0;
+    }
+
+    av_log(ic, AV_LOG_DEBUG, "Probing streams with %d threads\n", ret);
+    *ppt = pt;
+    return 0;
+
+fail:
+    probe_thread_free(&pt);
+    /* no threading support, probe serially */
+    return ret == AVERROR(ENOSYS) ? 0 : ret;
+}
+
+static int probe_thread_queue(ProbeThread *pt, const AVPacket *pkt)
+{
+    const FFStream *const sti = cffstream(pt->ic->streams[pkt->stream_index]);
+    int ret = av_packet_ref(pt->pkts[pt->nb_pkts], pkt);
+
+    if (ret < 0)
+        return ret;
+    pt->pkt_nb_frames[pt->nb_pkts++] = sti->codec_info_nb_frames;
+    return 0;
+}
+
+static int probe_thread_decode(ProbeThread *pt)
+{
+    AVFormatContext *const ic = pt->ic;
+    int nb_jobs = 0;
+
+    if (!pt->nb_pkts)
+        return 0;
+
+    av_fast_malloc(&pt->streams, &pt->streams_size,
+                   ic->nb_streams * sizeof(*pt->streams));
+    if (!pt->streams)
+        return AVERROR(ENOMEM);
+
+    for (unsigned i = 0; i < ic->nb_streams; i++) {
+        for (int j = 0; j < pt->nb_pkts; j++) {
+            if (pt->pkts[j]->stream_index == i) {
+                pt->streams[nb_jobs++] = i;
+                break;
+            }
+        }
+    }
+
+    avpriv_slicethread_execute(pt->thread, nb_jobs, 0);
+
+    for (int i = 0; i < pt->nb_pkts; i++)
+        av_packet_unref(pt->pkts[i]);
+    pt->nb_pkts = 0;
+
+    return 0;
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     FFFormatContext *const si = ffformatcontext(ic);
@@ -2454,10 +2614,30 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t max_subtitle_analyze_duration;
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
+    int analyzed_all_streams = 0;
+    int complete = 1;
+    char cache_key[PROBE_CACHE_KEY_SIZE] = "";
+    ProbeThread *pt = NULL;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
 
     flush_codecs = probesize > 0;
 
+    /* Streams of formats without a header are only created while reading
+     * packets, so only formats with a header can be restored. */
+    if (ic->probe_cache && !(ic->ctx_flags & AVFMTCTX_NOHEADER) &&
+        ff_probe_cache_key(ic, cache_key) >= 0) {
+        ret = ff_probe_cache_load(ic, cache_key);
+        if (ret >= 0) {
+            av_log(ic, AV_LOG_VERBOSE, "Stream info restored from the probe cache\n");
+            ret = update_stream_avctx(ic);
+            goto find_stream_info_err;
+        }
+        if (ret != AVERROR(ENOENT))
+            av_log(ic, AV_LOG_VERBOSE, "Ignoring unusable probe cache entry %s\n",
+                   cache_key);
+        ret = 0;
+    }
+
     av_opt_set_int(ic, "skip_clear", 1, AV_OPT_SEARCH_CHILDREN);
 
     max_stream_analyze_duration = max_analyze_duration;
@@ -2534,13 +2714,17 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             av_dict_free(&thread_opt);
     }
 
+    ret = probe_thread_init(&pt, ic, options, orig_nb_streams);
+    if (ret < 0)
+        goto find_stream_info_err;
+
     read_size = 0;
     for (;;) {
         const AVPacket *pkt;
         AVStream *st;
         FFStream *sti;
         AVCodecContext *avctx;
-        int analyzed_all_streams;
+        int deferred = 0;
         unsigned i;
         if (ff_check_interrupt(&ic->interrupt_callback)) {
             ret = AVERROR_EXIT;
@@ -2548,8 +2732,20 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             break;
         }
 
+        /* When decoding in parallel, the decoder state is only checked
+         * once a full batch of packets has been decoded. */
+        if (pt) {
+            if (pt->nb_pkts && pt->nb_pkts < pt->max_pkts && read_size < probesize) {
+                deferred = 1;
+            } else {
+                ret = probe_thread_decode(pt);
+                if (ret < 0)
+                    goto find_stream_info_err;
+            }
+        }
+
         /* check if one codec still needs to be handled */
-        for (i = 0; i < ic->nb_streams; i++) {
+        for (i = 0; !deferred && i < ic->nb_streams; i++) {
             AVStream *const st  = ic->streams[i];
             FFStream *const sti = ffstream(st);
             int fps_analyze_framecount = 20;
@@ -2557,6 +2753,13 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
             if (!has_codec_parameters(st, NULL))
                 break;
+            if (ic->flags & AVFMT_FLAG_FAST_PROBE) {
+                if (!sti->avctx->extradata &&
+                    (!sti->extract_extradata.inited || sti->extract_extradata.bsf) &&
+                    extract_extradata_check(st))
+                    break;
+                continue;
+            }
             /* If the timebase is coarse (like the usual millisecond precision
              * of mkv), we need to analyze more frames to reliably arrive at
              * the correct fps. */
@@ -2592,13 +2795,16 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                  st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO))
                 break;
         }
-        analyzed_all_streams = 0;
-        if (!missing_streams || !*missing_streams)
+        if (!deferred)
+            analyzed_all_streams = 0;
+        if (!deferred && (!missing_streams || !*missing_streams))
             if (i == ic->nb_streams) {
                 analyzed_all_streams = 1;
                 /* NOTE: If the format has no header, then we need to read some
-                 * packets to get most of the streams, so we cannot stop here. */
-                if (!(ic->ctx_flags & AVFMTCTX_NOHEADER)) {
+                 * packets to get most of the streams, so we cannot stop here,
+                 * unless the caller accepts missing streams that appear later. */
+                if (!(ic->ctx_flags & AVFMTCTX_NOHEADER) ||
+                    (ic->flags & AVFMT_FLAG_FAST_PROBE)) {
                     /* If we found the info for all the codecs, we can stop. */
                     ret = count;
                     av_log(ic, AV_LOG_DEBUG, "All info found\n");
@@ -2763,8 +2969,14 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
          * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+        if (pt) {
+            ret = probe_thread_queue(pt, pkt);
+            if (ret < 0)
+                goto unref_then_goto_end;
+        } else {
+            try_decode_frame(ic, st, pkt,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
+        }
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(pkt1);
@@ -2773,6 +2985,15 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         count++;
     }
 
+    if (pt) {
+        int err = probe_thread_decode(pt);
+        probe_thread_free(&pt);
+        if (err < 0) {
+            ret = err;
+            goto find_stream_info_err;
+        }
+    }
+
     if (eof_reached) {
         for (unsigned stream_index = 0; stream_index < ic->nb_streams; stream_index++) {
             AVStream *const st = ic->streams[stream_index];
@@ -2948,6 +3169,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                    "Could not find codec parameters for stream %d (%s): %s\n"
                    "Consider increasing the value for the 'analyzeduration' (%"PRId64") and 'probesize' (%"PRId64") options\n",
                    i, buf, errmsg, ic->max_analyze_duration, ic->probesize);
+            complete = 0;
         } else {
             ret = 0;
         }
@@ -2974,7 +3196,15 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         sti->avctx_inited = 0;
     }
 
+    if (*cache_key && complete) {
+        int err = ff_probe_cache_store(ic, cache_key);
+        if (err < 0)
+            av_log(ic, AV_LOG_WARNING, "Could not write probe cache entry: %s\n",
+                   av_err2str(err));
+    }
+
 find_stream_info_err:
+    probe_thread_free(&pt);
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
         FFStream *const sti = ffstream(st);
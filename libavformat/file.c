@@ -22,9 +22,11 @@
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -36,11 +38,21 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
 #  ifdef S_IFIFO
@@ -88,6 +100,48 @@
 
 /* standard file protocol */
 
+#if HAVE_IO_URING
+enum URingSlotState {
+    SLOT_FREE,
+    SLOT_PENDING,       ///< read in flight
+    SLOT_DONE,          ///< data (or an error) available
+    SLOT_STALE,         ///< cancelled, the kernel may still write to the buffer
+};
+
+typedef struct URingSlot {
+    enum URingSlotState state;
+    uint64_t user_data; ///< identifies the last read queued for the slot
+    int64_t pos;        ///< file offset of the block
+    int filled;         ///< bytes read into data so far
+    int eof;            ///< the end of the file was reached within the block
+    int err;
+    uint8_t *data;
+    struct iovec iov;
+} URingSlot;
+
+typedef struct URing {
+    int fd;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned to_submit;     ///< queued requests not yet passed to the kernel
+    unsigned in_flight;     ///< requests whose completion was not reaped yet
+    uint64_t nb_reads;      ///< number of reads queued so far
+
+    URingSlot *slots;
+    int nb_slots;
+    int block_size;
+    uint8_t *buf;
+    int64_t pos;            ///< logical read position
+    int64_t window;         ///< block the read-ahead window was last set up for
+    int64_t size;           ///< file size, bounds the read-ahead
+} URing;
+#endif
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -95,6 +149,14 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int use_mmap;
+    int64_t map_size;   ///< file size if packets are mapped from it, 0 otherwise
+    int use_uring;
+    int uring_depth;
+    int uring_window;
+#if HAVE_IO_URING
+    URing *ring;
+#endif
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -105,6 +167,10 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "map the file into memory and make packets reference it instead of copying", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring", "read through io_uring, keeping reads ahead of the current position in flight", offsetof(FileContext, use_uring), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring_depth", "set the maximum number of io_uring reads in flight", offsetof(FileContext, uring_depth), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 256, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring_window", "set the io_uring read-ahead window in bytes", offsetof(FileContext, uring_window), AV_OPT_TYPE_INT, { .i64 = 8 << 20 }, 4096, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -135,11 +201,382 @@ static const AVClass fd_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if HAVE_IO_URING
+/* io_uring read-ahead: the file is split into blocks of block_size bytes and
+ * the nb_slots blocks starting at the current position are kept in flight.
+ * Blocks that fall out of the window after a seek are cancelled. */
+
+/* The user_data of a read is its sequence number followed by the slot index,
+ * so that a late cancel request cannot hit a later read reusing the slot. */
+#define URING_SLOT_BITS 16
+#define URING_CANCEL    UINT64_MAX
+
+static int uring_enter(URing *r, int wait)
+{
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait,
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return AVERROR(errno);
+
+    r->to_submit -= FFMIN(ret, r->to_submit);
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(URing *r)
+{
+    unsigned head = atomic_load_explicit((atomic_uint *)r->sq_head,
+                                         memory_order_acquire);
+    unsigned tail = *r->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - head >= r->sq_entries)
+        return NULL;
+
+    sqe = &r->sqes[tail & *r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void uring_commit_sqe(URing *r)
+{
+    unsigned tail = *r->sq_tail;
+
+    r->sq_array[tail & *r->sq_mask] = tail & *r->sq_mask;
+    atomic_store_explicit((atomic_uint *)r->sq_tail, tail + 1,
+                          memory_order_release);
+    r->to_submit++;
+    r->in_flight++;
+}
+
+static int uring_queue_read(URing *r, int fd, int idx)
+{
+    URingSlot *s = &r->slots[idx];
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+
+    if (!sqe)
+        return AVERROR(EAGAIN);
+
+    s->iov.iov_base = s->data     + s->filled;
+    s->iov.iov_len  = r->block_size - s->filled;
+
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = fd;
+    sqe->addr      = (uintptr_t)&s->iov;
+    sqe->len       = 1;
+    sqe->off       = s->pos + s->filled;
+    sqe->user_data = s->user_data = r->nb_reads++ << URING_SLOT_BITS | idx;
+    uring_commit_sqe(r);
+
+    s->state = SLOT_PENDING;
+    return 0;
+}
+
+static void uring_cancel(URing *r, int idx)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+
+    /* without a cancel request the read simply runs to completion */
+    if (sqe) {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->fd        = -1;
+        sqe->addr      = r->slots[idx].user_data;
+        sqe->user_data = URING_CANCEL;
+        uring_commit_sqe(r);
+    }
+    r->slots[idx].state = SLOT_STALE;
+}
+
+static void uring_reap(URing *r, int fd)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = atomic_load_explicit((atomic_uint *)r->cq_tail,
+                                         memory_order_acquire);
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        URingSlot *s;
+
+        r->in_flight--;
+        if (cqe->user_data == URING_CANCEL)
+            continue;
+
+        s = &r->slots[cqe->user_data & ((1 << URING_SLOT_BITS) - 1)];
+        if (s->user_data != cqe->user_data)
+            continue;
+        if (s->state == SLOT_STALE) {
+            s->state = SLOT_FREE;
+            continue;
+        }
+
+        s->state = SLOT_DONE;
+        if (cqe->res < 0) {
+            s->err = AVERROR(-cqe->res);
+        } else if (!cqe->res) {
+            s->eof = 1;
+        } else {
+            s->filled += cqe->res;
+            /* short read, not necessarily the end of the file; if the rest
+             * cannot be queued now, uring_read() does it when needed */
+            if (s->filled < r->block_size)
+                uring_queue_read(r, fd, s - r->slots);
+        }
+    }
+
+    atomic_store_explicit((atomic_uint *)r->cq_head, head, memory_order_release);
+}
+
+static int uring_fill(URing *r, int fd, int64_t first)
+{
+    int64_t end = first + (int64_t)r->nb_slots * r->block_size;
+    int free_idx = 0;
+
+    for (int i = 0; i < r->nb_slots; i++) {
+        URingSlot *s = &r->slots[i];
+
+        if (s->state == SLOT_FREE || s->state == SLOT_STALE ||
+            (s->pos >= first && s->pos < end))
+            continue;
+        if (s->state == SLOT_PENDING)
+            uring_cancel(r, i);
+        else
+            s->state = SLOT_FREE;
+    }
+
+    for (int64_t pos = first; pos < end; pos += r->block_size) {
+        int i, ret;
+
+        if (pos > first && pos >= r->size)
+            break;
+
+        for (i = 0; i < r->nb_slots; i++)
+            if ((r->slots[i].state == SLOT_PENDING ||
+                 r->slots[i].state == SLOT_DONE) && r->slots[i].pos == pos)
+                break;
+        if (i < r->nb_slots)
+            continue;
+
+        while (free_idx < r->nb_slots && r->slots[free_idx].state != SLOT_FREE)
+            free_idx++;
+        if (free_idx == r->nb_slots)
+            break;
+
+        r->slots[free_idx] = (URingSlot){ .pos  = pos,
+                                          .data = r->slots[free_idx].data };
+        ret = uring_queue_read(r, fd, free_idx);
+        if (ret < 0)
+            break;
+    }
+
+    return r->to_submit ? uring_enter(r, 0) : 0;
+}
+
+static int uring_read(URLContext *h, unsigned char *buf, int size)
+{
+    FileContext *c = h->priv_data;
+    URing *r = c->ring;
+
+    for (;;) {
+        int64_t block = r->pos - r->pos % r->block_size;
+        URingSlot *s = NULL;
+        int ret;
+
+        uring_reap(r, c->fd);
+
+        if (block != r->window) {
+            ret = uring_fill(r, c->fd, block);
+            if (ret < 0)
+                return ret;
+            r->window = block;
+        }
+
+        for (int i = 0; i < r->nb_slots; i++)
+            if ((r->slots[i].state == SLOT_PENDING ||
+                 r->slots[i].state == SLOT_DONE) && r->slots[i].pos == block)
+                s = &r->slots[i];
+
+        if (!s || s->state == SLOT_PENDING) {
+            /* all slots may still be owned by cancelled reads */
+            if (!s)
+                r->window = -1;
+            if (!r->in_flight)
+                return AVERROR_BUG;
+            ret = uring_enter(r, 1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+
+        if (s->err) {
+            ret = s->err;
+            s->state = SLOT_FREE;
+            r->window = -1;
+            return ret;
+        }
+
+        if (r->pos >= s->pos + s->filled) {
+            if (s->eof)
+                return AVERROR_EOF;
+            /* the rest of a short read is still missing */
+            ret = uring_queue_read(r, c->fd, s - r->slots);
+            if (ret < 0 && ret != AVERROR(EAGAIN))
+                return ret;
+            ret = uring_enter(r, 1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+
+        size = FFMIN(size, s->pos + s->filled - r->pos);
+        memcpy(buf, s->data + (r->pos - s->pos), size);
+        r->pos += size;
+        return size;
+    }
+}
+
+static int64_t uring_seek(URLContext *h, int64_t pos, int whence)
+{
+    FileContext *c = h->priv_data;
+    URing *r = c->ring;
+    struct stat st;
+
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += r->pos;
+        break;
+    case SEEK_END:
+        if (fstat(c->fd, &st) < 0)
+            return AVERROR(errno);
+        r->size = st.st_size;
+        pos += st.st_size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    /* reads outside the new window are cancelled by the next uring_read() */
+    r->pos = pos;
+    return pos;
+}
+
+static void uring_free(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    URing *r = c->ring;
+
+    if (!r)
+        return;
+
+    if (r->slots) {
+        for (int i = 0; i < r->nb_slots; i++)
+            if (r->slots[i].state == SLOT_PENDING)
+                uring_cancel(r, i);
+        /* the buffers must outlive every read the kernel may still perform */
+        while (r->in_flight) {
+            if (uring_enter(r, 1) < 0)
+                break;
+            uring_reap(r, c->fd);
+        }
+    }
+
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring)
+        munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    av_freep(&r->slots);
+    av_freep(&r->buf);
+    av_freep(&c->ring);
+}
+
+static void *uring_mmap(int fd, size_t size, off_t offset)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int uring_init(URLContext *h, const struct stat *st)
+{
+    FileContext *c = h->priv_data;
+    struct io_uring_params p = { 0 };
+    URing *r;
+    int ret;
+
+    r = c->ring = av_mallocz(sizeof(*r));
+    if (!r)
+        return AVERROR(ENOMEM);
+
+    /* every slot may have a read and a cancel request outstanding */
+    r->fd = syscall(__NR_io_uring_setup, 2 * c->uring_depth, &p);
+    if (r->fd < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size    = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_ring = uring_mmap(r->fd, r->sq_ring_size, IORING_OFF_SQ_RING);
+    r->cq_ring = uring_mmap(r->fd, r->cq_ring_size, IORING_OFF_CQ_RING);
+    r->sqes    = uring_mmap(r->fd, r->sqes_size,    IORING_OFF_SQES);
+    if (!r->sq_ring || !r->cq_ring || !r->sqes) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+
+    r->sq_head    = (unsigned *)((uint8_t *)r->sq_ring + p.sq_off.head);
+    r->sq_tail    = (unsigned *)((uint8_t *)r->sq_ring + p.sq_off.tail);
+    r->sq_mask    = (unsigned *)((uint8_t *)r->sq_ring + p.sq_off.ring_mask);
+    r->sq_array   = (unsigned *)((uint8_t *)r->sq_ring + p.sq_off.array);
+    r->cq_head    = (unsigned *)((uint8_t *)r->cq_ring + p.cq_off.head);
+    r->cq_tail    = (unsigned *)((uint8_t *)r->cq_ring + p.cq_off.tail);
+    r->cq_mask    = (unsigned *)((uint8_t *)r->cq_ring + p.cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)((uint8_t *)r->cq_ring + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+
+    r->nb_slots   = c->uring_depth;
+    r->block_size = FFALIGN(FFMAX(c->uring_window / c->uring_depth, 4096), 4096);
+    r->window     = -1;
+    r->size       = st->st_size;
+    r->buf   = av_malloc_array(r->nb_slots, r->block_size);
+    r->slots = av_calloc(r->nb_slots, sizeof(*r->slots));
+    if (!r->buf || !r->slots) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < r->nb_slots; i++)
+        r->slots[i].data = r->buf + (size_t)i * r->block_size;
+
+    av_log(h, AV_LOG_DEBUG, "io_uring read-ahead with %d reads of %d bytes\n",
+           r->nb_slots, r->block_size);
+    return 0;
+
+fail:
+    uring_free(h);
+    return ret;
+}
+#endif /* HAVE_IO_URING */
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if HAVE_IO_URING
+    if (c->ring)
+        return uring_read(h, buf, size);
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -218,7 +655,13 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+
+#if HAVE_IO_URING
+    uring_free(h);
+#endif
+
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -234,6 +677,11 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+#if HAVE_IO_URING
+    if (c->ring)
+        return uring_seek(h, pos, whence);
+#endif
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -241,6 +689,63 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    size_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+
+    munmap((void *)((uintptr_t)data & ~page_mask), (size_t)(uintptr_t)opaque);
+}
+#endif
+
+/**
+ * Map the pages of the file holding size bytes at pos privately, so that
+ * zeroing the padding only copies the last page, while the others stay
+ * shared with the page cache.
+ */
+static int file_get_buffer(URLContext *h, int64_t pos, int size,
+                           AVBufferRef **buf)
+{
+#if HAVE_MMAP
+    FileContext *c = h->priv_data;
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t offset;
+    size_t len;
+    uint8_t *data;
+
+    /* mapping costs more than copying less than a page */
+    if (!c->map_size || pos < 0 || size < page_size ||
+        pos + size > c->map_size)
+        return AVERROR(ENOSYS);
+
+    /* the padding must not extend past the last page of the file, which
+     * cannot be accessed through the mapping */
+    offset = pos & ~(page_size - 1);
+    len    = FFALIGN(pos - offset + size + AV_INPUT_BUFFER_PADDING_SIZE,
+                     page_size);
+    if (offset + len > FFALIGN(c->map_size, page_size))
+        return AVERROR(ENOSYS);
+
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, c->fd, offset);
+    if (data == MAP_FAILED)
+        return AVERROR(ENOSYS);
+
+    memset(data + (pos - offset) + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    mprotect(data, len, PROT_READ);
+
+    *buf = av_buffer_create(data + (pos - offset), size, file_unmap,
+                            (void *)(uintptr_t)len, AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        munmap(data, len);
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int file_delete(URLContext *h)
 {
 #if HAVE_UNISTD_H
@@ -315,6 +820,30 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+#if HAVE_MMAP
+    /* the packets are mapped on demand in file_get_buffer() */
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow &&
+        !h->is_streamed && !fstat(fd, &st)) {
+        if (S_ISREG(st.st_mode) && st.st_size > 0)
+            c->map_size = st.st_size;
+        else
+            av_log(h, AV_LOG_VERBOSE, "Not mapping %s, reading it instead\n",
+                   h->filename);
+    }
+#endif
+
+    if (c->use_uring && !c->map_size && !(flags & AVIO_FLAG_WRITE) && !c->follow &&
+        !h->is_streamed && !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+#if HAVE_IO_URING
+        int ret = uring_init(h, &st);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "io_uring unavailable, reading %s "
+                   "synchronously: %s\n", h->filename, av_err2str(ret));
+#else
+        av_log(h, AV_LOG_WARNING, "io_uring support not compiled in\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -410,6 +939,7 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+    .url_get_buffer      = file_get_buffer,
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
@@ -37,6 +37,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
@@ -85,6 +86,31 @@ struct segment {
 };
 
 struct rendition;
+struct playlist;
+
+/*
+ * A segment downloaded ahead into memory by a prefetch thread. The data can
+ * be read while the download is still running.
+ */
+struct segment_prefetch {
+    struct playlist *pls; /* only used as a key, not accessed by the threads */
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    int64_t distance;     /* segments ahead of the current one, for ordering */
+    AVDictionary *opts;
+
+    int running;
+    int done;
+    int cancelled;
+    int ret;
+
+    uint8_t *buf;
+    unsigned int buf_size;
+    unsigned int data_len;
+    unsigned int read_pos;
+};
 
 enum PlaylistType {
     PLS_TYPE_UNSPECIFIED,
@@ -105,6 +131,7 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    struct segment_prefetch *prefetch; /* current segment, if prefetched */
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -228,6 +255,25 @@ typedef struct HLSContext {
     int seg_max_retry;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
+
+    int prefetch_segments;
+    int64_t prefetch_buffer_size;
+#if HAVE_THREADS
+    pthread_t *prefetch_threads;
+    int nb_prefetch_threads;
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_work; /* signaled when jobs are queued */
+    pthread_cond_t prefetch_data; /* signaled when data was downloaded */
+    int prefetch_init;
+    int prefetch_quit;
+    struct segment_prefetch **prefetch;
+    int n_prefetch;
+    int64_t prefetch_bytes;
+    /* running averages of the completed downloads */
+    int64_t prefetch_latency;   /* time until the response starts, in us */
+    int64_t prefetch_rate;      /* bytes per second of one connection */
+    int64_t prefetch_seg_size;  /* bytes */
+#endif
 } HLSContext;
 
 static void free_segment_dynarray(struct segment **segments, int n_segments)
@@ -1056,16 +1102,416 @@ static struct segment *next_segment(struct playlist *pls)
     return pls->segments[n];
 }
 
+#if HAVE_THREADS
+#define PREFETCH_CHUNK_SIZE (64 * 1024)
+
+/* Must be called with prefetch_lock held. */
+static void prefetch_free(HLSContext *c, struct segment_prefetch *job)
+{
+    c->prefetch_bytes -= job->data_len;
+    av_freep(&job->url);
+    av_dict_free(&job->opts);
+    av_freep(&job->buf);
+    av_free(job);
+}
+
+/* Must be called with prefetch_lock held. The job has to be removed from
+ * the queue already. A running job is freed by its thread. */
+static void prefetch_discard(HLSContext *c, struct segment_prefetch *job)
+{
+    if (job->running && !job->done)
+        job->cancelled = 1;
+    else
+        prefetch_free(c, job);
+}
+
+static void prefetch_update_avg(int64_t *avg, int64_t val)
+{
+    *avg = *avg ? (*avg * 7 + val) / 8 : FFMAX(val, 1);
+}
+
+/* Number of segments to download ahead, enough to hide the request latency
+ * behind the transfer of the preceding segments. */
+static int prefetch_window(HLSContext *c)
+{
+    int64_t seg_time;
+
+    if (!c->prefetch_rate || !c->prefetch_seg_size)
+        return c->prefetch_segments;
+
+    seg_time = FFMAX(c->prefetch_seg_size * 1000000 / c->prefetch_rate, 1);
+    return av_clip64(1 + c->prefetch_latency / seg_time, 1, c->prefetch_segments);
+}
+
+static void prefetch_download(HLSContext *c, struct segment_prefetch *job,
+                              AVIOContext **pb, uint8_t *chunk)
+{
+    AVFormatContext *s = c->ctx;
+    int64_t start = av_gettime_relative(), opened;
+    int64_t total = 0;
+    int is_http = 0, ret;
+
+    ret = open_url(s, pb, job->url, &job->opts, NULL, &is_http);
+    /* see open_input() */
+    if (ret >= 0 && !is_http && job->url_offset) {
+        int64_t seekret = avio_seek(*pb, job->url_offset, SEEK_SET);
+        if (seekret < 0)
+            ret = seekret;
+    }
+    opened = av_gettime_relative();
+
+    while (ret >= 0) {
+        int len = PREFETCH_CHUNK_SIZE;
+        uint8_t *buf;
+
+        if (job->size >= 0)
+            len = FFMIN(len, job->size - total);
+        if (len <= 0)
+            break;
+        ret = avio_read(*pb, chunk, len);
+        if (ret == AVERROR_EOF || !ret) {
+            ret = 0;
+            break;
+        }
+        if (ret < 0)
+            break;
+
+        pthread_mutex_lock(&c->prefetch_lock);
+        if (job->cancelled || c->prefetch_quit) {
+            pthread_mutex_unlock(&c->prefetch_lock);
+            ret = AVERROR_EXIT;
+            break;
+        }
+        buf = job->data_len <= UINT_MAX - ret ?
+              av_fast_realloc(job->buf, &job->buf_size, job->data_len + ret) : NULL;
+        if (!buf) {
+            pthread_mutex_unlock(&c->prefetch_lock);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        job->buf = buf;
+        memcpy(job->buf + job->data_len, chunk, ret);
+        job->data_len     += ret;
+        c->prefetch_bytes += ret;
+        total             += ret;
+        pthread_cond_broadcast(&c->prefetch_data);
+        pthread_mutex_unlock(&c->prefetch_lock);
+    }
+
+    /* Only a completely read response leaves the connection reusable. */
+    if (ret < 0 || !is_http || !c->http_persistent)
+        ff_format_io_close(s, pb);
+
+    if (ret < 0 && ret != AVERROR_EXIT)
+        av_log(s, AV_LOG_WARNING, "Failed to prefetch segment %"PRId64": %s\n",
+               job->seq_no, av_err2str(ret));
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    if (ret >= 0 && total) {
+        int64_t elapsed = av_gettime_relative() - opened;
+        prefetch_update_avg(&c->prefetch_latency, opened - start);
+        prefetch_update_avg(&c->prefetch_rate, total * 1000000 / FFMAX(elapsed, 1));
+        prefetch_update_avg(&c->prefetch_seg_size, total);
+    }
+    job->ret  = ret;
+    job->done = 1;
+    if (job->cancelled)
+        prefetch_free(c, job);
+    pthread_cond_broadcast(&c->prefetch_data);
+    pthread_mutex_unlock(&c->prefetch_lock);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    HLSContext *c = arg;
+    AVIOContext *pb = NULL;
+    uint8_t *chunk = av_malloc(PREFETCH_CHUNK_SIZE);
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    while (chunk && !c->prefetch_quit) {
+        struct segment_prefetch *job = NULL;
+
+        /* pick the queued segment that is needed first */
+        if (c->prefetch_bytes < c->prefetch_buffer_size) {
+            for (int i = 0; i < c->n_prefetch; i++) {
+                struct segment_prefetch *cur = c->prefetch[i];
+                if (!cur->running && (!job || cur->distance < job->distance))
+                    job = cur;
+            }
+        }
+        if (!job) {
+            pthread_cond_wait(&c->prefetch_work, &c->prefetch_lock);
+            continue;
+        }
+
+        job->running = 1;
+        pthread_mutex_unlock(&c->prefetch_lock);
+        prefetch_download(c, job, &pb, chunk);
+        pthread_mutex_lock(&c->prefetch_lock);
+    }
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    ff_format_io_close(c->ctx, &pb);
+    av_free(chunk);
+    return NULL;
+}
+
+static int prefetch_init(HLSContext *c)
+{
+    int ret;
+
+    if ((ret = pthread_mutex_init(&c->prefetch_lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&c->prefetch_work, NULL))) {
+        pthread_mutex_destroy(&c->prefetch_lock);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&c->prefetch_data, NULL))) {
+        pthread_cond_destroy(&c->prefetch_work);
+        pthread_mutex_destroy(&c->prefetch_lock);
+        return AVERROR(ret);
+    }
+    c->prefetch_init = 1;
+
+    c->prefetch_threads = av_calloc(c->prefetch_segments, sizeof(*c->prefetch_threads));
+    if (!c->prefetch_threads)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < c->prefetch_segments; i++) {
+        if ((ret = pthread_create(&c->prefetch_threads[i], NULL, prefetch_thread, c)))
+            return AVERROR(ret);
+        c->nb_prefetch_threads++;
+    }
+
+    return 0;
+}
+
+static void prefetch_uninit(HLSContext *c)
+{
+    if (!c->prefetch_init)
+        return;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    c->prefetch_quit = 1;
+    pthread_cond_broadcast(&c->prefetch_work);
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    for (int i = 0; i < c->nb_prefetch_threads; i++)
+        pthread_join(c->prefetch_threads[i], NULL);
+    av_freep(&c->prefetch_threads);
+    c->nb_prefetch_threads = 0;
+
+    for (int i = 0; i < c->n_prefetch; i++)
+        prefetch_free(c, c->prefetch[i]);
+    av_freep(&c->prefetch);
+    c->n_prefetch = 0;
+    for (int i = 0; i < c->n_playlists; i++) {
+        if (c->playlists[i]->prefetch)
+            prefetch_free(c, c->playlists[i]->prefetch);
+        c->playlists[i]->prefetch = NULL;
+    }
+
+    pthread_cond_destroy(&c->prefetch_data);
+    pthread_cond_destroy(&c->prefetch_work);
+    pthread_mutex_destroy(&c->prefetch_lock);
+    c->prefetch_init = 0;
+}
+
+/* Must be called with prefetch_lock held. */
+static void prefetch_remove(HLSContext *c, int i)
+{
+    c->prefetch[i] = c->prefetch[--c->n_prefetch];
+}
+
+/* Release the current segment of pls and drop all its queued segments. */
+static void prefetch_cancel(HLSContext *c, struct playlist *pls)
+{
+    if (!c->prefetch_init)
+        return;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    for (int i = c->n_prefetch - 1; i >= 0; i--) {
+        if (c->prefetch[i]->pls == pls) {
+            struct segment_prefetch *job = c->prefetch[i];
+            prefetch_remove(c, i);
+            prefetch_discard(c, job);
+        }
+    }
+    if (pls->prefetch)
+        prefetch_discard(c, pls->prefetch);
+    pls->prefetch = NULL;
+    pthread_cond_broadcast(&c->prefetch_work);
+    pthread_mutex_unlock(&c->prefetch_lock);
+}
+
+/* Release the current, completely read segment of pls. */
+static void prefetch_release(HLSContext *c, struct playlist *pls)
+{
+    pthread_mutex_lock(&c->prefetch_lock);
+    prefetch_discard(c, pls->prefetch);
+    pls->prefetch = NULL;
+    pthread_cond_broadcast(&c->prefetch_work);
+    pthread_mutex_unlock(&c->prefetch_lock);
+}
+
+/* Queue the segments following the current one of pls and drop those
+ * that are not needed anymore. */
+static int prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int window, ret = 0;
+
+    if (!c->prefetch_init)
+        return 0;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    window = prefetch_window(c);
+
+    for (int i = c->n_prefetch - 1; i >= 0; i--) {
+        struct segment_prefetch *job = c->prefetch[i];
+        if (job->pls != pls)
+            continue;
+        job->distance = job->seq_no - pls->cur_seq_no;
+        /* the current segment is kept for prefetch_take() */
+        if (job->distance < 0 || job->distance > c->prefetch_segments) {
+            prefetch_remove(c, i);
+            prefetch_discard(c, job);
+        }
+    }
+
+    for (int k = 1; k <= window && c->prefetch_bytes < c->prefetch_buffer_size; k++) {
+        int64_t n = pls->cur_seq_no - pls->start_seq_no + k;
+        struct segment_prefetch *job;
+        struct segment *seg;
+        int queued = 0;
+
+        if (n < 0 || n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        /* keys and decryption are handled by open_input() only */
+        if (seg->key_type != KEY_NONE)
+            break;
+
+        for (int i = 0; i < c->n_prefetch && !queued; i++)
+            queued = c->prefetch[i]->pls == pls &&
+                     c->prefetch[i]->seq_no == pls->cur_seq_no + k;
+        if (queued)
+            continue;
+
+        job = av_mallocz(sizeof(*job));
+        if (!job || !(job->url = av_strdup(seg->url))) {
+            av_free(job);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        job->pls        = pls;
+        job->seq_no     = pls->cur_seq_no + k;
+        job->distance   = k;
+        job->url_offset = seg->url_offset;
+        job->size       = seg->size;
+        /* copied, as open_url() updates the cookies in it */
+        av_dict_copy(&job->opts, c->avio_opts, 0);
+        if (c->http_persistent)
+            av_dict_set(&job->opts, "multiple_requests", "1", 0);
+        if (seg->size >= 0) {
+            av_dict_set_int(&job->opts, "offset", seg->url_offset, 0);
+            av_dict_set_int(&job->opts, "end_offset", seg->url_offset + seg->size, 0);
+        }
+        if ((ret = av_dynarray_add_nofree(&c->prefetch, &c->n_prefetch, job)) < 0) {
+            prefetch_free(c, job);
+            break;
+        }
+    }
+
+    pthread_cond_broadcast(&c->prefetch_work);
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    return ret;
+}
+
+/* Hand the current segment of pls over to it, if it is being prefetched. */
+static struct segment_prefetch *prefetch_take(HLSContext *c, struct playlist *pls)
+{
+    struct segment_prefetch *job = NULL;
+
+    if (!c->prefetch_init)
+        return NULL;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    for (int i = 0; i < c->n_prefetch; i++) {
+        if (c->prefetch[i]->pls == pls && c->prefetch[i]->seq_no == pls->cur_seq_no) {
+            job = c->prefetch[i];
+            prefetch_remove(c, i);
+            break;
+        }
+    }
+    /* open segments that have not been started or failed directly, so
+     * that the usual retry logic applies */
+    if (job && (!job->running || (job->done && job->ret < 0 && !job->data_len))) {
+        prefetch_discard(c, job);
+        job = NULL;
+    }
+    if (job)
+        job->distance = 0;
+    pthread_cond_broadcast(&c->prefetch_work);
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    if (job)
+        av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetched segment %"PRId64", playlist %d\n",
+               job->seq_no, pls->index);
+
+    return job;
+}
+
+static int prefetch_read(HLSContext *c, struct segment_prefetch *job,
+                         uint8_t *buf, int buf_size)
+{
+    int ret;
+
+    pthread_mutex_lock(&c->prefetch_lock);
+    while (!job->done && job->read_pos == job->data_len) {
+        int64_t t = av_gettime() + 100000;
+        struct timespec tv = { .tv_sec  =  t / 1000000,
+                               .tv_nsec = (t % 1000000) * 1000 };
+        pthread_cond_timedwait(&c->prefetch_data, &c->prefetch_lock, &tv);
+        if (ff_check_interrupt(c->interrupt_callback)) {
+            pthread_mutex_unlock(&c->prefetch_lock);
+            return AVERROR_EXIT;
+        }
+    }
+    if (job->read_pos < job->data_len) {
+        ret = FFMIN(buf_size, job->data_len - job->read_pos);
+        memcpy(buf, job->buf + job->read_pos, ret);
+        job->read_pos += ret;
+    } else {
+        ret = job->ret < 0 ? job->ret : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&c->prefetch_lock);
+
+    return ret;
+}
+#else
+static void prefetch_uninit(HLSContext *c) { }
+static void prefetch_cancel(HLSContext *c, struct playlist *pls) { }
+static void prefetch_release(HLSContext *c, struct playlist *pls) { }
+static int  prefetch_schedule(HLSContext *c, struct playlist *pls) { return 0; }
+static struct segment_prefetch *prefetch_take(HLSContext *c, struct playlist *pls) { return NULL; }
+static int  prefetch_read(HLSContext *c, struct segment_prefetch *job,
+                          uint8_t *buf, int buf_size) { return AVERROR_BUG; }
+#endif
+
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
+    HLSContext *c = pls->parent->priv_data;
     int ret;
 
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->prefetch)
+        ret = prefetch_read(c, pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1480,7 +1926,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if (!v->prefetch && (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1488,6 +1934,7 @@ restart:
         v->needed = playlist_needed(v);
 
         if (!v->needed) {
+            prefetch_cancel(c, v);
             av_log(v->parent, AV_LOG_INFO, "No longer receiving playlist %d ('%s')\n",
                    v->index, v->url);
             return AVERROR_EOF;
@@ -1551,7 +1998,15 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if ((ret = prefetch_schedule(c, v)) < 0)
+            return ret;
+
+        if ((v->prefetch = prefetch_take(c, v))) {
+            /* a persistent connection in v->input is kept for later */
+            v->input_read_done = !!v->input;
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1623,7 +2078,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->prefetch) {
+        prefetch_release(c, v);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1916,6 +2373,7 @@ static int hls_close(AVFormatContext *s)
 {
     HLSContext *c = s->priv_data;
 
+    prefetch_uninit(c);
     free_playlist_list(c);
     free_variant_list(c);
     free_rendition_list(c);
@@ -1950,6 +2408,17 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments) {
+#if HAVE_THREADS
+        /* the prefetch threads already keep several requests in flight */
+        c->http_multiple = 0;
+        if ((ret = prefetch_init(c)) < 0)
+            return ret;
+#else
+        av_log(s, AV_LOG_WARNING, "Segment prefetching requires threads, disabling it\n");
+#endif
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
@@ -2087,6 +2556,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            prefetch_cancel(c, pls);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2239,6 +2709,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            prefetch_cancel(c, pls);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2495,6 +2966,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_cancel(c, pls);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2584,6 +3056,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Maximum number of segments to download ahead in parallel, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 32, FLAGS},
+    {"prefetch_buffer_size", "Maximum amount of prefetched segment data to buffer",
+        OFFSET(prefetch_buffer_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 1, INT64_MAX, FLAGS},
     {NULL}
 };
 
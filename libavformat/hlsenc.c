@@ -55,6 +55,7 @@
 #include "internal.h"
 #include "mux.h"
 #include "os_support.h"
+#include "uploadqueue.h"
 
 typedef enum {
     HLS_START_SEQUENCE_AS_START_NUMBER = 0,
@@ -75,6 +76,12 @@ typedef enum {
 #define BUFSIZE (16 * 1024)
 #define POSTFIX_PATTERN "_%d"
 
+typedef struct HLSPart {
+    char *filename;
+    double duration; /* in seconds */
+    int independent;
+} HLSPart;
+
 typedef struct HLSSegment {
     char filename[MAX_URL_SIZE];
     char sub_filename[MAX_URL_SIZE];
@@ -91,6 +98,10 @@ typedef struct HLSSegment {
 
     struct HLSSegment *next;
     double discont_program_date_time;
+    int64_t upload_id; /* id of the asynchronous upload, 0 if written synchronously */
+
+    HLSPart *parts;
+    int nb_parts;
 } HLSSegment;
 
 typedef enum HLSFlags {
@@ -185,6 +196,16 @@ typedef struct VariantStream {
     const char *sgroup;   /* subtitle group name */
     const char *ccgroup;  /* closed caption group name */
     const char *varname;  /* variant name */
+
+    int64_t upload_id;           /* upload of the segment about to be appended */
+    int64_t published_upload_id; /* upload of the last segment in the playlist */
+
+    HLSPart *parts;         /* parts of the current segment written so far */
+    int nb_parts;
+    int part_offset;        /* bytes of the current segment written as parts */
+    int64_t part_start_pts; /* start of the current part, in the reference stream time base */
+    int part_independent;
+    AVIOContext *part_out;
 } VariantStream;
 
 typedef struct ClosedCaptionsStream {
@@ -258,6 +279,15 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+
+    int upload_threads;
+    int upload_queue_size;
+    int upload_retries;
+    UploadQueue *upload_queue;
+    int64_t upload_completed; /* all uploads up to this id have finished */
+
+    int64_t part_time;      // Set by a private option.
+    int can_block_reload;
 } HLSContext;
 
 static int strftime_expand(const char *fmt, char **dest)
@@ -559,6 +589,171 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
     avio_write(vs->out, vs->temp_buffer, *range_length);
 }
 
+static int upload_segment(AVFormatContext *s, VariantStream *vs, const char *filename,
+                          AVDictionary **options, int use_temp_file)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *ctx = vs->avf;
+    char *final_filename = NULL;
+    uint8_t *buffer;
+    int64_t id;
+    int size, ret;
+
+    av_write_frame(ctx, NULL);
+
+    if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+        AVIOContext *pb;
+        int data_size;
+        uint8_t *data;
+
+        if ((ret = avio_open_dyn_buf(&pb)) < 0)
+            return ret;
+        write_styp(pb);
+        data_size = avio_get_dyn_buf(ctx->pb, &data);
+        avio_write(pb, data, data_size);
+        ffio_free_dyn_buf(&ctx->pb);
+        size = avio_close_dyn_buf(pb, &buffer);
+    } else {
+        size = avio_close_dyn_buf(ctx->pb, &buffer);
+        ctx->pb = NULL;
+    }
+    if (!buffer)
+        return AVERROR(ENOMEM);
+
+    if (use_temp_file) {
+        final_filename = av_strndup(ctx->url, strlen(ctx->url) - 4);
+        if (!final_filename) {
+            av_free(buffer);
+            return AVERROR(ENOMEM);
+        }
+    }
+    if (hls->http_persistent)
+        av_dict_set(options, "connection_pool", "1", 0);
+    id = ff_upload_queue_add(hls->upload_queue, filename, *options,
+                             ctx->url, final_filename, buffer, size);
+    av_free(final_filename);
+    if (id < 0)
+        return id;
+    vs->upload_id = id;
+
+    return avio_open_dyn_buf(&ctx->pb);
+}
+
+/* name of part index of the current segment: the segment name with
+ * ".part<index>" inserted before the extension */
+static char *get_part_filename(HLSContext *hls, VariantStream *vs, int index)
+{
+    const char *url = vs->avf->url;
+    size_t len = strlen(url);
+    const char *ext = NULL;
+
+    if ((hls->flags & HLS_TEMP_FILE) && len > 4 && !strcmp(url + len - 4, ".tmp"))
+        len -= 4;
+    for (const char *p = url; p < url + len; p++) {
+        if (*p == '.')
+            ext = p;
+        else if (*p == '/')
+            ext = NULL;
+    }
+    if (!ext)
+        ext = url + len;
+
+    return av_asprintf("%.*s.part%d%.*s", (int)(ext - url), url, index,
+                       (int)(url + len - ext), ext);
+}
+
+/**
+ * Write the media data of the current segment buffered since the last part
+ * to a new part file.
+ *
+ * @return 1 if a part was written, 0 if there is no media data yet
+ */
+static int hls_flush_part(AVFormatContext *s, VariantStream *vs, double duration)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    const char *proto = avio_find_protocol_name(oc->url);
+    int use_temp_file = proto && !strcmp(proto, "file") && (hls->flags & HLS_TEMP_FILE);
+    AVDictionary *options = NULL;
+    char *filename, *temp_filename;
+    HLSPart *parts, *part;
+    uint8_t *buffer;
+    int size, ret;
+
+    av_write_frame(oc, NULL);
+
+    if (!vs->init_range_length) {
+        /* the first flush only writes the moov, unless a track has no
+         * sample yet; the samples follow in the next fragment */
+        if (!avio_get_dyn_buf(oc->pb, &buffer))
+            return 0;
+        vs->init_range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
+        avio_write(vs->out, vs->init_buffer, vs->init_range_length);
+        if (!hls->resend_init_file)
+            av_freep(&vs->init_buffer);
+        vs->packets_written = 0;
+        vs->start_pos = vs->init_range_length;
+        hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+        if ((ret = avio_open_dyn_buf(&oc->pb)) < 0)
+            return ret;
+        av_write_frame(oc, NULL);
+    }
+
+    size = avio_get_dyn_buf(oc->pb, &buffer);
+    if (size <= vs->part_offset)
+        return 0;
+
+    filename = get_part_filename(hls, vs, vs->nb_parts);
+    if (!filename)
+        return AVERROR(ENOMEM);
+    temp_filename = use_temp_file ? av_asprintf("%s.tmp", filename) : filename;
+    if (!temp_filename) {
+        av_free(filename);
+        return AVERROR(ENOMEM);
+    }
+
+    set_http_options(s, &options, hls);
+    ret = hlsenc_io_open(s, &vs->part_out, temp_filename, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+               "Failed to open file '%s'\n", temp_filename);
+        goto fail;
+    }
+    avio_write(vs->part_out, buffer + vs->part_offset, size - vs->part_offset);
+    ret = hlsenc_io_close(s, &vs->part_out, temp_filename);
+    if (ret < 0)
+        goto fail;
+    if (use_temp_file && (ret = ff_rename(temp_filename, filename, s)) < 0)
+        goto fail;
+    vs->part_offset = size;
+
+    parts = av_realloc_array(vs->parts, vs->nb_parts + 1, sizeof(*vs->parts));
+    if (!parts) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    vs->parts = parts;
+    part = &vs->parts[vs->nb_parts];
+    part->filename = av_strdup(hls->use_localtime_mkdir ? filename : av_basename(filename));
+    if (!part->filename) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    part->duration    = duration;
+    part->independent = vs->part_independent;
+    vs->nb_parts++;
+    ret = 1;
+
+fail:
+    if (temp_filename != filename)
+        av_free(temp_filename);
+    av_free(filename);
+    if (ret < 0 && hls->ignore_io_errors)
+        ret = 0;
+    return ret;
+}
+
 #if HAVE_DOS_PATHS
 #define SEPARATOR '\\'
 #else
@@ -589,11 +784,26 @@ static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
     return 0;
 }
 
+static void hls_free_parts(HLSPart **parts, int *nb_parts)
+{
+    for (int i = 0; i < *nb_parts; i++)
+        av_freep(&(*parts)[i].filename);
+    av_freep(parts);
+    *nb_parts = 0;
+}
+
+static void hls_free_segment(HLSSegment *en)
+{
+    hls_free_parts(&en->parts, &en->nb_parts);
+    av_free(en);
+}
+
 static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
                                    VariantStream *vs)
 {
 
     HLSSegment *segment, *previous_segment = NULL;
+    HLSSegment **pending = NULL;
     float playlist_duration = 0.0f;
     int ret = 0;
     int segment_cnt = 0;
@@ -630,6 +840,10 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         }
     }
 
+    /* segments still being uploaded are kept for a later call */
+    if (segment)
+        pending = &previous_segment->next;
+
     if (segment && !hls->use_localtime_mkdir) {
         dirname_r = hls->segment_filename ? av_strdup(hls->segment_filename): av_strdup(vs->avf->url);
         dirname = av_dirname(dirname_r);
@@ -654,6 +868,14 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
     }
 
     while (segment) {
+        if (segment->upload_id > hls->upload_completed) {
+            *pending = segment;
+            pending  = &segment->next;
+            segment  = segment->next;
+            *pending = NULL;
+            continue;
+        }
+
         av_log(hls, AV_LOG_DEBUG, "deleting old segment %s\n",
                segment->filename);
         if (!hls->use_localtime_mkdir) // segment->filename contains basename only
@@ -669,6 +891,21 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         if (ret = hls_delete_file(hls, s, path.str, proto))
             goto fail;
 
+        for (int i = 0; i < segment->nb_parts; i++) {
+            av_bprint_clear(&path);
+            if (!hls->use_localtime_mkdir)
+                av_bprintf(&path, "%s%c", dirname, SEPARATOR);
+            av_bprintf(&path, "%s", segment->parts[i].filename);
+
+            if (!av_bprint_is_complete(&path)) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+
+            if (ret = hls_delete_file(hls, s, path.str, proto))
+                goto fail;
+        }
+
         if ((segment->sub_filename[0] != '\0')) {
             vtt_dirname_r = av_strdup(vs->vtt_avf->url);
             vtt_dirname = av_dirname(vtt_dirname_r);
@@ -689,7 +926,7 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         av_bprint_clear(&path);
         previous_segment = segment;
         segment = previous_segment->next;
-        av_freep(&previous_segment);
+        hls_free_segment(previous_segment);
     }
 
 fail:
@@ -1153,6 +1390,13 @@ static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
     en->next     = NULL;
     en->discont  = 0;
     en->discont_program_date_time = 0;
+    en->upload_id = vs->upload_id;
+    vs->upload_id = 0;
+    en->parts    = vs->parts;
+    en->nb_parts = vs->nb_parts;
+    vs->parts    = NULL;
+    vs->nb_parts = 0;
+    vs->part_offset = 0;
 
     if (vs->discontinuity) {
         en->discont = 1;
@@ -1187,7 +1431,7 @@ static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
             if ((ret = hls_delete_old_segments(s, hls, vs)) < 0)
                 return ret;
         } else
-            av_freep(&en);
+            hls_free_segment(en);
     } else
         vs->nb_entries++;
 
@@ -1319,7 +1563,7 @@ static void hls_free_segments(HLSSegment *p)
     while (p) {
         en = p;
         p = p->next;
-        av_freep(&en);
+        hls_free_segment(en);
     }
 }
 
@@ -1559,6 +1803,9 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     double prog_date_time = vs->initial_prog_date_time;
     double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &prog_date_time : NULL;
     int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int list_parts = hls->part_time && !(last && !(hls->flags & HLS_OMIT_ENDLIST));
+    double part_target = hls->part_time / (double)HLS_MICROSECOND_UNIT;
+    double remaining = 0; /* duration from the current entry to the end */
 
     hls->version = 2;
     if (!(hls->flags & HLS_ROUND_DURATIONS)) {
@@ -1609,7 +1856,18 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     if (vs->has_video && (hls->flags & HLS_INDEPENDENT_SEGMENTS)) {
         avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
     }
-    for (en = vs->segments; en; en = en->next) {
+    if (hls->part_time) {
+        ff_hls_write_server_control(vs->out, hls->can_block_reload, 3 * part_target);
+        ff_hls_write_part_inf(vs->out, part_target);
+    }
+    if (list_parts) {
+        for (en = vs->segments; en; en = en->next)
+            remaining += en->duration;
+        for (int i = 0; i < vs->nb_parts; i++)
+            remaining += vs->parts[i].duration;
+    }
+    /* segments still being uploaded are left out until they are complete */
+    for (en = vs->segments; en && en->upload_id <= hls->upload_completed; en = en->next) {
         if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
                                     av_strcasecmp(en->iv_string, iv_string))) {
             avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
@@ -1625,6 +1883,14 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
                                    hls->flags & HLS_SINGLE_FILE, vs->init_range_length, 0);
         }
 
+        /* parts are only listed for the last three target durations */
+        if (list_parts && remaining <= 3 * target_duration) {
+            for (int i = 0; i < en->nb_parts; i++)
+                ff_hls_write_part(vs->out, en->parts[i].duration, hls->baseurl,
+                                  en->parts[i].filename, en->parts[i].independent, 0, 0);
+        }
+        remaining -= en->duration;
+
         ret = ff_hls_write_file_entry(byterange_mode ? hls->m3u8_out : vs->out, en->discont, byterange_mode,
                                       en->duration, hls->flags & HLS_ROUND_DURATIONS,
                                       en->size, en->pos, hls->baseurl,
@@ -1636,6 +1902,25 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         if (ret < 0) {
             av_log(s, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
         }
+        vs->published_upload_id = en->upload_id;
+    }
+
+    if (list_parts) {
+        char *filename;
+
+        for (int i = 0; i < vs->nb_parts; i++)
+            ff_hls_write_part(vs->out, vs->parts[i].duration, hls->baseurl,
+                              vs->parts[i].filename, vs->parts[i].independent, 0, 0);
+        if (!last) {
+            filename = get_part_filename(hls, vs, vs->nb_parts);
+            if (!filename) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            ff_hls_write_preload_hint(vs->out, hls->baseurl,
+                                      hls->use_localtime_mkdir ? filename : av_basename(filename), -1);
+            av_free(filename);
+        }
     }
 
     if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
@@ -1650,7 +1935,7 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         }
         ff_hls_write_playlist_header(hls->sub_m3u8_out, hls->version, hls->allowcache,
                                      target_duration, sequence, PLAYLIST_TYPE_NONE, 0);
-        for (en = vs->segments; en; en = en->next) {
+        for (en = vs->segments; en && en->upload_id <= hls->upload_completed; en = en->next) {
             ret = ff_hls_write_file_entry(hls->sub_m3u8_out, 0, byterange_mode,
                                           en->duration, 0, en->size, en->pos,
                                           hls->baseurl, en->sub_filename, NULL, 0, 0, 0);
@@ -2410,6 +2695,40 @@ static int64_t append_single_file(AVFormatContext *s, VariantStream *vs)
 
     return ret;
 }
+
+/* Publish the playlists of the variant streams which got new complete segments. */
+static int poll_uploads(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    int64_t completed;
+    int ret;
+
+    ret = ff_upload_queue_poll(hls->upload_queue, &completed);
+    if (ret < 0 && !hls->ignore_io_errors)
+        return ret;
+    if (completed == hls->upload_completed)
+        return 0;
+    hls->upload_completed = completed;
+
+    if (hls->pl_type == PLAYLIST_TYPE_VOD)
+        return 0;
+
+    for (int i = 0; i < hls->nb_varstreams; i++) {
+        VariantStream *vs = &hls->var_streams[i];
+        HLSSegment *en;
+
+        for (en = vs->segments; en && en->upload_id <= completed; en = en->next) {
+            if (en->upload_id > vs->published_upload_id) {
+                if ((ret = hls_window(s, 0, vs)) < 0)
+                    return ret;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
 static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     HLSContext *hls = s->priv_data;
@@ -2453,6 +2772,9 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         return AVERROR(ENOMEM);
     }
 
+    if (hls->upload_queue && (ret = poll_uploads(s)) < 0)
+        return ret;
+
     end_pts = hls->recording_time * vs->number;
 
     if (vs->sequence - vs->nb_entries > hls->start_sequence && hls->init_time > 0) {
@@ -2510,6 +2832,11 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         new_start_pos = avio_tell(oc->pb);
         vs->size = new_start_pos - vs->start_pos;
         avio_flush(oc->pb);
+        if (hls->part_time) {
+            double part_duration = (double)(pkt->pts - vs->part_start_pts) * st->time_base.num / st->time_base.den;
+            if ((ret = hls_flush_part(s, vs, part_duration)) < 0)
+                return ret;
+        }
         if (hls->segment_type == SEGMENT_TYPE_FMP4) {
             if (!vs->init_range_length) {
                 range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
@@ -2570,39 +2897,52 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
                 set_http_options(s, &options, hls);
 
-                ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                if (ret < 0) {
-                    av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
-                           "Failed to open file '%s'\n", filename);
-                    av_freep(&filename);
+                if (hls->upload_queue) {
+                    ret = upload_segment(s, vs, filename, &options, use_temp_file);
                     av_dict_free(&options);
-                    return hls->ignore_io_errors ? 0 : ret;
-                }
-                if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-                    write_styp(vs->out);
-                }
-                ret = flush_dynbuf(vs, &range_length);
-                if (ret < 0) {
                     av_freep(&filename);
-                    av_dict_free(&options);
-                    return ret;
-                }
-                ret = hlsenc_io_close(s, &vs->out, filename);
-                if (ret < 0) {
-                    av_log(s, AV_LOG_WARNING, "upload segment failed,"
-                           " will retry with a new http session.\n");
-                    ff_format_io_close(s, &vs->out);
+                    if (ret < 0)
+                        return ret;
+                } else {
                     ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                    reflush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                               "Failed to open file '%s'\n", filename);
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return hls->ignore_io_errors ? 0 : ret;
+                    }
+                    if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+                        write_styp(vs->out);
+                    }
+                    ret = flush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return ret;
+                    }
                     ret = hlsenc_io_close(s, &vs->out, filename);
+                    if (ret < 0) {
+                        av_log(s, AV_LOG_WARNING, "upload segment failed,"
+                               " will retry with a new http session.\n");
+                        ff_format_io_close(s, &vs->out);
+                        ret = hlsenc_io_open(s, &vs->out, filename, &options);
+                        reflush_dynbuf(vs, &range_length);
+                        ret = hlsenc_io_close(s, &vs->out, filename);
+                    }
+                    av_dict_free(&options);
+                    av_freep(&vs->temp_buffer);
+                    av_freep(&filename);
                 }
-                av_dict_free(&options);
-                av_freep(&vs->temp_buffer);
-                av_freep(&filename);
             }
 
-            if (use_temp_file)
-                hls_rename_temp_file(s, oc);
+            if (use_temp_file) {
+                // an uploaded segment is renamed once it is complete
+                if (hls->upload_queue)
+                    oc->url[strlen(oc->url) - 4] = '\0';
+                else
+                    hls_rename_temp_file(s, oc);
+            }
         }
 
         old_filename = av_strdup(oc->url);
@@ -2622,7 +2962,9 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         }
 
         // if we're building a VOD playlist, skip writing the manifest multiple times, and just wait until the end
-        if (hls->pl_type != PLAYLIST_TYPE_VOD) {
+        // an uploaded segment is added to the playlist once it is complete
+        // with parts, the playlist is written once the next segment is started
+        if (hls->pl_type != PLAYLIST_TYPE_VOD && !hls->upload_queue && !hls->part_time) {
             if ((ret = hls_window(s, 0, vs)) < 0) {
                 av_log(s, AV_LOG_WARNING, "upload playlist failed, will retry with a new http session.\n");
                 ff_format_io_close(s, &vs->out);
@@ -2670,6 +3012,31 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         if (ret < 0) {
             return ret;
         }
+
+        if (hls->part_time) {
+            vs->part_start_pts   = pkt->pts;
+            vs->part_independent = !!(pkt->flags & AV_PKT_FLAG_KEY);
+            if (hls->pl_type != PLAYLIST_TYPE_VOD && (ret = hls_window(s, 0, vs)) < 0)
+                return ret;
+        }
+    } else if (hls->part_time && is_ref_pkt) {
+        if (vs->part_start_pts == AV_NOPTS_VALUE) {
+            vs->part_start_pts   = pkt->pts;
+            vs->part_independent = !!(pkt->flags & AV_PKT_FLAG_KEY);
+        } else if (pkt->pts > vs->part_start_pts &&
+                   av_compare_ts(pkt->pts + pkt->duration - vs->part_start_pts, st->time_base,
+                                 hls->part_time, AV_TIME_BASE_Q) > 0) {
+            /* end the part before it would exceed the part target duration */
+            double part_duration = (double)(pkt->pts - vs->part_start_pts) * st->time_base.num / st->time_base.den;
+            if ((ret = hls_flush_part(s, vs, part_duration)) < 0)
+                return ret;
+            if (ret) {
+                vs->part_start_pts   = pkt->pts;
+                vs->part_independent = !!(pkt->flags & AV_PKT_FLAG_KEY);
+                if (hls->pl_type != PLAYLIST_TYPE_VOD && (ret = hls_window(s, 0, vs)) < 0)
+                    return ret;
+            }
+        }
     }
 
     vs->packets_written++;
@@ -2694,6 +3061,8 @@ static void hls_deinit(AVFormatContext *s)
     int i = 0;
     VariantStream *vs = NULL;
 
+    ff_upload_queue_free(&hls->upload_queue);
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2709,6 +3078,8 @@ static void hls_deinit(AVFormatContext *s)
             av_freep(&vs->init_buffer);
         hls_free_segments(vs->segments);
         hls_free_segments(vs->old_segments);
+        hls_free_parts(&vs->parts, &vs->nb_parts);
+        ff_format_io_close(s, &vs->part_out);
         av_freep(&vs->m3u8_name);
         av_freep(&vs->streams);
     }
@@ -2736,14 +3107,31 @@ static int hls_write_trailer(struct AVFormatContext *s)
     AVDictionary *options = NULL;
     int range_length, byterange_mode;
 
+    if (hls->upload_queue) {
+        ret = ff_upload_queue_flush(hls->upload_queue);
+        if (ret < 0 && !hls->ignore_io_errors)
+            return ret;
+        hls->upload_completed = INT64_MAX;
+        ret = 0;
+    }
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         char *filename = NULL;
         vs = &hls->var_streams[i];
         oc = vs->avf;
         vtt_oc = vs->vtt_avf;
-        old_filename = av_strdup(oc->url);
         use_temp_file = 0;
 
+        if (hls->part_time) {
+            double part_duration = vs->duration + vs->dpp;
+            for (int j = 0; j < vs->nb_parts; j++)
+                part_duration -= vs->parts[j].duration;
+            if ((ret = hls_flush_part(s, vs, part_duration)) < 0)
+                return ret;
+        }
+
+        old_filename = av_strdup(oc->url);
+
         if (!old_filename) {
             return AVERROR(ENOMEM);
         }
@@ -2957,6 +3345,38 @@ static int hls_init(AVFormatContext *s)
                "enabled together. Disabling 'independent_segments' flag\n");
     }
 
+    if (hls->part_time) {
+        if (hls->segment_type != SEGMENT_TYPE_FMP4 ||
+            (hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time requires fmp4 segments and "
+                   "cannot be used with single_file or hls_segment_size\n");
+            return AVERROR(EINVAL);
+        }
+        if (hls->part_time >= hls->time ||
+            (hls->init_time && hls->part_time >= hls->init_time)) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time must be smaller than the segment duration\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
+    if (hls->upload_threads) {
+        if ((hls->flags & (HLS_SINGLE_FILE | HLS_SECOND_LEVEL_SEGMENT_SIZE |
+                           HLS_SECOND_LEVEL_SEGMENT_DURATION)) || hls->max_seg_size > 0 ||
+            hls->part_time) {
+            av_log(s, AV_LOG_WARNING, "Asynchronous upload is not supported with "
+                   "single_file, second_level_segment_size, second_level_segment_duration, "
+                   "hls_segment_size or hls_part_time, uploading synchronously\n");
+        } else {
+            ret = ff_upload_queue_alloc(&hls->upload_queue, s, hls->upload_threads,
+                                        hls->upload_queue_size, hls->upload_retries);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "Asynchronous upload requires threads, "
+                       "uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2967,6 +3387,7 @@ static int hls_init(AVFormatContext *s)
         vs->sequence  = hls->start_sequence;
         vs->start_pts = AV_NOPTS_VALUE;
         vs->end_pts   = AV_NOPTS_VALUE;
+        vs->part_start_pts = AV_NOPTS_VALUE;
         vs->current_segment_final_filename_fmt[0] = '\0';
         vs->initial_prog_date_time = initial_program_date_time;
 
@@ -3118,6 +3539,8 @@ static const AVOption options[] = {
     {"start_number",  "set first number in the sequence",        OFFSET(start_sequence),AV_OPT_TYPE_INT64,  {.i64 = 0},     0, INT64_MAX, E},
     {"hls_time",      "set segment length",                      OFFSET(time),          AV_OPT_TYPE_DURATION, {.i64 = 2000000}, 0, INT64_MAX, E},
     {"hls_init_time", "set segment length at init list",         OFFSET(init_time),     AV_OPT_TYPE_DURATION, {.i64 = 0},       0, INT64_MAX, E},
+    {"hls_part_time", "set partial segment length for low-latency HLS", OFFSET(part_time), AV_OPT_TYPE_DURATION, {.i64 = 0},       0, INT64_MAX, E},
+    {"hls_can_block_reload", "advertise that the server supports blocking playlist reload", OFFSET(can_block_reload), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     {"hls_list_size", "set maximum number of playlist entries",  OFFSET(max_nb_segments),    AV_OPT_TYPE_INT,    {.i64 = 5},     0, INT_MAX, E},
     {"hls_delete_threshold", "set number of unreferenced segments to keep before deleting",  OFFSET(hls_delete_threshold),    AV_OPT_TYPE_INT,    {.i64 = 1},     1, INT_MAX, E},
     {"hls_vtt_options","set hls vtt list of options for the container format used for hls", OFFSET(vtt_format_options_str), AV_OPT_TYPE_STRING, {.str = NULL},  0, 0,    E},
@@ -3173,6 +3596,9 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"upload_threads", "number of threads uploading segments asynchronously", OFFSET(upload_threads), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, E},
+    {"upload_queue_size", "maximum number of segments being uploaded asynchronously", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 8}, 1, INT_MAX, E},
+    {"upload_retries", "number of times a failed asynchronous segment upload is retried", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 1}, 0, INT_MAX, E},
     { NULL },
 };
 
@@ -186,6 +186,43 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
     return 0;
 }
 
+void ff_hls_write_server_control(AVIOContext *out, int can_block_reload,
+                                 double part_hold_back)
+{
+    avio_printf(out, "#EXT-X-SERVER-CONTROL:");
+    if (can_block_reload)
+        avio_printf(out, "CAN-BLOCK-RELOAD=YES,");
+    avio_printf(out, "PART-HOLD-BACK=%.3f\n", part_hold_back);
+}
+
+void ff_hls_write_part_inf(AVIOContext *out, double part_target)
+{
+    avio_printf(out, "#EXT-X-PART-INF:PART-TARGET=%.3f\n", part_target);
+}
+
+void ff_hls_write_part(AVIOContext *out, double duration, const char *baseurl,
+                       const char *filename, int independent,
+                       int64_t size, int64_t pos)
+{
+    avio_printf(out, "#EXT-X-PART:DURATION=%.3f,URI=\"%s%s\"",
+                duration, baseurl ? baseurl : "", filename);
+    if (size > 0)
+        avio_printf(out, ",BYTERANGE=\"%"PRId64"@%"PRId64"\"", size, pos);
+    if (independent)
+        avio_printf(out, ",INDEPENDENT=YES");
+    avio_printf(out, "\n");
+}
+
+void ff_hls_write_preload_hint(AVIOContext *out, const char *baseurl,
+                               const char *filename, int64_t start)
+{
+    avio_printf(out, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%s\"",
+                baseurl ? baseurl : "", filename);
+    if (start >= 0)
+        avio_printf(out, ",BYTERANGE-START=%"PRId64, start);
+    avio_printf(out, "\n");
+}
+
 void ff_hls_write_end_list(AVIOContext *out)
 {
     if (!out)
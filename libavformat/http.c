@@ -31,6 +31,7 @@
 #include "libavutil/bprint.h"
 #include "libavutil/getenv_utf8.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 
@@ -80,6 +81,8 @@ typedef struct HTTPContext {
     char *http_proxy;
     char *headers;
     char *mime_type;
+    char *etag;
+    char *last_modified;
     char *http_version;
     char *user_agent;
     char *referer;
@@ -136,6 +139,10 @@ typedef struct HTTPContext {
     char *new_location;
     AVDictionary *redirect_cache;
     uint64_t filesize_from_content_range;
+    int connection_pool;
+    /* the open connections of the context that may go back to the pool */
+    struct HTTPPoolConnection **pool_conns;
+    int nb_pool_conns;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -154,6 +161,8 @@ static const AVOption options[] = {
     { "multiple_requests", "use persistent connections", OFFSET(multiple_requests), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the entity tag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the last modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
@@ -178,6 +187,7 @@ static const AVOption options[] = {
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "connection_pool", "reuse idle keep-alive connections of the process", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
     { NULL }
 };
 
@@ -197,6 +207,245 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
            sizeof(HTTPAuthState));
 }
 
+/* Idle keep-alive connections shared by all HTTP contexts of the process */
+#define HTTP_POOL_MAX_IDLE     16
+#define HTTP_POOL_IDLE_TIMEOUT (15 * 1000000)
+
+typedef struct HTTPPoolConnection {
+    URLContext *hd;
+    /* Forwarded to by the lower protocols of hd, so that they do not keep
+     * a copy of the callback of a context that is closed meanwhile. */
+    AVIOInterruptCB interrupt_callback;
+    char *key;
+    int64_t idle_since;
+    struct HTTPPoolConnection *next;
+} HTTPPoolConnection;
+
+static AVMutex pool_lock = AV_MUTEX_INITIALIZER;
+static HTTPPoolConnection *pool_idle;
+
+static int http_pool_interrupt(void *opaque)
+{
+    HTTPPoolConnection *conn = opaque;
+    return ff_check_interrupt(&conn->interrupt_callback);
+}
+
+static void http_pool_free(HTTPPoolConnection *conn)
+{
+    ffurl_closep(&conn->hd);
+    av_freep(&conn->key);
+    av_free(conn);
+}
+
+static void http_pool_free_list(HTTPPoolConnection *conn)
+{
+    while (conn) {
+        HTTPPoolConnection *next = conn->next;
+        http_pool_free(conn);
+        conn = next;
+    }
+}
+
+/* Connections are only shared between requests to the same lower protocol
+ * URL, in the same direction and with the same lower protocol options. */
+static char *http_pool_key(URLContext *h, const char *lower_url, AVDictionary *options)
+{
+    char *opts = NULL, *key;
+
+    if (av_dict_get_string(options, &opts, '=', ',') < 0)
+        return NULL;
+    key = av_asprintf("%s %d %s", lower_url, h->flags & AVIO_FLAG_READ_WRITE, opts);
+    av_free(opts);
+    return key;
+}
+
+/* Check that an idle connection was not closed by the server, and drop
+ * the unread replies to chunked posts. */
+static int http_pool_alive(URLContext *h, HTTPPoolConnection *conn)
+{
+    uint8_t buf[1024];
+    int ret;
+
+    conn->hd->flags |= AVIO_FLAG_NONBLOCK;
+    do {
+        ret = ffurl_read(conn->hd, buf, sizeof(buf));
+    } while (ret > 0 && (h->flags & AVIO_FLAG_WRITE));
+    conn->hd->flags &= ~AVIO_FLAG_NONBLOCK;
+
+    return ret == AVERROR(EAGAIN);
+}
+
+static int http_pool_get(URLContext *h, const char *key)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPPoolConnection *conn, **p, *expired = NULL;
+    int64_t now = av_gettime_relative();
+
+    while (1) {
+        ff_mutex_lock(&pool_lock);
+        for (p = &pool_idle; *p;) {
+            conn = *p;
+            if (now - conn->idle_since > HTTP_POOL_IDLE_TIMEOUT) {
+                *p = conn->next;
+                conn->next = expired;
+                expired = conn;
+            } else {
+                p = &conn->next;
+            }
+        }
+        for (p = &pool_idle; *p && strcmp((*p)->key, key); p = &(*p)->next)
+            ;
+        conn = *p;
+        if (conn)
+            *p = conn->next;
+        ff_mutex_unlock(&pool_lock);
+
+        http_pool_free_list(expired);
+        expired = NULL;
+        if (!conn)
+            return 0;
+
+        conn->next = NULL;
+        conn->interrupt_callback = h->interrupt_callback;
+        if (http_pool_alive(h, conn))
+            break;
+        http_pool_free(conn);
+    }
+
+    if (av_dynarray_add_nofree(&s->pool_conns, &s->nb_pool_conns, conn) < 0) {
+        http_pool_free(conn);
+        return AVERROR(ENOMEM);
+    }
+    s->hd = conn->hd;
+    av_log(h, AV_LOG_DEBUG, "Reusing a pooled connection to %s\n", key);
+
+    return 1;
+}
+
+static int http_pool_open(URLContext *h, const char *lower_url, const char *key,
+                          AVDictionary **options)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPPoolConnection *conn = av_mallocz(sizeof(*conn));
+    AVIOInterruptCB interrupt_callback = { http_pool_interrupt, conn };
+    int ret;
+
+    if (!conn)
+        return AVERROR(ENOMEM);
+    conn->interrupt_callback = h->interrupt_callback;
+    if (!(conn->key = av_strdup(key)) ||
+        (ret = av_dynarray_add_nofree(&s->pool_conns, &s->nb_pool_conns, conn)) < 0) {
+        av_free(conn->key);
+        av_free(conn);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = ffurl_open_whitelist(&s->hd, lower_url, AVIO_FLAG_READ_WRITE,
+                               &interrupt_callback, options,
+                               h->protocol_whitelist, h->protocol_blacklist, h);
+    conn->hd = s->hd;
+    if (ret < 0) {
+        s->nb_pool_conns--;
+        http_pool_free(conn);
+    }
+    return ret;
+}
+
+/* Close a connection of the context and drop its pool entry, so that the
+ * entries of a context reconnecting many times do not pile up. */
+static void http_pool_close(HTTPContext *s, URLContext **hd)
+{
+    for (int i = 0; *hd && i < s->nb_pool_conns; i++) {
+        HTTPPoolConnection *conn = s->pool_conns[i];
+        if (conn && conn->hd == *hd) {
+            s->pool_conns[i] = s->pool_conns[--s->nb_pool_conns];
+            http_pool_free(conn);
+            *hd = NULL;
+            return;
+        }
+    }
+    ffurl_closep(hd);
+}
+
+/* Whether the connection can carry another request. */
+static int http_pool_reusable(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint64_t target_end = s->end_off ? s->end_off : s->filesize;
+
+    if (!s->connection_pool || s->listen || s->willclose || !s->nb_pool_conns)
+        return 0;
+    /* the reply to an upload was read by http_read_reply() */
+    if (h->flags & AVIO_FLAG_WRITE)
+        return !(h->flags & AVIO_FLAG_READ) && s->chunked_post && s->end_chunked_post;
+    if (s->buf_ptr != s->buf_end)
+        return 0;
+    if (s->chunksize != UINT64_MAX)
+        return s->chunkend;
+    return target_end != UINT64_MAX && s->off >= target_end;
+}
+
+/* Hand s->hd over to the pool, or close it. */
+static void http_pool_release(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPPoolConnection *conn = NULL, *evicted = NULL;
+
+    if (s->hd && http_pool_reusable(h)) {
+        for (int i = 0; i < s->nb_pool_conns; i++) {
+            if (s->pool_conns[i]->hd == s->hd) {
+                conn = s->pool_conns[i];
+                s->pool_conns[i] = NULL;
+                break;
+            }
+        }
+    }
+
+    if (conn) {
+        int nb_idle = 0;
+
+        conn->interrupt_callback = (AVIOInterruptCB){ 0 };
+        conn->idle_since         = av_gettime_relative();
+        s->hd = NULL;
+
+        ff_mutex_lock(&pool_lock);
+        conn->next = pool_idle;
+        pool_idle  = conn;
+        for (HTTPPoolConnection **p = &pool_idle; *p; p = &(*p)->next) {
+            if (++nb_idle > HTTP_POOL_MAX_IDLE) {
+                evicted = *p;
+                *p = NULL;
+                break;
+            }
+        }
+        ff_mutex_unlock(&pool_lock);
+        http_pool_free_list(evicted);
+    }
+
+    ffurl_closep(&s->hd);
+    /* all other connections of the context are closed at this point */
+    for (int i = 0; i < s->nb_pool_conns; i++) {
+        if (s->pool_conns[i]) {
+            s->pool_conns[i]->hd = NULL;
+            http_pool_free(s->pool_conns[i]);
+        }
+    }
+    av_freep(&s->pool_conns);
+    s->nb_pool_conns = 0;
+}
+
+void ff_http_pool_flush(void)
+{
+    HTTPPoolConnection *conn;
+
+    ff_mutex_lock(&pool_lock);
+    conn = pool_idle;
+    pool_idle = NULL;
+    ff_mutex_unlock(&pool_lock);
+
+    http_pool_free_list(conn);
+}
+
 static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 {
     const char *path, *proxy_path, *lower_proto = "tcp", *local_path;
@@ -206,7 +455,8 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char auth[1024], proxyauth[1024] = "";
     char path1[MAX_URL_SIZE], sanitized_path[MAX_URL_SIZE + 1];
     char buf[1024], urlbuf[MAX_URL_SIZE];
-    int port, use_proxy, err = 0;
+    char *pool_key = NULL;
+    int port, use_proxy, pooled = 0, err = 0;
     HTTPContext *s = h->priv_data;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
@@ -262,16 +512,38 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
-    if (!s->hd) {
+    if (!s->hd && s->connection_pool && !s->listen) {
+        if (!(pool_key = http_pool_key(h, buf, options ? *options : NULL))) {
+            err = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((pooled = err = http_pool_get(h, pool_key)) < 0)
+            goto end;
+        if (!s->hd)
+            err = http_pool_open(h, buf, pool_key, options);
+    } else if (!s->hd) {
         err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                                    &h->interrupt_callback, options,
                                    h->protocol_whitelist, h->protocol_blacklist, h);
     }
 
+    if (err >= 0)
+        err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    /* the server may have closed an idle connection just before it was
+     * reused, retry once on a new one */
+    if (pooled && (err == AVERROR_EOF || err == AVERROR(EIO) ||
+                   err == AVERROR(EPIPE) || err == AVERROR(ECONNRESET))) {
+        av_log(h, AV_LOG_DEBUG, "Pooled connection failed, opening a new one\n");
+        http_pool_close(s, &s->hd);
+        err = http_pool_open(h, buf, pool_key, options);
+        if (err >= 0)
+            err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    }
+
 end:
+    av_free(pool_key);
     freeenv_utf8(env_http_proxy);
-    return err < 0 ? err : http_connect(
-        h, path, local_path, hoststr, auth, proxyauth);
+    return err;
 }
 
 static int http_should_reconnect(HTTPContext *s, int err)
@@ -392,7 +664,7 @@ redo:
         /* restore the offset (http_connect resets it) */
         s->off = off;
 
-        ffurl_closep(&s->hd);
+        http_pool_close(s, &s->hd);
         goto redo;
     }
 
@@ -400,7 +672,7 @@ redo:
     if (s->http_code == 401) {
         if ((cur_auth_type == HTTP_AUTH_NONE || s->auth_state.stale) &&
             s->auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_closep(&s->hd);
+            http_pool_close(s, &s->hd);
             goto redo;
         } else
             goto fail;
@@ -408,7 +680,7 @@ redo:
     if (s->http_code == 407) {
         if ((cur_proxy_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
             s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && attempts < 4) {
-            ffurl_closep(&s->hd);
+            http_pool_close(s, &s->hd);
             goto redo;
         } else
             goto fail;
@@ -417,7 +689,7 @@ redo:
          s->http_code == 303 || s->http_code == 307 || s->http_code == 308) &&
         s->new_location) {
         /* url moved, get next */
-        ffurl_closep(&s->hd);
+        http_pool_close(s, &s->hd);
         if (redirects++ >= MAX_REDIRECTS)
             return AVERROR(EIO);
 
@@ -443,7 +715,7 @@ redo:
 
 fail:
     if (s->hd)
-        ffurl_closep(&s->hd);
+        http_pool_close(s, &s->hd);
     if (ret < 0)
         return ret;
     return ff_http_averror(s->http_code, AVERROR(EIO));
@@ -722,6 +994,7 @@ static int http_open(URLContext *h, const char *uri, int flags,
     ret = http_open_cnx(h, options);
 bail_out:
     if (ret < 0) {
+        http_pool_release(h);
         av_dict_free(&s->chained_options);
         av_dict_free(&s->cookie_dict);
         av_dict_free(&s->redirect_cache);
@@ -1206,6 +1479,12 @@ static int process_line(URLContext *h, char *line, int line_count)
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1475,7 +1754,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
         av_bprintf(&request, "Expect: 100-continue\r\n");
 
     if (!has_header(s->headers, "\r\nConnection: "))
-        av_bprintf(&request, "Connection: %s\r\n", s->multiple_requests ? "keep-alive" : "close");
+        av_bprintf(&request, "Connection: %s\r\n",
+                   s->multiple_requests || s->connection_pool ? "keep-alive" : "close");
 
     if (!has_header(s->headers, "\r\nHost: "))
         av_bprintf(&request, "Host: %s\r\n", hoststr);
@@ -1580,14 +1860,14 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
                    "Chunked encoding data size: %"PRIu64"\n",
                     s->chunksize);
 
-            if (!s->chunksize && s->multiple_requests) {
+            if (!s->chunksize && (s->multiple_requests || s->connection_pool)) {
                 http_get_line(s, line, sizeof(line)); // read empty chunk
                 s->chunkend = 1;
                 return 0;
             }
             else if (!s->chunksize) {
                 av_log(h, AV_LOG_DEBUG, "Last chunk received, closing conn\n");
-                ffurl_closep(&s->hd);
+                http_pool_close(s, &s->hd);
                 return 0;
             }
             else if (s->chunksize == UINT64_MAX) {
@@ -1853,8 +2133,9 @@ static int http_shutdown(URLContext *h, int flags)
         ((flags & AVIO_FLAG_READ) && s->chunked_post && s->listen)) {
         ret = ffurl_write(s->hd, footer, sizeof(footer) - 1);
         ret = ret > 0 ? 0 : ret;
-        /* flush the receive buffer when it is write only mode */
-        if (!(flags & AVIO_FLAG_READ)) {
+        /* flush the receive buffer when it is write only mode, unless the
+         * reply is read before pooling the connection */
+        if (!(flags & AVIO_FLAG_READ) && !s->connection_pool) {
             char buf[1024];
             int read_ret;
             s->hd->flags |= AVIO_FLAG_NONBLOCK;
@@ -1871,6 +2152,30 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+/* Read the reply to an upload, so that a connection only goes back to the
+ * pool once the server accepted the upload, and a rejected upload fails. */
+static int http_read_reply(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    int ret;
+
+    s->buf_ptr    = s->buffer;
+    s->buf_end    = s->buffer;
+    s->line_count = 0;
+    s->end_header = 0;
+    s->filesize   = UINT64_MAX;
+    if ((ret = http_read_header(h)) < 0)
+        return ret;
+    if (s->http_code < 200 || s->http_code >= 300) {
+        av_log(h, AV_LOG_ERROR, "Upload failed with HTTP code %d\n", s->http_code);
+        return ff_http_averror(s->http_code, AVERROR(EIO));
+    }
+    /* the body of the reply is not read, do not reuse the connection */
+    if (s->filesize || s->chunksize != UINT64_MAX)
+        s->willclose = 1;
+    return 0;
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
@@ -1884,9 +2189,13 @@ static int http_close(URLContext *h)
     if (s->hd && !s->end_chunked_post)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
+    if (ret >= 0 && s->hd && s->connection_pool && !s->listen && s->chunked_post &&
+        (h->flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_WRITE)
+        ret = http_read_reply(h);
 
-    if (s->hd)
-        ffurl_closep(&s->hd);
+    if (ret < 0)
+        http_pool_close(s, &s->hd);
+    http_pool_release(h);
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
@@ -1921,10 +2230,11 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         return AVERROR(EINVAL);
     if (off < 0)
         return AVERROR(EINVAL);
-    s->off = off;
-
-    if (s->off && h->is_streamed)
+    /* keep the position, reading on from a wrong one would not stop at the
+     * end of the body of a persistent connection */
+    if (off && h->is_streamed)
         return AVERROR(ENOSYS);
+    s->off = off;
 
     /* do not try to make a new connection if seeking past the end of the file */
     if (s->end_off || s->filesize != UINT64_MAX) {
@@ -1959,7 +2269,7 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         return ret;
     }
     av_dict_free(&options);
-    ffurl_close(old_hd);
+    http_pool_close(s, &old_hd);
     return off;
 }
 
@@ -47,6 +47,14 @@
  */
 #define FF_FMT_INIT_CLEANUP                             (1 << 0)
 
+/**
+ * For an AVInputFormat with this flag set, packets returned by
+ * av_get_packet() may reference the memory of the protocol instead of a
+ * copy of the data (see ffio_read_ref()). Such packets are read-only, so
+ * the demuxer must not modify them.
+ */
+#define FF_FMT_ZERO_COPY                                (1 << 1)
+
 typedef struct AVCodecTag {
     enum AVCodecID id;
     unsigned int tag;
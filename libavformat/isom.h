@@ -163,6 +163,31 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+enum MOVSampleIndexKeys {
+    MOV_INDEX_KEYS_ALL,     ///< every sample is a keyframe
+    MOV_INDEX_KEYS_FIRST,   ///< only the first sample is a keyframe
+    MOV_INDEX_KEYS_TABLES,  ///< keyframes are listed in stss and stps
+};
+
+/**
+ * Sample index kept in the run-length form of the sample tables, samples are
+ * resolved on demand instead of expanding one AVIndexEntry per sample.
+ */
+typedef struct MOVSampleIndex {
+    unsigned int nb_samples;
+    int64_t first_dts;
+    int64_t *stts_sample;   ///< first sample of each stts entry
+    int64_t *stts_dts;      ///< dts of the first sample of each stts entry, relative to first_dts
+    int64_t *stsc_sample;   ///< first sample of each stsc entry
+    enum MOVSampleIndexKeys keys;
+    int key_off;
+    /** last resolved samples, so that sequential reads do not search the tables */
+    AVIndexEntry entries[2];
+    int samples[2];
+    unsigned int chunks[2];
+    int last;
+} MOVSampleIndex;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -201,6 +226,7 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVSampleIndex *sample_index; ///< set instead of the AVStream index with lazy_index
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -287,6 +313,7 @@ typedef struct MOVContext {
     int ignore_editlist;
     int advanced_editlist;
     int advanced_editlist_autodisabled;
+    int lazy_index;
     int ignore_chapters;
     int seek_individually;
     int64_t next_root_atom; ///< offset of the next root atom
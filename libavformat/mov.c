@@ -3682,10 +3682,358 @@ static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, uns
 }
 
 #define MAX_REORDER_DELAY 16
+static unsigned int mov_index_find_run(const int64_t *first, unsigned int nb, int64_t sample)
+{
+    unsigned int a = 0, b = nb;
+
+    while (b - a > 1) {
+        unsigned int m = (a + b) >> 1;
+        if (first[m] <= sample)
+            a = m;
+        else
+            b = m;
+    }
+    return a;
+}
+
+/* number of entries of a strictly increasing table smaller than value */
+static unsigned int mov_index_lower_bound(const int *table, unsigned int nb, int64_t value)
+{
+    unsigned int a = 0, b = nb;
+
+    while (a < b) {
+        unsigned int m = (a + b) >> 1;
+        if (table[m] < value)
+            a = m + 1;
+        else
+            b = m;
+    }
+    return a;
+}
+
+static int64_t mov_index_dts(const MOVStreamContext *sc, int64_t sample)
+{
+    const MOVSampleIndex *idx = sc->sample_index;
+    unsigned int k = mov_index_find_run(idx->stts_sample, sc->stts_count, sample);
+
+    return idx->first_dts + idx->stts_dts[k] +
+           (sample - idx->stts_sample[k]) * sc->stts_data[k].duration;
+}
+
+/* last keyframe at or before sample, -1 if there is none */
+static int64_t mov_index_prev_keyframe(const MOVStreamContext *sc, int64_t sample)
+{
+    const MOVSampleIndex *idx = sc->sample_index;
+    int64_t key = -1;
+    unsigned int n;
+
+    switch (idx->keys) {
+    case MOV_INDEX_KEYS_ALL:
+        return sample;
+    case MOV_INDEX_KEYS_FIRST:
+        return sample >= 0 ? 0 : -1;
+    case MOV_INDEX_KEYS_TABLES:
+        break;
+    }
+
+    if (!sc->keyframe_absent) {
+        n = mov_index_lower_bound(sc->keyframes, sc->keyframe_count, sample + idx->key_off + 1);
+        if (n)
+            key = sc->keyframes[n - 1] - idx->key_off;
+    }
+    n = mov_index_lower_bound((const int *)sc->stps_data, sc->stps_count, sample + idx->key_off + 1);
+    if (n)
+        key = FFMAX(key, (int64_t)sc->stps_data[n - 1] - idx->key_off);
+    return key;
+}
+
+/* first keyframe at or after sample, the number of samples if there is none */
+static int64_t mov_index_next_keyframe(const MOVStreamContext *sc, int64_t sample)
+{
+    const MOVSampleIndex *idx = sc->sample_index;
+    int64_t key = idx->nb_samples;
+    unsigned int n;
+
+    switch (idx->keys) {
+    case MOV_INDEX_KEYS_ALL:
+        return sample;
+    case MOV_INDEX_KEYS_FIRST:
+        return sample <= 0 ? 0 : key;
+    case MOV_INDEX_KEYS_TABLES:
+        break;
+    }
+
+    if (!sc->keyframe_absent) {
+        n = mov_index_lower_bound(sc->keyframes, sc->keyframe_count, sample + idx->key_off);
+        if (n < sc->keyframe_count)
+            key = sc->keyframes[n] - idx->key_off;
+    }
+    n = mov_index_lower_bound((const int *)sc->stps_data, sc->stps_count, sample + idx->key_off);
+    if (n < sc->stps_count)
+        key = FFMIN(key, (int64_t)sc->stps_data[n] - idx->key_off);
+    return FFMIN(key, idx->nb_samples);
+}
+
+/**
+ * Resolve a sample of the compact sample index into an index entry. The
+ * entry stays valid until two other samples of the stream are resolved.
+ */
+static AVIndexEntry *mov_index_resolve(MOVStreamContext *sc, int sample)
+{
+    MOVSampleIndex *idx = sc->sample_index;
+    const AVIndexEntry *prev = &idx->entries[idx->last];
+    AVIndexEntry *e;
+    int64_t chunk_sample, key;
+    unsigned int k, chunk;
+    int slot;
+
+    for (slot = 0; slot < FF_ARRAY_ELEMS(idx->samples); slot++) {
+        if (idx->samples[slot] == sample) {
+            idx->last = slot;
+            return &idx->entries[slot];
+        }
+    }
+    slot = !idx->last;
+    e    = &idx->entries[slot];
+
+    k            = mov_index_find_run(idx->stsc_sample, sc->stsc_count, sample);
+    chunk_sample = (sample - idx->stsc_sample[k]) % sc->stsc_data[k].count;
+    chunk        = sc->stsc_data[k].first - 1 +
+                   (sample - idx->stsc_sample[k]) / sc->stsc_data[k].count;
+
+    if (sample > 0 && idx->samples[idx->last] == sample - 1 && idx->chunks[idx->last] == chunk) {
+        e->pos = prev->pos + prev->size;
+    } else if (sc->stsz_sample_size > 0) {
+        e->pos = sc->chunk_offsets[chunk] + chunk_sample * sc->stsz_sample_size;
+    } else {
+        e->pos = sc->chunk_offsets[chunk];
+        for (int i = sample - chunk_sample; i < sample; i++)
+            e->pos += (unsigned)sc->sample_sizes[i];
+    }
+    e->size      = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[sample];
+    e->timestamp = mov_index_dts(sc, sample);
+
+    key             = mov_index_prev_keyframe(sc, sample);
+    e->flags        = key == sample ? AVINDEX_KEYFRAME : 0;
+    e->min_distance = sample - FFMAX(key, 0);
+
+    idx->samples[slot] = sample;
+    idx->chunks[slot]  = chunk;
+    idx->last          = slot;
+    return e;
+}
+
+static int mov_index_nb_entries(const AVStream *st)
+{
+    const MOVStreamContext *sc = st->priv_data;
+
+    return sc->sample_index ? sc->sample_index->nb_samples : cffstream(st)->nb_index_entries;
+}
+
+static AVIndexEntry *mov_index_get_entry(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->sample_index ? mov_index_resolve(sc, sample) : &ffstream(st)->index_entries[sample];
+}
+
+/**
+ * Same as av_index_search_timestamp(), on the compact sample index if the
+ * stream uses one.
+ */
+static int mov_index_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    const MOVStreamContext *sc = st->priv_data;
+    int64_t a = -1, b, m;
+
+    if (!sc->sample_index)
+        return av_index_search_timestamp(st, wanted_timestamp, flags);
+
+    b = sc->sample_index->nb_samples;
+    if (b && mov_index_dts(sc, b - 1) < wanted_timestamp)
+        a = b - 1;
+    while (b - a > 1) {
+        int64_t timestamp;
+
+        m = (a + b) >> 1;
+        timestamp = mov_index_dts(sc, m);
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY))
+        m = (flags & AVSEEK_FLAG_BACKWARD) ? mov_index_prev_keyframe(sc, m) :
+                                             mov_index_next_keyframe(sc, m);
+
+    return m == sc->sample_index->nb_samples ? -1 : m;
+}
+
+static void mov_index_free(MOVStreamContext *sc)
+{
+    if (!sc->sample_index)
+        return;
+    av_freep(&sc->sample_index->stts_sample);
+    av_freep(&sc->sample_index->stts_dts);
+    av_freep(&sc->sample_index->stsc_sample);
+    av_freep(&sc->sample_index);
+}
+
+/**
+ * Set up the compact sample index of a stream, if its sample tables can be
+ * resolved on demand to the same entries as mov_build_index_entries() builds.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the stream needs the full index
+ */
+static int mov_index_init(MOVContext *mov, AVStream *st, int64_t first_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+    int whole_edit = sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist;
+    int64_t edit_time, edit_duration;
+    MOVSampleIndex *idx;
+    int64_t nb_samples = 0, sample = 0, dts = 0;
+    uint64_t stream_size = 0;
+
+    if (!mov->lazy_index ||
+        !sc->stts_count || !sc->stsc_count || !sc->chunk_count ||
+        (sc->rap_group_count && sc->rap_group) ||
+        sc->sample_count >= INT_MAX)
+        return AVERROR(ENOSYS);
+
+    /* the only edit list for which mov_fix_index() keeps the index as it is
+     * is a single edit of the whole media, checked below */
+    if (whole_edit &&
+        (sc->elst_count != 1 || sc->ctts_data || sc->dts_shift || first_dts ||
+         !get_edit_list_entry(mov, sc, 0, &edit_time, &edit_duration, mov->time_scale) ||
+         edit_time))
+        return AVERROR(ENOSYS);
+
+    /* only tables that are resolved the same way in any order */
+    if (sc->stsc_data[0].first != 1)
+        return AVERROR(ENOSYS);
+    for (unsigned i = 0; i < sc->stsc_count; i++) {
+        if (sc->stsc_data[i].count <= 0 || sc->stsc_data[i].first > sc->chunk_count ||
+            (i && sc->stsc_data[i].first <= sc->stsc_data[i - 1].first) ||
+            (sc->pseudo_stream_id != -1 && sc->stsc_data[i].id - 1 != sc->pseudo_stream_id))
+            return AVERROR(ENOSYS);
+    }
+    for (unsigned i = 0; i < sc->stts_count; i++)
+        if (!sc->stts_data[i].count)
+            return AVERROR(ENOSYS);
+    for (unsigned i = 0; i < sc->keyframe_count; i++)
+        if (sc->keyframes[i] < key_off || (i && sc->keyframes[i] <= sc->keyframes[i - 1]))
+            return AVERROR(ENOSYS);
+    for (unsigned i = 0; i < sc->stps_count; i++)
+        if (sc->stps_data[i] < key_off || sc->stps_data[i] > INT_MAX ||
+            (i && sc->stps_data[i] <= sc->stps_data[i - 1]))
+            return AVERROR(ENOSYS);
+
+    if (sc->stsz_sample_size > 0 && sc->stsz_sample_size < sc->sample_size) {
+        av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+        sc->stsz_sample_size = sc->sample_size;
+    }
+
+    idx = av_mallocz(sizeof(*idx));
+    if (!idx)
+        return AVERROR(ENOMEM);
+    sc->sample_index = idx;
+    idx->stts_sample = av_malloc_array(sc->stts_count, sizeof(*idx->stts_sample));
+    idx->stts_dts    = av_malloc_array(sc->stts_count, sizeof(*idx->stts_dts));
+    idx->stsc_sample = av_malloc_array(sc->stsc_count, sizeof(*idx->stsc_sample));
+    if (!idx->stts_sample || !idx->stts_dts || !idx->stsc_sample) {
+        mov_index_free(sc);
+        return AVERROR(ENOMEM);
+    }
+
+    for (unsigned i = 0; i < sc->stts_count; i++) {
+        idx->stts_sample[i] = sample;
+        idx->stts_dts[i]    = dts;
+        sample += sc->stts_data[i].count;
+        dts    += sc->stts_data[i].count * (int64_t)sc->stts_data[i].duration;
+    }
+    if (whole_edit && (edit_duration < dts || sample < sc->sample_count))
+        goto unsupported;
+
+    /* check the sizes and offsets the full index would reject */
+    for (unsigned i = 0; i < sc->stsc_count; i++) {
+        unsigned end = mov_stsc_index_valid(i, sc->stsc_count) ?
+                       sc->stsc_data[i + 1].first - 1 : sc->chunk_count;
+
+        idx->stsc_sample[i] = nb_samples;
+        for (unsigned chunk = sc->stsc_data[i].first - 1; chunk < end; chunk++) {
+            int64_t next_offset = chunk + 1 < sc->chunk_count ? sc->chunk_offsets[chunk + 1] : INT64_MAX;
+            int64_t offset = sc->chunk_offsets[chunk];
+
+            if (next_offset > offset && sc->sample_size > 0 && sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[i].count * (int64_t)sc->stsz_sample_size > next_offset - offset)
+                goto unsupported;
+
+            /* the full index reports the errors */
+            if (sc->stsc_data[i].count > sc->sample_count - nb_samples)
+                goto unsupported;
+            if (sc->stsz_sample_size > 0) {
+                if (sc->stsz_sample_size > 0x3FFFFFFF ||
+                    offset > INT64_MAX - sc->stsc_data[i].count * (int64_t)sc->stsz_sample_size)
+                    goto unsupported;
+                nb_samples  += sc->stsc_data[i].count;
+                stream_size += sc->stsc_data[i].count * (uint64_t)sc->stsz_sample_size;
+                continue;
+            }
+            for (int j = 0; j < sc->stsc_data[i].count; j++) {
+                unsigned size = sc->sample_sizes[nb_samples];
+
+                if (size > 0x3FFFFFFF || offset > INT64_MAX - size)
+                    goto unsupported;
+                offset      += size;
+                stream_size += size;
+                nb_samples++;
+            }
+        }
+    }
+    if (!nb_samples)
+        goto unsupported;
+    idx->nb_samples = nb_samples;
+    idx->first_dts  = first_dts;
+    idx->key_off    = key_off;
+    if (!sc->keyframe_absent && !sc->keyframe_count)
+        idx->keys = MOV_INDEX_KEYS_ALL;
+    else if (sc->keyframe_absent && !sc->stps_count)
+        idx->keys = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ? MOV_INDEX_KEYS_ALL :
+                                                                    MOV_INDEX_KEYS_FIRST;
+    else
+        idx->keys = MOV_INDEX_KEYS_TABLES;
+    idx->samples[0] = idx->samples[1] = -1;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        for (int i = 0; i < FFMIN(idx->nb_samples, 99); i++)
+            ff_rfps_add_frame(mov->fc, st, mov_index_dts(sc, i));
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    if (whole_edit) {
+        /* what mov_fix_index() sets for this edit */
+        sc->min_corrected_pts = 0;
+        st->start_time        = 0;
+        st->duration          = FFMIN(st->duration, edit_duration);
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            ffstream(st)->skip_samples = sc->start_pad = 0;
+    }
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: compact index of %u samples\n",
+           st->index, idx->nb_samples);
+    return 0;
+
+unsupported:
+    mov_index_free(sc);
+    return AVERROR(ENOSYS);
+}
+
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3698,14 +4046,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        for (int ind = 0; ind < mov_index_nb_entries(st) && ctts_ind < msc->ctts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = mov_index_get_entry(st, ind)->timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4164,12 +4512,14 @@ static int build_open_gop_key_points(AVStream *st)
     return 0;
 }
 
-static void mov_build_index(MOVContext *mov, AVStream *st)
+/**
+ * Expand the sample tables of a stream into one index entry per sample.
+ */
+static int mov_build_index_entries(MOVContext *mov, AVStream *st, int64_t current_dts, int add_rfps)
 {
     MOVStreamContext *sc = st->priv_data;
     FFStream *const sti = ffstream(st);
     int64_t current_offset;
-    int64_t current_dts = 0;
     unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
     unsigned int stss_index = 0;
@@ -4178,6 +4528,174 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     uint64_t stream_size = 0;
     MOVCtts *ctts_data_old = sc->ctts_data;
     unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int current_sample = 0;
+    unsigned int stts_sample = 0;
+    unsigned int sample_size;
+    unsigned int distance = 0;
+    unsigned int rap_group_index = 0;
+    unsigned int rap_group_sample = 0;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+
+    if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
+        return AVERROR(ENOMEM);
+    if (av_reallocp_array(&sti->index_entries,
+                          sti->nb_index_entries + sc->sample_count,
+                          sizeof(*sti->index_entries)) < 0) {
+        sti->nb_index_entries = 0;
+        return AVERROR(ENOMEM);
+    }
+    sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
+
+    if (ctts_data_old) {
+        // Expand ctts entries such that we have a 1-1 mapping with samples
+        if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+            return AVERROR(ENOMEM);
+        sc->ctts_count = 0;
+        sc->ctts_allocated_size = 0;
+        sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                                sc->sample_count * sizeof(*sc->ctts_data));
+        if (!sc->ctts_data) {
+            av_free(ctts_data_old);
+            return AVERROR(ENOMEM);
+        }
+
+        memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+        for (i = 0; i < ctts_count_old &&
+                    sc->ctts_count < sc->sample_count; i++)
+            for (j = 0; j < ctts_data_old[i].count &&
+                        sc->ctts_count < sc->sample_count; j++)
+                add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                               &sc->ctts_allocated_size, 1,
+                               ctts_data_old[i].duration);
+        av_free(ctts_data_old);
+    }
+
+    for (i = 0; i < sc->chunk_count; i++) {
+        int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
+        current_offset = sc->chunk_offsets[i];
+        while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+            i + 1 == sc->stsc_data[stsc_index + 1].first)
+            stsc_index++;
+
+        if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+            sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+        if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+            av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+            sc->stsz_sample_size = sc->sample_size;
+        }
+
+        for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
+            int keyframe = 0;
+            if (current_sample >= sc->sample_count) {
+                av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+                return AVERROR_INVALIDDATA;
+            }
+
+            if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
+                keyframe = 1;
+                if (stss_index + 1 < sc->keyframe_count)
+                    stss_index++;
+            } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
+                keyframe = 1;
+                if (stps_index + 1 < sc->stps_count)
+                    stps_index++;
+            }
+            if (rap_group_present && rap_group_index < sc->rap_group_count) {
+                if (sc->rap_group[rap_group_index].index > 0)
+                    keyframe = 1;
+                if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
+                    rap_group_sample = 0;
+                    rap_group_index++;
+                }
+            }
+            if (sc->keyframe_absent
+                && !sc->stps_count
+                && !rap_group_present
+                && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
+                 keyframe = 1;
+            if (keyframe)
+                distance = 0;
+            sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
+            if (current_offset > INT64_MAX - sample_size) {
+                av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
+                       current_offset,
+                       sample_size);
+                return AVERROR_INVALIDDATA;
+            }
+
+            if (sc->pseudo_stream_id == -1 ||
+               sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
+                AVIndexEntry *e;
+                if (sample_size > 0x3FFFFFFF) {
+                    av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+                    return AVERROR_INVALIDDATA;
+                }
+                e = &sti->index_entries[sti->nb_index_entries++];
+                e->pos = current_offset;
+                e->timestamp = current_dts;
+                e->size = sample_size;
+                e->min_distance = distance;
+                e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+                av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                        "size %u, distance %u, keyframe %d\n", st->index, current_sample,
+                        current_offset, current_dts, sample_size, distance, keyframe);
+                if (add_rfps && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
+                    ff_rfps_add_frame(mov->fc, st, current_dts);
+            }
+
+            current_offset += sample_size;
+            stream_size += sample_size;
+
+            current_dts += sc->stts_data[stts_index].duration;
+
+            distance++;
+            stts_sample++;
+            current_sample++;
+            if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
+                stts_sample = 0;
+                stts_index++;
+            }
+        }
+    }
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    return 0;
+}
+
+/**
+ * Replace the compact sample index of a stream by the full one, for the
+ * fragments to be appended to it.
+ */
+static int mov_index_expand(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t first_dts = sc->sample_index->first_dts;
+    int ret;
+
+    mov_index_free(sc);
+    ret = mov_build_index_entries(mov, st, first_dts, 0);
+    /* the composition offsets were expanded to one entry per sample */
+    if (sc->ctts_data) {
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+    return ret;
+}
+
+static void mov_build_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    int64_t current_offset;
+    int64_t current_dts = 0;
+    unsigned int stsc_index = 0;
+    unsigned int i;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4234,146 +4752,15 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
-
         current_dts -= sc->dts_shift;
 
-        if (!sc->sample_count || sti->nb_index_entries)
+        if (!sc->sample_count || sti->nb_index_entries || sc->sample_index)
             return;
-        if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
-            return;
-        if (av_reallocp_array(&sti->index_entries,
-                              sti->nb_index_entries + sc->sample_count,
-                              sizeof(*sti->index_entries)) < 0) {
-            sti->nb_index_entries = 0;
+        ret = mov_index_init(mov, st, current_dts);
+        if (ret == AVERROR(ENOSYS))
+            ret = mov_build_index_entries(mov, st, current_dts, 1);
+        if (ret < 0)
             return;
-        }
-        sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
-
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
-                return;
-            }
-
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
-        }
-
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
-
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (current_offset > INT64_MAX - sample_size) {
-                    av_log(mov->fc, AV_LOG_ERROR, "Current offset %"PRId64" or sample size %u is too large\n",
-                           current_offset,
-                           sample_size);
-                    return;
-                }
-
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &sti->index_entries[sti->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
-
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                current_dts += sc->stts_data[stts_index].duration;
-
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
-            }
-        }
-        if (st->duration > 0)
-            st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -4482,8 +4869,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     }
 
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && mov_index_nb_entries(st) > 0) {
+        st->start_time = mov_index_get_entry(st, 0)->timestamp + sc->dts_shift;
         if (sc->ctts_data) {
             st->start_time += sc->ctts_data[0].duration;
         }
@@ -4733,12 +5120,14 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is resolved from them. */
+    if (!sc->sample_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+    }
     av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
@@ -5258,6 +5647,12 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    if (sc->sample_index) {
+        int ret = mov_index_expand(c, st);
+        if (ret < 0)
+            return ret;
+    }
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -7431,6 +7826,9 @@ static int cenc_filter(MOVContext *mov, AVStream* st, MOVStreamContext *sc, AVPa
         }
 
         if (mov->decryption_key) {
+            ret = av_packet_make_writable(pkt);
+            if (ret < 0)
+                return ret;
             return cenc_decrypt(mov, sc, encrypted_sample, pkt->data, pkt->size);
         } else {
             size_t size;
@@ -8159,7 +8557,6 @@ static void mov_read_chapters(AVFormatContext *s)
 
     for (j = 0; j < mov->nb_chapter_tracks; j++) {
         AVStream *st = NULL;
-        FFStream *sti = NULL;
         chapter_track = mov->chapter_tracks[j];
         for (i = 0; i < s->nb_streams; i++)
             if (s->streams[i]->id == chapter_track) {
@@ -8170,16 +8567,14 @@ static void mov_read_chapters(AVFormatContext *s)
             av_log(s, AV_LOG_ERROR, "Referenced QT chapter track not found\n");
             continue;
         }
-        sti = ffstream(st);
-
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
-            if (sti->nb_index_entries) {
+            if (mov_index_nb_entries(st)) {
                 // Retrieve the first frame, if possible
-                AVIndexEntry *sample = &sti->index_entries[0];
+                AVIndexEntry *sample = mov_index_get_entry(st, 0);
                 if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
                     av_log(s, AV_LOG_ERROR, "Failed to retrieve first frame\n");
                     goto finish;
@@ -8192,9 +8587,9 @@ static void mov_read_chapters(AVFormatContext *s)
             st->codecpar->codec_type = AVMEDIA_TYPE_DATA;
             st->codecpar->codec_id = AV_CODEC_ID_BIN_DATA;
             st->discard = AVDISCARD_ALL;
-            for (int i = 0; i < sti->nb_index_entries; i++) {
-                AVIndexEntry *sample = &sti->index_entries[i];
-                int64_t end = i+1 < sti->nb_index_entries ? sti->index_entries[i+1].timestamp : st->duration;
+            for (int i = 0; i < mov_index_nb_entries(st); i++) {
+                AVIndexEntry *sample = mov_index_get_entry(st, i);
+                int64_t end = i+1 < mov_index_nb_entries(st) ? mov_index_get_entry(st, i+1)->timestamp : st->duration;
                 uint8_t *title;
                 uint16_t ch;
                 int len, title_len;
@@ -8263,15 +8658,14 @@ static int parse_timecode_in_framenum_format(AVFormatContext *s, AVStream *st,
 static int mov_read_rtmd_track(AVFormatContext *s, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     char buf[AV_TIMECODE_STR_SIZE];
     int64_t cur_pos = avio_tell(sc->pb);
     int hh, mm, ss, ff, drop;
 
-    if (!sti->nb_index_entries)
+    if (!mov_index_nb_entries(st))
         return -1;
 
-    avio_seek(sc->pb, sti->index_entries->pos, SEEK_SET);
+    avio_seek(sc->pb, mov_index_get_entry(st, 0)->pos, SEEK_SET);
     avio_skip(s->pb, 13);
     hh = avio_r8(s->pb);
     mm = avio_r8(s->pb);
@@ -8289,7 +8683,6 @@ static int mov_read_rtmd_track(AVFormatContext *s, AVStream *st)
 static int mov_read_timecode_track(AVFormatContext *s, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int flags = 0;
     int64_t cur_pos = avio_tell(sc->pb);
     int64_t value;
@@ -8297,13 +8690,13 @@ static int mov_read_timecode_track(AVFormatContext *s, AVStream *st)
     int tmcd_nb_frames = sc->tmcd_nb_frames;
     int rounded_tc_rate;
 
-    if (!sti->nb_index_entries)
+    if (!mov_index_nb_entries(st))
         return -1;
 
     if (!tc_rate.num || !tc_rate.den || !tmcd_nb_frames)
         return -1;
 
-    avio_seek(sc->pb, sti->index_entries->pos, SEEK_SET);
+    avio_seek(sc->pb, mov_index_get_entry(st, 0)->pos, SEEK_SET);
     value = avio_rb32(s->pb);
 
     if (sc->tmcd_flags & 0x0001) flags |= AV_TIMECODE_FLAG_DROPFRAME;
@@ -8385,6 +8778,7 @@ static int mov_read_close(AVFormatContext *s)
         av_freep(&sc->open_key_samples);
         av_freep(&sc->display_matrix);
         av_freep(&sc->index_ranges);
+        mov_index_free(sc);
 
         if (sc->extradata)
             for (j = 0; j < sc->stsd_count; j++)
@@ -8784,10 +9178,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int i;
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < mov_index_nb_entries(avst)) {
+            AVIndexEntry *current_sample = mov_index_get_entry(avst, msc->current_sample);
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) && current_sample->pos < sample->pos) ||
@@ -8990,8 +9383,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-            ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+        int64_t next_dts = (sc->current_sample < mov_index_nb_entries(st)) ?
+            mov_index_get_entry(st, sc->current_sample)->timestamp : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -9026,8 +9419,13 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         }
     }
 
-    if (mov->aax_mode)
+    if (mov->aax_mode) {
+        /* decrypted in place, so it must not reference the mapped file */
+        ret = av_packet_make_writable(pkt);
+        if (ret < 0)
+            return ret;
         aax_filter(pkt->data, pkt->size, mov);
+    }
 
     ret = cenc_filter(mov, st, sc, pkt, current_index);
     if (ret < 0) {
@@ -9076,7 +9474,6 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -9085,7 +9482,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_index_get_entry(st, sample)->timestamp;
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -9102,7 +9499,6 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret;
     unsigned int i;
 
@@ -9115,9 +9511,9 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && mov_index_nb_entries(st) && timestamp < mov_index_get_entry(st, 0)->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -9164,9 +9560,8 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_index_get_entry(st, 0)->timestamp;
+    int64_t ts = mov_index_get_entry(st, sample)->timestamp;
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -9197,7 +9592,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_index_get_entry(st, sample)->timestamp;
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -9253,6 +9648,10 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Resolve the sample index from the sample tables on demand instead of building it at open time, leaving the stream index empty",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"use_mfra_for",
         "use mfra for fragment timestamps",
         OFFSET(use_mfra_for), AV_OPT_TYPE_INT, {.i64 = FF_MOV_FLAG_MFRA_AUTO},
@@ -9301,7 +9700,7 @@ const AVInputFormat ff_mov_demuxer = {
     .priv_class     = &mov_class,
     .priv_data_size = sizeof(MOVContext),
     .extensions     = "mov,mp4,m4a,3gp,3g2,mj2,psp,m4b,ism,ismv,isma,f4v,avif",
-    .flags_internal = FF_FMT_INIT_CLEANUP,
+    .flags_internal = FF_FMT_INIT_CLEANUP | FF_FMT_ZERO_COPY,
     .read_probe     = mov_probe,
     .read_header    = mov_read_header,
     .read_packet    = mov_read_packet,
@@ -71,7 +71,8 @@
 static const AVOption options[] = {
     { "movflags", "MOV muxer flags", offsetof(MOVMuxContext, flags), AV_OPT_TYPE_FLAGS, {.i64 = 0}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "rtphint", "Add RTP hint tracks", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RTP_HINT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
-    { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, 0 },
+    { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, -1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "moov_size" },
+    { "auto", "estimate the moov size from the first seconds of the sample tables", 0, AV_OPT_TYPE_CONST, {.i64 = -1}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "moov_size" },
     { "empty_moov", "Make the initial moov atom empty", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_EMPTY_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_keyframe", "Fragment at video keyframes", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_KEYFRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_every_frame", "Fragment at every frame", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_EVERY_FRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
@@ -6079,6 +6080,13 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
             }
             pb = mov->mdat_buf;
         }
+    } else if (mov->reserved_moov_size < 0) {
+        /* Buffer the first samples until the moov size can be estimated */
+        if (!mov->mdat_buf) {
+            if ((ret = avio_open_dyn_buf(&mov->mdat_buf)) < 0)
+                return ret;
+        }
+        pb = mov->mdat_buf;
     }
 
     if (par->codec_id == AV_CODEC_ID_AMR_NB) {
@@ -6386,6 +6394,120 @@ err:
     return ret;
 }
 
+#define MOV_RESERVE_PROBE_DURATION (10 * AV_TIME_BASE)
+#define MOV_RESERVE_PROBE_SIZE     (32 << 20)
+
+/**
+ * Get the size of the moov atom for the samples written so far, with the
+ * sample data starting at data_offset, and undo the chunk building done for
+ * it since more samples follow.
+ */
+static int mov_probe_moov_size(AVFormatContext *s, int64_t data_offset)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int i, j, size;
+
+    for (i = 0; i < mov->nb_streams; i++)
+        mov->tracks[i].data_offset = data_offset;
+
+    size = get_moov_size(s);
+
+    for (i = 0; i < mov->nb_streams; i++) {
+        MOVTrack *track = &mov->tracks[i];
+        for (j = 0; j < track->entry; j++) {
+            track->cluster[j].chunkNum         = 0;
+            track->cluster[j].samples_in_chunk = track->cluster[j].entries;
+        }
+        track->chunkCount  = 0;
+        track->data_offset = 0;
+    }
+    mov->track_ids_ok = 0;
+
+    return size;
+}
+
+/**
+ * Reserve space for the moov atom in front of the samples buffered so far
+ * and write them out. Unless all samples are known (final), the size is
+ * extrapolated to the expected duration from the growth of the sample
+ * tables over the buffered duration.
+ */
+static int mov_reserve_moov(AVFormatContext *s, int final)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
+    int64_t buffered = mov->mdat_buf ? avio_tell(mov->mdat_buf) : 0;
+    int64_t time = 0, duration, reserved, pos;
+    int i, j, size, buf_size;
+    uint8_t *buf;
+
+    for (i = 0; i < mov->nb_streams; i++) {
+        MOVTrack *track = &mov->tracks[i];
+        if (track->entry > 0 && track->timescale > 0)
+            time = FFMAX(time, av_rescale(track->track_duration, AV_TIME_BASE,
+                                          track->timescale));
+    }
+    duration = FFMAX(mov->reserved_moov_duration, time);
+
+    if (!final) {
+        if (!mov->reserved_probe_time && time >= MOV_RESERVE_PROBE_DURATION / 2) {
+            size = mov_probe_moov_size(s, av_rescale(buffered, duration, time));
+            if (size < 0)
+                return size;
+            mov->reserved_probe_time = time;
+            mov->reserved_probe_size = size;
+        }
+        if (time <= 0 || (time < MOV_RESERVE_PROBE_DURATION &&
+                          buffered < MOV_RESERVE_PROBE_SIZE))
+            return 0;
+
+        /* Measure with chunk offsets as large as at the expected end, so
+         * that the choice between stco and co64 is accounted for. */
+        size = mov_probe_moov_size(s, av_rescale(buffered, duration, time));
+        if (size < 0)
+            return size;
+        if (mov->reserved_probe_time && time > mov->reserved_probe_time)
+            reserved = size + av_rescale(size - mov->reserved_probe_size, duration - time,
+                                         time - mov->reserved_probe_time);
+        else
+            reserved = av_rescale(size, duration, time);
+        /* Leave room for irregular sample tables and not yet started tracks */
+        reserved = FFMIN(reserved + reserved / 8 + 1024 * mov->nb_streams, INT_MAX);
+        mov->reserved_moov_estimated = 1;
+    } else {
+        /* All samples are known, make the reserved space an exact fit; the
+         * sample data follows it and the wide and mdat atom headers. */
+        reserved = 0;
+        do {
+            size     = reserved;
+            reserved = mov_probe_moov_size(s, avio_tell(pb) + size + 16);
+            if (reserved < 0)
+                return reserved;
+        } while (reserved != size);
+    }
+
+    mov->reserved_header_pos = avio_tell(pb);
+    avio_wb32(pb, reserved);
+    ffio_wfourcc(pb, "free");
+    ffio_fill(pb, 0, reserved - 8);
+
+    mov_write_mdat_tag(pb, mov);
+    pos = avio_tell(pb);
+    if (mov->mdat_buf) {
+        buf_size = avio_get_dyn_buf(mov->mdat_buf, &buf);
+        avio_write(pb, buf, buf_size);
+        ffio_free_dyn_buf(&mov->mdat_buf);
+    }
+    for (i = 0; i < mov->nb_streams; i++)
+        for (j = 0; j < mov->tracks[i].entry; j++)
+            mov->tracks[i].cluster[j].pos += pos;
+
+    mov->reserved_moov_size = reserved;
+    av_log(s, AV_LOG_VERBOSE, "Reserved %d bytes for the moov atom\n", mov->reserved_moov_size);
+
+    return 0;
+}
+
 static int mov_write_single_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6442,6 +6564,9 @@ static int mov_write_single_packet(AVFormatContext *s, AVPacket *pkt)
         return 0;             /* Discard 0 sized packets */
     }
 
+    if (mov->reserved_moov_size < 0 && (ret = mov_reserve_moov(s, 0)) < 0)
+        return ret;
+
     if (trk->entry && pkt->stream_index < s->nb_streams)
         frag_duration = av_rescale_q(pkt->dts - trk->cluster[0].dts,
                 s->streams[pkt->stream_index]->time_base,
@@ -6976,8 +7101,28 @@ static int mov_init(AVFormatContext *s)
         mov->flags &= ~FF_MOV_FLAG_SKIP_SIDX;
     }
 
-    if (mov->flags & FF_MOV_FLAG_FASTSTART) {
-        mov->reserved_moov_size = -1;
+    if (mov->reserved_moov_size < 0) {
+        if (mov->flags & FF_MOV_FLAG_FRAGMENT || mov->mode == MODE_AVIF) {
+            av_log(s, AV_LOG_WARNING, "Automatic moov_size is only supported "
+                   "for non-fragmented output, disabling it\n");
+            mov->reserved_moov_size = 0;
+        } else {
+            int64_t duration = 0;
+
+            /* The stream time bases are still the ones set by the caller. */
+            for (i = 0; i < s->nb_streams; i++) {
+                AVStream *st = s->streams[i];
+                if (st->duration > 0 && st->time_base.num > 0 && st->time_base.den > 0)
+                    duration = FFMAX(duration, av_rescale_q(st->duration, st->time_base,
+                                                            AV_TIME_BASE_Q));
+            }
+            mov->reserved_moov_duration = s->duration > 0 ? s->duration : duration;
+            if (!mov->reserved_moov_duration) {
+                av_log(s, AV_LOG_WARNING, "Output duration is unknown, "
+                       "not reserving space for the moov atom\n");
+                mov->reserved_moov_size = 0;
+            }
+        }
     }
 
     if (mov->use_editlist < 0) {
@@ -7408,10 +7553,11 @@ static int mov_write_header(AVFormatContext *s)
             return ret;
     }
 
-    if (mov->reserved_moov_size){
+    /* With an automatic size, the space is reserved once the first samples
+     * have been buffered, see mov_reserve_moov(). */
+    if (mov->reserved_moov_size > 0) {
         mov->reserved_header_pos = avio_tell(pb);
-        if (mov->reserved_moov_size > 0)
-            avio_skip(pb, mov->reserved_moov_size);
+        avio_skip(pb, mov->reserved_moov_size);
     }
 
     if (mov->flags & FF_MOV_FLAG_FRAGMENT) {
@@ -7421,8 +7567,8 @@ static int mov_write_header(AVFormatContext *s)
                             FF_MOV_FLAG_FRAG_EVERY_FRAME)) &&
             !mov->max_fragment_duration && !mov->max_fragment_size)
             mov->flags |= FF_MOV_FLAG_FRAG_KEYFRAME;
-    } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+    } else if (mov->mode != MODE_AVIF && mov->reserved_moov_size >= 0) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && !mov->reserved_moov_size)
             mov->reserved_header_pos = avio_tell(pb);
         mov_write_mdat_tag(pb, mov);
     }
@@ -7516,7 +7662,11 @@ static int get_sidx_size(AVFormatContext *s)
  * entries) when the moov is moved to the beginning, so the size of the moov
  * would change. It also updates the chunk offset tables.
  */
-static int compute_moov_size(AVFormatContext *s)
+/**
+ * Compute the size of the moov atom, moving the sample data by what it
+ * needs beyond the reserved size.
+ */
+static int compute_moov_size(AVFormatContext *s, int reserved)
 {
     int i, moov_size, moov_size2;
     MOVMuxContext *mov = s->priv_data;
@@ -7526,7 +7676,7 @@ static int compute_moov_size(AVFormatContext *s)
         return moov_size;
 
     for (i = 0; i < mov->nb_streams; i++)
-        mov->tracks[i].data_offset += moov_size;
+        mov->tracks[i].data_offset += moov_size - reserved;
 
     moov_size2 = get_moov_size(s);
     if (moov_size2 < 0)
@@ -7564,13 +7714,72 @@ static int shift_data(AVFormatContext *s)
     if (mov->flags & FF_MOV_FLAG_FRAGMENT)
         moov_size = compute_sidx_size(s);
     else
-        moov_size = compute_moov_size(s);
+        moov_size = compute_moov_size(s, 0);
     if (moov_size < 0)
         return moov_size;
 
     return ff_format_shift_data(s, mov->reserved_header_pos, moov_size);
 }
 
+/**
+ * Write the moov atom in the space reserved for it, with the remainder as a
+ * free atom. If it does not fit, only shift the sample data by what is
+ * missing when faststart is enabled, or write the moov atom at the end if
+ * the reserved size was an estimate.
+ */
+static int mov_write_reserved_moov(AVFormatContext *s, int64_t moov_pos)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
+    int reserved = mov->reserved_moov_size;
+    int moov_size, ret;
+
+    moov_size = get_moov_size(s);
+    if (moov_size < 0)
+        return moov_size;
+
+    if (moov_size != reserved && moov_size > reserved - 8) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+            int shift;
+
+            av_log(s, AV_LOG_INFO, "Reserved moov size %d is too small, needed %d; "
+                   "starting second pass: shifting the data\n", reserved, moov_size);
+            /* keep an empty free atom after the moov atom */
+            moov_size = compute_moov_size(s, reserved - 8);
+            if (moov_size < 0)
+                return moov_size;
+            shift = moov_size - reserved + 8;
+            avio_seek(pb, moov_pos, SEEK_SET);
+            ret = ff_format_shift_data(s, mov->reserved_header_pos + reserved, shift);
+            if (ret < 0)
+                return ret;
+            moov_pos += shift;
+            reserved  = moov_size + 8;
+        } else if (mov->reserved_moov_estimated) {
+            av_log(s, AV_LOG_WARNING, "Reserved moov size %d is too small, needed %d; "
+                   "writing the moov atom at the end\n", reserved, moov_size);
+            avio_seek(pb, moov_pos, SEEK_SET);
+            return mov_write_moov_tag(pb, mov, s);
+        } else {
+            av_log(s, AV_LOG_ERROR, "reserved_moov_size is too small, needed %d additional\n",
+                   moov_size + 8 - reserved);
+            return AVERROR(EINVAL);
+        }
+    }
+
+    avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+    if ((ret = mov_write_moov_tag(pb, mov, s)) < 0)
+        return ret;
+    if (reserved > moov_size) {
+        avio_wb32(pb, reserved - moov_size);
+        ffio_wfourcc(pb, "free");
+        ffio_fill(pb, 0, reserved - moov_size - 8);
+    }
+    avio_seek(pb, moov_pos, SEEK_SET);
+
+    return 0;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -7625,6 +7834,8 @@ static int mov_write_trailer(AVFormatContext *s)
     }
 
     if (!(mov->flags & FF_MOV_FLAG_FRAGMENT)) {
+        if (mov->reserved_moov_size < 0 && (res = mov_reserve_moov(s, 1)) < 0)
+            return res;
         moov_pos = avio_tell(pb);
 
         /* Write size of mdat tag */
@@ -7642,7 +7853,10 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->reserved_moov_size > 0) {
+            if ((res = mov_write_reserved_moov(s, moov_pos)) < 0)
+                return res;
+        } else if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
@@ -7650,19 +7864,6 @@ static int mov_write_trailer(AVFormatContext *s)
             avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
-        } else if (mov->reserved_moov_size > 0) {
-            int64_t size;
-            if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
-                return res;
-            size = mov->reserved_moov_size - (avio_tell(pb) - mov->reserved_header_pos);
-            if (size < 8){
-                av_log(s, AV_LOG_ERROR, "reserved_moov_size is too small, needed %"PRId64" additional\n", 8-size);
-                return AVERROR(EINVAL);
-            }
-            avio_wb32(pb, size);
-            ffio_wfourcc(pb, "free");
-            ffio_fill(pb, 0, size - 8);
-            avio_seek(pb, moov_pos, SEEK_SET);
         } else {
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
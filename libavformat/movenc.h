@@ -215,6 +215,10 @@ typedef struct MOVMuxContext {
 
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
+    int reserved_moov_estimated;    ///< reserved_moov_size was estimated from the first samples
+    int64_t reserved_moov_duration; ///< expected output duration the moov size is extrapolated to
+    int64_t reserved_probe_time;    ///< buffered duration at the first moov size measurement
+    int reserved_probe_size;        ///< moov size at the first measurement
 
     char *major_brand;
 
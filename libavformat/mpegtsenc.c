@@ -94,6 +94,12 @@ typedef struct MpegTSWrite {
     int pes_payload_size;
     int64_t total_size;
 
+    /* TS packets are built in this buffer and written to s->pb at once */
+    uint8_t *batch_buf;
+    int batch_size;
+    int batch_len;
+    int batch_packets;
+
     int transport_stream_id;
     int original_network_id;
     int service_id;
@@ -960,17 +966,41 @@ static int64_t get_pcr(const MpegTSWrite *ts)
            ts->first_pcr;
 }
 
+static void write_batch(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+
+    if (ts->batch_len) {
+        avio_write(s->pb, ts->batch_buf, ts->batch_len);
+        ts->batch_len = 0;
+    }
+}
+
+/* Return the place of the next TS packet in the batch buffer. A packet built
+ * there is queued by passing it to write_packet(), which then does not copy it. */
+static uint8_t *get_packet_buf(AVFormatContext *s)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int header_size = ts->m2ts_mode ? 4 : 0;
+
+    if (ts->batch_len + header_size + TS_PACKET_SIZE > ts->batch_size)
+        write_batch(s);
+    return ts->batch_buf + ts->batch_len + header_size;
+}
+
 static void write_packet(AVFormatContext *s, const uint8_t *packet)
 {
     MpegTSWrite *ts = s->priv_data;
+    uint8_t *buf = get_packet_buf(s);
+
     if (ts->m2ts_mode) {
-        int64_t pcr = get_pcr(s->priv_data);
-        uint32_t tp_extra_header = pcr % 0x3fffffff;
-        tp_extra_header = AV_RB32(&tp_extra_header);
-        avio_write(s->pb, (unsigned char *) &tp_extra_header,
-                   sizeof(tp_extra_header));
+        int64_t pcr = get_pcr(ts);
+        AV_WB32(buf - 4, pcr % 0x3fffffff);
+        ts->batch_len += 4;
     }
-    avio_write(s->pb, packet, TS_PACKET_SIZE);
+    if (packet != buf)
+        memcpy(buf, packet, TS_PACKET_SIZE);
+    ts->batch_len  += TS_PACKET_SIZE;
     ts->total_size += TS_PACKET_SIZE;
 }
 
@@ -1101,6 +1131,11 @@ static int mpegts_init(AVFormatContext *s)
         }
     }
 
+    ts->batch_size = ts->batch_packets * (TS_PACKET_SIZE + (ts->m2ts_mode ? 4 : 0));
+    ts->batch_buf  = av_malloc(ts->batch_size);
+    if (!ts->batch_buf)
+        return AVERROR(ENOMEM);
+
     ts->m2ts_video_pid   = M2TS_VIDEO_PID;
     ts->m2ts_audio_pid   = M2TS_AUDIO_START_PID;
     ts->m2ts_pgssub_pid  = M2TS_PGSSUB_START_PID;
@@ -1351,7 +1386,7 @@ static int write_pcr_bits(uint8_t *buf, int64_t pcr)
 static void mpegts_insert_null_packet(AVFormatContext *s)
 {
     uint8_t *q;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf = get_packet_buf(s);
 
     q    = buf;
     *q++ = 0x47;
@@ -1368,7 +1403,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     MpegTSWrite *ts = s->priv_data;
     MpegTSWriteStream *ts_st = st->priv_data;
     uint8_t *q;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf = get_packet_buf(s);
 
     q    = buf;
     *q++ = 0x47;
@@ -1479,7 +1514,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
 {
     MpegTSWriteStream *ts_st = st->priv_data;
     MpegTSWrite *ts = s->priv_data;
-    uint8_t buf[TS_PACKET_SIZE];
+    uint8_t *buf;
     uint8_t *q;
     int val, is_start, len, header_len, write_pcr, flags;
     int afc_len, stuffing_len;
@@ -1490,7 +1525,6 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
     int force_sdt = 0;
     int force_nit = 0;
 
-    av_assert0(ts_st->payload != buf || st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO);
     if (ts->flags & MPEGTS_FLAG_PAT_PMT_AT_FRAMES && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
         force_pat = 1;
     }
@@ -1559,7 +1593,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
         }
 
         /* prepare packet header */
-        q    = buf;
+        q    = buf = get_packet_buf(s);
         *q++ = 0x47;
         val  = ts_st->pid >> 8;
         if (ts->m2ts_mode && st->codecpar->codec_id == AV_CODEC_ID_AC3)
@@ -2204,7 +2238,9 @@ static void mpegts_write_flush(AVFormatContext *s)
     }
 
     if (ts->m2ts_mode) {
-        int packets = (avio_tell(s->pb) / (TS_PACKET_SIZE + 4)) % 32;
+        int packets;
+        write_batch(s);
+        packets = (avio_tell(s->pb) / (TS_PACKET_SIZE + 4)) % 32;
         while (packets++ < 32)
             mpegts_insert_null_packet(s);
     }
@@ -2212,18 +2248,25 @@ static void mpegts_write_flush(AVFormatContext *s)
 
 static int mpegts_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    int ret;
+
     if (!pkt) {
         mpegts_write_flush(s);
-        return 1;
+        ret = 1;
     } else {
-        return mpegts_write_packet_internal(s, pkt);
+        ret = mpegts_write_packet_internal(s, pkt);
     }
+    /* callers such as hlsenc check the output position after each packet */
+    write_batch(s);
+    return ret;
 }
 
 static int mpegts_write_end(AVFormatContext *s)
 {
-    if (s->pb)
+    if (s->pb) {
         mpegts_write_flush(s);
+        write_batch(s);
+    }
 
     return 0;
 }
@@ -2252,6 +2295,7 @@ static void mpegts_deinit(AVFormatContext *s)
         av_freep(&service);
     }
     av_freep(&ts->services);
+    av_freep(&ts->batch_buf);
 }
 
 static int mpegts_check_bitstream(AVFormatContext *s, AVStream *st,
@@ -2330,6 +2374,8 @@ static const AVOption options[] = {
     { "tables_version", "set PAT, PMT, SDT and NIT version", OFFSET(tables_version), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 31, ENC },
     { "omit_video_pes_length", "Omit the PES packet length for video packets",
       OFFSET(omit_video_pes_length), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, ENC },
+    { "batch_packets", "Number of TS packets written to the output at once",
+      OFFSET(batch_packets), AV_OPT_TYPE_INT, { .i64 = 64 }, 1, 4096, ENC },
     { "pcr_period", "PCR retransmission time in milliseconds",
       OFFSET(pcr_period_ms), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, INT_MAX, ENC },
     { "pat_period", "PAT/PMT retransmission time limit in seconds",
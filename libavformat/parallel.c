@@ -0,0 +1,496 @@
+/*
+ * Parallel ranged input protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Based on libavformat/async.c
+ */
+
+/**
+ * @file
+ * Read a seekable resource over several connections at once.
+ *
+ * The resource is split into chunks which are downloaded by one thread per
+ * connection, in the order they are needed. The chunks are kept in a ring of
+ * slots until they have been read, which bounds both the memory use and how
+ * far the downloads may run ahead of the reader. HTTP connections are kept
+ * alive and reused with a new range request for every chunk, other protocols
+ * seek to the start of each chunk.
+ */
+
+#include "config_components.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "http.h"
+#include "url.h"
+
+typedef struct Chunk {
+    int64_t     index;      ///< chunk of the resource held, -1 if the slot is free
+    uint8_t    *buf;
+    int         size;
+    int         filled;     ///< number of bytes downloaded so far
+    int         error;
+    int         busy;       ///< a thread is downloading into buf
+} Chunk;
+
+typedef struct Connection {
+    URLContext *parent;
+    URLContext *inner;
+    pthread_t   thread;
+    int         unbounded;  ///< inner was opened at the start of the resource without a range
+    int         reusable;   ///< inner can serve another request once the current one is read
+} Connection;
+
+typedef struct ParallelContext {
+    const AVClass  *class;
+    int             nb_connections;
+    int             chunk_size;
+    int64_t         buffer_size;
+
+    char           *url;
+    int             flags;
+    AVDictionary   *inner_opts;
+    int             is_http;
+    int64_t         size;
+
+    /* the only connection, if the resource is not read in parallel */
+    URLContext     *inner;
+
+    Chunk          *chunks;
+    int             nb_chunks;
+    Connection     *conns;
+    int             nb_threads;
+
+    int64_t         pos;
+    int64_t         next_chunk; ///< next chunk to be downloaded
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond_wakeup_main;
+    pthread_cond_t  cond_wakeup_background;
+    int             sync_init;
+    int             abort_request;
+    AVIOInterruptCB interrupt_callback;
+} ParallelContext;
+
+static int parallel_check_interrupt(void *arg)
+{
+    URLContext      *h = arg;
+    ParallelContext *c = h->priv_data;
+
+    if (c->abort_request)
+        return 1;
+
+    if (ff_check_interrupt(&c->interrupt_callback))
+        c->abort_request = 1;
+
+    return c->abort_request;
+}
+
+/* Must be called with the mutex held. */
+static void chunk_release(Chunk *chunk)
+{
+    /* a busy slot is freed by its thread once it notices */
+    chunk->index = -1;
+}
+
+/* Make conn->inner deliver the bytes from start to end. */
+static int connection_request(ParallelContext *c, Connection *conn,
+                              int64_t start, int64_t end)
+{
+    AVIOInterruptCB interrupt_callback = { .callback = parallel_check_interrupt,
+                                           .opaque   = conn->parent };
+    AVDictionary *opts = NULL;
+    int ret = 0;
+
+    /* a HTTP response covering the whole resource is not read to its end */
+    if (conn->inner && conn->unbounded) {
+        conn->unbounded = 0;
+        conn->reusable  = !c->is_http;
+        if (!start)
+            return 0;
+    }
+    if (conn->inner && !conn->reusable)
+        ffurl_closep(&conn->inner);
+    conn->reusable = 1;
+
+    av_dict_copy(&opts, c->inner_opts, 0);
+    if (c->is_http) {
+        av_dict_set_int(&opts, "offset", start, 0);
+        av_dict_set_int(&opts, "end_offset", end, 0);
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    }
+
+#if CONFIG_HTTP_PROTOCOL
+    if (conn->inner && c->is_http) {
+        ret = ff_http_do_new_request2(conn->inner, c->url, &opts);
+        if (ret < 0) {
+            ffurl_closep(&conn->inner);
+            av_dict_free(&opts);
+            av_dict_copy(&opts, c->inner_opts, 0);
+            av_dict_set_int(&opts, "offset", start, 0);
+            av_dict_set_int(&opts, "end_offset", end, 0);
+            av_dict_set(&opts, "multiple_requests", "1", 0);
+        }
+    }
+#endif
+    if (!conn->inner)
+        ret = ffurl_open_whitelist(&conn->inner, c->url, c->flags, &interrupt_callback,
+                                   &opts, conn->parent->protocol_whitelist,
+                                   conn->parent->protocol_blacklist, conn->parent);
+    if (ret >= 0 && !c->is_http) {
+        int64_t pos = ffurl_seek(conn->inner, start, SEEK_SET);
+        ret = pos < 0 ? pos : 0;
+    }
+
+    av_dict_free(&opts);
+    return ret;
+}
+
+static void *parallel_task(void *arg)
+{
+    Connection      *conn = arg;
+    URLContext      *h    = conn->parent;
+    ParallelContext *c    = h->priv_data;
+
+    ff_thread_setname("parallel");
+
+    pthread_mutex_lock(&c->mutex);
+    while (!parallel_check_interrupt(h)) {
+        int64_t index = c->next_chunk;
+        Chunk  *chunk = &c->chunks[index % c->nb_chunks];
+        int64_t start = index * c->chunk_size;
+        int ret;
+
+        /* stay within the reorder buffer */
+        if (start >= c->size || index >= c->pos / c->chunk_size + c->nb_chunks ||
+            chunk->index >= 0 || chunk->busy) {
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            continue;
+        }
+
+        if (!chunk->buf) {
+            chunk->buf = av_malloc(c->chunk_size);
+            if (!chunk->buf) {
+                c->abort_request = 1;
+                break;
+            }
+        }
+        chunk->index  = index;
+        chunk->size   = FFMIN(c->chunk_size, c->size - start);
+        chunk->filled = 0;
+        chunk->error  = 0;
+        chunk->busy   = 1;
+        c->next_chunk++;
+        pthread_mutex_unlock(&c->mutex);
+
+        ret = connection_request(c, conn, start, start + chunk->size);
+        while (ret >= 0 && chunk->filled < chunk->size) {
+            /* only this thread writes beyond chunk->filled */
+            ret = ffurl_read(conn->inner, chunk->buf + chunk->filled,
+                             chunk->size - chunk->filled);
+            if (!ret)
+                ret = AVERROR_EOF;
+            if (ret < 0)
+                break;
+
+            pthread_mutex_lock(&c->mutex);
+            if (chunk->index != index) {
+                /* dropped by a seek */
+                ret = AVERROR_EXIT;
+            } else {
+                chunk->filled += ret;
+                pthread_cond_signal(&c->cond_wakeup_main);
+            }
+            pthread_mutex_unlock(&c->mutex);
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        chunk->busy = 0;
+        if (ret < 0) {
+            ffurl_closep(&conn->inner);
+            if (chunk->index == index) {
+                if (ret != AVERROR_EXIT)
+                    av_log(h, AV_LOG_ERROR, "Failed to read bytes %"PRId64" to %"PRId64": %s\n",
+                           start, start + chunk->size - 1, av_err2str(ret));
+                chunk->error = ret;
+            }
+        }
+        pthread_cond_signal(&c->cond_wakeup_main);
+        pthread_cond_broadcast(&c->cond_wakeup_background);
+    }
+    pthread_cond_signal(&c->cond_wakeup_main);
+    pthread_mutex_unlock(&c->mutex);
+
+    ffurl_closep(&conn->inner);
+
+    return NULL;
+}
+
+static void parallel_stop(URLContext *h)
+{
+    ParallelContext *c = h->priv_data;
+
+    pthread_mutex_lock(&c->mutex);
+    c->abort_request = 1;
+    pthread_cond_broadcast(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    for (int i = 0; i < c->nb_threads; i++) {
+        int ret = pthread_join(c->conns[i].thread, NULL);
+        if (ret != 0)
+            av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(AVERROR(ret)));
+    }
+    c->nb_threads = 0;
+}
+
+static int parallel_close(URLContext *h)
+{
+    ParallelContext *c = h->priv_data;
+
+    if (c->sync_init) {
+        parallel_stop(h);
+        pthread_cond_destroy(&c->cond_wakeup_background);
+        pthread_cond_destroy(&c->cond_wakeup_main);
+        pthread_mutex_destroy(&c->mutex);
+        c->sync_init = 0;
+    }
+    if (c->conns)
+        ffurl_closep(&c->conns[0].inner);
+    av_freep(&c->conns);
+    for (int i = 0; i < c->nb_chunks; i++)
+        av_freep(&c->chunks[i].buf);
+    av_freep(&c->chunks);
+    ffurl_closep(&c->inner);
+    av_dict_free(&c->inner_opts);
+    av_freep(&c->url);
+
+    return 0;
+}
+
+static int parallel_open_internal(URLContext *h, const char *arg, int flags, AVDictionary **options)
+{
+    ParallelContext *c = h->priv_data;
+    AVIOInterruptCB  interrupt_callback = { .callback = parallel_check_interrupt, .opaque = h };
+    uint8_t *location = NULL;
+    int ret;
+
+    av_strstart(arg, "parallel:", &arg);
+
+    c->url   = av_strdup(arg);
+    c->flags = flags;
+    if (!c->url)
+        return AVERROR(ENOMEM);
+    /* every connection is opened with the options of the caller */
+    if (options && (ret = av_dict_copy(&c->inner_opts, *options, 0)) < 0)
+        return ret;
+
+    c->interrupt_callback = h->interrupt_callback;
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &interrupt_callback, options,
+                               h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0) {
+        av_log(h, AV_LOG_ERROR, "ffurl_open failed : %s, %s\n", av_err2str(ret), arg);
+        return ret;
+    }
+
+    c->size        = ffurl_size(c->inner);
+    h->is_streamed = c->inner->is_streamed;
+    c->is_http     = !strcmp(c->inner->prot->name, "http") ||
+                     !strcmp(c->inner->prot->name, "https");
+
+    if (c->nb_connections < 2 || c->size <= c->chunk_size || h->is_streamed) {
+        av_log(h, AV_LOG_VERBOSE, "Reading %s over a single connection\n", arg);
+        return 0;
+    }
+
+    /* skip the redirects for the following requests */
+    if (c->is_http &&
+        av_opt_get(c->inner->priv_data, "location", 0, &location) >= 0 && location) {
+        av_free(c->url);
+        c->url = location;
+    }
+
+    c->nb_chunks = FFMAX(c->buffer_size / c->chunk_size, c->nb_connections);
+    c->chunks    = av_calloc(c->nb_chunks, sizeof(*c->chunks));
+    c->conns     = av_calloc(c->nb_connections, sizeof(*c->conns));
+    if (!c->chunks || !c->conns)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < c->nb_chunks; i++)
+        c->chunks[i].index = -1;
+
+    if ((ret = pthread_mutex_init(&c->mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&c->cond_wakeup_main, NULL))) {
+        pthread_mutex_destroy(&c->mutex);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&c->cond_wakeup_background, NULL))) {
+        pthread_cond_destroy(&c->cond_wakeup_main);
+        pthread_mutex_destroy(&c->mutex);
+        return AVERROR(ret);
+    }
+    c->sync_init = 1;
+
+    /* the connection opened above continues with the first chunk */
+    c->conns[0].inner     = c->inner;
+    c->conns[0].unbounded = 1;
+    c->inner              = NULL;
+
+    for (int i = 0; i < c->nb_connections; i++) {
+        c->conns[i].parent = h;
+        ret = pthread_create(&c->conns[i].thread, NULL, parallel_task, &c->conns[i]);
+        if (ret) {
+            av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(AVERROR(ret)));
+            return AVERROR(ret);
+        }
+        c->nb_threads++;
+    }
+
+    av_log(h, AV_LOG_VERBOSE, "Reading %s over %d connections in chunks of %d bytes\n",
+           c->url, c->nb_connections, c->chunk_size);
+
+    return 0;
+}
+
+static int parallel_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
+{
+    int ret = parallel_open_internal(h, arg, flags, options);
+
+    /* url_close() is not called when opening failed */
+    if (ret < 0)
+        parallel_close(h);
+
+    return ret;
+}
+
+static int parallel_read(URLContext *h, unsigned char *buf, int size)
+{
+    ParallelContext *c = h->priv_data;
+    int ret = 0;
+
+    if (c->inner)
+        return ffurl_read(c->inner, buf, size);
+
+    pthread_mutex_lock(&c->mutex);
+    while (1) {
+        int64_t index = c->pos / c->chunk_size;
+        int     off   = c->pos % c->chunk_size;
+        Chunk  *chunk = &c->chunks[index % c->nb_chunks];
+
+        if (c->pos >= c->size) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        if (parallel_check_interrupt(h)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (chunk->index == index && chunk->filled > off) {
+            ret = FFMIN(size, chunk->filled - off);
+            memcpy(buf, chunk->buf + off, ret);
+            c->pos += ret;
+            if (off + ret == chunk->size) {
+                chunk_release(chunk);
+                pthread_cond_broadcast(&c->cond_wakeup_background);
+            }
+            break;
+        }
+        if (chunk->index == index && chunk->error) {
+            ret = chunk->error;
+            /* retry the chunk on the next read */
+            chunk_release(chunk);
+            c->next_chunk = FFMIN(c->next_chunk, index);
+            for (int i = 0; i < c->nb_chunks; i++)
+                if (c->chunks[i].index >= c->next_chunk)
+                    chunk_release(&c->chunks[i]);
+            pthread_cond_broadcast(&c->cond_wakeup_background);
+            break;
+        }
+        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int64_t parallel_seek(URLContext *h, int64_t pos, int whence)
+{
+    ParallelContext *c = h->priv_data;
+    int64_t index;
+
+    if (c->inner)
+        return ffurl_seek(c->inner, pos, whence);
+
+    if (whence == AVSEEK_SIZE)
+        return c->size;
+    else if (whence == SEEK_CUR)
+        pos += c->pos;
+    else if (whence == SEEK_END)
+        pos += c->size;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+    if (pos < 0 || pos > c->size)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&c->mutex);
+    index = pos / c->chunk_size;
+    /* keep the chunks that are still ahead of the new position */
+    if (index < c->pos / c->chunk_size || index >= c->next_chunk)
+        c->next_chunk = index;
+    for (int i = 0; i < c->nb_chunks; i++) {
+        Chunk *chunk = &c->chunks[i];
+        if (chunk->index >= 0 && (chunk->index < index || chunk->index >= c->next_chunk))
+            chunk_release(chunk);
+    }
+    c->pos = pos;
+    pthread_cond_broadcast(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    return pos;
+}
+
+#define OFFSET(x) offsetof(ParallelContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+
+static const AVOption options[] = {
+    { "connections", "number of connections to read from in parallel", OFFSET(nb_connections), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, 64, D },
+    { "range_size", "number of bytes requested at once over a connection", OFFSET(chunk_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, INT_MAX, D },
+    { "buffer_size", "maximum number of bytes buffered ahead of the read position", OFFSET(buffer_size), AV_OPT_TYPE_INT64, { .i64 = 16 << 20 }, 4096, INT64_MAX, D },
+    { NULL },
+};
+
+#undef D
+#undef OFFSET
+
+static const AVClass parallel_context_class = {
+    .class_name = "Parallel",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const URLProtocol ff_parallel_protocol = {
+    .name                = "parallel",
+    .url_open2           = parallel_open,
+    .url_read            = parallel_read,
+    .url_seek            = parallel_seek,
+    .url_close           = parallel_close,
+    .priv_data_size      = sizeof(ParallelContext),
+    .priv_data_class     = &parallel_context_class,
+};
@@ -139,6 +139,7 @@ const AVInputFormat ff_pcm_ ## name_ ## _demuxer = {        \
     .read_packet    = ff_pcm_read_packet,                   \
     .read_seek      = ff_pcm_read_seek,                     \
     .flags          = AVFMT_GENERIC_INDEX,                  \
+    .flags_internal = FF_FMT_ZERO_COPY,                     \
     .extensions     = ext,                                  \
     .raw_codec_id   = codec,                                \
     .priv_class     = &pcm_demuxer_class,                   \
@@ -0,0 +1,529 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * on-disk cache of the avformat_find_stream_info() results
+ *
+ * Every entry is a text file named after the key of the input, with one
+ * "name=value" line per field, first for the format and then for each
+ * stream, each stream starting with a "[stream]" line.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/dict.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
+
+#include "libavcodec/defs.h"
+
+#include "avformat.h"
+#include "avio_internal.h"
+#include "internal.h"
+#include "os_support.h"
+#include "probecache.h"
+#include "url.h"
+
+#define PROBE_CACHE_VERSION   1
+/* amount of data from the start of the input that goes into the key */
+#define PROBE_CACHE_HASH_SIZE (64 * 1024)
+/* refuse to load larger entries, they can not be genuine */
+#define PROBE_CACHE_MAX_SIZE  (16 * 1024 * 1024)
+
+enum FieldType {
+    FIELD_INT,
+    FIELD_INT64,
+    FIELD_RATIONAL,
+};
+
+typedef struct CacheField {
+    const char     *name;
+    size_t          offset;
+    enum FieldType  type;
+} CacheField;
+
+#define FORMAT(field, type) { #field, offsetof(AVFormatContext,   field), type }
+#define STREAM(field, type) { #field, offsetof(AVStream,          field), type }
+#define PAR(field, type)    { #field, offsetof(AVCodecParameters, field), type }
+
+static const CacheField format_fields[] = {
+    FORMAT(start_time,                 FIELD_INT64),
+    FORMAT(duration,                   FIELD_INT64),
+    FORMAT(bit_rate,                   FIELD_INT64),
+    FORMAT(duration_estimation_method, FIELD_INT),
+};
+
+static const CacheField stream_fields[] = {
+    STREAM(start_time,          FIELD_INT64),
+    STREAM(duration,            FIELD_INT64),
+    STREAM(nb_frames,           FIELD_INT64),
+    STREAM(disposition,         FIELD_INT),
+    /* named apart from the codec parameter of the same name */
+    { "stream_sample_aspect_ratio", offsetof(AVStream, sample_aspect_ratio), FIELD_RATIONAL },
+    STREAM(avg_frame_rate,      FIELD_RATIONAL),
+    STREAM(r_frame_rate,        FIELD_RATIONAL),
+};
+
+static const CacheField par_fields[] = {
+    PAR(codec_id,              FIELD_INT),
+    PAR(codec_tag,             FIELD_INT),
+    PAR(format,                FIELD_INT),
+    PAR(bit_rate,              FIELD_INT64),
+    PAR(bits_per_coded_sample, FIELD_INT),
+    PAR(bits_per_raw_sample,   FIELD_INT),
+    PAR(profile,               FIELD_INT),
+    PAR(level,                 FIELD_INT),
+    PAR(width,                 FIELD_INT),
+    PAR(height,                FIELD_INT),
+    PAR(sample_aspect_ratio,   FIELD_RATIONAL),
+    PAR(field_order,           FIELD_INT),
+    PAR(color_range,           FIELD_INT),
+    PAR(color_primaries,       FIELD_INT),
+    PAR(color_trc,             FIELD_INT),
+    PAR(color_space,           FIELD_INT),
+    PAR(chroma_location,       FIELD_INT),
+    PAR(video_delay,           FIELD_INT),
+    PAR(sample_rate,           FIELD_INT),
+    PAR(block_align,           FIELD_INT),
+    PAR(frame_size,            FIELD_INT),
+    PAR(initial_padding,       FIELD_INT),
+    PAR(trailing_padding,      FIELD_INT),
+    PAR(seek_preroll,          FIELD_INT),
+    PAR(framerate,             FIELD_RATIONAL),
+};
+
+static void write_fields(AVBPrint *bp, const void *obj,
+                         const CacheField *fields, int nb_fields)
+{
+    for (int i = 0; i < nb_fields; i++) {
+        const uint8_t *p = (const uint8_t *)obj + fields[i].offset;
+
+        switch (fields[i].type) {
+        case FIELD_INT:
+            av_bprintf(bp, "%s=%d\n", fields[i].name, *(const int *)p);
+            break;
+        case FIELD_INT64:
+            av_bprintf(bp, "%s=%"PRId64"\n", fields[i].name, *(const int64_t *)p);
+            break;
+        case FIELD_RATIONAL:
+            av_bprintf(bp, "%s=%d/%d\n", fields[i].name,
+                       ((const AVRational *)p)->num, ((const AVRational *)p)->den);
+            break;
+        }
+    }
+}
+
+static int read_fields(const AVDictionary *d, void *obj,
+                       const CacheField *fields, int nb_fields)
+{
+    for (int i = 0; i < nb_fields; i++) {
+        const AVDictionaryEntry *e = av_dict_get(d, fields[i].name, NULL, 0);
+        uint8_t *p = (uint8_t *)obj + fields[i].offset;
+        char *end;
+
+        if (!e)
+            return AVERROR_INVALIDDATA;
+
+        switch (fields[i].type) {
+        case FIELD_INT:
+            *(int *)p = strtol(e->value, &end, 10);
+            break;
+        case FIELD_INT64:
+            *(int64_t *)p = strtoll(e->value, &end, 10);
+            break;
+        case FIELD_RATIONAL:
+            ((AVRational *)p)->num = strtol(e->value, &end, 10);
+            if (*end++ != '/')
+                return AVERROR_INVALIDDATA;
+            ((AVRational *)p)->den = strtol(end, &end, 10);
+            break;
+        }
+        if (end == e->value || *end)
+            return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+static void copy_fields(void *dst, const void *src,
+                        const CacheField *fields, int nb_fields)
+{
+    static const size_t sizes[] = {
+        [FIELD_INT]      = sizeof(int),
+        [FIELD_INT64]    = sizeof(int64_t),
+        [FIELD_RATIONAL] = sizeof(AVRational),
+    };
+
+    for (int i = 0; i < nb_fields; i++)
+        memcpy((uint8_t *)dst + fields[i].offset,
+               (const uint8_t *)src + fields[i].offset, sizes[fields[i].type]);
+}
+
+static char *entry_path(AVFormatContext *s, const char *key)
+{
+    return av_asprintf("%s/%s.probe", s->probe_cache, key);
+}
+
+/* Identify the version of the input: its modification time for local files,
+ * its entity tag or modification date for HTTP resources. */
+static char *input_version(AVFormatContext *s)
+{
+    URLContext *h = ffio_geturlcontext(s->pb);
+    uint8_t *str = NULL;
+    struct stat st;
+    int fd;
+
+    if (h && (fd = ffurl_get_file_handle(h)) >= 0 &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+#if HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+        return av_asprintf("mtime=%"PRId64".%09ld", (int64_t)st.st_mtime,
+                           (long)st.st_mtim.tv_nsec);
+#else
+        return av_asprintf("mtime=%"PRId64, (int64_t)st.st_mtime);
+#endif
+    }
+
+    if (av_opt_get(s->pb, "etag", AV_OPT_SEARCH_CHILDREN, &str) >= 0 && str && *str)
+        return (char *)str;
+    av_freep(&str);
+    if (av_opt_get(s->pb, "last_modified", AV_OPT_SEARCH_CHILDREN, &str) >= 0 && str && *str)
+        return (char *)str;
+    av_freep(&str);
+    return av_strdup("");
+}
+
+int ff_probe_cache_key(AVFormatContext *s, char key[PROBE_CACHE_KEY_SIZE])
+{
+    AVIOContext *pb = s->pb;
+    struct AVSHA *sha;
+    uint8_t *buf, digest[32], size_buf[8];
+    char *version;
+    int64_t pos, size, res;
+    int len, ret;
+
+    if (!pb || !s->url || !(pb->seekable & AVIO_SEEKABLE_NORMAL))
+        return AVERROR(ENOSYS);
+
+    size = avio_size(pb);
+    if (size < 0)
+        return size;
+    pos = avio_tell(pb);
+
+    buf     = av_malloc(PROBE_CACHE_HASH_SIZE);
+    sha     = av_sha_alloc();
+    version = input_version(s);
+    if (!buf || !sha || !version) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* the start of the data is read for probing anyway, and catches inputs
+     * rewritten without a change of size or version */
+    res = avio_seek(pb, 0, SEEK_SET);
+    if (res < 0) {
+        ret = res;
+        goto end;
+    }
+    len = avio_read(pb, buf, FFMIN(size, PROBE_CACHE_HASH_SIZE));
+    res = avio_seek(pb, pos, SEEK_SET);
+    if (res < 0 || len < 0) {
+        ret = res < 0 ? res : len;
+        goto end;
+    }
+
+    AV_WL64(size_buf, size);
+    av_sha_init(sha, 256);
+    av_sha_update(sha, s->url, strlen(s->url) + 1);
+    av_sha_update(sha, size_buf, sizeof(size_buf));
+    av_sha_update(sha, version, strlen(version) + 1);
+    av_sha_update(sha, buf, len);
+    av_sha_final(sha, digest);
+    ff_data_to_hex(key, digest, sizeof(digest), 1);
+    ret = 0;
+
+end:
+    av_free(version);
+    av_free(sha);
+    av_free(buf);
+    return ret;
+}
+
+static int parse_entry(AVFormatContext *s, char *buf, AVDictionary **sections)
+{
+    char *line, *saveptr = NULL;
+    unsigned cur = 0;
+
+    for (line = av_strtok(buf, "\n", &saveptr); line;
+         line = av_strtok(NULL, "\n", &saveptr)) {
+        char *sep;
+        int ret;
+
+        if (!strcmp(line, "[stream]")) {
+            if (++cur > s->nb_streams)
+                return AVERROR_INVALIDDATA;
+            continue;
+        }
+
+        sep = strchr(line, '=');
+        if (!sep)
+            return AVERROR_INVALIDDATA;
+        *sep = '\0';
+        if (av_dict_get(sections[cur], line, NULL, 0))
+            return AVERROR_INVALIDDATA;
+        ret = av_dict_set(&sections[cur], line, sep + 1, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    return cur == s->nb_streams ? 0 : AVERROR_INVALIDDATA;
+}
+
+static int check_header(AVFormatContext *s, const AVDictionary *header)
+{
+    const AVDictionaryEntry *version    = av_dict_get(header, "version",    NULL, 0);
+    const AVDictionaryEntry *format     = av_dict_get(header, "format",     NULL, 0);
+    const AVDictionaryEntry *nb_streams = av_dict_get(header, "nb_streams", NULL, 0);
+
+    if (!version || atoi(version->value) != PROBE_CACHE_VERSION ||
+        !format  || strcmp(format->value, s->iformat->name) ||
+        !nb_streams || strtoul(nb_streams->value, NULL, 10) != s->nb_streams)
+        return AVERROR_INVALIDDATA;
+    return 0;
+}
+
+static int read_stream(AVStream *st, const AVDictionary *d,
+                       AVStream *tmp, AVCodecParameters *par)
+{
+    const AVDictionaryEntry *e;
+    AVRational time_base;
+    int ret;
+
+    /* the demuxer state must be the one the entry was made from */
+    e = av_dict_get(d, "codec_type", NULL, 0);
+    if (!e || atoi(e->value) != st->codecpar->codec_type ||
+        ffstream(st)->request_probe > 0)
+        return AVERROR_INVALIDDATA;
+    e = av_dict_get(d, "time_base", NULL, 0);
+    if (!e || sscanf(e->value, "%d/%d", &time_base.num, &time_base.den) != 2 ||
+        av_cmp_q(time_base, st->time_base))
+        return AVERROR_INVALIDDATA;
+
+    ret = read_fields(d, tmp, stream_fields, FF_ARRAY_ELEMS(stream_fields));
+    if (ret < 0)
+        return ret;
+
+    ret = avcodec_parameters_copy(par, st->codecpar);
+    if (ret < 0)
+        return ret;
+    ret = read_fields(d, par, par_fields, FF_ARRAY_ELEMS(par_fields));
+    if (ret < 0)
+        return ret;
+
+    av_channel_layout_uninit(&par->ch_layout);
+    e = av_dict_get(d, "ch_layout", NULL, 0);
+    if (e && (ret = av_channel_layout_from_string(&par->ch_layout, e->value)) < 0)
+        return ret;
+
+    av_freep(&par->extradata);
+    par->extradata_size = 0;
+    e = av_dict_get(d, "extradata", NULL, 0);
+    if (e) {
+        int size = ff_hex_to_data(NULL, e->value);
+
+        par->extradata = av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!par->extradata)
+            return AVERROR(ENOMEM);
+        par->extradata_size = ff_hex_to_data(par->extradata, e->value);
+    }
+
+    return 0;
+}
+
+int ff_probe_cache_load(AVFormatContext *s, const char *key)
+{
+    AVDictionary **sections = NULL;
+    AVCodecParameters **pars = NULL;
+    AVStream *tmp = NULL;
+    AVFormatContext *fmt = NULL;
+    AVIOContext *pb = NULL;
+    AVBPrint bp;
+    char *path;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    path = entry_path(s, key);
+    if (!path)
+        return AVERROR(ENOMEM);
+    ret = ffio_open_whitelist(&pb, path, AVIO_FLAG_READ, &s->interrupt_callback,
+                              NULL, "file", NULL);
+    av_free(path);
+    if (ret < 0)
+        return ret == AVERROR(ENOENT) ? ret : AVERROR_INVALIDDATA;
+    ret = avio_read_to_bprint(pb, &bp, PROBE_CACHE_MAX_SIZE);
+    avio_closep(&pb);
+    if (ret < 0)
+        goto end;
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    sections = av_calloc(s->nb_streams + 1, sizeof(*sections));
+    pars     = av_calloc(s->nb_streams,     sizeof(*pars));
+    tmp      = av_calloc(s->nb_streams,     sizeof(*tmp));
+    fmt      = av_mallocz(sizeof(*fmt));
+    if (!sections || !pars || !tmp || !fmt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = parse_entry(s, bp.str, sections);
+    if (ret < 0)
+        goto end;
+    ret = check_header(s, sections[0]);
+    if (ret < 0)
+        goto end;
+    ret = read_fields(sections[0], fmt, format_fields, FF_ARRAY_ELEMS(format_fields));
+    if (ret < 0)
+        goto end;
+
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        pars[i] = avcodec_parameters_alloc();
+        if (!pars[i]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = read_stream(s->streams[i], sections[i + 1], &tmp[i], pars[i]);
+        if (ret < 0)
+            goto end;
+    }
+
+    /* the whole entry is valid, apply it */
+    copy_fields(s, fmt, format_fields, FF_ARRAY_ELEMS(format_fields));
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        AVStream *const st = s->streams[i];
+
+        copy_fields(st, &tmp[i], stream_fields, FF_ARRAY_ELEMS(stream_fields));
+        FFSWAP(AVCodecParameters *, st->codecpar, pars[i]);
+        ffstream(st)->need_context_update = 1;
+    }
+
+end:
+    if (sections) {
+        for (unsigned i = 0; i <= s->nb_streams; i++)
+            av_dict_free(&sections[i]);
+        av_free(sections);
+    }
+    if (pars) {
+        for (unsigned i = 0; i < s->nb_streams; i++)
+            avcodec_parameters_free(&pars[i]);
+        av_free(pars);
+    }
+    av_free(tmp);
+    av_free(fmt);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
+
+int ff_probe_cache_store(AVFormatContext *s, const char *key)
+{
+    AVIOContext *pb = NULL;
+    char *path = NULL, *tmp_path = NULL;
+    AVBPrint bp;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    av_bprintf(&bp, "version=%d\nformat=%s\nnb_streams=%u\n",
+               PROBE_CACHE_VERSION, s->iformat->name, s->nb_streams);
+    write_fields(&bp, s, format_fields, FF_ARRAY_ELEMS(format_fields));
+
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const AVStream *const st = s->streams[i];
+        const AVCodecParameters *const par = st->codecpar;
+
+        av_bprintf(&bp, "[stream]\ncodec_type=%d\ntime_base=%d/%d\n",
+                   par->codec_type, st->time_base.num, st->time_base.den);
+        write_fields(&bp, st,  stream_fields, FF_ARRAY_ELEMS(stream_fields));
+        write_fields(&bp, par, par_fields,    FF_ARRAY_ELEMS(par_fields));
+
+        if (par->ch_layout.nb_channels) {
+            char layout[128];
+
+            ret = av_channel_layout_describe(&par->ch_layout, layout, sizeof(layout));
+            if (ret < 0 || ret > sizeof(layout)) {
+                ret = ret < 0 ? ret : AVERROR(ENOSYS);
+                goto end;
+            }
+            av_bprintf(&bp, "ch_layout=%s\n", layout);
+        }
+
+        if (par->extradata_size > 0) {
+            char *hex = av_malloc(2 * par->extradata_size + 1);
+
+            if (!hex) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            av_bprintf(&bp, "extradata=%s\n",
+                       ff_data_to_hex(hex, par->extradata, par->extradata_size, 1));
+            av_free(hex);
+        }
+    }
+
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* write to a private file first, several processes may probe the same
+     * input at the same time */
+    path     = entry_path(s, key);
+    tmp_path = av_asprintf("%s.%08"PRIx32".tmp", path, av_get_random_seed());
+    if (!path || !tmp_path) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = ffio_open_whitelist(&pb, tmp_path, AVIO_FLAG_WRITE, &s->interrupt_callback,
+                              NULL, "file", NULL);
+    if (ret < 0)
+        goto end;
+    avio_write(pb, bp.str, bp.len);
+    ret = avio_closep(&pb);
+    if (ret >= 0)
+        ret = ff_rename(tmp_path, path, s);
+    if (ret < 0)
+        ffurl_delete(tmp_path);
+
+end:
+    av_free(tmp_path);
+    av_free(path);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PROBECACHE_H
+#define AVFORMAT_PROBECACHE_H
+
+#include "avformat.h"
+
+/** Size of a probe cache key, as a hexadecimal string including the terminator */
+#define PROBE_CACHE_KEY_SIZE 65
+
+/**
+ * Compute the key identifying the input of s in the probe cache, from its
+ * URL, its size and a hash of the data at its start. The input must be
+ * seekable; its position is restored.
+ *
+ * @return 0 on success, a negative AVERROR code if the input can not be cached
+ */
+int ff_probe_cache_key(AVFormatContext *s, char key[PROBE_CACHE_KEY_SIZE]);
+
+/**
+ * Restore the stream parameters found by an earlier
+ * avformat_find_stream_info() on the same input from the probe cache.
+ * Nothing is changed unless the entry matches the streams created by the
+ * demuxer.
+ *
+ * @return 0 on success, AVERROR(ENOENT) if there is no entry for the key,
+ *         another negative AVERROR code if the entry is not usable
+ */
+int ff_probe_cache_load(AVFormatContext *s, const char *key);
+
+/**
+ * Store the stream parameters found by avformat_find_stream_info() in the
+ * probe cache.
+ */
+int ff_probe_cache_store(AVFormatContext *s, const char *key);
+
+#endif /* AVFORMAT_PROBECACHE_H */
@@ -156,6 +156,7 @@ const AVInputFormat ff_rawvideo_demuxer = {
     .read_header    = rawvideo_read_header,
     .read_packet    = rawvideo_read_packet,
     .flags          = AVFMT_GENERIC_INDEX,
+    .flags_internal = FF_FMT_ZERO_COPY,
     .extensions     = "yuv,cif,qcif,rgb",
     .raw_codec_id   = AV_CODEC_ID_RAWVIDEO,
     .priv_class     = &rawvideo_demuxer_class,
@@ -176,6 +177,7 @@ const AVInputFormat ff_bitpacked_demuxer = {
     .read_header    = rawvideo_read_header,
     .read_packet    = rawvideo_read_packet,
     .flags          = AVFMT_GENERIC_INDEX,
+    .flags_internal = FF_FMT_ZERO_COPY,
     .extensions     = "bitpacked",
     .raw_codec_id   = AV_CODEC_ID_BITPACKED,
     .priv_class     = &bitpacked_demuxer_class,
@@ -197,6 +199,7 @@ const AVInputFormat ff_v210_demuxer = {
     .read_header    = rawvideo_read_header,
     .read_packet    = rawvideo_read_packet,
     .flags          = AVFMT_GENERIC_INDEX,
+    .flags_internal = FF_FMT_ZERO_COPY,
     .extensions     = "v210",
     .raw_codec_id   = AV_CODEC_ID_V210,
     .priv_class     = &v210_demuxer_class,
@@ -211,6 +214,7 @@ const AVInputFormat ff_v210x_demuxer = {
     .read_header    = rawvideo_read_header,
     .read_packet    = rawvideo_read_packet,
     .flags          = AVFMT_GENERIC_INDEX,
+    .flags_internal = FF_FMT_ZERO_COPY,
     .extensions     = "yuv10",
     .raw_codec_id   = AV_CODEC_ID_V210X,
     .priv_class     = &v210_demuxer_class,
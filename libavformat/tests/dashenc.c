@@ -0,0 +1,156 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Tests the LL-HLS parts the dash muxer lists in its media playlists in
+ * low latency chunked mode.
+ *
+ * Chunks of 3 frames are muxed, the frames of the second segment lasting
+ * twice as long as those of the first, so that its chunks are closed before
+ * the part target set from the first frame is exceeded. The media playlist is
+ * printed before the trailer is written, as the final playlist does not list
+ * parts, and every part is checked to be no longer than the part target.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "libavformat/avformat.h"
+#include "libavformat/internal.h"
+#include "libavformat/os_support.h"
+#include "libavutil/dict.h"
+
+static int print_parts(const char *filename)
+{
+    char line[1024];
+    double target = 0;
+    FILE *f = fopen(filename, "r");
+    int ret = 0;
+
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return AVERROR(ENOENT);
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *duration;
+
+        if (!strncmp(line, "#EXT-X-PART-INF:PART-TARGET=", 28)) {
+            target = atof(line + 28);
+        } else if (!strncmp(line, "#EXT-X-PART:", 12)) {
+            if ((duration = strstr(line, "DURATION=")) &&
+                atof(duration + 9) > target) {
+                fprintf(stderr, "Part longer than the part target: %s", line);
+                ret = AVERROR(EINVAL);
+            }
+        } else if (strncmp(line, "#EXT-X-PRELOAD-HINT:", 20)) {
+            continue;
+        }
+        printf("%s", line);
+    }
+
+    fclose(f);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVFormatContext *s = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = NULL;
+    AVStream *st;
+    char filename[1024];
+    int64_t pts = 0;
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <output directory>\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(filename, sizeof(filename), "%s/out.mpd", argv[1]);
+    if ((ret = ff_mkdir_p(argv[1])) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s\n", argv[1]);
+        return 1;
+    }
+
+    if ((ret = avformat_alloc_output_context2(&s, NULL, "dash", filename)) < 0 ||
+        !(pkt = av_packet_alloc()) ||
+        !(st = avformat_new_stream(s, NULL))) {
+        ret = ret < 0 ? ret : AVERROR(ENOMEM);
+        goto end;
+    }
+    s->flags |= AVFMT_FLAG_BITEXACT;
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id   = AV_CODEC_ID_MPEG4;
+    st->codecpar->width      = 64;
+    st->codecpar->height     = 64;
+    st->time_base            = (AVRational){ 1, 1000 };
+
+    av_dict_set(&opts, "seg_duration",   "1",      0);
+    av_dict_set(&opts, "use_template",   "1",      0);
+    av_dict_set(&opts, "use_timeline",   "0",      0);
+    av_dict_set(&opts, "streaming",      "1",      0);
+    av_dict_set(&opts, "ldash",          "1",      0);
+    av_dict_set(&opts, "hls_playlist",   "1",      0);
+    av_dict_set(&opts, "frag_type",      "frames", 0);
+    av_dict_set(&opts, "frag_frames",    "3",      0);
+    av_dict_set(&opts, "remove_at_exit", "1",      0);
+    ret = avformat_write_header(s, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    /* 10 frames of 100 ms, then 8 frames of 200 ms */
+    for (int i = 0; i < 18; i++) {
+        if ((ret = av_new_packet(pkt, 100)) < 0)
+            goto end;
+        memset(pkt->data, i, pkt->size);
+        pkt->pts = pkt->dts = pts;
+        pkt->duration = i < 10 ? 100 : 200;
+        if (!i || i == 10)
+            pkt->flags |= AV_PKT_FLAG_KEY;
+        pts += pkt->duration;
+        /* the muxer uses the time base of its mp4 output */
+        av_packet_rescale_ts(pkt, (AVRational){ 1, 1000 }, st->time_base);
+        if ((ret = av_write_frame(s, pkt)) < 0)
+            goto end;
+    }
+
+    snprintf(filename, sizeof(filename), "%s/media_0.m3u8", argv[1]);
+    if ((ret = print_parts(filename)) < 0)
+        goto end;
+
+    /* the segments and playlists are removed by the muxer */
+    if ((ret = av_write_trailer(s)) >= 0)
+        rmdir(argv[1]);
+
+end:
+    if (ret < 0)
+        fprintf(stderr, "Muxing failed: %s\n", av_err2str(ret));
+    av_packet_free(&pkt);
+    avformat_free_context(s);
+    return ret < 0;
+}
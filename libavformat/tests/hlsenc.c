@@ -0,0 +1,132 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Prints the low-latency HLS media playlist the hls muxer publishes while a
+ * stream is muxed, as the final playlist does not list parts.
+ *
+ * Segments of 1 second are split into parts of 200 ms. The playlist is
+ * printed before the trailer is written, in the middle of a segment, so it
+ * lists the parts of the last three target durations and a preload hint for
+ * the next part.
+ *
+ * The files are kept in memory by the io_open callback. Their URLs do not
+ * use the file protocol, so that the muxer does not rename temporary files.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/mem.h"
+
+static AVIOContext *playlist_pb;
+static char *playlist;
+
+static int io_open(AVFormatContext *s, AVIOContext **pb, const char *url,
+                   int flags, AVDictionary **options)
+{
+    int ret = avio_open_dyn_buf(pb);
+
+    if (ret >= 0 && av_match_ext(url, "m3u8"))
+        playlist_pb = *pb;
+    return ret;
+}
+
+static int io_close2(AVFormatContext *s, AVIOContext *pb)
+{
+    int is_playlist = pb == playlist_pb;
+    uint8_t *buf;
+    int size = avio_close_dyn_buf(pb, &buf);
+
+    if (is_playlist) {
+        av_free(playlist);
+        playlist    = av_strndup(buf, size);
+        playlist_pb = NULL;
+    }
+    av_free(buf);
+    return is_playlist && !playlist ? AVERROR(ENOMEM) : 0;
+}
+
+int main(void)
+{
+    AVFormatContext *s = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = NULL;
+    AVStream *st;
+    int ret;
+
+    if ((ret = avformat_alloc_output_context2(&s, NULL, "hls", "http://localhost/hls_ll.m3u8")) < 0 ||
+        !(pkt = av_packet_alloc()) ||
+        !(st = avformat_new_stream(s, NULL))) {
+        ret = ret < 0 ? ret : AVERROR(ENOMEM);
+        goto end;
+    }
+    s->flags    |= AVFMT_FLAG_BITEXACT;
+    s->io_open   = io_open;
+    s->io_close2 = io_close2;
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id   = AV_CODEC_ID_MPEG4;
+    st->codecpar->width      = 64;
+    st->codecpar->height     = 64;
+    st->time_base            = (AVRational){ 1, 1000 };
+
+    av_dict_set(&opts, "hls_segment_type",       "fmp4",    0);
+    av_dict_set(&opts, "hls_fmp4_init_filename", "init.mp4", 0);
+    av_dict_set(&opts, "hls_list_size",          "0",       0);
+    av_dict_set(&opts, "hls_time",               "1",       0);
+    av_dict_set(&opts, "hls_part_time",          "0.2",     0);
+    ret = avformat_write_header(s, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    /* 5.5 seconds of 40 ms frames, a keyframe every second */
+    for (int i = 0; i < 137; i++) {
+        if ((ret = av_new_packet(pkt, 100)) < 0)
+            goto end;
+        memset(pkt->data, i, pkt->size);
+        pkt->pts = pkt->dts = i * 40;
+        pkt->duration = 40;
+        if (!(i % 25))
+            pkt->flags |= AV_PKT_FLAG_KEY;
+        /* the muxer uses the time base of its mp4 output */
+        av_packet_rescale_ts(pkt, (AVRational){ 1, 1000 }, st->time_base);
+        if ((ret = av_write_frame(s, pkt)) < 0)
+            goto end;
+    }
+
+    if (!playlist) {
+        fprintf(stderr, "No playlist written\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    printf("%s", playlist);
+
+    ret = av_write_trailer(s);
+
+end:
+    if (ret < 0)
+        fprintf(stderr, "Muxing failed: %s\n", av_err2str(ret));
+    av_packet_free(&pkt);
+    avformat_free_context(s);
+    av_free(playlist);
+    return ret < 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Tests that the file protocol's mmap option makes zero-copy demuxers
+ * return packets referencing the mapped file.
+ *
+ * The input is remuxed to mov, then both files are demuxed with and
+ * without mmap, counting the packets that are read-only references
+ * instead of writable copies.
+ */
+
+#include <stdio.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/dict.h"
+
+static int remux(const char *in, const char *out)
+{
+    AVFormatContext *ic = NULL, *oc = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    int ret;
+
+    if (!pkt)
+        return AVERROR(ENOMEM);
+
+    if ((ret = avformat_open_input(&ic, in, NULL, NULL)) < 0 ||
+        (ret = avformat_alloc_output_context2(&oc, NULL, "mov", out)) < 0)
+        goto end;
+
+    for (int i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = avformat_new_stream(oc, NULL);
+        if (!st) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = avcodec_parameters_copy(st->codecpar, ic->streams[i]->codecpar)) < 0)
+            goto end;
+        st->codecpar->codec_tag = 0;
+        st->time_base = ic->streams[i]->time_base;
+    }
+
+    if ((ret = avio_open(&oc->pb, out, AVIO_FLAG_WRITE)) < 0 ||
+        (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+
+    while ((ret = av_read_frame(ic, pkt)) >= 0) {
+        av_packet_rescale_ts(pkt, ic->streams[pkt->stream_index]->time_base,
+                             oc->streams[pkt->stream_index]->time_base);
+        if ((ret = av_interleaved_write_frame(oc, pkt)) < 0)
+            goto end;
+    }
+    if (ret != AVERROR_EOF)
+        goto end;
+
+    ret = av_write_trailer(oc);
+
+end:
+    if (oc)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    avformat_close_input(&ic);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static int count_mapped(const char *filename, int mmap)
+{
+    AVFormatContext *s = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    int nb_packets = 0, nb_mapped = 0, ret;
+
+    if (!pkt)
+        return AVERROR(ENOMEM);
+
+    av_dict_set(&opts, "mmap", mmap ? "1" : "0", 0);
+    ret = avformat_open_input(&s, filename, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    while ((ret = av_read_frame(s, pkt)) >= 0) {
+        nb_packets++;
+        nb_mapped += pkt->buf && !av_buffer_is_writable(pkt->buf);
+        av_packet_unref(pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+    printf("%s mmap=%d: %d packets, %d mapped\n",
+           s->iformat->name, mmap, nb_packets, nb_mapped);
+
+end:
+    avformat_close_input(&s);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input> <mov output>\n", argv[0]);
+        return 1;
+    }
+
+    if ((ret = remux(argv[1], argv[2])) < 0) {
+        fprintf(stderr, "Remuxing %s failed: %s\n", argv[1], av_err2str(ret));
+        return 1;
+    }
+
+    for (int i = 1; i <= 2; i++)
+        for (int mmap = 0; mmap <= 1; mmap++)
+            if ((ret = count_mapped(argv[i], mmap)) < 0) {
+                fprintf(stderr, "Reading %s failed: %s\n", argv[i], av_err2str(ret));
+                return 1;
+            }
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "avio.h"
+#include "internal.h"
+#include "uploadqueue.h"
+
+#if HAVE_THREADS
+
+typedef struct UploadJob {
+    int64_t id;
+    char *url;
+    char *tmp_url;
+    char *final_url;
+    AVDictionary *options;
+    uint8_t *data;
+    int size;
+    int started;
+    int done;
+    struct UploadJob *next;
+} UploadJob;
+
+struct UploadQueue {
+    AVFormatContext *s;
+    int max_in_flight;
+    int max_retries;
+
+    pthread_t *threads;
+    int nb_threads;
+
+    pthread_mutex_t mutex;
+    /* signalled when a job is queued or the queue is stopped */
+    pthread_cond_t work;
+    /* signalled when a job finishes */
+    pthread_cond_t done;
+
+    /* jobs in the order they were queued; finished jobs are removed from
+     * the head only, so that the head is the oldest unfinished job */
+    UploadJob *head, *tail;
+    int nb_jobs;
+    int64_t next_id;
+    int64_t completed;
+    int error;
+    int quit;
+};
+
+static void free_job(UploadJob *job)
+{
+    av_freep(&job->url);
+    av_freep(&job->tmp_url);
+    av_freep(&job->final_url);
+    av_dict_free(&job->options);
+    av_freep(&job->data);
+    av_free(job);
+}
+
+static int run_job(UploadQueue *q, UploadJob *job)
+{
+    AVFormatContext *s = q->s;
+    int ret;
+
+    for (int retry = 0; ; retry++) {
+        AVIOContext *pb = NULL;
+        AVDictionary *options = NULL;
+
+        ret = av_dict_copy(&options, job->options, 0);
+        if (ret >= 0)
+            ret = s->io_open(s, &pb, job->url, AVIO_FLAG_WRITE, &options);
+        av_dict_free(&options);
+        if (ret >= 0) {
+            int ret2;
+            avio_write(pb, job->data, job->size);
+            avio_flush(pb);
+            ret = pb->error;
+            ret2 = ff_format_io_close(s, &pb);
+            if (ret >= 0)
+                ret = ret2;
+        }
+        if (ret >= 0 && job->final_url)
+            ret = ff_rename(job->tmp_url, job->final_url, s);
+        if (ret >= 0 || ret == AVERROR_EXIT || retry >= q->max_retries)
+            break;
+        av_log(s, AV_LOG_WARNING, "Uploading '%s' failed: %s, retrying\n",
+               job->url, av_err2str(ret));
+    }
+    if (ret < 0)
+        av_log(s, AV_LOG_ERROR, "Failed to upload '%s': %s\n",
+               job->url, av_err2str(ret));
+
+    return ret;
+}
+
+static void *upload_thread(void *arg)
+{
+    UploadQueue *q = arg;
+
+    pthread_mutex_lock(&q->mutex);
+    for (;;) {
+        UploadJob *job;
+        int ret;
+
+        for (job = q->head; job && job->started; job = job->next)
+            ;
+        if (!job) {
+            if (q->quit)
+                break;
+            pthread_cond_wait(&q->work, &q->mutex);
+            continue;
+        }
+        job->started = 1;
+        pthread_mutex_unlock(&q->mutex);
+
+        ret = run_job(q, job);
+        av_freep(&job->data);
+
+        pthread_mutex_lock(&q->mutex);
+        job->done = 1;
+        if (ret < 0 && !q->error)
+            q->error = ret;
+        while (q->head && q->head->done) {
+            UploadJob *next = q->head->next;
+            q->completed = q->head->id;
+            free_job(q->head);
+            q->head = next;
+            q->nb_jobs--;
+        }
+        if (!q->head)
+            q->tail = NULL;
+        pthread_cond_broadcast(&q->done);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return NULL;
+}
+
+int ff_upload_queue_alloc(UploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_in_flight, int max_retries)
+{
+    UploadQueue *q;
+    int ret;
+
+    *pq = NULL;
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->s             = s;
+    q->max_in_flight = FFMAX(max_in_flight, 1);
+    q->max_retries   = max_retries;
+    q->next_id       = 1;
+
+    q->threads = av_calloc(nb_threads, sizeof(*q->threads));
+    if (!q->threads) {
+        av_free(q);
+        return AVERROR(ENOMEM);
+    }
+    if ((ret = pthread_mutex_init(&q->mutex, NULL))) {
+        av_free(q->threads);
+        av_free(q);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&q->work, NULL))) {
+        pthread_mutex_destroy(&q->mutex);
+        av_free(q->threads);
+        av_free(q);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&q->done, NULL))) {
+        pthread_cond_destroy(&q->work);
+        pthread_mutex_destroy(&q->mutex);
+        av_free(q->threads);
+        av_free(q);
+        return AVERROR(ret);
+    }
+
+    for (; q->nb_threads < nb_threads; q->nb_threads++) {
+        ret = pthread_create(&q->threads[q->nb_threads], NULL, upload_thread, q);
+        if (ret) {
+            *pq = q;
+            ff_upload_queue_free(pq);
+            return AVERROR(ret);
+        }
+    }
+
+    *pq = q;
+    return 0;
+}
+
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, AVDictionary *options,
+                            const char *tmp_url, const char *final_url,
+                            uint8_t *data, int size)
+{
+    UploadJob *job = av_mallocz(sizeof(*job));
+    int64_t id;
+
+    if (!job) {
+        av_free(data);
+        return AVERROR(ENOMEM);
+    }
+    job->data = data;
+    job->size = size;
+    job->url  = av_strdup(url);
+    if (final_url) {
+        job->tmp_url   = av_strdup(tmp_url);
+        job->final_url = av_strdup(final_url);
+    }
+    if (!job->url || (final_url && (!job->tmp_url || !job->final_url)) ||
+        av_dict_copy(&job->options, options, 0) < 0) {
+        free_job(job);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->nb_jobs >= q->max_in_flight)
+        pthread_cond_wait(&q->done, &q->mutex);
+    id = job->id = q->next_id++;
+    if (q->tail)
+        q->tail->next = job;
+    else
+        q->head = job;
+    q->tail = job;
+    q->nb_jobs++;
+    pthread_cond_signal(&q->work);
+    pthread_mutex_unlock(&q->mutex);
+
+    return id;
+}
+
+int ff_upload_queue_poll(UploadQueue *q, int64_t *completed)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->mutex);
+    *completed = q->completed;
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->mutex);
+
+    return ret;
+}
+
+int ff_upload_queue_flush(UploadQueue *q)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->mutex);
+    while (q->nb_jobs)
+        pthread_cond_wait(&q->done, &q->mutex);
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->mutex);
+
+    return ret;
+}
+
+void ff_upload_queue_free(UploadQueue **pq)
+{
+    UploadQueue *q = *pq;
+
+    if (!q)
+        return;
+
+    pthread_mutex_lock(&q->mutex);
+    q->quit = 1;
+    pthread_cond_broadcast(&q->work);
+    pthread_mutex_unlock(&q->mutex);
+
+    for (int i = 0; i < q->nb_threads; i++)
+        pthread_join(q->threads[i], NULL);
+
+    /* only left over if no thread could be started */
+    while (q->head) {
+        UploadJob *next = q->head->next;
+        free_job(q->head);
+        q->head = next;
+    }
+
+    pthread_cond_destroy(&q->done);
+    pthread_cond_destroy(&q->work);
+    pthread_mutex_destroy(&q->mutex);
+    av_freep(&q->threads);
+    av_freep(pq);
+}
+
+#else
+
+int ff_upload_queue_alloc(UploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_in_flight, int max_retries)
+{
+    *pq = NULL;
+    return AVERROR(ENOSYS);
+}
+
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, AVDictionary *options,
+                            const char *tmp_url, const char *final_url,
+                            uint8_t *data, int size)
+{
+    av_free(data);
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_queue_poll(UploadQueue *q, int64_t *completed)
+{
+    *completed = 0;
+    return 0;
+}
+
+int ff_upload_queue_flush(UploadQueue *q)
+{
+    return 0;
+}
+
+void ff_upload_queue_free(UploadQueue **pq)
+{
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,94 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_UPLOADQUEUE_H
+#define AVFORMAT_UPLOADQUEUE_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avformat.h"
+
+/**
+ * Queue writing complete files through the io_open() callback of a muxer
+ * from a pool of worker threads.
+ *
+ * Every upload gets an id, increasing in the order the uploads are queued.
+ * Uploads may finish in any order; ff_upload_queue_poll() reports the id up
+ * to which all uploads have finished, so that a playlist referencing them
+ * is only published once they are all written and closed without error.
+ * This does not imply that the server accepted them: the http protocol only
+ * reads the reply to an upload with its connection_pool option.
+ */
+typedef struct UploadQueue UploadQueue;
+
+/**
+ * Allocate an upload queue and start its worker threads.
+ *
+ * @param s             muxer whose io_open()/io_close2() callbacks are used;
+ *                      they are called from the worker threads
+ * @param nb_threads    number of worker threads
+ * @param max_in_flight maximum number of queued and running uploads,
+ *                      ff_upload_queue_add() blocks when it is reached
+ * @param max_retries   number of times a failed upload is retried
+ * @return 0 on success, a negative AVERROR code on failure,
+ *         AVERROR(ENOSYS) if FFmpeg was built without threads
+ */
+int ff_upload_queue_alloc(UploadQueue **pq, AVFormatContext *s, int nb_threads,
+                          int max_in_flight, int max_retries);
+
+/**
+ * Queue writing data to url.
+ *
+ * @param options   options for io_open(), copied
+ * @param tmp_url   if final_url is not NULL, the file written through url
+ *                  (without protocol wrappers such as crypto:), which is
+ *                  renamed to final_url once written
+ * @param data      av_malloc()ed data to write, the queue takes ownership of
+ *                  it, also on failure
+ * @return the id of the upload (> 0), a negative AVERROR code on failure
+ */
+int64_t ff_upload_queue_add(UploadQueue *q, const char *url, AVDictionary *options,
+                            const char *tmp_url, const char *final_url,
+                            uint8_t *data, int size);
+
+/**
+ * Check the progress of the queued uploads without blocking.
+ *
+ * @param completed set to the largest id for which this and all earlier
+ *                  uploads have finished
+ * @return 0, or the error of an upload that failed after all its retries
+ *         since the last call; failed uploads count as finished
+ */
+int ff_upload_queue_poll(UploadQueue *q, int64_t *completed);
+
+/**
+ * Wait for all queued uploads to finish.
+ *
+ * @return 0, or the error of an upload that failed and was not reported by
+ *         ff_upload_queue_poll() yet
+ */
+int ff_upload_queue_flush(UploadQueue *q);
+
+/**
+ * Wait for all queued uploads to finish, stop the worker threads and free
+ * the queue.
+ */
+void ff_upload_queue_free(UploadQueue **pq);
+
+#endif /* AVFORMAT_UPLOADQUEUE_H */
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -85,6 +86,14 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    /**
+     * Return a reference to size bytes of the resource starting at offset
+     * pos, without copying them. The referenced data must be followed by
+     * at least AV_INPUT_BUFFER_PADDING_SIZE zero bytes.
+     * Return AVERROR(ENOSYS) if the data is not available this way.
+     */
+    int (*url_get_buffer)(URLContext *h, int64_t pos, int size,
+                          AVBufferRef **buf);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -253,6 +262,15 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(URLContext *h);
 
+/**
+ * Get a reference to size bytes of the resource starting at offset pos,
+ * without copying them.
+ *
+ * @return 0 on success, AVERROR(ENOSYS) if the protocol cannot provide the
+ *         data this way, another negative error code on failure
+ */
+int ffurl_get_buffer(URLContext *h, int64_t pos, int size, AVBufferRef **buf);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
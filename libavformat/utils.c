@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 #include "config.h"
+#include "config_components.h"
 
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -33,6 +34,7 @@
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "http.h"
 #include "internal.h"
 #if CONFIG_NETWORK
 #include "network.h"
@@ -101,6 +103,8 @@ static int append_packet_chunked(AVIOContext *s, AVPacket *pkt, int size)
 
 int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
+    int ret;
+
 #if FF_API_INIT_PACKET
 FF_DISABLE_DEPRECATION_WARNINGS
     av_init_packet(pkt);
@@ -112,6 +116,16 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     pkt->pos  = avio_tell(s);
 
+    /* reference the data directly if the protocol allows it, e.g. when the
+     * file protocol maps the file into memory */
+    ret = ffio_read_ref(s, size, &pkt->buf);
+    if (ret >= 0) {
+        pkt->data = pkt->buf->data;
+        pkt->size = size;
+        return size;
+    } else if (ret != AVERROR(ENOSYS))
+        return ret;
+
     return append_packet_chunked(s, pkt, size);
 }
 
@@ -569,6 +583,9 @@ int avformat_network_init(void)
 int avformat_network_deinit(void)
 {
 #if CONFIG_NETWORK
+#if CONFIG_HTTP_PROTOCOL || CONFIG_HTTPS_PROTOCOL || CONFIG_HTTPPROXY_PROTOCOL
+    ff_http_pool_flush();
+#endif
     ff_network_close();
     ff_tls_deinit();
 #endif
@@ -293,14 +293,65 @@ AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size
     return pool;
 }
 
+static BufferPoolEntry *pool_entry(AVBufferPool *pool, unsigned idx)
+{
+    unsigned n     = idx - 1;
+    unsigned chunk = av_log2(n / POOL_CHUNK_SIZE + 1);
+
+    return &pool->entries[chunk][n - POOL_CHUNK_SIZE * ((1U << chunk) - 1)];
+}
+
+/* the head of the stack with the generation advanced and idx on top */
+static uintptr_t pool_head(uintptr_t top, unsigned idx)
+{
+    return ((top & ~POOL_IDX_MASK) + POOL_GEN_ONE) | idx;
+}
+
+static void buffer_pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    uintptr_t top = atomic_load_explicit(&pool->pool, memory_order_relaxed);
+
+    do {
+        atomic_store_explicit(&buf->next, top & POOL_IDX_MASK, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->pool, &top,
+                                                    pool_head(top, buf->idx),
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+/* must be called with pool->mutex held if POOL_SERIAL_POP */
+static BufferPoolEntry *buffer_pool_pop(AVBufferPool *pool)
+{
+    uintptr_t top = atomic_load_explicit(&pool->pool, memory_order_acquire);
+    BufferPoolEntry *buf;
+    unsigned next;
+
+    do {
+        if (!(top & POOL_IDX_MASK))
+            return NULL;
+        /* entries are never freed while the pool is in use, so this is safe
+         * even if another thread pops buf in the meantime */
+        buf  = pool_entry(pool, top & POOL_IDX_MASK);
+        next = atomic_load_explicit(&buf->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->pool, &top,
+                                                    pool_head(top, next),
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return buf;
+}
+
+/* free the buffers available for reuse; must not run concurrently with pops */
 static void buffer_pool_flush(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+    uintptr_t top = atomic_exchange_explicit(&pool->pool, 0, memory_order_acquire);
+    unsigned idx  = top & POOL_IDX_MASK;
 
+    while (idx) {
+        BufferPoolEntry *buf = pool_entry(pool, idx);
+
+        idx = atomic_load_explicit(&buf->next, memory_order_relaxed);
         buf->free(buf->opaque, buf->data);
-        av_freep(&buf);
     }
 }
 
@@ -313,6 +364,9 @@ static void buffer_pool_free(AVBufferPool *pool)
     buffer_pool_flush(pool);
     ff_mutex_destroy(&pool->mutex);
 
+    for (int i = 0; i < FF_ARRAY_ELEMS(pool->entries); i++)
+        av_freep(&pool->entries[i]);
+
     if (pool->pool_free)
         pool->pool_free(pool->opaque);
 
@@ -341,15 +395,31 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     BufferPoolEntry *buf = opaque;
     AVBufferPool *pool = buf->pool;
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    buffer_pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
 }
 
+/* get the next unused slot of the entry table, growing it if needed;
+ * must be called with pool->mutex held */
+static BufferPoolEntry *pool_new_entry(AVBufferPool *pool)
+{
+    unsigned chunk = av_log2(pool->nb_entries / POOL_CHUNK_SIZE + 1);
+
+    if (chunk >= POOL_MAX_CHUNKS)
+        return NULL;
+
+    if (!pool->entries[chunk]) {
+        pool->entries[chunk] = av_calloc(POOL_CHUNK_SIZE << chunk,
+                                         sizeof(*pool->entries[chunk]));
+        if (!pool->entries[chunk])
+            return NULL;
+    }
+
+    return pool_entry(pool, pool->nb_entries + 1);
+}
+
 /* allocate a new buffer and override its free() callback so that
  * it is returned to the pool on free */
 static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
@@ -364,7 +434,7 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
     if (!ret)
         return NULL;
 
-    buf = av_mallocz(sizeof(*buf));
+    buf = pool_new_entry(pool);
     if (!buf) {
         av_buffer_unref(&ret);
         return NULL;
@@ -374,6 +444,8 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
     buf->opaque = ret->buffer->opaque;
     buf->free   = ret->buffer->free;
     buf->pool   = pool;
+    buf->idx    = ++pool->nb_entries;
+    atomic_init(&buf->next, 0);
 
     ret->buffer->opaque = buf;
     ret->buffer->free   = pool_release_buffer;
@@ -386,21 +458,30 @@ AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
     AVBufferRef *ret;
     BufferPoolEntry *buf;
 
+#if POOL_SERIAL_POP
     ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
+    buf = buffer_pool_pop(pool);
+    if (!buf)
+        ret = pool_alloc_buffer(pool);
+    ff_mutex_unlock(&pool->mutex);
+#else
+    buf = buffer_pool_pop(pool);
+    if (!buf) {
+        ff_mutex_lock(&pool->mutex);
+        ret = pool_alloc_buffer(pool);
+        ff_mutex_unlock(&pool->mutex);
+    }
+#endif
+
     if (buf) {
         memset(&buf->buffer, 0, sizeof(buf->buffer));
         ret = buffer_create(&buf->buffer, buf->data, pool->size,
                             pool_release_buffer, buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
+        if (ret)
             buf->buffer.flags_internal |= BUFFER_FLAG_NO_FREE;
-        }
-    } else {
-        ret = pool_alloc_buffer(pool);
+        else
+            buffer_pool_push(pool, buf);
     }
-    ff_mutex_unlock(&pool->mutex);
 
     if (ret)
         atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
@@ -65,6 +65,31 @@ struct AVBuffer {
     int flags_internal;
 };
 
+/*
+ * The stack head packs the index of the top entry (plus one, 0 for an empty
+ * stack) in the low half and a generation counter in the high half. The
+ * generation changes on every push and pop, so a pop that raced with others
+ * which removed and pushed back its top entry fails its compare-and-swap
+ * instead of installing a stale next entry (the ABA problem).
+ *
+ * With 32-bit pointers this leaves only 16 bits for the generation, which
+ * may wrap around while a pop is preempted, so there pops are serialized on
+ * the pool mutex instead, which is enough to rule out ABA.
+ */
+#define POOL_IDX_BITS   (sizeof(uintptr_t) * 4)
+#define POOL_IDX_MASK   (((uintptr_t)1 << POOL_IDX_BITS) - 1)
+#define POOL_GEN_ONE    ((uintptr_t)1 << POOL_IDX_BITS)
+#define POOL_SERIAL_POP (UINTPTR_MAX <= UINT32_MAX)
+
+/*
+ * Entries are allocated in chunks of geometrically growing size, which are
+ * never moved or freed while the pool is alive, so that a pop can look up
+ * an entry by index without holding the mutex. Chunk n holds
+ * POOL_CHUNK_SIZE << n entries.
+ */
+#define POOL_CHUNK_SIZE 16
+#define POOL_MAX_CHUNKS (POOL_IDX_BITS - 4)
+
 typedef struct BufferPoolEntry {
     uint8_t *data;
 
@@ -76,7 +101,13 @@ typedef struct BufferPoolEntry {
     void (*free)(void *opaque, uint8_t *data);
 
     AVBufferPool *pool;
-    struct BufferPoolEntry *next;
+
+    /*
+     * Index of this entry in the pool's entry table plus one, and the same
+     * for the next entry on the stack of available buffers (0 for none).
+     */
+    unsigned idx;
+    atomic_uint next;
 
     /*
      * An AVBuffer structure to (re)use as AVBuffer for subsequent uses
@@ -86,8 +117,23 @@ typedef struct BufferPoolEntry {
 } BufferPoolEntry;
 
 struct AVBufferPool {
+    /*
+     * Serializes the calls to the alloc callbacks, which need not be
+     * thread-safe, and the growth of the entry table.
+     */
     AVMutex mutex;
-    BufferPoolEntry *pool;
+
+    /*
+     * Lock-free stack of the BufferPoolEntry holding the buffers that are
+     * available for reuse, see POOL_IDX_BITS for the layout.
+     */
+    atomic_uintptr_t pool;
+
+    /*
+     * Entry table, see POOL_CHUNK_SIZE. Only written with the mutex held.
+     */
+    BufferPoolEntry *entries[POOL_MAX_CHUNKS];
+    unsigned nb_entries;
 
     /*
      * This is used to track when the pool is to be freed.
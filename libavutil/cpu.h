@@ -120,6 +120,26 @@ int av_cpu_count(void);
  */
 void av_cpu_force_count(int count);
 
+/**
+ * Run slice threading on a single process-wide pool of worker threads.
+ *
+ * When count is positive, slice threading contexts created afterwards by
+ * libavcodec, libavfilter and libswscale spawn no threads of their own.
+ * Instead their jobs are run by the calling thread together with whichever
+ * workers of a shared pool of count threads are idle, which bounds the total
+ * number of slice threads in the process. Each context still uses at most as
+ * many threads as it was configured with, capped to count + 1. The pool is
+ * created on first use and destroyed with the last context using it.
+ *
+ * Contexts created before the call are unaffected. Slice threading that
+ * needs dedicated threads (e.g. for libavcodec's main function based slice
+ * threading) does not use the pool.
+ *
+ * @param count maximum number of pool threads, 0 to disable the pool (default)
+ * @return 0 on success, AVERROR(ENOSYS) if threading is not supported
+ */
+int av_cpu_set_shared_threads(int count);
+
 /**
  * Get the maximum data alignment that may be required by FFmpeg.
  *
@@ -28,6 +28,31 @@
 
 #if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
 
+/**
+ * Process-wide pool of worker threads shared by all slice threading
+ * contexts created while av_cpu_set_shared_threads() is in effect.
+ *
+ * Such contexts own no threads. Executing one queues it on the pool, lets
+ * the calling thread start on the jobs and wakes up idle pool workers, which
+ * pick up whatever context is at the head of the queue and help until its
+ * jobs run out. Since the caller always works on its own jobs, progress never
+ * depends on pool workers being available, even with nested execution.
+ */
+typedef struct SharedPool {
+    pthread_t       *workers;
+    int              nb_workers;
+    int              refcount;
+    int              finished;
+    pthread_cond_t   cond;
+    AVSliceThread   *queue;
+} SharedPool;
+
+/* protects shared_max_threads, shared_pool and everything in it, as well as
+ * the queueing state of the contexts running on it */
+static AVMutex shared_mutex = AV_MUTEX_INITIALIZER;
+static int shared_max_threads;
+static SharedPool *shared_pool;
+
 typedef struct WorkerContext {
     AVSliceThread   *ctx;
     pthread_mutex_t mutex;
@@ -52,6 +77,13 @@ struct AVSliceThread {
     void            *priv;
     void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
     void            (*main_func)(void *priv);
+
+    /* state used when running on the shared pool */
+    SharedPool      *pool;
+    AVSliceThread   *next;              ///< next context in pool->queue
+    int             queued;
+    int             nb_participants;    ///< threads that joined the current execution
+    int             nb_helpers;         ///< pool workers still running jobs
 };
 
 static int run_jobs(AVSliceThread *ctx)
@@ -95,6 +127,172 @@ static void *attribute_align_arg thread_worker(void *v)
     }
 }
 
+static void run_shared_jobs(AVSliceThread *ctx, int threadnr)
+{
+    unsigned nb_jobs = ctx->nb_jobs;
+    unsigned jobnr;
+
+    while ((jobnr = atomic_fetch_add_explicit(&ctx->current_job, 1, memory_order_acq_rel)) < nb_jobs)
+        ctx->worker_func(ctx->priv, jobnr, threadnr, nb_jobs, ctx->nb_active_threads);
+}
+
+static void shared_dequeue(SharedPool *pool, AVSliceThread *ctx)
+{
+    AVSliceThread **p = &pool->queue;
+
+    if (!ctx->queued)
+        return;
+
+    while (*p != ctx)
+        p = &(*p)->next;
+    *p = ctx->next;
+    ctx->next   = NULL;
+    ctx->queued = 0;
+}
+
+static void *attribute_align_arg shared_worker(void *v)
+{
+    SharedPool *pool = v;
+
+    ff_mutex_lock(&shared_mutex);
+    while (!pool->finished) {
+        AVSliceThread *ctx = pool->queue;
+        int threadnr;
+
+        if (!ctx) {
+            pthread_cond_wait(&pool->cond, &shared_mutex);
+            continue;
+        }
+
+        threadnr = ctx->nb_participants++;
+        ctx->nb_helpers++;
+        if (ctx->nb_participants == ctx->nb_active_threads)
+            shared_dequeue(pool, ctx);
+        ff_mutex_unlock(&shared_mutex);
+
+        run_shared_jobs(ctx, threadnr);
+
+        ff_mutex_lock(&shared_mutex);
+        if (!--ctx->nb_helpers)
+            pthread_cond_signal(&ctx->done_cond);
+    }
+    ff_mutex_unlock(&shared_mutex);
+
+    return NULL;
+}
+
+static void shared_pool_free(SharedPool *pool)
+{
+    ff_mutex_lock(&shared_mutex);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->cond);
+    ff_mutex_unlock(&shared_mutex);
+
+    for (int i = 0; i < pool->nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_cond_destroy(&pool->cond);
+    av_freep(&pool->workers);
+    av_free(pool);
+}
+
+/* must be called with shared_mutex held */
+static SharedPool *shared_pool_ref(void)
+{
+    SharedPool *pool = shared_pool;
+
+    if (pool) {
+        pool->refcount++;
+        return pool;
+    }
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->workers = av_calloc(shared_max_threads, sizeof(*pool->workers));
+    if (!pool->workers) {
+        av_free(pool);
+        return NULL;
+    }
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (int i = 0; i < shared_max_threads; i++) {
+        if (pthread_create(&pool->workers[i], NULL, shared_worker, pool))
+            break;
+        pool->nb_workers++;
+    }
+    if (!pool->nb_workers) {
+        pthread_cond_destroy(&pool->cond);
+        av_freep(&pool->workers);
+        av_free(pool);
+        return NULL;
+    }
+
+    pool->refcount = 1;
+    shared_pool    = pool;
+
+    return pool;
+}
+
+static void shared_pool_unref(SharedPool *pool)
+{
+    int last;
+
+    ff_mutex_lock(&shared_mutex);
+    last = !--pool->refcount;
+    if (last && shared_pool == pool)
+        shared_pool = NULL;
+    ff_mutex_unlock(&shared_mutex);
+
+    if (last)
+        shared_pool_free(pool);
+}
+
+static void shared_execute(AVSliceThread *ctx, int nb_jobs)
+{
+    SharedPool *pool = ctx->pool;
+    int nb_helpers;
+
+    ctx->nb_jobs           = nb_jobs;
+    ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
+    atomic_store_explicit(&ctx->current_job, 1, memory_order_relaxed);
+
+    nb_helpers = FFMIN(ctx->nb_active_threads - 1, pool->nb_workers);
+    if (nb_helpers > 0) {
+        AVSliceThread **p = &pool->queue;
+
+        ff_mutex_lock(&shared_mutex);
+        ctx->nb_participants = 1;
+        while (*p)
+            p = &(*p)->next;
+        *p          = ctx;
+        ctx->queued = 1;
+        for (int i = 0; i < nb_helpers; i++)
+            pthread_cond_signal(&pool->cond);
+        ff_mutex_unlock(&shared_mutex);
+    }
+
+    /* job 0 always runs with threadnr 0, see avpriv_slicethread_execute() */
+    ctx->worker_func(ctx->priv, 0, 0, nb_jobs, ctx->nb_active_threads);
+    run_shared_jobs(ctx, 0);
+
+    if (nb_helpers > 0) {
+        ff_mutex_lock(&shared_mutex);
+        shared_dequeue(pool, ctx);
+        while (ctx->nb_helpers)
+            pthread_cond_wait(&ctx->done_cond, &shared_mutex);
+        ff_mutex_unlock(&shared_mutex);
+    }
+}
+
+int av_cpu_set_shared_threads(int count)
+{
+    ff_mutex_lock(&shared_mutex);
+    shared_max_threads = FFMAX(count, 0);
+    ff_mutex_unlock(&shared_mutex);
+    return 0;
+}
+
 int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
                               void (*main_func)(void *priv),
@@ -120,6 +318,29 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     if (!ctx)
         return AVERROR(ENOMEM);
 
+    /* main_func expects the jobs to run concurrently on dedicated workers,
+     * so such contexts keep threads of their own */
+    if (!main_func && nb_threads > 1) {
+        ff_mutex_lock(&shared_mutex);
+        if (shared_max_threads) {
+            ctx->pool = shared_pool_ref();
+            if (ctx->pool)
+                nb_threads = FFMIN(nb_threads, ctx->pool->nb_workers + 1);
+        }
+        ff_mutex_unlock(&shared_mutex);
+
+        if (ctx->pool) {
+            ctx->priv        = priv;
+            ctx->worker_func = worker_func;
+            ctx->nb_threads  = nb_threads;
+            atomic_init(&ctx->first_job, 0);
+            atomic_init(&ctx->current_job, 0);
+            pthread_mutex_init(&ctx->done_mutex, NULL);
+            pthread_cond_init(&ctx->done_cond, NULL);
+            return nb_threads;
+        }
+    }
+
     if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
         av_freep(pctx);
         return AVERROR(ENOMEM);
@@ -170,6 +391,12 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     int nb_workers, i, is_last = 0;
 
     av_assert0(nb_jobs > 0);
+
+    if (ctx->pool) {
+        shared_execute(ctx, nb_jobs);
+        return;
+    }
+
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
@@ -209,6 +436,15 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
         return;
 
     ctx = *pctx;
+
+    if (ctx->pool) {
+        shared_pool_unref(ctx->pool);
+        pthread_cond_destroy(&ctx->done_cond);
+        pthread_mutex_destroy(&ctx->done_mutex);
+        av_freep(pctx);
+        return;
+    }
+
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
@@ -237,6 +473,11 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
 
 #else /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS32THREADS */
 
+int av_cpu_set_shared_threads(int count)
+{
+    return count > 0 ? AVERROR(ENOSYS) : 0;
+}
+
 int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
                               void (*main_func)(void *priv),
@@ -37,6 +37,9 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
 
 /**
  * Execute slice threading.
+ * Job 0 is always executed with threadnr 0, also with the shared thread pool,
+ * so callers may keep state set up before the execution for it in the
+ * per-thread context of thread 0. Other jobs may run with any threadnr.
  * @param ctx slice threading context
  * @param nb_jobs number of jobs, must be > 0
  * @param execute_main also execute main_func
@@ -0,0 +1,203 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Tests AVBufferPool reuse and concurrent get/release.
+ *
+ * Run with "-t [threads] [iterations]" to benchmark the contended
+ * av_buffer_pool_get()/av_buffer_unref() throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define POOL_BUF_SIZE   1024
+#define NB_HELD         4
+#define MAX_THREADS     64
+
+static int test_reuse(void)
+{
+    AVBufferPool *pool = av_buffer_pool_init(POOL_BUF_SIZE, NULL);
+    /* enough buffers to span several chunks of the pool's entry table */
+    AVBufferRef *bufs[40];
+    uint8_t *data[40];
+    int reused = 0;
+
+    if (!pool)
+        return 1;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++) {
+        bufs[i] = av_buffer_pool_get(pool);
+        if (!bufs[i])
+            return 1;
+        data[i] = bufs[i]->data;
+        for (int j = 0; j < i; j++)
+            if (data[i] == data[j]) {
+                printf("buffer %d handed out twice\n", i);
+                return 1;
+            }
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        av_buffer_unref(&bufs[i]);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++) {
+        bufs[i] = av_buffer_pool_get(pool);
+        if (!bufs[i])
+            return 1;
+        for (int j = 0; j < FF_ARRAY_ELEMS(data); j++)
+            reused += bufs[i]->data == data[j];
+    }
+
+    /* the pool is released while buffers are still in use */
+    av_buffer_pool_uninit(&pool);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        av_buffer_unref(&bufs[i]);
+
+    printf("reused %d of %d buffers\n", reused, (int)FF_ARRAY_ELEMS(bufs));
+
+    return reused != FF_ARRAY_ELEMS(bufs);
+}
+
+#if HAVE_THREADS
+typedef struct PoolLimit {
+    int nb_allocated;
+    int max_allocated;
+} PoolLimit;
+
+/* alloc callback of a pool that holds a fixed number of buffers, like
+ * the hardware frame pools; calls are serialized by the pool */
+static AVBufferRef *limited_alloc(void *opaque, size_t size)
+{
+    PoolLimit *limit = opaque;
+
+    if (limit->nb_allocated >= limit->max_allocated)
+        return NULL;
+    limit->nb_allocated++;
+
+    return av_buffer_alloc(size);
+}
+
+typedef struct ThreadCtx {
+    pthread_t     thread;
+    AVBufferPool *pool;
+    int           idx;
+    int           iterations;
+    int           errors;
+} ThreadCtx;
+
+static void *thread_main(void *arg)
+{
+    ThreadCtx *t = arg;
+    AVBufferRef *held[NB_HELD] = { NULL };
+
+    for (int i = 0; i < t->iterations; i++) {
+        AVBufferRef **buf = &held[i % NB_HELD];
+        uint8_t pattern = t->idx * 31 + i;
+
+        /* make sure nobody else wrote to our buffer while we held it */
+        if (*buf && ((*buf)->data[0] != (*buf)->data[POOL_BUF_SIZE - 1] ||
+                     (*buf)->data[0] != (uint8_t)(pattern - NB_HELD)))
+            t->errors++;
+        av_buffer_unref(buf);
+
+        *buf = av_buffer_pool_get(t->pool);
+        if (!*buf) {
+            t->errors++;
+            break;
+        }
+        (*buf)->data[0]                 = pattern;
+        (*buf)->data[POOL_BUF_SIZE - 1] = pattern;
+    }
+
+    for (int i = 0; i < NB_HELD; i++)
+        av_buffer_unref(&held[i]);
+
+    return NULL;
+}
+
+static int test_threads(int nb_threads, int iterations, int bench)
+{
+    /* each thread holds at most NB_HELD buffers and returns one before
+     * getting the next, so the pool must never need more than this */
+    PoolLimit limit = { .max_allocated = nb_threads * NB_HELD };
+    AVBufferPool *pool = av_buffer_pool_init2(POOL_BUF_SIZE, &limit,
+                                              limited_alloc, NULL);
+    ThreadCtx threads[MAX_THREADS];
+    int64_t start;
+    int errors = 0, ret;
+
+    if (!pool)
+        return 1;
+
+    start = av_gettime_relative();
+
+    for (int i = 0; i < nb_threads; i++) {
+        threads[i] = (ThreadCtx){ .pool = pool, .idx = i,
+                                  .iterations = iterations };
+        if ((ret = pthread_create(&threads[i].thread, NULL, thread_main, &threads[i]))) {
+            fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+            return 1;
+        }
+    }
+    for (int i = 0; i < nb_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        errors += threads[i].errors;
+    }
+
+    if (bench) {
+        double elapsed = (av_gettime_relative() - start) / 1000000.0;
+        fprintf(stderr, "%d threads: %d get/release pairs in %.3fs, %.0f/s\n",
+                nb_threads, nb_threads * iterations, elapsed,
+                nb_threads * iterations / FFMAX(elapsed, 1e-6));
+    }
+
+    av_buffer_pool_uninit(&pool);
+
+    printf("%d threads: %s\n", nb_threads, errors ? "failed" : "ok");
+
+    return !!errors;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int ret = test_reuse();
+
+#if HAVE_THREADS
+    if (argc > 1 && !strcmp(argv[1], "-t")) {
+        int nb_threads = argc > 2 ? av_clip(atoi(argv[2]), 1, MAX_THREADS) : 8;
+        int iterations = argc > 3 ? FFMAX(atoi(argv[3]), 1) : 1000000;
+
+        for (int n = 1; n <= nb_threads; n *= 2)
+            ret |= test_threads(n, iterations, 1);
+    } else {
+        ret |= test_threads(8, 10000, 0);
+    }
+#endif
+
+    return ret;
+}
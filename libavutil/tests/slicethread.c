@@ -0,0 +1,143 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Runs several slice threading contexts concurrently, with private threads
+ * and on the shared pool, and checks that every job runs exactly once with a
+ * thread number that no other thread uses at the same time.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+
+#define NB_CONTEXTS     4
+#define NB_THREADS      4
+#define NB_JOBS         37
+#define NB_EXECUTIONS   200
+
+typedef struct TestContext {
+    AVSliceThread   *thread;
+    AVSliceThread   *nested;
+    pthread_t        caller;
+    atomic_int       runs[NB_JOBS];
+    atomic_int       busy[NB_THREADS];
+    atomic_int       nested_runs;
+    atomic_int       errors;
+    int              nb_threads;
+} TestContext;
+
+static void nested_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    TestContext *t = priv;
+    atomic_fetch_add(&t->nested_runs, 1);
+}
+
+static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    TestContext *t = priv;
+
+    if (threadnr < 0 || threadnr >= t->nb_threads ||
+        atomic_fetch_add(&t->busy[threadnr], 1)) {
+        atomic_fetch_add(&t->errors, 1);
+        return;
+    }
+
+    atomic_fetch_add(&t->runs[jobnr], 1);
+
+    // execute another context from within a job
+    if (!jobnr && t->nested)
+        avpriv_slicethread_execute(t->nested, NB_JOBS, 0);
+
+    atomic_fetch_sub(&t->busy[threadnr], 1);
+}
+
+static void *caller_main(void *arg)
+{
+    TestContext *t = arg;
+
+    for (int i = 0; i < NB_EXECUTIONS; i++) {
+        avpriv_slicethread_execute(t->thread, NB_JOBS, 0);
+        for (int j = 0; j < NB_JOBS; j++)
+            if (atomic_exchange(&t->runs[j], 0) != 1)
+                atomic_fetch_add(&t->errors, 1);
+        if (atomic_exchange(&t->nested_runs, 0) != (t->nested ? NB_JOBS : 0))
+            atomic_fetch_add(&t->errors, 1);
+    }
+
+    return NULL;
+}
+
+static int run_test(const char *name)
+{
+    static TestContext ctx[NB_CONTEXTS];
+    int errors = 0, ret;
+
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        TestContext *t = &ctx[i];
+
+        *t = (TestContext){ 0 };
+        ret = avpriv_slicethread_create(&t->thread, t, worker_func, NULL, NB_THREADS);
+        if (ret < 0)
+            return 1;
+        t->nb_threads = ret;
+        atomic_init(&t->nested_runs, 0);
+        atomic_init(&t->errors, 0);
+        for (int j = 0; j < NB_JOBS; j++)
+            atomic_init(&t->runs[j], 0);
+        for (int j = 0; j < NB_THREADS; j++)
+            atomic_init(&t->busy[j], 0);
+
+        if (i & 1) {
+            ret = avpriv_slicethread_create(&t->nested, t, nested_func, NULL, NB_THREADS);
+            if (ret < 0)
+                return 1;
+        }
+    }
+
+    for (int i = 0; i < NB_CONTEXTS; i++)
+        if (pthread_create(&ctx[i].caller, NULL, caller_main, &ctx[i]))
+            return 1;
+
+    for (int i = 0; i < NB_CONTEXTS; i++) {
+        pthread_join(ctx[i].caller, NULL);
+        errors += atomic_load(&ctx[i].errors);
+        avpriv_slicethread_free(&ctx[i].thread);
+        avpriv_slicethread_free(&ctx[i].nested);
+    }
+
+    printf("%s: %s\n", name, errors ? "failed" : "ok");
+
+    return !!errors;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    ret |= run_test("private threads");
+
+    if (av_cpu_set_shared_threads(3) < 0)
+        return 1;
+    ret |= run_test("shared threads");
+
+    return ret;
+}
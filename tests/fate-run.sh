@@ -125,6 +125,56 @@ probegaplessinfo(){
     tail -n 9 "$framefile1"
 }
 
+probecache(){
+    cachedir="${outdir}/${test}.cache"
+    probefile1="${outdir}/${test}.probe1"
+    probefile2="${outdir}/${test}.probe2"
+    cleanfiles="$cleanfiles $probefile1 $probefile2"
+    rm -rf "$cachedir"
+    mkdir -p "$cachedir"
+    run ffprobe${PROGSUF}${EXECSUF} -bitexact -probe_cache "$cachedir" -show_streams -show_format "$@" > "$probefile1"
+    run ffprobe${PROGSUF}${EXECSUF} -bitexact -probe_cache "$cachedir" -show_streams -show_format -v verbose "$@" 2>&1 > "$probefile2" |
+        grep -o "Stream info restored from the probe cache"
+    cat "$probefile1"
+    diff -u "$probefile1" "$probefile2" || return
+    rm -rf "$cachedir"
+}
+
+dashenc(){
+    dashdir="${outdir}/${test}.dir"
+    rm -rf "$dashdir"
+    mkdir -p "$dashdir"
+    ffmpeg "$@" -f dash -seg_duration 1 -use_template 1 -use_timeline 0 \
+        -flags +bitexact -fflags +bitexact $(target_path $dashdir/out.mpd) || return
+    for file in $(ls "$dashdir"); do
+        cleanfiles="$cleanfiles $dashdir/$file"
+    done
+}
+
+dashsegments(){
+    segments=$(target_path $dashdir/init-stream0.m4s)
+    for seg in $(ls "$dashdir" | grep '^chunk-stream0-'); do
+        segments="$segments|$(target_path $dashdir/$seg)"
+    done
+    ffmpeg -flags +bitexact -i "concat:$segments" -c copy -fflags +bitexact -f framecrc -
+}
+
+dashcmaf(){
+    dashenc "$@" -cmaf 1 || return
+    grep -o 'profiles="[^"]*"' "$dashdir/out.mpd"
+    cat "$dashdir/master.m3u8"
+    dashsegments
+}
+
+dashchunks(){
+    dashenc "$@" -streaming 1 -ldash 1 -hls_playlist 1 -frag_type frames || return
+    grep -o 'availabilityTimeOffset="[^"]*"' "$dashdir/out.mpd"
+    for seg in $(ls "$dashdir" | grep '^chunk-stream0-'); do
+        echo "$seg" moof $(grep -ao moof "$dashdir/$seg" | wc -l)
+    done
+    dashsegments
+}
+
 ffmpeg(){
     dec_opts="-hwaccel $hwaccel -threads $threads -thread_type $thread_type"
     ffmpeg_args="-nostdin -nostats -noauto_conversion_filters -cpuflags $cpuflags"
@@ -158,6 +158,20 @@ fate-aac-aref-encode: CMP_TARGET = 596
 fate-aac-aref-encode: SIZE_TOLERANCE = 2464
 fate-aac-aref-encode: FUZZ = 89
 
+# the channels are searched in parallel with slice threads, which must not
+# change the output of the default coder
+FATE_AAC_TWOLOOP_ENCODE = fate-aac-twoloop-encode fate-aac-twoloop-encode-threads
+FATE_AAC_ENCODE += $(FATE_AAC_TWOLOOP_ENCODE)
+$(FATE_AAC_TWOLOOP_ENCODE): ./tests/data/asynth-44100-2.wav
+$(FATE_AAC_TWOLOOP_ENCODE): CMD = enc_dec_pcm adts wav s16le $(REF) -c:a aac -b:a 256k $(ENCOPTS) -fflags +bitexact -flags +bitexact
+$(FATE_AAC_TWOLOOP_ENCODE): CMP = stddev
+$(FATE_AAC_TWOLOOP_ENCODE): REF = ./tests/data/asynth-44100-2.wav
+$(FATE_AAC_TWOLOOP_ENCODE): CMP_SHIFT = -4096
+$(FATE_AAC_TWOLOOP_ENCODE): CMP_TARGET = 596
+$(FATE_AAC_TWOLOOP_ENCODE): SIZE_TOLERANCE = 2464
+$(FATE_AAC_TWOLOOP_ENCODE): FUZZ = 60
+fate-aac-twoloop-encode-threads: ENCOPTS = -threads 2
+
 FATE_AAC_ENCODE += fate-aac-ln-encode
 fate-aac-ln-encode: CMD = enc_dec_pcm adts wav s16le $(TARGET_SAMPLES)/audio-reference/luckynight_2ch_44kHz_s16.wav -c:a aac -aac_coder fast -aac_is 0 -aac_pns 0 -aac_ms 0 -aac_tns 0 -b:a 512k -fflags +bitexact -flags +bitexact
 fate-aac-ln-encode: CMP = stddev
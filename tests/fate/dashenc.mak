@@ -0,0 +1,17 @@
+FATE_DASHENC-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER AEVALSRC_FILTER ARESAMPLE_FILTER MPEG4_ENCODER MP2FIXED_ENCODER DASH_MUXER MP4_MUXER CONCAT_PROTOCOL MOV_DEMUXER FRAMECRC_MUXER) += fate-dash-cmaf
+fate-dash-cmaf: CMD = dashcmaf -auto_conversion_filters -f lavfi -i "testsrc2=s=64x64:r=10:d=3,format=yuv420p" -f lavfi -i "aevalsrc=sin(440*2*PI*t):d=3" -map 0 -map 1 -c:v mpeg4 -g 10 -c:a mp2fixed -metadata:s:a language=eng
+
+# chunks of 3 frames in 1 second segments, the LL-HLS parts in the media
+# playlists are byte ranges of these chunks
+FATE_DASHENC-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER MPEG4_ENCODER DASH_MUXER MP4_MUXER CONCAT_PROTOCOL MOV_DEMUXER FRAMECRC_MUXER) += fate-dash-ll-chunks
+fate-dash-ll-chunks: CMD = dashchunks -f lavfi -i "testsrc2=s=64x64:r=10:d=3,format=yuv420p" -c:v mpeg4 -g 10 -frag_frames 3
+
+# the LL-HLS parts of chunks whose frames get longer than the first ones
+# must stay within the part target
+FATE_DASHENC_PARTS-$(call ALLYES, DASH_MUXER MP4_MUXER FILE_PROTOCOL) += fate-dash-ll-parts
+fate-dash-ll-parts: libavformat/tests/dashenc$(EXESUF)
+fate-dash-ll-parts: CMD = run libavformat/tests/dashenc$(EXESUF) $(TARGET_PATH)/tests/data/fate/dash-ll-parts.dir
+
+FATE_FFMPEG += $(FATE_DASHENC-yes)
+FATE_LIBAVFORMAT += $(FATE_DASHENC_PARTS-yes)
+fate-dashenc: $(FATE_DASHENC-yes) $(FATE_DASHENC_PARTS-yes)
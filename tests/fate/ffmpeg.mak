@@ -26,6 +26,32 @@ fate-mapchan: $(FATE_MAPCHAN)
 FATE_FFMPEG-$(call FILTERFRAMECRC, COLOR) += fate-ffmpeg-filter_complex
 fate-ffmpeg-filter_complex: CMD = framecrc -filter_complex color=d=1:r=5 -fflags +bitexact
 
+# packets referencing the mapped input file
+FATE_FFMPEG-$(call DEMMUX, WAV, FRAMECRC) += fate-ffmpeg-file-mmap
+fate-ffmpeg-file-mmap: tests/data/asynth-44100-2.wav
+fate-ffmpeg-file-mmap: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav -c copy
+
+FATE_FFMPEG-$(call TRANSCODE, PCM_S16LE, MOV, WAV_DEMUXER) += fate-ffmpeg-file-mmap-mov
+fate-ffmpeg-file-mmap-mov: tests/data/asynth-44100-2.wav
+fate-ffmpeg-file-mmap-mov: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-2.wav mov "-c:a pcm_s16le" "-c copy" "" "" "-mmap 1"
+
+FATE_FFMPEG-$(call TRANSCODE, MPEG2VIDEO, MXF, RAWVIDEO_DEMUXER) += fate-ffmpeg-file-mmap-mxf
+fate-ffmpeg-file-mmap-mxf: tests/data/vsynth1.yuv
+fate-ffmpeg-file-mmap-mxf: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" $(TARGET_PATH)/tests/data/vsynth1.yuv mxf "-c:v mpeg2video -frames:v 10" "-c copy" "" "" "-mmap 1"
+
+# io_uring read-ahead with a window much smaller than the file, falls back to
+# regular reads where io_uring is not available
+FATE_FFMPEG-$(call DEMMUX, WAV, FRAMECRC) += fate-ffmpeg-file-io_uring
+fate-ffmpeg-file-io_uring: tests/data/asynth-44100-2.wav
+fate-ffmpeg-file-io_uring: CMD = framecrc -io_uring 1 -io_uring_depth 3 -io_uring_window 20000 -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav -c copy
+fate-ffmpeg-file-io_uring: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-file-mmap
+
+# ranges much smaller than the file, read over several connections
+FATE_FFMPEG-$(call DEMMUX, WAV, FRAMECRC, PARALLEL_PROTOCOL) += fate-ffmpeg-parallel
+fate-ffmpeg-parallel: tests/data/asynth-44100-2.wav
+fate-ffmpeg-parallel: CMD = framecrc -connections 3 -range_size 8192 -buffer_size 32768 -i parallel:$(TARGET_PATH)/tests/data/asynth-44100-2.wav -c copy
+fate-ffmpeg-parallel: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-file-mmap
+
 # Ticket 6603
 FATE_FFMPEG-$(call FILTERFRAMECRC, AEVALSRC ASETNSAMPLES ARESAMPLE, AC3_FIXED_ENCODER) += fate-ffmpeg-filter_complex_audio
 fate-ffmpeg-filter_complex_audio: CMD = framecrc -auto_conversion_filters -filter_complex "aevalsrc=0:d=0.1,asetnsamples=1537" -c ac3_fixed
@@ -13,6 +13,17 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_default
 fate-ffprobe_default: $(FFPROBE_TEST_FILE)
 fate-ffprobe_default: CMD = run $(FFPROBE_COMMAND) -of default
 
+# decoding the streams in parallel while probing must not change the result
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_probe_threads
+fate-ffprobe_probe_threads: $(FFPROBE_TEST_FILE)
+fate-ffprobe_probe_threads: CMD = run $(FFPROBE_COMMAND) -of default -probe_threads 4
+fate-ffprobe_probe_threads: REF = $(SRC_PATH)/tests/ref/fate/ffprobe_default
+
+# the second run restores the stream information from the cache
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_probe_cache
+fate-ffprobe_probe_cache: $(FFPROBE_TEST_FILE)
+fate-ffprobe_probe_cache: CMD = probecache $(TARGET_PATH)/$(FFPROBE_TEST_FILE) -print_filename $(FFPROBE_TEST_FILE)
+
 FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_flat
 fate-ffprobe_flat: $(FFPROBE_TEST_FILE)
 fate-ffprobe_flat: CMD = run $(FFPROBE_COMMAND) -of flat
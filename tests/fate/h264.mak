@@ -233,6 +233,22 @@ FATE_H264-$(call FRAMECRC, MPEGTS, H264, H264_PARSER MP3_DECODER SCALE_FILTER AR
 FATE_H264_FFPROBE-$(call DEMDEC, MATROSKA, H264) += fate-h264-dts_5frames
 FATE_H264_FFPROBE-$(call PARSERDEMDEC, H264, H264, H264) += fate-h264-afd
 
+# frame threads decoding the slices of each picture with slice threads must
+# match the single-threaded references
+FATE_H264_FRAME_SLICE_THREADS = ba1_ft_c                                \
+                                cabast3_sony_e                          \
+                                cabastbr3_sony_b                        \
+                                capama3_sand_f                          \
+
+FATE_H264_FRAME_SLICE_THREADS := $(FATE_H264_FRAME_SLICE_THREADS:%=fate-h264-frame-slice-threads-%)
+$(FATE_H264_FRAME_SLICE_THREADS): THREADS = 2
+$(FATE_H264_FRAME_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-$(subst fate-h264-frame-slice-threads-,,$(@))
+FATE_H264-$(call FRAMECRC, H264, H264, H264_PARSER) += $(FATE_H264_FRAME_SLICE_THREADS)
+fate-h264-frame-slice-threads-ba1_ft_c:           CMD = framecrc -slice_threads 2 -framerate 19 -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
+fate-h264-frame-slice-threads-cabast3_sony_e:     CMD = framecrc -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CABAST3_Sony_E.jsv
+fate-h264-frame-slice-threads-cabastbr3_sony_b:   CMD = framecrc -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CABASTBR3_Sony_B.jsv
+fate-h264-frame-slice-threads-capama3_sand_f:     CMD = framecrc -slice_threads 2 -i $(TARGET_SAMPLES)/h264-conformance/CAPAMA3_Sand_F.264
+
 FATE_SAMPLES_AVCONV += $(FATE_H264-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_H264_FFPROBE-yes)
 fate-h264: $(FATE_H264-yes) $(FATE_H264_FFPROBE-yes)
@@ -210,6 +210,26 @@ FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER) +=         \
                                                     $(HEVC_TESTS_422_10BIN) \
                                                     $(HEVC_TESTS_444_12BIT) \
 
+# tiles decoded in parallel with slice threads must match the references
+HEVC_TILES_SAMPLES = TILES_A_Cisco_2 TILES_B_Cisco_1
+HEVC_TESTS_TILES_SLICE_THREADS = $(addprefix fate-hevc-tiles-slice-threads-, $(HEVC_TILES_SAMPLES))
+$(HEVC_TESTS_TILES_SLICE_THREADS): THREADS = 4
+$(HEVC_TESTS_TILES_SLICE_THREADS): THREAD_TYPE = slice
+$(HEVC_TESTS_TILES_SLICE_THREADS): CMD = framecrc -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(subst fate-hevc-tiles-slice-threads-,,$(@)).bit -pix_fmt yuv420p
+$(HEVC_TESTS_TILES_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(subst fate-hevc-tiles-slice-threads-,,$(@))
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += $(HEVC_TESTS_TILES_SLICE_THREADS)
+
+# frame threads decoding the wavefront rows of each picture with slice
+# threads must match the references
+HEVC_WPP_SAMPLES = WPP_A_ericsson_MAIN_2 WPP_B_ericsson_MAIN_2 WPP_C_ericsson_MAIN_2 \
+                   WPP_D_ericsson_MAIN_2 WPP_E_ericsson_MAIN_2 WPP_F_ericsson_MAIN_2
+HEVC_TESTS_FRAME_SLICE_THREADS = $(addprefix fate-hevc-frame-slice-threads-, $(HEVC_WPP_SAMPLES))
+$(HEVC_TESTS_FRAME_SLICE_THREADS): THREADS = 2
+$(HEVC_TESTS_FRAME_SLICE_THREADS): THREAD_TYPE = frame+slice
+$(HEVC_TESTS_FRAME_SLICE_THREADS): CMD = framecrc -slice_threads 2 -flags unaligned -i $(TARGET_SAMPLES)/hevc-conformance/$(subst fate-hevc-frame-slice-threads-,,$(@)).bit -pix_fmt yuv420p
+$(HEVC_TESTS_FRAME_SLICE_THREADS): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(subst fate-hevc-frame-slice-threads-,,$(@))
+FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER) += $(HEVC_TESTS_FRAME_SLICE_THREADS)
+
 fate-hevc-paramchange-yuv420p-yuv420p10: CMD = framecrc -vsync passthrough -i $(TARGET_SAMPLES)/hevc/paramchange_yuv420p_yuv420p10.hevc -sws_flags area+accurate_rnd+bitexact
 FATE_HEVC-$(call FRAMECRC, HEVC, HEVC, HEVC_PARSER SCALE_FILTER LARGE_TESTS) += fate-hevc-paramchange-yuv420p-yuv420p10
 
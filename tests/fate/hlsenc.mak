@@ -41,6 +41,21 @@ fate-hls-live-endlist: CMD = md5 -i $(SRC) -af hdcd=process_stereo=false -t 20 -
 fate-hls-live-endlist: CMP = oneline
 fate-hls-live-endlist: REF = e189ce781d9c87882f58e3929455167b
 
+tests/data/live_endlist_upload.m3u8: TAG = GEN
+tests/data/live_endlist_upload.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" -f hls -hls_time 3 -map 0 \
+        -hls_list_size 0 -upload_threads 2 -upload_queue_size 2 -codec:a mp2fixed \
+        -hls_segment_filename $(TARGET_PATH)/tests/data/live_endlist_upload_%d.ts \
+        $(TARGET_PATH)/tests/data/live_endlist_upload.m3u8 2>/dev/null
+
+FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-live-endlist-upload
+fate-hls-live-endlist-upload: tests/data/live_endlist_upload.m3u8
+fate-hls-live-endlist-upload: SRC = $(TARGET_PATH)/tests/data/live_endlist_upload.m3u8
+fate-hls-live-endlist-upload: CMD = md5 -i $(SRC) -af hdcd=process_stereo=false -t 20 -f s24le
+fate-hls-live-endlist-upload: CMP = oneline
+fate-hls-live-endlist-upload: REF = e189ce781d9c87882f58e3929455167b
+
 tests/data/hls_segment_size.m3u8: TAG = GEN
 tests/data/hls_segment_size.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -97,6 +112,23 @@ FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILT
 fate-hls-fmp4: tests/data/hls_fmp4.m3u8
 fate-hls-fmp4: CMD = framecrc -auto_conversion_filters -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_fmp4.m3u8 -vf setpts=N*23
 
+FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-fmp4-prefetch
+fate-hls-fmp4-prefetch: tests/data/hls_fmp4.m3u8
+fate-hls-fmp4-prefetch: CMD = framecrc -auto_conversion_filters -flags +bitexact -prefetch_segments 3 -i $(TARGET_PATH)/tests/data/hls_fmp4.m3u8 -vf setpts=N*23
+fate-hls-fmp4-prefetch: REF = $(SRC_PATH)/tests/ref/fate/hls-fmp4
+
+tests/data/hls_ll.m3u8: TAG = GEN
+tests/data/hls_ll.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=5" -map 0 -codec:a mp2fixed \
+	-hls_segment_type fmp4 -hls_fmp4_init_filename hls_ll_init.mp4 -hls_list_size 0 \
+	-hls_time 1 -hls_part_time 0.3 -hls_segment_filename "$(TARGET_PATH)/tests/data/hls_ll_%d.m4s" \
+	$(TARGET_PATH)/tests/data/hls_ll.m3u8 2>/dev/null
+
+FATE_HLSENC-$(call ALLYES, MOV_DEMUXER MP4_MUXER CONCAT_PROTOCOL AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-ll-parts
+fate-hls-ll-parts: tests/data/hls_ll.m3u8
+fate-hls-ll-parts: CMD = framecrc -flags +bitexact -i "concat:$(TARGET_PATH)/tests/data/hls_ll_init.mp4|$(TARGET_PATH)/tests/data/hls_ll_1.part0.m4s|$(TARGET_PATH)/tests/data/hls_ll_1.part1.m4s|$(TARGET_PATH)/tests/data/hls_ll_1.part2.m4s|$(TARGET_PATH)/tests/data/hls_ll_1.part3.m4s" -c copy
+
 tests/data/hls_fmp4_ac3.m3u8: TAG = GEN
 tests/data/hls_fmp4_ac3.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -109,6 +141,12 @@ FATE_HLSENC_PROBE-$(call ALLYES, HLS_DEMUXER EAC3_DEMUXER) += fate-hls-fmp4_ac3
 fate-hls-fmp4_ac3: tests/data/hls_fmp4_ac3.m3u8
 fate-hls-fmp4_ac3: CMD = probeaudiostream $(TARGET_PATH)/tests/data/now_ac3.mp4
 
+# the low-latency media playlist published while the stream is muxed
+FATE_HLSENC_PLAYLIST-$(call ALLYES, HLS_MUXER MP4_MUXER) += fate-hls-ll-playlist
+fate-hls-ll-playlist: libavformat/tests/hlsenc$(EXESUF)
+fate-hls-ll-playlist: CMD = run libavformat/tests/hlsenc$(EXESUF)
+
+FATE_LIBAVFORMAT += $(FATE_HLSENC_PLAYLIST-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_HLSENC-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_HLSENC_PROBE-yes)
-fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes)
+fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes) $(FATE_HLSENC_PLAYLIST-yes)
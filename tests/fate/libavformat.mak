@@ -22,6 +22,13 @@ FATE_LIBAVFORMAT-$(CONFIG_MOV_MUXER) += fate-movenc
 fate-movenc: libavformat/tests/movenc$(EXESUF)
 fate-movenc: CMD = run libavformat/tests/movenc$(EXESUF)
 
+# packets of zero-copy demuxers referencing the input mapped with -mmap 1
+FATE_LIBAVFORMAT_MMAP-$(call ALLYES, FILE_PROTOCOL WAV_DEMUXER MOV_MUXER MOV_DEMUXER) += fate-mmap
+fate-mmap: tests/data/asynth-44100-2.wav
+fate-mmap: libavformat/tests/mmap$(EXESUF)
+fate-mmap: CMD = run libavformat/tests/mmap$(EXESUF) $(TARGET_PATH)/tests/data/asynth-44100-2.wav $(TARGET_PATH)/tests/data/mmap.mov
+FATE_LIBAVFORMAT-$(HAVE_MMAP) += $(FATE_LIBAVFORMAT_MMAP-yes)
+
 FATE_LIBAVFORMAT-$(CONFIG_IMF_DEMUXER) += fate-imf
 fate-imf: libavformat/tests/imf$(EXESUF)
 fate-imf: CMD = run libavformat/tests/imf$(EXESUF)
@@ -150,6 +150,13 @@ FATE_SEEK_LAVF_CONTAINER := $(FATE_SEEK_LAVF_CONTAINER:%=fate-seek-lavf-%)
 FATE_SEEK_LAVF_CONTAINER := $(filter $(subst fate-,fate-seek-,$(FATE_LAVF_CONTAINER)), $(FATE_SEEK_LAVF_CONTAINER))
 FATE_SEEK += $(FATE_SEEK_LAVF_CONTAINER)
 
+# the compact index of the mov demuxer must seek like the full index
+FATE_SEEK_LAVF_MOV_LAZY_INDEX := $(if $(filter fate-seek-lavf-mov, $(FATE_SEEK_LAVF_CONTAINER)), fate-seek-lavf-mov-lazy-index)
+fate-seek-lavf-mov-lazy-index: fate-lavf-mov libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-mov-lazy-index: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -lazy_index 1
+fate-seek-lavf-mov-lazy-index: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+FATE_AVCONV += $(FATE_SEEK_LAVF_MOV_LAZY_INDEX)
+
 # files from fate-lavf-video
 
 FATE_SEEK_LAVF_VIDEO += gif y4m
@@ -207,4 +214,4 @@ fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
 FATE_AVCONV += $(FATE_SEEK)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAVF_MOV_LAZY_INDEX)
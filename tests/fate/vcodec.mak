@@ -236,6 +236,17 @@ fate-vsynth%-mjpeg-trell:             ENCOPTS = -qscale 9 -pix_fmt yuvj420p -tre
 fate-vsynth%-mjpeg-huffman:           ENCOPTS = -qscale 9 -pix_fmt yuvj420p -huffman optimal
 fate-vsynth%-mjpeg-trell-huffman:     ENCOPTS = -qscale 9 -pix_fmt yuvj420p -trellis 1 -huffman optimal
 
+# the slices of the encoder are separated by restart markers, decoding them
+# with frame threads or with the restart intervals spread over slice threads
+# must give the same pictures as the single-threaded decoding
+FATE_VCODEC_MJPEG_RST-$(call ENCDEC, MJPEG, AVI) = fate-vsynth1-mjpeg-rst               \
+                                                   fate-vsynth1-mjpeg-rst-frame-threads \
+                                                   fate-vsynth1-mjpeg-rst-slice-threads
+fate-vsynth1-mjpeg-rst fate-vsynth1-mjpeg-rst-%-threads: ENCOPTS = -qscale 9 -pix_fmt yuvj420p -threads 2 -slices 4
+fate-vsynth1-mjpeg-rst-%-threads: THREADS = 2
+fate-vsynth1-mjpeg-rst-frame-threads: THREAD_TYPE = frame
+fate-vsynth1-mjpeg-rst-slice-threads: THREAD_TYPE = slice
+
 FATE_VCODEC-$(call ENCDEC, MPEG1VIDEO, MPEG1VIDEO MPEGVIDEO) += mpeg1 mpeg1b
 fate-vsynth%-mpeg1:              FMT     = mpeg1video
 fate-vsynth%-mpeg1:              CODEC   = mpeg1video
@@ -486,6 +497,11 @@ $(FATE_VSYNTH2): tests/data/vsynth2.yuv
 $(FATE_VSYNTH_LENA): tests/data/vsynth_lena.yuv
 $(FATE_VSYNTH3): tests/data/vsynth3.yuv
 
+FATE_VCODEC_MJPEG_RST := $(if $(CONFIG_SCALE_FILTER),$(FATE_VCODEC_MJPEG_RST-yes))
+FATE_VCODEC_MJPEG_RST := $(if $(call ENCDEC, RAWVIDEO, RAWVIDEO),$(FATE_VCODEC_MJPEG_RST))
+$(FATE_VCODEC_MJPEG_RST): tests/data/vsynth1.yuv
+FATE_VSYNTH1 += $(FATE_VCODEC_MJPEG_RST)
+
 FATE_AVCONV += $(FATE_VSYNTH1) $(FATE_VSYNTH2) $(FATE_VSYNTH3)
 FATE_SAMPLES_AVCONV += $(FATE_VSYNTH_LENA)
 
@@ -131,6 +131,12 @@ $(eval $(call FATE_VP9_SUITE,tiling-pedestrian))
 $(eval $(call FATE_VP9_SUITE,trac3849))
 $(eval $(call FATE_VP9_SUITE,trac4359))
 
+# tile columns decoded with slice threads inside each frame thread
+FATE_VP9-$(call FRAMEMD5, MATROSKA, VP9) += fate-vp9-frame-slice-threads-tiling-pedestrian
+fate-vp9-frame-slice-threads-tiling-pedestrian: THREADS = 2
+fate-vp9-frame-slice-threads-tiling-pedestrian: CMD = framemd5 -slice_threads 2 -i $(TARGET_SAMPLES)/vp9-test-vectors/vp90-2-tiling-pedestrian.webm
+fate-vp9-frame-slice-threads-tiling-pedestrian: REF = $(SRC_PATH)/tests/ref/fate/vp9-tiling-pedestrian
+
 FATE_VP9-$(call FRAMEMD5, IVF, VP9, SCALE_FILTER) += fate-vp9-05-resize
 fate-vp9-05-resize: CMD = framemd5 -i $(TARGET_SAMPLES)/vp9-test-vectors/vp90-2-05-resize.ivf -s 352x288 -sws_flags bitexact+bilinear
 fate-vp9-05-resize: REF = $(SRC_PATH)/tests/ref/fate/vp9-05-resize
@@ -0,0 +1,194 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the throughput of a muxer: synthetic video packets are muxed into
+ * an output that discards the data, so only the muxer itself is timed.
+ *
+ * make tools/mux_bench
+ * tools/mux_bench -f mpegts -s 250000 -n 2000 -o "mpegts_flags=resend_headers"
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h> /* for getopt */
+#endif
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+static int64_t bytes_written;
+
+static int write_null(void *opaque, uint8_t *buf, int buf_size)
+{
+    bytes_written += buf_size;
+    return buf_size;
+}
+
+static void usage(void)
+{
+    printf("Usage: mux_bench [options]\n"
+           "-f format    muxer to benchmark (default mpegts)\n"
+           "-s size      size of the packets in bytes (default 100000)\n"
+           "-n count     number of packets per run (default 1000)\n"
+           "-r runs      number of runs (default 5)\n"
+           "-g gop       keyframe interval in packets (default 50)\n"
+           "-o options   muxer options, as key=value pairs separated by ':'\n");
+}
+
+static int run(const char *format, const AVDictionary *options,
+               const uint8_t *data, int size, int count, int gop)
+{
+    AVFormatContext *oc = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = NULL;
+    uint8_t *iobuf = NULL;
+    AVStream *st;
+    int ret;
+
+    ret = avformat_alloc_output_context2(&oc, NULL, format, NULL);
+    if (ret < 0)
+        return ret;
+
+    ret   = AVERROR(ENOMEM);
+    iobuf = av_malloc(32768);
+    if (!iobuf)
+        goto end;
+    oc->pb = avio_alloc_context(iobuf, 32768, 1, NULL, NULL, write_null, NULL);
+    if (!oc->pb) {
+        av_free(iobuf);
+        goto end;
+    }
+    pkt = av_packet_alloc();
+    st  = avformat_new_stream(oc, NULL);
+    if (!pkt || !st)
+        goto end;
+    st->time_base                = (AVRational){ 1, 25 };
+    st->codecpar->codec_type     = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id       = AV_CODEC_ID_MPEG2VIDEO;
+    st->codecpar->width          = 1920;
+    st->codecpar->height         = 1080;
+
+    av_dict_copy(&opts, options, 0);
+    ret = avformat_write_header(oc, &opts);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < count; i++) {
+        pkt->data         = (uint8_t *)data;
+        pkt->size         = size;
+        pkt->pts          = i + 1;
+        pkt->dts          = i;
+        pkt->duration     = 1;
+        pkt->flags        = i % gop ? 0 : AV_PKT_FLAG_KEY;
+        pkt->stream_index = st->index;
+        pkt->time_base    = st->time_base;
+        ret = av_write_frame(oc, pkt);
+        if (ret < 0)
+            goto end;
+    }
+    ret = av_write_trailer(oc);
+    avio_flush(oc->pb);
+
+end:
+    av_dict_free(&opts);
+    av_packet_free(&pkt);
+    if (oc->pb)
+        av_freep(&oc->pb->buffer);
+    avio_context_free(&oc->pb);
+    avformat_free_context(oc);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    const char *format = "mpegts";
+    AVDictionary *options = NULL;
+    int size = 100000, count = 1000, runs = 5, gop = 50;
+    int64_t best = INT64_MAX, in_bytes;
+    uint8_t *data;
+    AVLFG lfg;
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "hf:s:n:r:g:o:")) != -1) {
+        switch (opt) {
+        case 'f': format = optarg;                 break;
+        case 's': size   = strtol(optarg, NULL, 0); break;
+        case 'n': count  = strtol(optarg, NULL, 0); break;
+        case 'r': runs   = strtol(optarg, NULL, 0); break;
+        case 'g': gop    = strtol(optarg, NULL, 0); break;
+        case 'o':
+            if (av_dict_parse_string(&options, optarg, "=", ":", 0) < 0) {
+                fprintf(stderr, "Invalid options '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (size <= 0 || count <= 0 || runs <= 0 || gop <= 0) {
+        usage();
+        return 1;
+    }
+
+    data = av_malloc(size);
+    if (!data)
+        return 1;
+    /* random payload, so that no start codes are found in it */
+    av_lfg_init(&lfg, 0);
+    for (int i = 0; i < size; i++)
+        data[i] = av_lfg_get(&lfg) | 0x80;
+
+    for (int i = 0; i < runs; i++) {
+        int64_t t = av_gettime_relative();
+        bytes_written = 0;
+        ret = run(format, options, data, size, count, gop);
+        if (ret < 0) {
+            fprintf(stderr, "Muxing failed: %s\n", av_err2str(ret));
+            break;
+        }
+        best = FFMIN(best, av_gettime_relative() - t);
+    }
+
+    if (ret >= 0) {
+        in_bytes = (int64_t)size * count;
+        printf("%s: %d packets of %d bytes, %"PRId64" bytes written, "
+               "%.3f ms, %.1f MB/s in, %.1f MB/s out\n",
+               format, count, size, bytes_written, best / 1000.0,
+               (double)in_bytes / FFMAX(best, 1), (double)bytes_written / FFMAX(best, 1));
+    }
+
+    av_free(data);
+    av_dict_free(&options);
+    return ret < 0;
+}